@@ -0,0 +1,824 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include "term.h"
+#include "compare_term.h"
+#include "sort_term.h"
+#include "simplify_term.h"
+#include "polynomial_term.h"
+#include "integrate_term.h"
+#include "optimize_term.h"
+#include "parse_term.h"
+#include "format_term.h"
+#include "memory_term.h"
+#include "compile_term.h"
+#include "differentiate_term.h"
+#include "sparse_term.h"
+#include "tape_term.h"
+#include "newton_term.h"
+#include "modular_term.h"
+#include "egraph_term.h"
+
+// repetitions of every measurement, min and median are reported
+#define BENCH_REPETITIONS 5
+// longest line of a baseline file
+#define BENCH_LINE 512
+
+typedef struct Bench Bench;
+typedef struct Baseline Baseline;
+typedef struct Family Family;
+
+typedef enum {
+    BENCH_CSV,
+    BENCH_JSON
+} BenchFormat;
+
+// median of an earlier run, keyed by name, operation and size
+struct Baseline {
+    char name[64];
+    char operation[64];
+    int size;
+    double median;
+};
+
+struct Bench {
+    BenchFormat format;
+    int repetitions;
+    char *filter;
+    int rowc;
+
+    int baselinec;
+    Baseline *baselines;
+};
+
+// generated expression family, sizes are given small and large so that a
+// report shows how an operation scales
+struct Family {
+    char *name;
+    Term *(*build)(int size);
+    int sizes[2];
+};
+
+static unsigned long long random_state;
+
+static double
+seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+// every family starts from the same state, so runs of different commits
+// see the same terms
+static unsigned long long
+next_random(void)
+{
+    unsigned long long z;
+
+    random_state += 0x9e3779b97f4a7c15ULL;
+    z = random_state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static Term *
+random_literal(void)
+{
+    return literal((double) (next_random() % 2000) / 8.0 - 125.0);
+}
+
+static Term *
+numbered_variable(const char *prefix, int number)
+{
+    char name[32];
+
+    snprintf(name, sizeof(name), "%s%d", prefix, number);
+    return variable(name);
+}
+
+// l_1 + l_2 + ... + l_size
+static Term *
+wide_sum(int size)
+{
+    Term *result = random_literal();
+
+    for (int i = 1;i < size;i++)
+        result = add(result, random_literal());
+    return result;
+}
+
+// p_0 = x_0 + 1, p_i = (p_{i-1} + x_i) * (y_i + i)
+static Term *
+product_of_sums(int size)
+{
+    Term *result = add(numbered_variable("x", 0), literal(1.0));
+
+    for (int i = 1;i <= size;i++)
+        result = multiply(add(result, numbered_variable("x", i)),
+                add(numbered_variable("y", i), literal((double) i)));
+    return result;
+}
+
+// 1 / (1 + 1 / (1 + ... 1 / (1 + x)))
+static Term *
+inverse_chain(int size)
+{
+    Term *result = variable("x");
+
+    for (int i = 0;i < size;i++)
+        result = multiple_inverse(add(literal(1.0), result));
+    return result;
+}
+
+// product of size powers of size / 2 variables in random order, so that
+// simplify has to sort and combine them
+static Term *
+monomial(int size)
+{
+    Term *result = NULL;
+
+    for (int i = 0;i < size;i++) {
+        Term *factor = numbered_variable("v", (int) (next_random() % (unsigned long long) (size / 2 + 1)));
+
+        if (next_random() % 2 == 0)
+            factor = power(factor, literal((double) (1 + next_random() % 3)));
+        result = result == NULL ? factor : multiply(result, factor);
+    }
+    return result;
+}
+
+// sum of imaginary literals, imaginary variables, double imaginaries and
+// negated imaginary products
+static Term *
+imaginary_mix(int size)
+{
+    Term *result = NULL;
+
+    for (int i = 0;i < size;i++) {
+        Term *temp_variable = numbered_variable("z", (int) (next_random() % 8));
+        Term *summand;
+
+        switch (next_random() % 4) {
+        case 0:
+            free_term(temp_variable);
+            summand = imaginary(random_literal());
+            break;
+        case 1:
+            summand = imaginary(temp_variable);
+            break;
+        case 2:
+            summand = imaginary(imaginary(temp_variable));
+            break;
+        default:
+            summand = additive_inverse(multiply(imaginary(random_literal()), temp_variable));
+            break;
+        }
+        result = result == NULL ? summand : add(result, summand);
+    }
+    return result;
+}
+
+// imaginary literals that cancel must leave no zero summand behind, the
+// sum of 1 + x has to come back as it would without them
+static void
+check_imaginary_cancel(void)
+{
+    Term *cancelled[2], *expected;
+
+    cancelled[0] = add(add(add(imaginary(literal(2.0)), literal(1.0)),
+                imaginary(literal(-2.0))), variable("x"));
+    cancelled[1] = add(add(imaginary(additive_inverse(literal(2.0))), literal(1.0)),
+            add(imaginary(literal(2.0)), variable("x")));
+    expected = simplify(add(literal(1.0), variable("x")));
+
+    for (int i = 0;i < 2;i++) {
+        Term *simplified = simplify(cancelled[i]);
+
+        if (!is_equal(simplified, expected))
+            fprintf(stderr, "bench: cancelled imaginary parts %d are left over\n", i);
+        free_term(simplified);
+    }
+    free_term(expected);
+    return;
+}
+
+static Family families[] = {
+    {"wide_sum", wide_sum, {64, 512}},
+    {"product_of_sums", product_of_sums, {4, 8}},
+    {"inverse_chain", inverse_chain, {6, 12}},
+    {"monomial", monomial, {32, 256}},
+    {"imaginary_mix", imaginary_mix, {64, 256}}
+};
+
+static long
+count_nodes(Term *term)
+{
+    Operator *temp_operator;
+    long count = 1;
+
+    if (strcmp(term->meaning, "operator") != 0)
+        return 1;
+
+    temp_operator = term->content;
+    for (int i = 0;i < temp_operator->argc;i++)
+        count += count_nodes(temp_operator->argv[i]);
+    return count;
+}
+
+static int
+compare_times(const void *lhs, const void *rhs)
+{
+    double a = *(const double *) lhs, b = *(const double *) rhs;
+
+    return (a > b) - (a < b);
+}
+
+static bool
+is_selected(Bench *bench, const char *name)
+{
+    return bench->filter == NULL || strstr(name, bench->filter) != NULL;
+}
+
+static double
+baseline_median(Bench *bench, const char *name, const char *operation, int size)
+{
+    for (int i = 0;i < bench->baselinec;i++) {
+        Baseline *baseline = &bench->baselines[i];
+
+        if (baseline->size == size && strcmp(baseline->name, name) == 0 &&
+                strcmp(baseline->operation, operation) == 0)
+            return baseline->median;
+    }
+    return NAN;
+}
+
+// reads the csv written by an earlier run, returns false if it can not be
+// opened
+static bool
+read_baseline(Bench *bench, char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[BENCH_LINE];
+    int capacity = 64;
+
+    if (file == NULL)
+        return false;
+
+    bench->baselines = (Baseline *) malloc(sizeof(Baseline) * capacity);
+    while (fgets(line, sizeof(line), file) != NULL) {
+        Baseline baseline;
+        double minimum;
+        long nodes;
+        int repetitions;
+
+        if (sscanf(line, "%63[^,],%63[^,],%d,%ld,%d,%lf,%lf", baseline.name, baseline.operation,
+                    &baseline.size, &nodes, &repetitions, &minimum, &baseline.median) != 7)
+            continue;
+
+        if (bench->baselinec == capacity) {
+            capacity *= 2;
+            bench->baselines = (Baseline *) realloc(bench->baselines, sizeof(Baseline) * capacity);
+        }
+        bench->baselines[bench->baselinec++] = baseline;
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void
+print_header(Bench *bench)
+{
+    if (bench->format == BENCH_JSON) {
+        printf("[\n");
+        return;
+    }
+
+    printf("name,operation,size,nodes,repetitions,min,median,work");
+    if (bench->baselines != NULL)
+        printf(",baseline,ratio");
+    printf("\n");
+    return;
+}
+
+static void
+print_footer(Bench *bench)
+{
+    if (bench->format == BENCH_JSON)
+        printf("\n]\n");
+    fflush(stdout);
+    return;
+}
+
+// one row per measurement, times in seconds. work is what the operation
+// got done besides its term: bytes printed or parsed, iterations of an
+// optimizer, 0 otherwise.
+static void
+report(Bench *bench, const char *name, const char *operation, int size, long nodes, double *times, long work)
+{
+    double minimum, median, baseline;
+
+    qsort(times, bench->repetitions, sizeof(double), compare_times);
+    minimum = times[0];
+    median = times[bench->repetitions / 2];
+    baseline = baseline_median(bench, name, operation, size);
+
+    if (bench->format == BENCH_JSON) {
+        printf("%s  {\"name\": \"%s\", \"operation\": \"%s\", \"size\": %d, \"nodes\": %ld, "
+                "\"repetitions\": %d, \"min\": %.9f, \"median\": %.9f, \"work\": %ld",
+                bench->rowc > 0 ? ",\n" : "", name, operation, size, nodes,
+                bench->repetitions, minimum, median, work);
+        if (!isnan(baseline))
+            printf(", \"baseline\": %.9f, \"ratio\": %.3f", baseline, median / baseline);
+        printf("}");
+    } else {
+        printf("%s,%s,%d,%ld,%d,%.9f,%.9f,%ld", name, operation, size, nodes,
+                bench->repetitions, minimum, median, work);
+        if (bench->baselines != NULL) {
+            if (isnan(baseline))
+                printf(",,");
+            else
+                printf(",%.9f,%.3f", baseline, median / baseline);
+        }
+        printf("\n");
+    }
+
+    bench->rowc++;
+    fflush(stdout);
+    return;
+}
+
+// construct, copy, compare, sort, print, parse, simplify and free one
+// family at one size. Each repetition builds a fresh term, operations that
+// consume their input get a copy made outside the clock. parse_arena
+// parses into an arena and resets it, which is parse and free together.
+static void
+bench_family(Bench *bench, Family *family, int size)
+{
+    enum { CONSTRUCT, COPY, COMPARE, SORT, PRINT, PARSE, PARSE_ARENA, SIMPLIFY, FREE, OPERATIONS };
+    static char *operations[] = {"construct", "copy", "compare", "sort", "print", "parse", "parse_arena",
+        "simplify", "free"};
+    double *times[OPERATIONS];
+    long nodes = 0, bytes = 0;
+    Arena *parse_arena = arena();
+
+    for (int i = 0;i < OPERATIONS;i++)
+        times[i] = (double *) malloc(sizeof(double) * bench->repetitions);
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        Term *temp_term, *copy, *parsed, *simplified, **arguments;
+        Operator *temp_operator;
+        Allocator *previous;
+        double start;
+        char *text;
+        int argc = 0;
+
+        random_state = 0;
+        start = seconds();
+        temp_term = family->build(size);
+        times[CONSTRUCT][r] = seconds() - start;
+        nodes = count_nodes(temp_term);
+
+        start = seconds();
+        copy = copy_term(temp_term);
+        times[COPY][r] = seconds() - start;
+
+        start = seconds();
+        if (!is_equal(temp_term, copy) || is_less(temp_term, copy))
+            fprintf(stderr, "bench: %s copy compares unequal\n", family->name);
+        times[COMPARE][r] = seconds() - start;
+
+        // the arguments of the outermost operator in generation order
+        temp_operator = NULL;
+        if (strcmp(copy->meaning, "operator") == 0) {
+            temp_operator = copy->content;
+            argc = temp_operator->argc;
+        }
+        arguments = (Term **) malloc(sizeof(Term *) * (argc + 1));
+        if (argc > 0)
+            memcpy(arguments, temp_operator->argv, sizeof(Term *) * argc);
+        start = seconds();
+        if (argc > 1)
+            merge_sort_terms(arguments, 0, argc - 1);
+        times[SORT][r] = seconds() - start;
+        free(arguments);
+
+        start = seconds();
+        text = format_term(temp_term, FORMAT_INFIX);
+        times[PRINT][r] = seconds() - start;
+        bytes = (long) strlen(text);
+
+        start = seconds();
+        parsed = parse_term(text, strlen(text), NULL, NULL);
+        times[PARSE][r] = seconds() - start;
+        if (parsed == NULL)
+            fprintf(stderr, "bench: %s does not parse back\n", family->name);
+        else
+            free_term(parsed);
+
+        previous = set_allocator(arena_allocator(parse_arena));
+        start = seconds();
+        parse_term(text, strlen(text), NULL, NULL);
+        reset_arena(parse_arena);
+        times[PARSE_ARENA][r] = seconds() - start;
+        set_allocator(previous);
+        free(text);
+
+        start = seconds();
+        simplified = simplify(copy);
+        times[SIMPLIFY][r] = seconds() - start;
+        free_term(simplified);
+
+        start = seconds();
+        free_term(temp_term);
+        times[FREE][r] = seconds() - start;
+    }
+
+    for (int i = 0;i < OPERATIONS;i++) {
+        report(bench, family->name, operations[i], size, nodes, times[i],
+                i == PRINT || i == PARSE || i == PARSE_ARENA ? bytes : 0);
+        free(times[i]);
+    }
+    free_arena(parse_arena);
+    return;
+}
+
+// integral of (x^2 + 1)^-size, Hermite reduction of a denominator of
+// degree 2 size
+static void
+bench_hermite(Bench *bench, int size)
+{
+    double *times = (double *) malloc(sizeof(double) * bench->repetitions);
+    Term *x = variable("x");
+    Term *integrand = power(add(power(copy_term(x), literal(2.0)), literal(1.0)), literal((double) -size));
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        double start = seconds();
+        Term *result = integrate(integrand, x);
+
+        times[r] = seconds() - start;
+        if (result == NULL)
+            fprintf(stderr, "bench: hermite %d does not integrate\n", size);
+        else
+            free_term(result);
+    }
+
+    report(bench, "hermite", "integrate", 2 * size, count_nodes(integrand), times, 0);
+    free_term(integrand);
+    free_term(x);
+    free(times);
+    return;
+}
+
+// (x_0 + ... + x_(size-1))^2 against the size^2 products of its expansion
+static void
+bench_equivalence(Bench *bench, int size)
+{
+    double *times = (double *) malloc(sizeof(double) * bench->repetitions);
+    Term *sum = numbered_variable("x", 0), *expansion = NULL;
+
+    for (int i = 1;i < size;i++)
+        sum = add(sum, numbered_variable("x", i));
+    sum = power(sum, literal(2.0));
+    for (int i = 0;i < size;i++) {
+        for (int j = 0;j < size;j++) {
+            Term *product = multiply(numbered_variable("x", i), numbered_variable("x", j));
+
+            expansion = expansion == NULL ? product : add(expansion, product);
+        }
+    }
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        double start = seconds();
+        Equivalence equivalence = test_equivalence(sum, expansion, MODULAR_TRIALS);
+
+        times[r] = seconds() - start;
+        if (equivalence != EQUIVALENCE_EQUAL)
+            fprintf(stderr, "bench: equivalence %d is not found\n", size);
+    }
+
+    report(bench, "equivalence", "test", size, count_nodes(sum) + count_nodes(expansion), times, 0);
+    free_term(sum);
+    free_term(expansion);
+    free(times);
+    return;
+}
+
+// derivative of the inverse chain of the families, work is the number of
+// instructions the derivative adds to the compiled chain. decompile
+// reports the node count of the same derivative written out as a term.
+static void
+bench_derivative(Bench *bench, int size)
+{
+    double *times = (double *) malloc(sizeof(double) * bench->repetitions);
+    double *decompile_times = (double *) malloc(sizeof(double) * bench->repetitions);
+    Term *x = variable("x");
+    Term *chain = inverse_chain(size);
+    long instructions = 0, nodes = 0;
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        Program *program = compile_term(chain, 1, &x);
+        int length = program->length, index;
+        double start = seconds();
+        Term *derivative;
+
+        index = differentiate_instruction(program, program->results[0], 0);
+        times[r] = seconds() - start;
+        instructions = program->length - length;
+
+        start = seconds();
+        derivative = decompile_instruction(program, index);
+        decompile_times[r] = seconds() - start;
+        nodes = count_nodes(derivative);
+
+        free_term(derivative);
+        free_program(program);
+    }
+
+    report(bench, "derivative", "differentiate", size, count_nodes(chain), times, instructions);
+    report(bench, "derivative", "decompile", size, count_nodes(chain), decompile_times, nodes);
+    free_term(chain);
+    free_term(x);
+    free(times);
+    free(decompile_times);
+    return;
+}
+
+// 1 + x + x^2 + ... + x^size under the flop cost, work is the node count
+// of the form found
+static void
+bench_egraph(Bench *bench, int size)
+{
+    double *times = (double *) malloc(sizeof(double) * bench->repetitions);
+    Term *x = variable("x");
+    Term *polynomial = literal(1.0);
+    long nodes = 0;
+
+    for (int i = 1;i <= size;i++)
+        polynomial = add(polynomial, power(copy_term(x), literal((double) i)));
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        double start = seconds();
+        Term *cheapest = cheapest_form(polynomial, count_flops);
+
+        times[r] = seconds() - start;
+        nodes = count_nodes(cheapest);
+        free_term(cheapest);
+    }
+
+    report(bench, "egraph", "cheapest_form", size, count_nodes(polynomial), times, nodes);
+    free_term(polynomial);
+    free_term(x);
+    free(times);
+    return;
+}
+
+// Broyden tridiagonal system (3 - 2 x_i) x_i - x_{i-1} - 2 x_{i+1} + 1 = 0
+// from x = -1, sizes from NEWTON_SPARSE_SIZE on take the sparse path.
+// A matrix with an empty column has to come back from sparse_lu as NULL.
+static void
+bench_newton(Bench *bench, int size)
+{
+    double *times = (double *) malloc(sizeof(double) * bench->repetitions);
+    double *values = (double *) malloc(sizeof(double) * size);
+    Term **variables = (Term **) malloc(sizeof(Term *) * size);
+    Term **equations = (Term **) malloc(sizeof(Term *) * size);
+    Sparse *singular = sparse(size, size, size - 1);
+    SparseLU *lu;
+    NewtonStatistics statistics;
+    long nodes = 0;
+
+    for (int i = 0;i < size;i++) {
+        singular->rows[i + 1] = i;
+        if (i > 0) {
+            singular->columns[i - 1] = i;
+            singular->values[i - 1] = 1.0;
+        }
+    }
+    lu = sparse_lu(singular, 0.1);
+    if (lu != NULL) {
+        fprintf(stderr, "bench: singular matrix %d is factored\n", size);
+        free_sparse_lu(lu);
+    }
+    free_sparse(singular);
+
+    for (int i = 0;i < size;i++)
+        variables[i] = numbered_variable("x", i);
+    for (int i = 0;i < size;i++) {
+        Term *equation = add(add(multiply(literal(3.0), copy_term(variables[i])),
+                    multiply(literal(-2.0), power(copy_term(variables[i]), literal(2.0)))), literal(1.0));
+
+        if (i > 0)
+            equation = add(equation, additive_inverse(copy_term(variables[i - 1])));
+        if (i + 1 < size)
+            equation = add(equation, multiply(literal(-2.0), copy_term(variables[i + 1])));
+        equations[i] = equation;
+        nodes += count_nodes(equation);
+    }
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        for (int i = 0;i < size;i++)
+            values[i] = -1.0;
+        if (!solve_system(size, equations, size, variables, values, 1e-10, &statistics))
+            fprintf(stderr, "bench: newton %d did not converge\n", size);
+        times[r] = statistics.total_time;
+    }
+
+    report(bench, "newton", "solve_system", size, nodes, times, statistics.iterations);
+
+    for (int i = 0;i < size;i++) {
+        free_term(variables[i]);
+        free_term(equations[i]);
+    }
+    free(variables);
+    free(equations);
+    free(values);
+    free(times);
+    return;
+}
+
+// sum of 100 (x_{i+1} - x_i^2)^2 + (1 - x_i)^2, minimum 0 at (1, ..., 1)
+static Term *
+rosenbrock(int size, Term **variables)
+{
+    Term *result = NULL;
+
+    for (int i = 0;i + 1 < size;i++) {
+        Term *difference = add(copy_term(variables[i + 1]),
+                additive_inverse(power(copy_term(variables[i]), literal(2.0))));
+        Term *offset = add(literal(1.0), additive_inverse(copy_term(variables[i])));
+        Term *summand = add(multiply(literal(100.0), power(difference, literal(2.0))),
+                power(offset, literal(2.0)));
+
+        result = result == NULL ? summand : add(result, summand);
+    }
+    return result;
+}
+
+// (x^2 + y - 11)^2 + (x + y^2 - 7)^2, four minima of value 0
+static Term *
+himmelblau(int size, Term **variables)
+{
+    Term *x = variables[0], *y = variables[1];
+    Term *first = add(add(power(copy_term(x), literal(2.0)), copy_term(y)), literal(-11.0));
+    Term *second = add(add(copy_term(x), power(copy_term(y), literal(2.0))), literal(-7.0));
+
+    (void) size;
+    return add(power(first, literal(2.0)), power(second, literal(2.0)));
+}
+
+// half the sum of x_i^4 - 16 x_i^2 + 5 x_i, many local minima and a global
+// one of about -39.17 per dimension
+static Term *
+styblinski_tang(int size, Term **variables)
+{
+    Term *result = NULL;
+
+    for (int i = 0;i < size;i++) {
+        Term *summand = add(add(power(copy_term(variables[i]), literal(4.0)),
+                    multiply(literal(-16.0), power(copy_term(variables[i]), literal(2.0)))),
+                multiply(literal(5.0), copy_term(variables[i])));
+
+        result = result == NULL ? summand : add(result, summand);
+    }
+    return multiply(literal(0.5), result);
+}
+
+static void
+bench_optimize(Bench *bench, char *name, Term *(*build)(int size, Term **variables), int size, int startc)
+{
+    double *times = (double *) malloc(sizeof(double) * bench->repetitions);
+    Term **variables = (Term **) malloc(sizeof(Term *) * size);
+    double *start = (double *) malloc(sizeof(double) * size);
+    Term *objective;
+    long iterations = 0;
+
+    for (int i = 0;i < size;i++) {
+        variables[i] = numbered_variable("x", i);
+        start[i] = -1.2 + 0.1 * i;
+    }
+    objective = build(size, variables);
+
+    for (int r = 0;r < bench->repetitions;r++) {
+        Optimization *optimization = minimize(objective, size, variables, start, NULL, NULL,
+                startc, 1, 1e-10);
+
+        times[r] = optimization->time;
+        iterations = optimization->iterations;
+        if (!optimization->is_converged)
+            fprintf(stderr, "bench: %s %d did not converge\n", name, size);
+        free_optimization(optimization);
+    }
+
+    report(bench, name, "minimize", size, count_nodes(objective), times, iterations);
+
+    for (int i = 0;i < size;i++)
+        free_term(variables[i]);
+    free(variables);
+    free(start);
+    free_term(objective);
+    free(times);
+    return;
+}
+
+static void
+usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-f format] [-r repetitions] [-n name] [-c baseline]\n", name);
+    fprintf(stderr, "  times term operations on generated expression families\n");
+    fprintf(stderr, "  -f  csv (default) or json\n");
+    fprintf(stderr, "  -r  repetitions of every measurement, %d by default\n", BENCH_REPETITIONS);
+    fprintf(stderr, "  -n  only benchmarks whose name contains this text\n");
+    fprintf(stderr, "  -c  csv of an earlier run, adds its median and the ratio to it\n");
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    Bench bench = {BENCH_CSV, BENCH_REPETITIONS, NULL, 0, 0, NULL};
+    int option;
+
+    while ((option = getopt(argc, argv, "f:r:n:c:h")) != -1) {
+        switch (option) {
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) {
+                bench.format = BENCH_CSV;
+            } else if (strcmp(optarg, "json") == 0) {
+                bench.format = BENCH_JSON;
+            } else {
+                usage(argv[0]);
+                return 0x01;
+            }
+            break;
+        case 'r':
+            bench.repetitions = atoi(optarg);
+            if (bench.repetitions <= 0) {
+                usage(argv[0]);
+                return 0x01;
+            }
+            break;
+        case 'n':
+            bench.filter = optarg;
+            break;
+        case 'c':
+            if (!read_baseline(&bench, optarg)) {
+                fprintf(stderr, "%s: cannot open %s\n", argv[0], optarg);
+                return 0x01;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0x00 : 0x01;
+        }
+    }
+
+    print_header(&bench);
+
+    if (is_selected(&bench, "imaginary_mix"))
+        check_imaginary_cancel();
+
+    for (int i = 0;i < (int) (sizeof(families) / sizeof(Family));i++) {
+        if (!is_selected(&bench, families[i].name))
+            continue;
+        for (int j = 0;j < 2;j++)
+            bench_family(&bench, &families[i], families[i].sizes[j]);
+    }
+
+    if (is_selected(&bench, "hermite"))
+        bench_hermite(&bench, 25);
+    if (is_selected(&bench, "equivalence")) {
+        bench_equivalence(&bench, 4);
+        bench_equivalence(&bench, 32);
+    }
+    if (is_selected(&bench, "derivative")) {
+        bench_derivative(&bench, 12);
+        bench_derivative(&bench, 48);
+    }
+    if (is_selected(&bench, "egraph")) {
+        bench_egraph(&bench, 4);
+        bench_egraph(&bench, 16);
+    }
+    if (is_selected(&bench, "newton")) {
+        bench_newton(&bench, 32);
+        bench_newton(&bench, 256);
+    }
+    if (is_selected(&bench, "rosenbrock")) {
+        bench_optimize(&bench, "rosenbrock", rosenbrock, 2, 1);
+        bench_optimize(&bench, "rosenbrock", rosenbrock, 20, 8);
+    }
+    if (is_selected(&bench, "himmelblau"))
+        bench_optimize(&bench, "himmelblau", himmelblau, 2, 8);
+    if (is_selected(&bench, "styblinski_tang"))
+        bench_optimize(&bench, "styblinski_tang", styblinski_tang, 10, 8);
+
+    print_footer(&bench);
+    free(bench.baselines);
+
+    return 0x00;
+}
@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "term.h"
+#include "memory_term.h"
+#include "builder_term.h"
+
+void
+begin_operator(TermBuilder *builder, char *name, int capacity)
+{
+    builder->name = name;
+    builder->is_flattening = strcmp(name, "+") == 0 || strcmp(name, "*") == 0;
+    builder->argc = 0;
+    builder->capacity = capacity > 0 ? capacity : 4;
+    builder->argv = (Term **) allocate(sizeof(Term *) * builder->capacity);
+    return;
+}
+
+static void
+reserve(TermBuilder *builder, int count)
+{
+    if (builder->argc + count <= builder->capacity)
+        return;
+
+    while (builder->argc + count > builder->capacity)
+        builder->capacity *= 2;
+    builder->argv = (Term **) reallocate(builder->argv, sizeof(Term *) * builder->capacity);
+    return;
+}
+
+// takes ownership of argument
+void
+push_argument(TermBuilder *builder, Term *argument)
+{
+    Operator *temp_operator = builder->is_flattening ? is_operator(argument, builder->name) : NULL;
+
+    if (temp_operator == NULL) {
+        reserve(builder, 1);
+        builder->argv[builder->argc++] = argument;
+        return;
+    }
+
+    reserve(builder, temp_operator->argc);
+    for (int i = 0;i < temp_operator->argc;i++)
+        builder->argv[builder->argc++] = temp_operator->argv[i];
+    free_shell(argument);
+    return;
+}
+
+void
+push_copy(TermBuilder *builder, Term *argument)
+{
+    push_argument(builder, copy_term(argument));
+    return;
+}
+
+// moves all arguments of the operator term into builder and frees what is
+// left of term, anything else is pushed as it is
+void
+push_arguments(TermBuilder *builder, Term *term)
+{
+    Operator *temp_operator;
+
+    if (strcmp(term->meaning, "operator") != 0) {
+        push_argument(builder, term);
+        return;
+    }
+
+    temp_operator = term->content;
+    reserve(builder, temp_operator->argc);
+    for (int i = 0;i < temp_operator->argc;i++)
+        push_argument(builder, temp_operator->argv[i]);
+    free_shell(term);
+    return;
+}
+
+// a sum or product of a single argument is that argument, one without any
+// is its neutral element
+Term *
+finish_operator(TermBuilder *builder)
+{
+    Term *result;
+
+    if (builder->is_flattening && builder->argc <= 1) {
+        if (builder->argc == 1)
+            result = builder->argv[0];
+        else
+            result = literal(strcmp(builder->name, "+") == 0 ? 0.0 : 1.0);
+        release(builder->argv);
+        builder->argv = NULL;
+        return result;
+    }
+
+    result = operator(builder->name, builder->argc, builder->argv);
+    builder->argv = NULL;
+    return result;
+}
+
+void
+abandon_operator(TermBuilder *builder)
+{
+    for (int i = 0;i < builder->argc;i++)
+        free_term(builder->argv[i]);
+    release(builder->argv);
+    builder->argv = NULL;
+    return;
+}
+
+// moves one argument out of the operator term, freeing term afterwards
+// frees only the arguments that are left
+Term *
+take_argument(Term *term, int index)
+{
+    Operator *temp_operator = term->content;
+    Term *argument = temp_operator->argv[index];
+
+    temp_operator->argv[index] = NULL;
+    return argument;
+}
@@ -0,0 +1,29 @@
+#ifndef BUILDER_TERM_H_
+#define BUILDER_TERM_H_
+
+typedef struct TermBuilder TermBuilder;
+
+// arguments of an operator under construction, usually on the stack. The
+// builder owns every pushed argument until finish_operator moves them into
+// the new operator. Sums and products splice in arguments of their own
+// kind the way add() and multiply() do, without the intermediate
+// operators a chain of add() calls allocates.
+struct TermBuilder {
+    char *name;
+    bool is_flattening;
+
+    int argc;
+    int capacity;
+    Term **argv;
+};
+
+void begin_operator(TermBuilder *builder, char *name, int capacity);
+void push_argument(TermBuilder *builder, Term *argument);
+void push_copy(TermBuilder *builder, Term *argument);
+void push_arguments(TermBuilder *builder, Term *term);
+Term *finish_operator(TermBuilder *builder);
+void abandon_operator(TermBuilder *builder);
+
+Term *take_argument(Term *term, int index);
+
+#endif // BUILDER_TERM_H_
@@ -0,0 +1,578 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "term.h"
+#include "simplify_term.h"
+#include "image_term.h"
+#include "cache_term.h"
+
+static const char cache_magic[8] = {'A', 'L', 'G', 'C', 'A', 'C', 'H', 'E'};
+
+// header fields, all little endian
+#define CACHE_VERSION_FIELD 8
+#define CACHE_RULES_FIELD 16
+#define CACHE_BUCKET_FIELD 24
+#define CACHE_ENTRY_FIELD 32
+#define CACHE_END_FIELD 40
+#define CACHE_GENERATION_FIELD 48
+
+// hash low, hash high, offset, length
+#define CACHE_BUCKET_SIZE 32
+
+typedef struct Entry Entry;
+typedef struct HashFrame HashFrame;
+
+struct Entry {
+    uint64_t low;
+    uint64_t high;
+    uint64_t offset;
+    uint64_t length;
+};
+
+// term whose arguments are being hashed, hash is the running state
+struct HashFrame {
+    int argc;
+    Term **argv;
+    int child;
+    TermHash hash;
+};
+
+static void
+put_u64(unsigned char *p, uint64_t value)
+{
+    for (int i = 0;i < 8;i++)
+        p[i] = (unsigned char) (value >> (8 * i));
+    return;
+}
+
+static uint64_t
+get_u64(const unsigned char *p)
+{
+    uint64_t value = 0;
+
+    for (int i = 7;i >= 0;i--)
+        value = value << 8 | p[i];
+    return value;
+}
+
+static uint64_t
+finalize(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// the two halves use different multipliers, so they are independent
+static void
+combine(TermHash *hash, uint64_t value)
+{
+    hash->low = finalize(hash->low ^ (value * 0x9E3779B97F4A7C15ULL));
+    hash->high = finalize(hash->high + value * 0xC2B2AE3D27D4EB4FULL + 0x165667B19E3779F9ULL);
+    return;
+}
+
+static void
+combine_name(TermHash *hash, const char *name)
+{
+    uint64_t word = 0;
+    int i = 0;
+
+    for (;name[i] != '\0';i++) {
+        word = word << 8 | (unsigned char) name[i];
+        if (i % 8 == 7) {
+            combine(hash, word);
+            word = 0;
+        }
+    }
+    combine(hash, word ^ (uint64_t) i << 56);
+    return;
+}
+
+// starts the hash of term, returns true if it has arguments to fold in
+static bool
+start_hash(Term *term, HashFrame *frame)
+{
+    TermHash hash = {0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL};
+
+    frame->argc = 0;
+    frame->argv = NULL;
+    frame->child = 0;
+
+    if (strcmp(term->meaning, "literal") == 0) {
+        uint64_t bits;
+        double value = ((Literal *) term->content)->value;
+
+        memcpy(&bits, &value, sizeof(bits));
+        combine(&hash, 1);
+        combine(&hash, bits);
+    } else if (strcmp(term->meaning, "constant") == 0) {
+        Constant *temp_constant = term->content;
+        uint64_t bits;
+
+        combine(&hash, 2);
+        combine_name(&hash, temp_constant->name);
+        memcpy(&bits, &temp_constant->upper_limit, sizeof(bits));
+        combine(&hash, bits);
+        memcpy(&bits, &temp_constant->lower_limit, sizeof(bits));
+        combine(&hash, bits);
+    } else if (strcmp(term->meaning, "variable") == 0) {
+        Variable *temp_variable = term->content;
+
+        combine(&hash, 3);
+        combine_name(&hash, temp_variable->name);
+        combine(&hash, temp_variable->indec);
+        frame->argc = temp_variable->indec;
+        frame->argv = temp_variable->index;
+    } else {
+        Operator *temp_operator = term->content;
+
+        combine(&hash, 4);
+        combine_name(&hash, temp_operator->name);
+        combine(&hash, temp_operator->argc);
+        frame->argc = temp_operator->argc;
+        frame->argv = temp_operator->argv;
+    }
+
+    frame->hash = hash;
+    return frame->argc != 0;
+}
+
+TermHash
+hash_term(Term *term)
+{
+    int capacity = 64, depth = 1;
+    HashFrame *stack = (HashFrame *) malloc(sizeof(HashFrame) * capacity);
+    TermHash result;
+
+    start_hash(term, &stack[0]);
+
+    while (true) {
+        HashFrame *frame = &stack[depth - 1];
+
+        if (frame->child == frame->argc) {
+            if (--depth == 0)
+                break;
+            combine(&stack[depth - 1].hash, frame->hash.low);
+            combine(&stack[depth - 1].hash, frame->hash.high);
+            continue;
+        }
+
+        if (depth == capacity) {
+            capacity *= 2;
+            stack = (HashFrame *) realloc(stack, sizeof(HashFrame) * capacity);
+            frame = &stack[depth - 1];
+        }
+        if (start_hash(frame->argv[frame->child++], &stack[depth])) {
+            depth++;
+            continue;
+        }
+        combine(&frame->hash, stack[depth].hash.low);
+        combine(&frame->hash, stack[depth].hash.high);
+    }
+
+    result = stack[0].hash;
+    free(stack);
+
+    return result;
+}
+
+static void
+lock(TermCache *cache, int operation)
+{
+    while (flock(cache->fd, operation) != 0 && errno == EINTR)
+        continue;
+    return;
+}
+
+// follows the file after another handle has grown or compacted it
+static bool
+remap(TermCache *cache)
+{
+    struct stat status;
+
+    if (fstat(cache->fd, &status) != 0)
+        return false;
+    if ((size_t) status.st_size == cache->size && cache->data != NULL)
+        return true;
+
+    if (cache->data != NULL)
+        munmap(cache->data, cache->size);
+    cache->data = NULL;
+    cache->size = status.st_size;
+
+    if (cache->size == 0)
+        return true;
+
+    cache->data = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (cache->data == MAP_FAILED) {
+        cache->data = NULL;
+        cache->size = 0;
+        return false;
+    }
+    return true;
+}
+
+static bool
+resize(TermCache *cache, size_t size)
+{
+    if (ftruncate(cache->fd, size) != 0)
+        return false;
+    return remap(cache);
+}
+
+static uint64_t
+bucket_count(TermCache *cache)
+{
+    return get_u64(&cache->data[CACHE_BUCKET_FIELD]);
+}
+
+static unsigned char *
+bucket(TermCache *cache, uint64_t index)
+{
+    return &cache->data[CACHE_HEADER + CACHE_BUCKET_SIZE * index];
+}
+
+// current layout and rule set, with every bucket inside the file
+static bool
+is_valid(TermCache *cache)
+{
+    uint64_t buckets, end;
+
+    if (cache->data == NULL || cache->size < CACHE_HEADER)
+        return false;
+    if (memcmp(cache->data, cache_magic, sizeof(cache_magic)) != 0
+            || get_u64(&cache->data[CACHE_VERSION_FIELD]) != CACHE_VERSION
+            || get_u64(&cache->data[CACHE_RULES_FIELD]) != cache->rules)
+        return false;
+
+    buckets = bucket_count(cache);
+    end = get_u64(&cache->data[CACHE_END_FIELD]);
+    if (buckets == 0 || (buckets & (buckets - 1)) != 0 || buckets > cache->size / CACHE_BUCKET_SIZE)
+        return false;
+
+    return CACHE_HEADER + CACHE_BUCKET_SIZE * buckets <= end && end <= cache->size;
+}
+
+static void
+write_header(unsigned char *data, unsigned long long rules, uint64_t buckets, uint64_t entries,
+        uint64_t end, uint64_t generation)
+{
+    memset(data, 0, CACHE_HEADER);
+    memcpy(data, cache_magic, sizeof(cache_magic));
+    put_u64(&data[CACHE_VERSION_FIELD], CACHE_VERSION);
+    put_u64(&data[CACHE_RULES_FIELD], rules);
+    put_u64(&data[CACHE_BUCKET_FIELD], buckets);
+    put_u64(&data[CACHE_ENTRY_FIELD], entries);
+    put_u64(&data[CACHE_END_FIELD], end);
+    put_u64(&data[CACHE_GENERATION_FIELD], generation);
+    return;
+}
+
+// empties the cache, also when it was written by another version or rule
+// set. Needs the exclusive lock.
+static bool
+reset(TermCache *cache)
+{
+    size_t size = CACHE_HEADER + CACHE_BUCKET_SIZE * CACHE_BUCKETS;
+    uint64_t generation = 0;
+
+    if (cache->data != NULL && cache->size >= CACHE_HEADER)
+        generation = get_u64(&cache->data[CACHE_GENERATION_FIELD]) + 1;
+
+    if (!resize(cache, 0) || !resize(cache, size))
+        return false;
+
+    write_header(cache->data, cache->rules, CACHE_BUCKETS, 0, size, generation);
+    return true;
+}
+
+// bucket holding hash, or the empty bucket where it belongs
+static uint64_t
+find_bucket(TermCache *cache, TermHash hash, bool *is_found)
+{
+    uint64_t buckets = bucket_count(cache), index = hash.low & (buckets - 1);
+
+    while (true) {
+        unsigned char *p = bucket(cache, index);
+
+        if (get_u64(&p[16]) == 0) {
+            *is_found = false;
+            return index;
+        }
+        if (get_u64(p) == hash.low && get_u64(&p[8]) == hash.high) {
+            *is_found = true;
+            return index;
+        }
+        index = (index + 1) & (buckets - 1);
+    }
+}
+
+static int
+compare_entries(const void *lhs, const void *rhs)
+{
+    const Entry *a = lhs, *b = rhs;
+
+    return (a->offset < b->offset) - (a->offset > b->offset);
+}
+
+// rewrites the file with the newest entries that fit into half the limit
+// after reserving room for one more record, doubling the buckets when
+// they are more than half full. Needs the exclusive lock.
+static bool
+compact(TermCache *cache, size_t reserve)
+{
+    uint64_t buckets = bucket_count(cache), entryc = 0, keep = 0, size, budget, end;
+    Entry *entries = (Entry *) malloc(sizeof(Entry) * (buckets + 1));
+    unsigned char *data;
+
+    for (uint64_t i = 0;i < buckets;i++) {
+        unsigned char *p = bucket(cache, i);
+
+        if (get_u64(&p[16]) == 0)
+            continue;
+        entries[entryc].low = get_u64(p);
+        entries[entryc].high = get_u64(&p[8]);
+        entries[entryc].offset = get_u64(&p[16]);
+        entries[entryc].length = get_u64(&p[24]);
+        entryc++;
+    }
+    qsort(entries, entryc, sizeof(Entry), compare_entries);
+
+    if (2 * (entryc + 1) > buckets
+            && (cache->limit == 0 || CACHE_HEADER + 4 * CACHE_BUCKET_SIZE * buckets <= cache->limit / 2))
+        buckets *= 2;
+
+    size = CACHE_HEADER + CACHE_BUCKET_SIZE * buckets;
+    budget = (uint64_t) -1;
+    if (cache->limit != 0)
+        budget = cache->limit > size + 2 * reserve ? (cache->limit - size) / 2 - reserve : 0;
+
+    for (uint64_t total = 0;keep < entryc && 2 * (keep + 2) <= buckets;keep++) {
+        uint64_t record = (entries[keep].length + 7) & ~(uint64_t) 7;
+
+        if (total + record > budget)
+            break;
+        total += record;
+    }
+    for (uint64_t i = 0;i < keep;i++)
+        size += (entries[i].length + 7) & ~(uint64_t) 7;
+
+    data = (unsigned char *) calloc(size, 1);
+    end = CACHE_HEADER + CACHE_BUCKET_SIZE * buckets;
+
+    // oldest first, so that the order of eviction is kept
+    for (uint64_t i = keep;i-- > 0;) {
+        uint64_t index = entries[i].low & (buckets - 1);
+
+        while (get_u64(&data[CACHE_HEADER + CACHE_BUCKET_SIZE * index + 16]) != 0)
+            index = (index + 1) & (buckets - 1);
+
+        memcpy(&data[end], &cache->data[entries[i].offset], entries[i].length);
+        put_u64(&data[CACHE_HEADER + CACHE_BUCKET_SIZE * index], entries[i].low);
+        put_u64(&data[CACHE_HEADER + CACHE_BUCKET_SIZE * index + 8], entries[i].high);
+        put_u64(&data[CACHE_HEADER + CACHE_BUCKET_SIZE * index + 16], end);
+        put_u64(&data[CACHE_HEADER + CACHE_BUCKET_SIZE * index + 24], entries[i].length);
+        end += (entries[i].length + 7) & ~(uint64_t) 7;
+    }
+    write_header(data, cache->rules, buckets, keep, end,
+            get_u64(&cache->data[CACHE_GENERATION_FIELD]) + 1);
+
+    free(entries);
+
+    if (!resize(cache, size)) {
+        free(data);
+        return false;
+    }
+    memcpy(cache->data, data, size);
+    free(data);
+
+    cache->compactions++;
+    return true;
+}
+
+// limit is the largest size of the file in bytes, 0 for no limit. rules
+// identifies the simplification rules, usually SIMPLIFY_RULES.
+TermCache *
+open_cache(char *path, size_t limit, unsigned long long rules)
+{
+    TermCache *cache;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    bool is_ready;
+
+    if (fd < 0)
+        return NULL;
+
+    cache = (TermCache *) malloc(sizeof(TermCache));
+    memset(cache, 0, sizeof(TermCache));
+    cache->fd = fd;
+    cache->limit = limit;
+    cache->rules = rules;
+
+    if (limit != 0 && limit < 2 * (CACHE_HEADER + CACHE_BUCKET_SIZE * CACHE_BUCKETS))
+        cache->limit = 2 * (CACHE_HEADER + CACHE_BUCKET_SIZE * CACHE_BUCKETS);
+
+    lock(cache, LOCK_EX);
+    is_ready = remap(cache) && (is_valid(cache) || reset(cache));
+    lock(cache, LOCK_UN);
+
+    if (!is_ready) {
+        close_cache(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void
+close_cache(TermCache *cache)
+{
+    if (cache->data != NULL)
+        munmap(cache->data, cache->size);
+    close(cache->fd);
+    free(cache);
+    return;
+}
+
+// simplified term stored for hash, or NULL
+Term *
+cache_lookup(TermCache *cache, TermHash hash)
+{
+    Term *result = NULL;
+    bool is_found;
+
+    lock(cache, LOCK_SH);
+
+    if (remap(cache) && is_valid(cache)) {
+        unsigned char *p = bucket(cache, find_bucket(cache, hash, &is_found));
+
+        if (is_found) {
+            uint64_t offset = get_u64(&p[16]), length = get_u64(&p[24]);
+            TermImage *image = NULL;
+
+            if (offset + length <= cache->size)
+                image = image_of_buffer(&cache->data[offset], length);
+            if (image != NULL && image->rootc == 1)
+                result = term_of_image(image, image_root(image, 0));
+            if (image != NULL)
+                close_image(image);
+        }
+    }
+
+    lock(cache, LOCK_UN);
+
+    if (result == NULL)
+        cache->misses++;
+    else
+        cache->hits++;
+
+    return result;
+}
+
+// appends the record of one image, needs the exclusive lock
+static bool
+store(TermCache *cache, TermHash hash, unsigned char *image, size_t length)
+{
+    size_t record = (length + 7) & ~(size_t) 7;
+    uint64_t end, index;
+    bool is_found;
+
+    if (!remap(cache) || (!is_valid(cache) && !reset(cache)))
+        return false;
+
+    index = find_bucket(cache, hash, &is_found);
+    if (is_found)
+        return true;
+
+    end = get_u64(&cache->data[CACHE_END_FIELD]);
+    if (2 * (get_u64(&cache->data[CACHE_ENTRY_FIELD]) + 1) > bucket_count(cache)
+            || (cache->limit != 0 && end + record > cache->limit)) {
+        if (!compact(cache, record))
+            return false;
+        end = get_u64(&cache->data[CACHE_END_FIELD]);
+        index = find_bucket(cache, hash, &is_found);
+    }
+
+    if (cache->limit != 0 && end + record > cache->limit)
+        return false;
+
+    if (end + record > cache->size) {
+        size_t size = 2 * cache->size;
+
+        if (cache->limit != 0 && size > cache->limit)
+            size = cache->limit;
+        if (size < end + record)
+            size = end + record;
+        if (!resize(cache, size))
+            return false;
+    }
+
+    // the record is complete before the bucket points to it
+    memcpy(&cache->data[end], image, length);
+    put_u64(bucket(cache, index), hash.low);
+    put_u64(bucket(cache, index) + 8, hash.high);
+    put_u64(bucket(cache, index) + 24, length);
+    put_u64(bucket(cache, index) + 16, end);
+    put_u64(&cache->data[CACHE_ENTRY_FIELD], get_u64(&cache->data[CACHE_ENTRY_FIELD]) + 1);
+    put_u64(&cache->data[CACHE_END_FIELD], end + record);
+
+    cache->stores++;
+    return true;
+}
+
+bool
+cache_store(TermCache *cache, TermHash hash, Term *simplified)
+{
+    size_t length;
+    unsigned char *image = serialize_terms(1, &simplified, &length);
+    bool is_stored;
+
+    lock(cache, LOCK_EX);
+    is_stored = store(cache, hash, image, length);
+    lock(cache, LOCK_UN);
+
+    free(image);
+    return is_stored;
+}
+
+bool
+compact_cache(TermCache *cache)
+{
+    bool is_compacted = false;
+
+    lock(cache, LOCK_EX);
+    if (remap(cache) && is_valid(cache))
+        is_compacted = compact(cache, 0);
+    lock(cache, LOCK_UN);
+
+    return is_compacted;
+}
+
+// simplify(term) through the cache, consumes term like simplify does
+Term *
+cached_simplify(TermCache *cache, Term *term)
+{
+    TermHash hash;
+    Term *result;
+
+    if (cache == NULL)
+        return simplify(term);
+
+    hash = hash_term(term);
+    result = cache_lookup(cache, hash);
+    if (result != NULL) {
+        free_term(term);
+        return result;
+    }
+
+    result = simplify(term);
+    cache_store(cache, hash, result);
+
+    return result;
+}
@@ -0,0 +1,45 @@
+#ifndef CACHE_TERM_H_
+#define CACHE_TERM_H_
+
+#define CACHE_VERSION 1
+#define CACHE_HEADER 64
+// initial number of buckets, always a power of two
+#define CACHE_BUCKETS 1024
+
+typedef struct TermHash TermHash;
+typedef struct TermCache TermCache;
+
+// structural hash, the same for equal terms in every process
+struct TermHash {
+    unsigned long long low;
+    unsigned long long high;
+};
+
+// handle on a cache file shared by any number of processes. The file is
+// a header, an open addressed table of (hash, offset, length) buckets and
+// the appended term images of the simplified results. Readers take a
+// shared flock, writers an exclusive one, and every handle remaps when
+// another one has grown or compacted the file.
+struct TermCache {
+    int fd;
+    unsigned char *data;
+    size_t size;
+    size_t limit;
+    unsigned long long rules;
+
+    long hits;
+    long misses;
+    long stores;
+    long compactions;
+};
+
+TermHash hash_term(Term *term);
+
+TermCache *open_cache(char *path, size_t limit, unsigned long long rules);
+void close_cache(TermCache *cache);
+Term *cache_lookup(TermCache *cache, TermHash hash);
+bool cache_store(TermCache *cache, TermHash hash, Term *simplified);
+bool compact_cache(TermCache *cache);
+Term *cached_simplify(TermCache *cache, Term *term);
+
+#endif // CACHE_TERM_H_
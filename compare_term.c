@@ -1,281 +1,160 @@
 #include <string.h>
 #include "term.h"
+#include "traverse_term.h"
 #include "compare_term.h"
 
-bool
-is_less(Term *lhs, Term *rhs)
+// literals come first, then constants, variables and operators. The four
+// meanings differ in their first character.
+static int
+rank(Term *term)
+{
+    switch (term->meaning[0]) {
+    case 'l':
+        return 0;
+    case 'c':
+        return 1;
+    case 'v':
+        return 2;
+    case 'o':
+        return 3;
+    }
+    return 4;
+}
+
+static int
+sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+// compares two terms without looking at their arguments or indices. Like
+// heads have as many of those, the ones of rhs are returned in rhs_childv.
+static int
+compare_heads(Term *lhs, Term *rhs, int *childc, Term ***rhs_childv)
 {
+    int lhs_rank = rank(lhs), rhs_rank = rank(rhs);
+
+    *childc = 0;
+
+    if (lhs_rank != rhs_rank)
+        return lhs_rank < rhs_rank ? -1 : 1;
+
     // literal
-    if (strcmp(lhs->meaning, "literal") == 0 &&
-        strcmp(rhs->meaning, "literal") == 0) {
+    if (lhs_rank == 0) {
         Literal *lhs_literal = (Literal*) lhs->content;
         Literal *rhs_literal = (Literal*) rhs->content;
 
-        if (lhs_literal->value < rhs_literal->value)
-            return true;
-        return false;
+        return (lhs_literal->value > rhs_literal->value) - (lhs_literal->value < rhs_literal->value);
     }
 
     // constant
-    if (strcmp(lhs->meaning, "constant") == 0 &&
-        strcmp(rhs->meaning, "constant") == 0) {
+    if (lhs_rank == 1) {
         Constant *lhs_constant = (Constant*) lhs->content;
         Constant *rhs_constant = (Constant*) rhs->content;
 
-        if (strcmp(lhs_constant->name, rhs_constant->name) < 0)
-            return true;
-        return false;
+        return sign(strcmp(lhs_constant->name, rhs_constant->name));
     }
 
     // variable
-    if (strcmp(lhs->meaning, "variable") == 0 &&
-        strcmp(rhs->meaning, "variable") == 0) {
+    if (lhs_rank == 2) {
         Variable *lhs_variable = (Variable*) lhs->content;
         Variable *rhs_variable = (Variable*) rhs->content;
+        int result = sign(strcmp(lhs_variable->name, rhs_variable->name));
 
-        if (strcmp(lhs_variable->name, rhs_variable->name) < 0)
-            return true;
-        if (strcmp(lhs_variable->name, rhs_variable->name) > 0)
-            return false;
-        if (strcmp(lhs_variable->name, rhs_variable->name) == 0) {
-            if (lhs_variable->indec < rhs_variable->indec)
-                return true;
-            if (lhs_variable->indec > rhs_variable->indec)
-                return false;
-            if (lhs_variable->indec == rhs_variable->indec) {
-                for (int i = 0;i < lhs_variable->indec;i++) {
-                    if (is_less(lhs_variable->index[i], rhs_variable->index[i]))
-                        return true;
-                    if (is_greater(lhs_variable->index[i], rhs_variable->index[i]))
-                        return false;
-                }
-                return false;
-            }
-        }
+        if (result != 0)
+            return result;
+        *childc = lhs_variable->indec;
+        *rhs_childv = rhs_variable->index;
+        return (lhs_variable->indec > rhs_variable->indec) - (lhs_variable->indec < rhs_variable->indec);
     }
 
     // operator
-    if (strcmp(lhs->meaning, "operator") == 0 &&
-        strcmp(rhs->meaning, "operator") == 0) {
+    if (lhs_rank == 3) {
         Operator *lhs_operator = (Operator*) lhs->content;
         Operator *rhs_operator = (Operator*) rhs->content;
+        int result = sign(strcmp(lhs_operator->name, rhs_operator->name));
 
-        if (strcmp(lhs_operator->name, rhs_operator->name) < 0)
-            return true;
-        if (strcmp(lhs_operator->name, rhs_operator->name) > 0)
-            return false;
-        if (strcmp(lhs_operator->name, rhs_operator->name) == 0) {
-            if (lhs_operator->argc < rhs_operator->argc)
-                return true;
-            if (lhs_operator->argc > rhs_operator->argc)
-                return false;
-            if (lhs_operator->argc == rhs_operator->argc) {
-                for (int i = lhs_operator->argc - 1;i >= 0;i--) {
-                    if (is_less(lhs_operator->argv[i], rhs_operator->argv[i]))
-                        return true;
-                    if (is_greater(lhs_operator->argv[i], rhs_operator->argv[i]))
-                        return false;
-                }
-                return false;
-            }
-        }
+        if (result != 0)
+            return result;
+        *childc = lhs_operator->argc;
+        *rhs_childv = rhs_operator->argv;
+        return (lhs_operator->argc > rhs_operator->argc) - (lhs_operator->argc < rhs_operator->argc);
     }
 
-    // other
-    if (strcmp(lhs->meaning, "literal") == 0 &&
-        strcmp(rhs->meaning, "constant") == 0)
-        return true;
-    if (strcmp(lhs->meaning, "literal") == 0 &&
-        strcmp(rhs->meaning, "variable") == 0)
-        return true;
-    if (strcmp(lhs->meaning, "literal") == 0 &&
-        strcmp(rhs->meaning, "operator") == 0)
-        return true;
-
-    if (strcmp(lhs->meaning, "constant") == 0 &&
-        strcmp(rhs->meaning, "variable") == 0)
-        return true;
-    if (strcmp(lhs->meaning, "constant") == 0 &&
-        strcmp(rhs->meaning, "operator") == 0)
-        return true;
-
-    if (strcmp(lhs->meaning, "variable") == 0 &&
-        strcmp(rhs->meaning, "operator") == 0)
-        return true;
-
-    return false;
+    return 0;
 }
 
-bool
-is_greater(Term *lhs, Term *rhs)
+// the first difference in a walk over both terms decides, where indices of
+// variables are visited first to last and arguments of operators last to
+// first. Every visit keeps the children of rhs in other.
+int
+compare_terms(Term *lhs, Term *rhs)
 {
-    // literal
-    if (strcmp(lhs->meaning, "literal") == 0 &&
-        strcmp(rhs->meaning, "literal") == 0) {
-        Literal *lhs_literal = (Literal*) lhs->content;
-        Literal *rhs_literal = (Literal*) rhs->content;
+    Traversal temp_traversal;
+    Term **rhs_childv;
+    int result, childc;
 
-        if (lhs_literal->value > rhs_literal->value)
-            return true;
-        return false;
-    }
-
-    // constant
-    if (strcmp(lhs->meaning, "constant") == 0 &&
-        strcmp(rhs->meaning, "constant") == 0) {
-        Constant *lhs_constant = (Constant*) lhs->content;
-        Constant *rhs_constant = (Constant*) rhs->content;
+    result = compare_heads(lhs, rhs, &childc, &rhs_childv);
+    if (result != 0 || childc == 0)
+        return result;
 
-        if (strcmp(lhs_constant->name, rhs_constant->name) > 0)
-            return true;
-        return false;
-    }
+    begin_traversal(&temp_traversal);
+    push_visit(&temp_traversal, lhs, rhs_childv);
 
-    // variable
-    if (strcmp(lhs->meaning, "variable") == 0 &&
-        strcmp(rhs->meaning, "variable") == 0) {
-        Variable *lhs_variable = (Variable*) lhs->content;
-        Variable *rhs_variable = (Variable*) rhs->content;
+    while (temp_traversal.depth > 0) {
+        Visit *visit = top_visit(&temp_traversal);
+        Term *lhs_child;
+        int i;
 
-        if (strcmp(lhs_variable->name, rhs_variable->name) > 0)
-            return true;
-        if (strcmp(lhs_variable->name, rhs_variable->name) < 0)
-            return false;
-        if (strcmp(lhs_variable->name, rhs_variable->name) == 0) {
-            if (lhs_variable->indec > rhs_variable->indec)
-                return true;
-            if (lhs_variable->indec < rhs_variable->indec)
-                return false;
-            if (lhs_variable->indec == rhs_variable->indec) {
-                for (int i = 0;i < lhs_variable->indec;i++) {
-                    if (is_greater(lhs_variable->index[i], rhs_variable->index[i]))
-                        return true;
-                    if (is_less(lhs_variable->index[i], rhs_variable->index[i]))
-                        return false;
-                }
-                return false;
-            }
+        if (visit->child == visit->childc) {
+            pop_visit(&temp_traversal);
+            continue;
         }
-        return false;
-    }
 
-    // operator
-    if (strcmp(lhs->meaning, "operator") == 0 &&
-        strcmp(rhs->meaning, "operator") == 0) {
-        Operator *lhs_operator = (Operator*) lhs->content;
-        Operator *rhs_operator = (Operator*) rhs->content;
+        i = visit->child++;
+        if (rank(visit->term) == 3)
+            i = visit->childc - 1 - i;
+        lhs_child = visit->childv[i];
 
-        if (strcmp(lhs_operator->name, rhs_operator->name) > 0)
-            return true;
-        if (strcmp(lhs_operator->name, rhs_operator->name) < 0)
-            return false;
-        if (strcmp(lhs_operator->name, rhs_operator->name) == 0) {
-            if (lhs_operator->argc > rhs_operator->argc)
-                return true;
-            if (lhs_operator->argc < rhs_operator->argc)
-                return false;
-            if (lhs_operator->argc == rhs_operator->argc) {
-                for (int i = lhs_operator->argc - 1;i >= 0;i--) {
-                    if (is_greater(lhs_operator->argv[i], rhs_operator->argv[i]))
-                        return true; 
-                    if (is_less(lhs_operator->argv[i], rhs_operator->argv[i]))
-                        return false;
-                }
-                return false;
-            }
-        }
-        return false;
+        result = compare_heads(lhs_child, ((Term **) visit->other)[i], &childc, &rhs_childv);
+        if (result != 0)
+            break;
+        if (childc > 0)
+            push_visit(&temp_traversal, lhs_child, rhs_childv);
     }
 
-    // other
-    if (strcmp(lhs->meaning, "constant") == 0 &&
-        strcmp(rhs->meaning, "literal") == 0)
-        return true;
-    if (strcmp(lhs->meaning, "variable") == 0 &&
-        strcmp(rhs->meaning, "literal") == 0)
-        return true;
-    if (strcmp(lhs->meaning, "operator") == 0 &&
-        strcmp(rhs->meaning, "literal") == 0)
-        return true;
+    end_traversal(&temp_traversal);
+    return result;
+}
 
-    if (strcmp(lhs->meaning, "variable") == 0 &&
-        strcmp(rhs->meaning, "constant") == 0)
-        return true;
-    if (strcmp(lhs->meaning, "operator") == 0 &&
-        strcmp(rhs->meaning, "constant") == 0)
-        return true;
+static bool
+are_literals(Term *lhs, Term *rhs)
+{
+    return strcmp(lhs->meaning, "literal") == 0 && strcmp(rhs->meaning, "literal") == 0;
+}
 
-    if (strcmp(lhs->meaning, "operator") == 0 &&
-        strcmp(rhs->meaning, "variable") == 0)
-        return true;
+bool
+is_less(Term *lhs, Term *rhs)
+{
+    if (are_literals(lhs, rhs))
+        return ((Literal*) lhs->content)->value < ((Literal*) rhs->content)->value;
+    return compare_terms(lhs, rhs) < 0;
+}
 
-    return false;
+bool
+is_greater(Term *lhs, Term *rhs)
+{
+    if (are_literals(lhs, rhs))
+        return ((Literal*) lhs->content)->value > ((Literal*) rhs->content)->value;
+    return compare_terms(lhs, rhs) > 0;
 }
 
+// two literals have to be ==, so a NaN is equal to nothing. Below the top
+// a NaN compares neither less nor greater and counts as equal.
 bool
 is_equal(Term *lhs, Term *rhs)
 {
-    // literal
-    if (strcmp(lhs->meaning, "literal") == 0 &&
-        strcmp(rhs->meaning, "literal") == 0) {
-        Literal *lhs_literal = (Literal*) lhs->content;
-        Literal *rhs_literal = (Literal*) rhs->content;
-
-        if (lhs_literal->value == rhs_literal->value)
-            return true;
-        return false;
-    }
-
-    // constant
-    if (strcmp(lhs->meaning, "constant") == 0 &&
-        strcmp(rhs->meaning, "constant") == 0) {
-        Constant *lhs_constant = (Constant*) lhs->content;
-        Constant *rhs_constant = (Constant*) rhs->content;
-
-        if (strcmp(lhs_constant->name, rhs_constant->name) == 0)
-            return true;
-        return false;
-    }
-
-    // variable
-    if (strcmp(lhs->meaning, "variable") == 0 &&
-        strcmp(rhs->meaning, "variable") == 0) {
-        Variable *lhs_variable = (Variable*) lhs->content;
-        Variable *rhs_variable = (Variable*) rhs->content;
-
-        if (strcmp(lhs_variable->name, rhs_variable->name) == 0) {
-            if (lhs_variable->indec == rhs_variable->indec) {
-                for (int i = 0;i < lhs_variable->indec;i++) {
-                    if (is_greater(lhs_variable->index[i], rhs_variable->index[i]))
-                        return false;
-                    if (is_less(lhs_variable->index[i], rhs_variable->index[i]))
-                        return false;
-                }
-                return true;
-            }
-        }
-        return false;
-    }
-
-    // operator
-    if (strcmp(lhs->meaning, "operator") == 0 &&
-        strcmp(rhs->meaning, "operator") == 0) {
-        Operator *lhs_operator = (Operator*) lhs->content;
-        Operator *rhs_operator = (Operator*) rhs->content;
-
-        if (strcmp(lhs_operator->name, rhs_operator->name) == 0) {
-            if (lhs_operator->argc == rhs_operator->argc) {
-                for (int i = lhs_operator->argc - 1;i >= 0;i--) {
-                    if (is_greater(lhs_operator->argv[i], rhs_operator->argv[i]))
-                        return false;
-                    if (is_less(lhs_operator->argv[i], rhs_operator->argv[i]))
-                        return false;
-                }
-                return true;
-            }
-        }
-        return false;
-    }
-
-    return false;
+    if (are_literals(lhs, rhs))
+        return ((Literal*) lhs->content)->value == ((Literal*) rhs->content)->value;
+    return compare_terms(lhs, rhs) == 0;
 }
@@ -1,6 +1,9 @@
 #ifndef COMPARE_TERM_H_
 #define COMPARE_TERM_H_
 
+// -1, 0 or 1 as lhs orders before, like or after rhs
+int compare_terms(Term *lhs, Term *rhs);
+
 bool is_less(Term *lhs, Term *rhs);
 bool is_greater(Term *lhs, Term *rhs);
 bool is_equal(Term *lhs, Term *rhs);
@@ -0,0 +1,436 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "term.h"
+#include "compare_term.h"
+#include "compile_term.h"
+
+struct Compiler {
+    Program *program;
+    int capacity;
+    int operand_capacity;
+    int constant_capacity;
+
+    int *table;
+    int table_capacity;
+};
+
+static unsigned long long
+hash_instruction(Instruction *instruction, int *operands)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    unsigned long long bits;
+
+    hash = (hash ^ (unsigned long long) instruction->opcode) * 1099511628211ULL;
+    hash = (hash ^ (unsigned long long) instruction->index) * 1099511628211ULL;
+
+    memcpy(&bits, &instruction->value, sizeof(bits));
+    hash = (hash ^ bits) * 1099511628211ULL;
+
+    for (int i = 0;i < instruction->argc;i++)
+        hash = (hash ^ (unsigned long long) operands[i]) * 1099511628211ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+static bool
+is_same_instruction(Program *program, int index, Instruction *instruction, int *operands)
+{
+    Instruction *other = &program->instructions[index];
+
+    if (other->opcode != instruction->opcode)
+        return false;
+    if (other->argc != instruction->argc)
+        return false;
+    if (other->index != instruction->index)
+        return false;
+    if (memcmp(&other->value, &instruction->value, sizeof(double)) != 0)
+        return false;
+
+    for (int i = 0;i < instruction->argc;i++)
+        if (program->operands[other->first + i] != operands[i])
+            return false;
+
+    return true;
+}
+
+static void
+resize_table(Compiler *compiler, int capacity)
+{
+    Program *program = compiler->program;
+    int *table = (int *) malloc(sizeof(int) * capacity);
+
+    for (int i = 0;i < capacity;i++)
+        table[i] = -1;
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        unsigned long long hash = hash_instruction(instruction, &program->operands[instruction->first]);
+        int slot = (int) (hash & (unsigned long long) (capacity - 1));
+
+        while (table[slot] != -1)
+            slot = (slot + 1) & (capacity - 1);
+        table[slot] = i;
+    }
+
+    free(compiler->table);
+    compiler->table = table;
+    compiler->table_capacity = capacity;
+}
+
+static int
+compare_operands(const void *lhs, const void *rhs)
+{
+    return *(const int *) lhs - *(const int *) rhs;
+}
+
+// appends an instruction unless an equal one was emitted before
+static int
+emit(Compiler *compiler, Instruction instruction, int *operands)
+{
+    Program *program = compiler->program;
+    unsigned long long hash;
+    int slot;
+
+    if (instruction.opcode == OPCODE_ADD || instruction.opcode == OPCODE_MULTIPLY)
+        qsort(operands, instruction.argc, sizeof(int), compare_operands);
+
+    hash = hash_instruction(&instruction, operands);
+    slot = (int) (hash & (unsigned long long) (compiler->table_capacity - 1));
+    while (compiler->table[slot] != -1) {
+        if (is_same_instruction(program, compiler->table[slot], &instruction, operands))
+            return compiler->table[slot];
+        slot = (slot + 1) & (compiler->table_capacity - 1);
+    }
+
+    if (program->length >= compiler->capacity) {
+        compiler->capacity *= 2;
+        program->instructions = (Instruction *) realloc(program->instructions,
+                sizeof(Instruction) * compiler->capacity);
+    }
+    while (program->operandc + instruction.argc > compiler->operand_capacity) {
+        compiler->operand_capacity *= 2;
+        program->operands = (int *) realloc(program->operands,
+                sizeof(int) * compiler->operand_capacity);
+    }
+
+    instruction.first = program->operandc;
+    for (int i = 0;i < instruction.argc;i++)
+        program->operands[program->operandc++] = operands[i];
+
+    program->instructions[program->length] = instruction;
+    compiler->table[slot] = program->length;
+    program->length++;
+
+    if (program->length * 2 > compiler->table_capacity)
+        resize_table(compiler, compiler->table_capacity * 2);
+
+    return program->length - 1;
+}
+
+static int
+constant_slot(Compiler *compiler, Constant *constant)
+{
+    Program *program = compiler->program;
+
+    for (int i = 0;i < program->constantc;i++)
+        if (strcmp(program->constants[i]->name, constant->name) == 0)
+            return i;
+
+    if (program->constantc >= compiler->constant_capacity) {
+        compiler->constant_capacity *= 2;
+        program->constants = (Constant **) realloc(program->constants,
+                sizeof(Constant *) * compiler->constant_capacity);
+    }
+    program->constants[program->constantc] = copy_constant(constant);
+
+    return program->constantc++;
+}
+
+static int
+compile_node(Compiler *compiler, Term *term)
+{
+    Program *program = compiler->program;
+    Instruction instruction = { OPCODE_LITERAL, 0, 0, -1, 0.0 };
+
+    if (strcmp(term->meaning, "literal") == 0) {
+        Literal *literal = term->content;
+
+        instruction.value = literal->value;
+        return emit(compiler, instruction, NULL);
+    }
+    if (strcmp(term->meaning, "constant") == 0) {
+        Constant *constant = term->content;
+
+        instruction.opcode = OPCODE_CONSTANT;
+        instruction.index = constant_slot(compiler, constant);
+        instruction.value = (constant->upper_limit + constant->lower_limit) / 2.0;
+        return emit(compiler, instruction, NULL);
+    }
+    if (strcmp(term->meaning, "variable") == 0) {
+        int i;
+
+        for (i = 0;i < program->variablec;i++)
+            if (is_equal(program->variables[i], term))
+                break;
+        if (i >= program->variablec)
+            return -1;
+
+        instruction.opcode = OPCODE_VARIABLE;
+        instruction.index = i;
+        return emit(compiler, instruction, NULL);
+    }
+    if (strcmp(term->meaning, "operator") == 0) {
+        Operator *operator = term->content;
+        int *operands;
+        int result;
+
+        if (strcmp(operator->name, "imaginary") == 0)
+            instruction.opcode = OPCODE_IMAGINARY;
+        else if (strcmp(operator->name, "+") == 0)
+            instruction.opcode = OPCODE_ADD;
+        else if (strcmp(operator->name, "additive_inverse") == 0)
+            instruction.opcode = OPCODE_ADDITIVE_INVERSE;
+        else if (strcmp(operator->name, "*") == 0)
+            instruction.opcode = OPCODE_MULTIPLY;
+        else if (strcmp(operator->name, "multiple_inverse") == 0)
+            instruction.opcode = OPCODE_MULTIPLE_INVERSE;
+        else if (strcmp(operator->name, "^") == 0)
+            instruction.opcode = OPCODE_POWER;
+        else
+            return -1;
+
+        operands = (int *) malloc(sizeof(int) * (operator->argc + 1));
+        for (int i = 0;i < operator->argc;i++) {
+            operands[i] = compile_node(compiler, operator->argv[i]);
+            if (operands[i] < 0) {
+                free(operands);
+                return -1;
+            }
+        }
+
+        instruction.argc = operator->argc;
+        result = emit(compiler, instruction, operands);
+
+        free(operands);
+        return result;
+    }
+
+    return -1;
+}
+
+Program *
+compile_term(Term *term, int variablec, Term **variables)
+{
+    return compile_terms(1, &term, variablec, variables);
+}
+
+Program *
+compile_terms(int termc, Term **terms, int variablec, Term **variables)
+{
+    Compiler compiler;
+    Program *program = (Program *) malloc(sizeof(Program));
+
+    program->length = 0;
+    program->instructions = (Instruction *) malloc(sizeof(Instruction) * 16);
+    program->operandc = 0;
+    program->operands = (int *) malloc(sizeof(int) * 16);
+    program->constantc = 0;
+    program->constants = (Constant **) malloc(sizeof(Constant *) * 4);
+
+    program->variablec = variablec;
+    program->variables = (Term **) malloc(sizeof(Term *) * (variablec + 1));
+    for (int i = 0;i < variablec;i++)
+        program->variables[i] = copy_term(variables[i]);
+
+    program->resultc = termc;
+    program->results = (int *) malloc(sizeof(int) * (termc + 1));
+
+    compiler.program = program;
+    compiler.capacity = 16;
+    compiler.operand_capacity = 16;
+    compiler.constant_capacity = 4;
+    compiler.table_capacity = 64;
+    compiler.table = (int *) malloc(sizeof(int) * compiler.table_capacity);
+    for (int i = 0;i < compiler.table_capacity;i++)
+        compiler.table[i] = -1;
+
+    for (int i = 0;i < termc;i++) {
+        program->results[i] = compile_node(&compiler, terms[i]);
+        if (program->results[i] < 0) {
+            free(compiler.table);
+            free_program(program);
+            return NULL;
+        }
+    }
+
+    free(compiler.table);
+
+    return program;
+}
+
+// picks up emitting into a program compiled before, instructions emitted
+// through the compiler are still shared with the ones program has
+Compiler *
+resume_program(Program *program)
+{
+    Compiler *compiler = (Compiler *) malloc(sizeof(Compiler));
+    int capacity = 64;
+
+    compiler->program = program;
+    compiler->capacity = program->length + 16;
+    compiler->operand_capacity = program->operandc + 16;
+    compiler->constant_capacity = program->constantc + 4;
+    program->instructions = (Instruction *) realloc(program->instructions,
+            sizeof(Instruction) * compiler->capacity);
+    program->operands = (int *) realloc(program->operands, sizeof(int) * compiler->operand_capacity);
+    program->constants = (Constant **) realloc(program->constants,
+            sizeof(Constant *) * compiler->constant_capacity);
+
+    while (program->length * 2 > capacity)
+        capacity *= 2;
+    compiler->table = NULL;
+    resize_table(compiler, capacity);
+
+    return compiler;
+}
+
+int
+emit_instruction(Compiler *compiler, Instruction instruction, int *operands)
+{
+    return emit(compiler, instruction, operands);
+}
+
+void
+free_compiler(Compiler *compiler)
+{
+    free(compiler->table);
+    free(compiler);
+    return;
+}
+
+void
+free_program(Program *program)
+{
+    for (int i = 0;i < program->variablec;i++)
+        free_term(program->variables[i]);
+    for (int i = 0;i < program->constantc;i++)
+        free_constant(program->constants[i]);
+
+    free(program->variables);
+    free(program->constants);
+    free(program->instructions);
+    free(program->operands);
+    free(program->results);
+    free(program);
+    return;
+}
+
+// rebuilds the term computed by one instruction
+Term *
+decompile_instruction(Program *program, int index)
+{
+    Instruction *instruction = &program->instructions[index];
+    int *operands = &program->operands[instruction->first];
+    Term *result;
+
+    switch (instruction->opcode) {
+    case OPCODE_LITERAL:
+        return literal(instruction->value);
+    case OPCODE_CONSTANT:
+        return term(copy_constant(program->constants[instruction->index]), "constant");
+    case OPCODE_VARIABLE:
+        return copy_term(program->variables[instruction->index]);
+    case OPCODE_IMAGINARY:
+        return imaginary(decompile_instruction(program, operands[0]));
+    case OPCODE_ADD:
+        result = decompile_instruction(program, operands[0]);
+        for (int i = 1;i < instruction->argc;i++)
+            result = add(result, decompile_instruction(program, operands[i]));
+        return result;
+    case OPCODE_ADDITIVE_INVERSE:
+        return additive_inverse(decompile_instruction(program, operands[0]));
+    case OPCODE_MULTIPLY:
+        result = decompile_instruction(program, operands[0]);
+        for (int i = 1;i < instruction->argc;i++)
+            result = multiply(result, decompile_instruction(program, operands[i]));
+        return result;
+    case OPCODE_MULTIPLE_INVERSE:
+        return multiple_inverse(decompile_instruction(program, operands[0]));
+    case OPCODE_POWER:
+        return power(decompile_instruction(program, operands[0]),
+                decompile_instruction(program, operands[1]));
+    }
+
+    return NULL;
+}
+
+void
+evaluate_program(Program *program, double *values, double *registers, double *results)
+{
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double value;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+        case OPCODE_CONSTANT:
+            value = instruction->value;
+            break;
+        case OPCODE_VARIABLE:
+            value = values[instruction->index];
+            break;
+        case OPCODE_IMAGINARY:
+            // not real valued
+            value = NAN;
+            break;
+        case OPCODE_ADD:
+            value = 0.0;
+            for (int j = 0;j < instruction->argc;j++)
+                value += registers[operands[j]];
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            value = -registers[operands[0]];
+            break;
+        case OPCODE_MULTIPLY:
+            value = 1.0;
+            for (int j = 0;j < instruction->argc;j++)
+                value *= registers[operands[j]];
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            value = 1.0 / registers[operands[0]];
+            break;
+        case OPCODE_POWER:
+            value = pow(registers[operands[0]], registers[operands[1]]);
+            break;
+        default:
+            value = NAN;
+            break;
+        }
+
+        registers[i] = value;
+    }
+
+    for (int i = 0;i < program->resultc;i++)
+        results[i] = registers[program->results[i]];
+    return;
+}
+
+double
+evaluate_term(Term *term, int variablec, Term **variables, double *values)
+{
+    Program *program = compile_term(term, variablec, variables);
+    double *registers, result;
+
+    if (program == NULL)
+        return NAN;
+
+    registers = (double *) malloc(sizeof(double) * program->length);
+    evaluate_program(program, values, registers, &result);
+
+    free(registers);
+    free_program(program);
+
+    return result;
+}
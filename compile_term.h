@@ -0,0 +1,59 @@
+#ifndef COMPILE_TERM_H_
+#define COMPILE_TERM_H_
+
+typedef struct Program Program;
+typedef struct Instruction Instruction;
+typedef struct Compiler Compiler;
+
+typedef enum {
+    OPCODE_LITERAL,
+    OPCODE_CONSTANT,
+    OPCODE_VARIABLE,
+    OPCODE_IMAGINARY,
+    OPCODE_ADD,
+    OPCODE_ADDITIVE_INVERSE,
+    OPCODE_MULTIPLY,
+    OPCODE_MULTIPLE_INVERSE,
+    OPCODE_POWER
+} Opcode;
+
+// operands of an instruction are program->operands[first .. first + argc - 1],
+// each one the index of an earlier instruction
+struct Instruction {
+    Opcode opcode;
+    int argc;
+    int first;
+    int index;      // variable slot or constant slot
+    double value;   // literal value or constant midpoint
+};
+
+// straight-line form of one or more terms, equal subterms are computed once
+struct Program {
+    int length;
+    Instruction *instructions;
+    int operandc;
+    int *operands;
+
+    int variablec;
+    Term **variables;
+    int constantc;
+    Constant **constants;
+
+    int resultc;
+    int *results;
+};
+
+Program *compile_term(Term *term, int variablec, Term **variables);
+Program *compile_terms(int termc, Term **terms, int variablec, Term **variables);
+void free_program(Program *program);
+
+Compiler *resume_program(Program *program);
+int emit_instruction(Compiler *compiler, Instruction instruction, int *operands);
+void free_compiler(Compiler *compiler);
+
+Term *decompile_instruction(Program *program, int index);
+
+void evaluate_program(Program *program, double *values, double *registers, double *results);
+double evaluate_term(Term *term, int variablec, Term **variables, double *values);
+
+#endif // COMPILE_TERM_H_
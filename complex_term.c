@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <math.h>
+#include "term.h"
+#include "compile_term.h"
+#include "complex_term.h"
+
+// number of points evaluated together by the batch evaluator
+#define COMPLEX_BLOCK 256
+
+Complex
+complex_number(double real, double imaginary)
+{
+    Complex complex;
+
+    complex.real = real;
+    complex.imaginary = imaginary;
+
+    return complex;
+}
+
+Complex
+complex_add(Complex lhs, Complex rhs)
+{
+    return complex_number(lhs.real + rhs.real, lhs.imaginary + rhs.imaginary);
+}
+
+Complex
+complex_additive_inverse(Complex operand)
+{
+    return complex_number(-operand.real, -operand.imaginary);
+}
+
+Complex
+complex_multiply(Complex lhs, Complex rhs)
+{
+    return complex_number(lhs.real * rhs.real - lhs.imaginary * rhs.imaginary,
+            lhs.real * rhs.imaginary + lhs.imaginary * rhs.real);
+}
+
+// scaled by the larger component so that |z|^2 does not overflow
+Complex
+complex_multiple_inverse(Complex operand)
+{
+    double scale = fmax(fabs(operand.real), fabs(operand.imaginary));
+    double real = operand.real / scale;
+    double imaginary = operand.imaginary / scale;
+    double denominator = (real * real + imaginary * imaginary) * scale;
+
+    if (scale == 0.0)
+        return complex_number(1.0 / operand.real, 0.0);
+
+    return complex_number(real / denominator, -imaginary / denominator);
+}
+
+static Complex
+complex_integer_power(Complex base, long exponent)
+{
+    Complex result = complex_number(1.0, 0.0);
+    bool is_inverse = false;
+
+    if (exponent < 0) {
+        exponent = -exponent;
+        is_inverse = true;
+    }
+
+    while (exponent > 0) {
+        if (exponent & 1)
+            result = complex_multiply(result, base);
+        base = complex_multiply(base, base);
+        exponent >>= 1;
+    }
+
+    if (is_inverse)
+        return complex_multiple_inverse(result);
+    return result;
+}
+
+// principal value exp(exponent * log(base))
+Complex
+complex_power(Complex base, Complex exponent)
+{
+    double modulus, argument, real, imaginary, magnitude;
+
+    if (exponent.imaginary == 0.0 &&
+        exponent.real == floor(exponent.real) &&
+        fabs(exponent.real) < 1024.0)
+        return complex_integer_power(base, (long) exponent.real);
+
+    if (base.real == 0.0 && base.imaginary == 0.0) {
+        if (exponent.real > 0.0)
+            return complex_number(0.0, 0.0);
+        return complex_number(NAN, NAN);
+    }
+
+    modulus = log(hypot(base.real, base.imaginary));
+    argument = atan2(base.imaginary, base.real);
+
+    real = exponent.real * modulus - exponent.imaginary * argument;
+    imaginary = exponent.real * argument + exponent.imaginary * modulus;
+    magnitude = exp(real);
+
+    return complex_number(magnitude * cos(imaginary), magnitude * sin(imaginary));
+}
+
+void
+evaluate_program_complex(Program *program, Complex *values, Complex *registers, Complex *results)
+{
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        Complex value;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+        case OPCODE_CONSTANT:
+            value = complex_number(instruction->value, 0.0);
+            break;
+        case OPCODE_VARIABLE:
+            value = values[instruction->index];
+            break;
+        case OPCODE_IMAGINARY:
+            value = complex_number(-registers[operands[0]].imaginary, registers[operands[0]].real);
+            break;
+        case OPCODE_ADD:
+            value = registers[operands[0]];
+            for (int j = 1;j < instruction->argc;j++)
+                value = complex_add(value, registers[operands[j]]);
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            value = complex_additive_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_MULTIPLY:
+            value = registers[operands[0]];
+            for (int j = 1;j < instruction->argc;j++)
+                value = complex_multiply(value, registers[operands[j]]);
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            value = complex_multiple_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_POWER:
+            value = complex_power(registers[operands[0]], registers[operands[1]]);
+            break;
+        default:
+            value = complex_number(NAN, NAN);
+            break;
+        }
+
+        registers[i] = value;
+    }
+
+    for (int i = 0;i < program->resultc;i++)
+        results[i] = registers[program->results[i]];
+    return;
+}
+
+static void
+evaluate_block(Program *program, int offset, int count, double **real, double **imaginary,
+        double **result_real, double **result_imaginary, double *registers)
+{
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double *register_real = &registers[(2 * i) * COMPLEX_BLOCK];
+        double *register_imaginary = &registers[(2 * i + 1) * COMPLEX_BLOCK];
+        double *lhs_real = NULL, *lhs_imaginary = NULL;
+
+        if (instruction->argc > 0) {
+            lhs_real = &registers[(2 * operands[0]) * COMPLEX_BLOCK];
+            lhs_imaginary = &registers[(2 * operands[0] + 1) * COMPLEX_BLOCK];
+        }
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+        case OPCODE_CONSTANT:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = instruction->value;
+                register_imaginary[k] = 0.0;
+            }
+            break;
+        case OPCODE_VARIABLE:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = real[instruction->index][offset + k];
+                register_imaginary[k] = imaginary[instruction->index][offset + k];
+            }
+            break;
+        case OPCODE_IMAGINARY:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = -lhs_imaginary[k];
+                register_imaginary[k] = lhs_real[k];
+            }
+            break;
+        case OPCODE_ADD:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = lhs_real[k];
+                register_imaginary[k] = lhs_imaginary[k];
+            }
+            for (int j = 1;j < instruction->argc;j++) {
+                double *rhs_real = &registers[(2 * operands[j]) * COMPLEX_BLOCK];
+                double *rhs_imaginary = &registers[(2 * operands[j] + 1) * COMPLEX_BLOCK];
+
+                for (int k = 0;k < count;k++) {
+                    register_real[k] += rhs_real[k];
+                    register_imaginary[k] += rhs_imaginary[k];
+                }
+            }
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = -lhs_real[k];
+                register_imaginary[k] = -lhs_imaginary[k];
+            }
+            break;
+        case OPCODE_MULTIPLY:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = lhs_real[k];
+                register_imaginary[k] = lhs_imaginary[k];
+            }
+            for (int j = 1;j < instruction->argc;j++) {
+                double *rhs_real = &registers[(2 * operands[j]) * COMPLEX_BLOCK];
+                double *rhs_imaginary = &registers[(2 * operands[j] + 1) * COMPLEX_BLOCK];
+
+                for (int k = 0;k < count;k++) {
+                    double a = register_real[k], b = register_imaginary[k];
+
+                    register_real[k] = a * rhs_real[k] - b * rhs_imaginary[k];
+                    register_imaginary[k] = a * rhs_imaginary[k] + b * rhs_real[k];
+                }
+            }
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            for (int k = 0;k < count;k++) {
+                double scale = fmax(fabs(lhs_real[k]), fabs(lhs_imaginary[k]));
+                double a = lhs_real[k] / scale, b = lhs_imaginary[k] / scale;
+                double denominator = (a * a + b * b) * scale;
+
+                if (scale == 0.0) {
+                    register_real[k] = 1.0 / lhs_real[k];
+                    register_imaginary[k] = 0.0;
+                    continue;
+                }
+
+                register_real[k] = a / denominator;
+                register_imaginary[k] = -b / denominator;
+            }
+            break;
+        case OPCODE_POWER:
+            for (int k = 0;k < count;k++) {
+                Complex value = complex_power(complex_number(lhs_real[k], lhs_imaginary[k]),
+                        complex_number(registers[(2 * operands[1]) * COMPLEX_BLOCK + k],
+                            registers[(2 * operands[1] + 1) * COMPLEX_BLOCK + k]));
+
+                register_real[k] = value.real;
+                register_imaginary[k] = value.imaginary;
+            }
+            break;
+        default:
+            for (int k = 0;k < count;k++) {
+                register_real[k] = NAN;
+                register_imaginary[k] = NAN;
+            }
+            break;
+        }
+    }
+
+    for (int i = 0;i < program->resultc;i++) {
+        int result = program->results[i];
+
+        for (int k = 0;k < count;k++) {
+            result_real[i][offset + k] = registers[(2 * result) * COMPLEX_BLOCK + k];
+            result_imaginary[i][offset + k] = registers[(2 * result + 1) * COMPLEX_BLOCK + k];
+        }
+    }
+    return;
+}
+
+// real[v][k] and imaginary[v][k] hold variable slot v at point k
+void
+evaluate_program_complex_batch(Program *program, int count,
+        double **real, double **imaginary, double **result_real, double **result_imaginary)
+{
+    double *registers = (double *) malloc(sizeof(double) * 2 * COMPLEX_BLOCK * (program->length + 1));
+
+    for (int offset = 0;offset < count;offset += COMPLEX_BLOCK) {
+        int block = count - offset < COMPLEX_BLOCK ? count - offset : COMPLEX_BLOCK;
+
+        evaluate_block(program, offset, block, real, imaginary, result_real, result_imaginary, registers);
+    }
+
+    free(registers);
+    return;
+}
+
+Complex
+evaluate_term_complex(Term *term, int variablec, Term **variables, Complex *values)
+{
+    Program *program = compile_term(term, variablec, variables);
+    Complex *registers, result;
+
+    if (program == NULL)
+        return complex_number(NAN, NAN);
+
+    registers = (Complex *) malloc(sizeof(Complex) * program->length);
+    evaluate_program_complex(program, values, registers, &result);
+
+    free(registers);
+    free_program(program);
+
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef COMPLEX_TERM_H_
+#define COMPLEX_TERM_H_
+
+typedef struct Complex Complex;
+
+struct Complex {
+    double real;
+    double imaginary;
+};
+
+Complex complex_number(double real, double imaginary);
+
+Complex complex_add(Complex lhs, Complex rhs);
+Complex complex_additive_inverse(Complex operand);
+Complex complex_multiply(Complex lhs, Complex rhs);
+Complex complex_multiple_inverse(Complex operand);
+Complex complex_power(Complex base, Complex exponent);
+
+void evaluate_program_complex(Program *program, Complex *values, Complex *registers, Complex *results);
+void evaluate_program_complex_batch(Program *program, int count,
+        double **real, double **imaginary, double **result_real, double **result_imaginary);
+
+Complex evaluate_term_complex(Term *term, int variablec, Term **variables, Complex *values);
+
+#endif // COMPLEX_TERM_H_
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <string.h>
+#include "term.h"
+#include "compare_term.h"
+#include "variable_term.h"
+#include "compile_term.h"
+#include "simplify_term.h"
+#include "differentiate_term.h"
+
+static int
+emit_operator(Compiler *compiler, Opcode opcode, int argc, int *operands)
+{
+    Instruction instruction = { opcode, argc, 0, -1, 0.0 };
+
+    return emit_instruction(compiler, instruction, operands);
+}
+
+static int
+emit_literal(Compiler *compiler, double value)
+{
+    Instruction instruction = { OPCODE_LITERAL, 0, 0, -1, value };
+
+    return emit_instruction(compiler, instruction, NULL);
+}
+
+// a sum of the count summands, -1 if there are none
+static int
+emit_sum(Compiler *compiler, int count, int *summands)
+{
+    if (count == 0)
+        return -1;
+    if (count == 1)
+        return summands[0];
+
+    return emit_operator(compiler, OPCODE_ADD, count, summands);
+}
+
+// derivatives are taken over the compiled program and emitted into it, so
+// every distinct subterm is differentiated once no matter how often it
+// occurs and the derivative refers to the instructions of the primal
+// instead of copies of them. -1 stands for zero. The instruction and its
+// operands are copied since emitting may move the program's arrays.
+static int
+derivative_of_instruction(Compiler *compiler, Program *program, int index, int slot,
+        int *derivatives, bool *is_failed)
+{
+    Instruction instruction = program->instructions[index];
+    int *operands = (int *) malloc(sizeof(int) * (instruction.argc + 1));
+    int *scratch = (int *) malloc(sizeof(int) * (instruction.argc + 3));
+    int *summands = (int *) malloc(sizeof(int) * (instruction.argc + 1));
+    int result = -1, count = 0, lowered;
+
+    memcpy(operands, &program->operands[instruction.first], sizeof(int) * instruction.argc);
+
+    switch (instruction.opcode) {
+    case OPCODE_LITERAL:
+    case OPCODE_CONSTANT:
+        break;
+    case OPCODE_VARIABLE:
+        if (instruction.index == slot)
+            result = emit_literal(compiler, 1.0);
+        break;
+    case OPCODE_IMAGINARY:
+    case OPCODE_ADDITIVE_INVERSE:
+        if (derivatives[operands[0]] < 0)
+            break;
+
+        scratch[0] = derivatives[operands[0]];
+        result = emit_operator(compiler, instruction.opcode, 1, scratch);
+        break;
+    case OPCODE_ADD:
+        for (int i = 0;i < instruction.argc;i++)
+            if (derivatives[operands[i]] >= 0)
+                summands[count++] = derivatives[operands[i]];
+        result = emit_sum(compiler, count, summands);
+        break;
+    case OPCODE_MULTIPLY:
+        // product rule, one summand per factor that depends on the variable
+        for (int i = 0;i < instruction.argc;i++) {
+            if (derivatives[operands[i]] < 0)
+                continue;
+
+            memcpy(scratch, operands, sizeof(int) * instruction.argc);
+            scratch[i] = derivatives[operands[i]];
+            summands[count++] = emit_operator(compiler, OPCODE_MULTIPLY, instruction.argc, scratch);
+        }
+        result = emit_sum(compiler, count, summands);
+        break;
+    case OPCODE_MULTIPLE_INVERSE:
+        // (1/f)' = -f' * 1/f * 1/f, where 1/f is this very instruction
+        if (derivatives[operands[0]] < 0)
+            break;
+
+        scratch[0] = derivatives[operands[0]];
+        scratch[1] = index;
+        scratch[2] = index;
+        result = emit_operator(compiler, OPCODE_MULTIPLY, 3, scratch);
+        result = emit_operator(compiler, OPCODE_ADDITIVE_INVERSE, 1, &result);
+        break;
+    case OPCODE_POWER:
+        if (derivatives[operands[1]] >= 0) {
+            // a variable exponent needs a logarithm, which is no operator
+            *is_failed = true;
+            break;
+        }
+        if (derivatives[operands[0]] < 0)
+            break;
+
+        // (f^g)' = g * f^(g - 1) * f'
+        scratch[0] = emit_literal(compiler, 1.0);
+        scratch[1] = emit_operator(compiler, OPCODE_ADDITIVE_INVERSE, 1, scratch);
+        scratch[0] = operands[1];
+        lowered = emit_operator(compiler, OPCODE_ADD, 2, scratch);
+
+        scratch[0] = operands[0];
+        scratch[1] = lowered;
+        lowered = emit_operator(compiler, OPCODE_POWER, 2, scratch);
+
+        scratch[0] = operands[1];
+        scratch[1] = lowered;
+        scratch[2] = derivatives[operands[0]];
+        result = emit_operator(compiler, OPCODE_MULTIPLY, 3, scratch);
+        break;
+    default:
+        *is_failed = true;
+        break;
+    }
+
+    free(operands);
+    free(scratch);
+    free(summands);
+
+    return result;
+}
+
+// appends the derivative of instruction index with respect to variable
+// slot to program and returns the instruction that computes it, or -1 if
+// index depends on something that can not be differentiated. The
+// derivative shares every subexpression with the primal and with itself,
+// so it stays linear in the size of the program however deeply products
+// and inverses nest. Only instructions index depends on are visited.
+int
+differentiate_instruction(Program *program, int index, int slot)
+{
+    Compiler *compiler = resume_program(program);
+    int *derivatives = (int *) malloc(sizeof(int) * (index + 1));
+    bool *is_needed = (bool *) calloc(index + 1, sizeof(bool));
+    int result = -1;
+    bool is_failed = false;
+
+    is_needed[index] = true;
+    for (int i = index;i >= 0;i--) {
+        Instruction *instruction = &program->instructions[i];
+
+        if (!is_needed[i])
+            continue;
+        for (int j = 0;j < instruction->argc;j++)
+            is_needed[program->operands[instruction->first + j]] = true;
+    }
+
+    for (int i = 0;i <= index && !is_failed;i++) {
+        derivatives[i] = -1;
+        if (is_needed[i])
+            derivatives[i] = derivative_of_instruction(compiler, program, i, slot, derivatives, &is_failed);
+    }
+
+    if (!is_failed) {
+        result = derivatives[index];
+        if (result < 0)
+            result = emit_literal(compiler, 0.0);
+    }
+
+    free(derivatives);
+    free(is_needed);
+    free_compiler(compiler);
+
+    return result;
+}
+
+// returns the simplified derivative of term with respect to variable, or
+// NULL if term contains something that can not be differentiated
+Term *
+differentiate(Term *term, Term *variable)
+{
+    Program *program;
+    Term **variables, *result;
+    int variablec, slot, index;
+
+    if (strcmp(variable->meaning, "variable") != 0)
+        return NULL;
+
+    variables = get_variables(term, &variablec);
+
+    program = compile_term(term, variablec, variables);
+    for (int i = 0;i < variablec;i++)
+        free_term(variables[i]);
+    free(variables);
+
+    if (program == NULL)
+        return NULL;
+
+    for (slot = 0;slot < program->variablec;slot++)
+        if (is_equal(program->variables[slot], variable))
+            break;
+
+    index = differentiate_instruction(program, program->results[0], slot);
+    result = index >= 0 ? decompile_instruction(program, index) : NULL;
+    free_program(program);
+
+    if (result == NULL)
+        return NULL;
+
+    return simplify(result);
+}
@@ -0,0 +1,7 @@
+#ifndef DIFFERENTIATE_TERM_H_
+#define DIFFERENTIATE_TERM_H_
+
+int differentiate_instruction(Program *program, int index, int slot);
+Term *differentiate(Term *term, Term *variable);
+
+#endif // DIFFERENTIATE_TERM_H_
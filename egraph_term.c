@@ -0,0 +1,1136 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "term.h"
+#include "builder_term.h"
+#include "traverse_term.h"
+#include "compare_term.h"
+#include "compile_term.h"
+#include "egraph_term.h"
+
+// flops of a division and of a power that is not an integer literal
+#define EGRAPH_DIVISION 4.0
+#define EGRAPH_POWER 20.0
+// matches collected in one round, per node of the limit
+#define EGRAPH_MATCHES 4
+// largest power written as a product with a power one lower, so that it
+// can be distributed
+#define EGRAPH_UNFOLD 8.0
+// nodes matched or matches applied between two looks at the clock
+#define EGRAPH_CLOCK 256
+
+typedef struct Match Match;
+typedef struct Frame Frame;
+
+// right hand side of a rule, built from x, y, z and value. opcode is the
+// operator that matched, inner the one moved across it.
+typedef enum {
+    REWRITE_SAME,               // x
+    REWRITE_LITERAL,            // value
+    REWRITE_SWAP,               // y op x
+    REWRITE_ASSOCIATE_RIGHT,    // x op (y op z)
+    REWRITE_ASSOCIATE_LEFT,     // (x op y) op z
+    REWRITE_DISTRIBUTE,         // x*y + x*z
+    REWRITE_FACTOR,             // x*(y + z)
+    REWRITE_SCALE,              // value*x
+    REWRITE_COMBINE,            // (x + 1)*y
+    REWRITE_POWER,              // x^value
+    REWRITE_INVERTED_POWER,     // 1/x^value
+    REWRITE_UNFOLD,             // x*x^value
+    REWRITE_APPLY,              // inner(x)
+    REWRITE_OUTSIDE,            // inner(x op y) or inner(op(x))
+    REWRITE_INSIDE,             // inner(x) op y or op(inner(x))
+    REWRITE_SPREAD              // inner(x) op inner(y)
+} Rewrite;
+
+// the class of a matched node and what it is equal to
+struct Match {
+    Rewrite rewrite;
+    Opcode opcode;
+    Opcode inner;
+    int class;
+    int x, y, z;
+    double value;
+};
+
+// an operator of an extracted term whose arguments are still being built,
+// sums and products take the arguments of nested ones as their own
+struct Frame {
+    int next;
+    int operandc;
+    int *operands;
+    TermBuilder builder;
+};
+
+static double
+seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static void
+push_index(int **indices, int *count, int *capacity, int index)
+{
+    if (*count >= *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 4;
+        *indices = (int *) realloc(*indices, sizeof(int) * *capacity);
+    }
+    (*indices)[(*count)++] = index;
+    return;
+}
+
+static char *
+leaf_name(Term *leaf)
+{
+    if (strcmp(leaf->meaning, "variable") == 0)
+        return ((Variable *) leaf->content)->name;
+    if (strcmp(leaf->meaning, "constant") == 0)
+        return ((Constant *) leaf->content)->name;
+    if (strcmp(leaf->meaning, "operator") == 0)
+        return ((Operator *) leaf->content)->name;
+    return leaf->meaning;
+}
+
+static unsigned long long
+hash_node(ENode *node)
+{
+    unsigned long long hash = 14695981039346656037ULL, bits;
+
+    hash = (hash ^ (unsigned long long) node->opcode) * 1099511628211ULL;
+    for (int i = 0;i < node->argc;i++)
+        hash = (hash ^ (unsigned long long) node->argv[i]) * 1099511628211ULL;
+    if (node->opcode == OPCODE_LITERAL) {
+        memcpy(&bits, &node->value, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ULL;
+    }
+    if (node->leaf != NULL)
+        for (const char *c = leaf_name(node->leaf);*c != '\0';c++)
+            hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+static bool
+is_same_node(ENode *lhs, ENode *rhs)
+{
+    if (lhs->opcode != rhs->opcode || lhs->argc != rhs->argc)
+        return false;
+    for (int i = 0;i < lhs->argc;i++)
+        if (lhs->argv[i] != rhs->argv[i])
+            return false;
+    if (lhs->opcode == OPCODE_LITERAL)
+        return memcmp(&lhs->value, &rhs->value, sizeof(double)) == 0;
+    if (lhs->leaf != NULL || rhs->leaf != NULL)
+        return lhs->leaf != NULL && rhs->leaf != NULL && is_equal(lhs->leaf, rhs->leaf);
+
+    return true;
+}
+
+static int
+lookup_node(EGraph *egraph, ENode *node)
+{
+    int bucket = (int) (hash_node(node) & (unsigned long long) (egraph->bucketc - 1));
+
+    for (int i = egraph->buckets[bucket];i != -1;i = egraph->nodes[i].next)
+        if (is_same_node(&egraph->nodes[i], node))
+            return i;
+
+    return -1;
+}
+
+static void
+insert_node(EGraph *egraph, int index)
+{
+    ENode *node = &egraph->nodes[index];
+    int bucket = (int) (hash_node(node) & (unsigned long long) (egraph->bucketc - 1));
+
+    node->next = egraph->buckets[bucket];
+    egraph->buckets[bucket] = index;
+    egraph->tablec++;
+    return;
+}
+
+// before the arguments of the node change, the node is found under its old
+// ones
+static void
+remove_node(EGraph *egraph, int index)
+{
+    ENode *node = &egraph->nodes[index];
+    int bucket = (int) (hash_node(node) & (unsigned long long) (egraph->bucketc - 1));
+    int *link = &egraph->buckets[bucket];
+
+    while (*link != -1 && *link != index)
+        link = &egraph->nodes[*link].next;
+    if (*link == -1)
+        return;
+
+    *link = node->next;
+    egraph->tablec--;
+    return;
+}
+
+// every live node is in the table whenever a node is added
+static void
+grow_table(EGraph *egraph)
+{
+    egraph->bucketc *= 2;
+    egraph->buckets = (int *) realloc(egraph->buckets, sizeof(int) * egraph->bucketc);
+    for (int i = 0;i < egraph->bucketc;i++)
+        egraph->buckets[i] = -1;
+
+    egraph->tablec = 0;
+    for (int i = 0;i < egraph->nodec;i++)
+        if (egraph->nodes[i].is_live)
+            insert_node(egraph, i);
+    return;
+}
+
+EGraph *
+egraph(void)
+{
+    EGraph *egraph = (EGraph *) malloc(sizeof(EGraph));
+
+    egraph->nodec = 0;
+    egraph->node_capacity = 64;
+    egraph->nodes = (ENode *) malloc(sizeof(ENode) * egraph->node_capacity);
+
+    egraph->classc = 0;
+    egraph->class_capacity = 64;
+    egraph->classes = (EClass *) malloc(sizeof(EClass) * egraph->class_capacity);
+
+    egraph->tablec = 0;
+    egraph->bucketc = 256;
+    egraph->buckets = (int *) malloc(sizeof(int) * egraph->bucketc);
+    for (int i = 0;i < egraph->bucketc;i++)
+        egraph->buckets[i] = -1;
+
+    egraph->pendingc = 0;
+    egraph->pending_capacity = 0;
+    egraph->pending = NULL;
+
+    egraph->mergec = 0;
+
+    return egraph;
+}
+
+void
+free_egraph(EGraph *egraph)
+{
+    for (int i = 0;i < egraph->nodec;i++)
+        if (egraph->nodes[i].leaf != NULL)
+            free_term(egraph->nodes[i].leaf);
+    for (int i = 0;i < egraph->classc;i++) {
+        free(egraph->classes[i].nodes);
+        free(egraph->classes[i].parents);
+    }
+
+    free(egraph->nodes);
+    free(egraph->classes);
+    free(egraph->buckets);
+    free(egraph->pending);
+    free(egraph);
+    return;
+}
+
+// path halving, every other class on the way points to its grandparent
+int
+find_class(EGraph *egraph, int class)
+{
+    EClass *classes = egraph->classes;
+
+    while (classes[class].parent != class) {
+        classes[class].parent = classes[classes[class].parent].parent;
+        class = classes[class].parent;
+    }
+
+    return class;
+}
+
+static int
+new_class(EGraph *egraph)
+{
+    EClass *temp_class;
+
+    if (egraph->classc >= egraph->class_capacity) {
+        egraph->class_capacity *= 2;
+        egraph->classes = (EClass *) realloc(egraph->classes, sizeof(EClass) * egraph->class_capacity);
+    }
+
+    temp_class = &egraph->classes[egraph->classc];
+    temp_class->parent = egraph->classc;
+    temp_class->literal = -1;
+    temp_class->nodec = 0;
+    temp_class->node_capacity = 0;
+    temp_class->nodes = NULL;
+    temp_class->parentc = 0;
+    temp_class->parent_capacity = 0;
+    temp_class->parents = NULL;
+
+    return egraph->classc++;
+}
+
+// class of the node, added with a class of its own unless a congruent one
+// exists. A leaf is copied only when it is added.
+static int
+add_node(EGraph *egraph, ENode *node)
+{
+    ENode *temp_node;
+    int found, index, class;
+
+    for (int i = 0;i < node->argc;i++)
+        node->argv[i] = find_class(egraph, node->argv[i]);
+
+    found = lookup_node(egraph, node);
+    if (found >= 0)
+        return find_class(egraph, egraph->nodes[found].class);
+
+    if (2 * (egraph->tablec + 1) > egraph->bucketc)
+        grow_table(egraph);
+    if (egraph->nodec >= egraph->node_capacity) {
+        egraph->node_capacity *= 2;
+        egraph->nodes = (ENode *) realloc(egraph->nodes, sizeof(ENode) * egraph->node_capacity);
+    }
+
+    index = egraph->nodec++;
+    class = new_class(egraph);
+    temp_node = &egraph->nodes[index];
+    *temp_node = *node;
+    temp_node->is_live = true;
+    temp_node->leaf = node->leaf != NULL ? copy_term(node->leaf) : NULL;
+    temp_node->class = class;
+
+    push_index(&egraph->classes[class].nodes, &egraph->classes[class].nodec,
+            &egraph->classes[class].node_capacity, index);
+    if (node->opcode == OPCODE_LITERAL)
+        egraph->classes[class].literal = index;
+    for (int i = 0;i < node->argc;i++) {
+        EClass *argument = &egraph->classes[node->argv[i]];
+
+        push_index(&argument->parents, &argument->parentc, &argument->parent_capacity, index);
+    }
+    insert_node(egraph, index);
+
+    return class;
+}
+
+static int
+add_literal(EGraph *egraph, double value)
+{
+    ENode temp_node = {OPCODE_LITERAL, true, 0, {-1, -1}, value == 0.0 ? 0.0 : value, NULL, -1, -1};
+
+    return add_node(egraph, &temp_node);
+}
+
+static int
+add_unary(EGraph *egraph, Opcode opcode, int argument)
+{
+    ENode temp_node = {opcode, true, 1, {argument, -1}, 0.0, NULL, -1, -1};
+
+    return add_node(egraph, &temp_node);
+}
+
+static int
+add_binary(EGraph *egraph, Opcode opcode, int lhs, int rhs)
+{
+    ENode temp_node = {opcode, true, 2, {lhs, rhs}, 0.0, NULL, -1, -1};
+
+    return add_node(egraph, &temp_node);
+}
+
+static int
+add_leaf(EGraph *egraph, Term *term)
+{
+    ENode temp_node = {OPCODE_VARIABLE, true, 0, {-1, -1}, 0.0, term, -1, -1};
+
+    if (strcmp(term->meaning, "literal") == 0)
+        return add_literal(egraph, ((Literal *) term->content)->value);
+    if (strcmp(term->meaning, "constant") == 0)
+        temp_node.opcode = OPCODE_CONSTANT;
+
+    return add_node(egraph, &temp_node);
+}
+
+// operators the rules know, with the number of arguments they need
+static bool
+get_opcode(Term *term, Opcode *opcode)
+{
+    Operator *temp_operator;
+
+    if (strcmp(term->meaning, "operator") != 0)
+        return false;
+
+    temp_operator = term->content;
+    if (strcmp(temp_operator->name, "+") == 0 && temp_operator->argc > 0)
+        *opcode = OPCODE_ADD;
+    else if (strcmp(temp_operator->name, "*") == 0 && temp_operator->argc > 0)
+        *opcode = OPCODE_MULTIPLY;
+    else if (strcmp(temp_operator->name, "additive_inverse") == 0 && temp_operator->argc == 1)
+        *opcode = OPCODE_ADDITIVE_INVERSE;
+    else if (strcmp(temp_operator->name, "multiple_inverse") == 0 && temp_operator->argc == 1)
+        *opcode = OPCODE_MULTIPLE_INVERSE;
+    else if (strcmp(temp_operator->name, "imaginary") == 0 && temp_operator->argc == 1)
+        *opcode = OPCODE_IMAGINARY;
+    else if (strcmp(temp_operator->name, "^") == 0 && temp_operator->argc == 2)
+        *opcode = OPCODE_POWER;
+    else
+        return false;
+
+    return true;
+}
+
+// post order, the classes of finished arguments wait on a stack of their
+// own. Sums and products of more than two arguments nest to the left.
+int
+insert_term(EGraph *egraph, Term *term)
+{
+    Traversal temp_traversal;
+    int *classes = NULL, classc = 0, capacity = 0, result;
+    Opcode opcode;
+
+    if (!get_opcode(term, &opcode))
+        return add_leaf(egraph, term);
+
+    begin_traversal(&temp_traversal);
+    push_visit(&temp_traversal, term, NULL);
+    while (temp_traversal.depth > 0) {
+        Visit *visit = top_visit(&temp_traversal);
+        Term *child;
+
+        if (visit->child >= visit->childc) {
+            int *arguments = &classes[classc - visit->childc];
+
+            get_opcode(visit->term, &opcode);
+            if (visit->childc == 1 && opcode != OPCODE_ADD && opcode != OPCODE_MULTIPLY) {
+                result = add_unary(egraph, opcode, arguments[0]);
+            } else {
+                result = arguments[0];
+                for (int i = 1;i < visit->childc;i++)
+                    result = add_binary(egraph, opcode, result, arguments[i]);
+            }
+
+            classc -= visit->childc;
+            push_index(&classes, &classc, &capacity, result);
+            pop_visit(&temp_traversal);
+            continue;
+        }
+
+        child = visit->childv[visit->child++];
+        if (get_opcode(child, &opcode))
+            push_visit(&temp_traversal, child, NULL);
+        else
+            push_index(&classes, &classc, &capacity, add_leaf(egraph, child));
+    }
+    end_traversal(&temp_traversal);
+
+    result = classes[0];
+    free(classes);
+
+    return result;
+}
+
+// the smaller class goes into the larger one, its parents wait in pending
+// for rebuild_egraph
+int
+merge_classes(EGraph *egraph, int lhs, int rhs)
+{
+    EClass *root, *child;
+
+    lhs = find_class(egraph, lhs);
+    rhs = find_class(egraph, rhs);
+    if (lhs == rhs)
+        return lhs;
+
+    if (egraph->classes[lhs].nodec + egraph->classes[lhs].parentc
+            < egraph->classes[rhs].nodec + egraph->classes[rhs].parentc) {
+        int temp = lhs;
+
+        lhs = rhs;
+        rhs = temp;
+    }
+    root = &egraph->classes[lhs];
+    child = &egraph->classes[rhs];
+
+    child->parent = lhs;
+    for (int i = 0;i < child->nodec;i++)
+        push_index(&root->nodes, &root->nodec, &root->node_capacity, child->nodes[i]);
+    for (int i = 0;i < child->parentc;i++)
+        push_index(&root->parents, &root->parentc, &root->parent_capacity, child->parents[i]);
+    if (root->literal < 0)
+        root->literal = child->literal;
+
+    free(child->nodes);
+    free(child->parents);
+    child->nodes = NULL;
+    child->parents = NULL;
+    child->nodec = child->node_capacity = 0;
+    child->parentc = child->parent_capacity = 0;
+
+    push_index(&egraph->pending, &egraph->pendingc, &egraph->pending_capacity, lhs);
+    egraph->mergec++;
+
+    return lhs;
+}
+
+// every parent of class is hashed again under the current classes of its
+// arguments. A parent that became congruent to another node merges their
+// classes and is no longer live, those merges are repaired in turn.
+static void
+repair_class(EGraph *egraph, int class, int *stamps, int stamp)
+{
+    int *parents = egraph->classes[class].parents, parentc = egraph->classes[class].parentc;
+    EClass *root;
+
+    egraph->classes[class].parents = NULL;
+    egraph->classes[class].parentc = 0;
+    egraph->classes[class].parent_capacity = 0;
+
+    for (int i = 0;i < parentc;i++) {
+        ENode *node = &egraph->nodes[parents[i]];
+        int found;
+
+        if (!node->is_live)
+            continue;
+
+        remove_node(egraph, parents[i]);
+        for (int j = 0;j < node->argc;j++)
+            node->argv[j] = find_class(egraph, node->argv[j]);
+
+        found = lookup_node(egraph, node);
+        if (found >= 0) {
+            node->is_live = false;
+            merge_classes(egraph, node->class, egraph->nodes[found].class);
+        } else {
+            insert_node(egraph, parents[i]);
+        }
+    }
+
+    root = &egraph->classes[find_class(egraph, class)];
+    for (int i = 0;i < parentc;i++) {
+        if (!egraph->nodes[parents[i]].is_live || stamps[parents[i]] == stamp)
+            continue;
+
+        stamps[parents[i]] = stamp;
+        push_index(&root->parents, &root->parentc, &root->parent_capacity, parents[i]);
+    }
+
+    free(parents);
+    return;
+}
+
+static int
+compare_indices(const void *lhs, const void *rhs)
+{
+    int a = *(const int *) lhs, b = *(const int *) rhs;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// only the classes merged since the last rebuild are repaired, until their
+// repairs merge nothing more
+void
+rebuild_egraph(EGraph *egraph)
+{
+    int *stamps, stamp = 0;
+
+    if (egraph->pendingc == 0)
+        return;
+
+    stamps = (int *) calloc(egraph->nodec + 1, sizeof(int));
+    while (egraph->pendingc > 0) {
+        int *pending = egraph->pending, pendingc = egraph->pendingc;
+
+        egraph->pending = NULL;
+        egraph->pendingc = 0;
+        egraph->pending_capacity = 0;
+
+        for (int i = 0;i < pendingc;i++)
+            pending[i] = find_class(egraph, pending[i]);
+        qsort(pending, pendingc, sizeof(int), compare_indices);
+        for (int i = 0;i < pendingc;i++)
+            if (i == 0 || pending[i] != pending[i - 1])
+                repair_class(egraph, pending[i], stamps, ++stamp);
+
+        free(pending);
+    }
+
+    free(stamps);
+    return;
+}
+
+bool
+get_class_literal(EGraph *egraph, int class, double *value)
+{
+    int literal = egraph->classes[find_class(egraph, class)].literal;
+
+    if (literal < 0)
+        return false;
+
+    *value = egraph->nodes[literal].value;
+    return true;
+}
+
+static bool
+is_class_literal(EGraph *egraph, int class, double value)
+{
+    double temp_value;
+
+    return get_class_literal(egraph, class, &temp_value) && temp_value == value;
+}
+
+static bool
+is_integer(double value)
+{
+    return value == floor(value) && fabs(value) <= 1e9;
+}
+
+static void
+push_match(Match **matches, int *matchc, int *capacity, Match match)
+{
+    if (*matchc >= *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 64;
+        *matches = (Match *) realloc(*matches, sizeof(Match) * *capacity);
+    }
+    (*matches)[(*matchc)++] = match;
+    return;
+}
+
+#define MATCH(rewrite_, opcode_, inner_, x_, y_, z_, value_) \
+    push_match(matches, matchc, capacity, \
+            (Match) {rewrite_, opcode_, inner_, class, x_, y_, z_, value_})
+
+// live nodes of class a with the given opcode
+#define EACH_NODE(m, a, opcode_) \
+    for (int i_##m = 0;i_##m < egraph->classes[a].nodec;i_##m++) \
+        if ((m = &egraph->nodes[egraph->classes[a].nodes[i_##m]])->is_live \
+                && m->opcode == (opcode_))
+
+static void
+match_add(EGraph *egraph, int class, int a, int b, Match **matches, int *matchc, int *capacity)
+{
+    ENode *m, *k;
+    double lhs, rhs;
+
+    MATCH(REWRITE_SWAP, OPCODE_ADD, OPCODE_ADD, a, b, -1, 0.0);
+    EACH_NODE(m, a, OPCODE_ADD)
+        MATCH(REWRITE_ASSOCIATE_RIGHT, OPCODE_ADD, OPCODE_ADD, m->argv[0], m->argv[1], b, 0.0);
+    EACH_NODE(m, b, OPCODE_ADD)
+        MATCH(REWRITE_ASSOCIATE_LEFT, OPCODE_ADD, OPCODE_ADD, a, m->argv[0], m->argv[1], 0.0);
+
+    if (is_class_literal(egraph, b, 0.0))
+        MATCH(REWRITE_SAME, OPCODE_ADD, OPCODE_ADD, a, -1, -1, 0.0);
+    if (get_class_literal(egraph, a, &lhs) && get_class_literal(egraph, b, &rhs))
+        MATCH(REWRITE_LITERAL, OPCODE_ADD, OPCODE_ADD, -1, -1, -1, lhs + rhs);
+    if (a == b)
+        MATCH(REWRITE_SCALE, OPCODE_ADD, OPCODE_ADD, a, -1, -1, 2.0);
+
+    EACH_NODE(m, b, OPCODE_ADDITIVE_INVERSE)
+        if (find_class(egraph, m->argv[0]) == a)
+            MATCH(REWRITE_LITERAL, OPCODE_ADD, OPCODE_ADD, -1, -1, -1, 0.0);
+    EACH_NODE(m, a, OPCODE_MULTIPLY) {
+        if (find_class(egraph, m->argv[1]) == b)
+            MATCH(REWRITE_COMBINE, OPCODE_ADD, OPCODE_ADD, m->argv[0], b, -1, 0.0);
+        EACH_NODE(k, b, OPCODE_MULTIPLY)
+            if (find_class(egraph, m->argv[0]) == find_class(egraph, k->argv[0]))
+                MATCH(REWRITE_FACTOR, OPCODE_ADD, OPCODE_ADD, m->argv[0], m->argv[1], k->argv[1], 0.0);
+    }
+    EACH_NODE(m, a, OPCODE_ADDITIVE_INVERSE)
+        EACH_NODE(k, b, OPCODE_ADDITIVE_INVERSE)
+            MATCH(REWRITE_OUTSIDE, OPCODE_ADD, OPCODE_ADDITIVE_INVERSE, m->argv[0], k->argv[0], -1, 0.0);
+    EACH_NODE(m, a, OPCODE_IMAGINARY)
+        EACH_NODE(k, b, OPCODE_IMAGINARY)
+            MATCH(REWRITE_OUTSIDE, OPCODE_ADD, OPCODE_IMAGINARY, m->argv[0], k->argv[0], -1, 0.0);
+    return;
+}
+
+static void
+match_multiply(EGraph *egraph, int class, int a, int b, Match **matches, int *matchc, int *capacity)
+{
+    ENode *m, *k;
+    double lhs, rhs;
+
+    MATCH(REWRITE_SWAP, OPCODE_MULTIPLY, OPCODE_MULTIPLY, a, b, -1, 0.0);
+    EACH_NODE(m, a, OPCODE_MULTIPLY)
+        MATCH(REWRITE_ASSOCIATE_RIGHT, OPCODE_MULTIPLY, OPCODE_MULTIPLY, m->argv[0], m->argv[1], b, 0.0);
+    EACH_NODE(m, b, OPCODE_MULTIPLY)
+        MATCH(REWRITE_ASSOCIATE_LEFT, OPCODE_MULTIPLY, OPCODE_MULTIPLY, a, m->argv[0], m->argv[1], 0.0);
+
+    if (is_class_literal(egraph, b, 1.0))
+        MATCH(REWRITE_SAME, OPCODE_MULTIPLY, OPCODE_MULTIPLY, a, -1, -1, 0.0);
+    if (is_class_literal(egraph, b, 0.0))
+        MATCH(REWRITE_LITERAL, OPCODE_MULTIPLY, OPCODE_MULTIPLY, -1, -1, -1, 0.0);
+    if (get_class_literal(egraph, a, &lhs) && get_class_literal(egraph, b, &rhs))
+        MATCH(REWRITE_LITERAL, OPCODE_MULTIPLY, OPCODE_MULTIPLY, -1, -1, -1, lhs * rhs);
+    if (a == b)
+        MATCH(REWRITE_POWER, OPCODE_MULTIPLY, OPCODE_MULTIPLY, a, -1, -1, 2.0);
+
+    EACH_NODE(m, a, OPCODE_POWER) {
+        if (!get_class_literal(egraph, m->argv[1], &lhs) || !is_integer(lhs))
+            continue;
+        if (find_class(egraph, m->argv[0]) == b)
+            MATCH(REWRITE_POWER, OPCODE_MULTIPLY, OPCODE_MULTIPLY, b, -1, -1, lhs + 1.0);
+        EACH_NODE(k, b, OPCODE_POWER)
+            if (find_class(egraph, m->argv[0]) == find_class(egraph, k->argv[0])
+                    && get_class_literal(egraph, k->argv[1], &rhs) && is_integer(rhs))
+                MATCH(REWRITE_POWER, OPCODE_MULTIPLY, OPCODE_MULTIPLY, m->argv[0], -1, -1, lhs + rhs);
+    }
+    EACH_NODE(m, b, OPCODE_ADD)
+        MATCH(REWRITE_DISTRIBUTE, OPCODE_MULTIPLY, OPCODE_MULTIPLY, a, m->argv[0], m->argv[1], 0.0);
+    EACH_NODE(m, b, OPCODE_MULTIPLE_INVERSE)
+        if (find_class(egraph, m->argv[0]) == a)
+            MATCH(REWRITE_LITERAL, OPCODE_MULTIPLY, OPCODE_MULTIPLY, -1, -1, -1, 1.0);
+    EACH_NODE(m, a, OPCODE_ADDITIVE_INVERSE)
+        MATCH(REWRITE_OUTSIDE, OPCODE_MULTIPLY, OPCODE_ADDITIVE_INVERSE, m->argv[0], b, -1, 0.0);
+    EACH_NODE(m, a, OPCODE_IMAGINARY)
+        MATCH(REWRITE_OUTSIDE, OPCODE_MULTIPLY, OPCODE_IMAGINARY, m->argv[0], b, -1, 0.0);
+    EACH_NODE(m, a, OPCODE_MULTIPLE_INVERSE)
+        EACH_NODE(k, b, OPCODE_MULTIPLE_INVERSE)
+            MATCH(REWRITE_OUTSIDE, OPCODE_MULTIPLY, OPCODE_MULTIPLE_INVERSE, m->argv[0], k->argv[0], -1, 0.0);
+    return;
+}
+
+// 1/value only where it is exact, 1/3 stays a fraction
+static void
+match_unary(EGraph *egraph, int class, Opcode opcode, int a, Match **matches, int *matchc, int *capacity)
+{
+    ENode *m;
+    double value;
+    int exponent;
+
+    switch (opcode) {
+    case OPCODE_ADDITIVE_INVERSE:
+        if (get_class_literal(egraph, a, &value))
+            MATCH(REWRITE_LITERAL, opcode, opcode, -1, -1, -1, -value);
+        EACH_NODE(m, a, OPCODE_ADDITIVE_INVERSE)
+            MATCH(REWRITE_SAME, opcode, opcode, m->argv[0], -1, -1, 0.0);
+        EACH_NODE(m, a, OPCODE_ADD)
+            MATCH(REWRITE_SPREAD, OPCODE_ADD, opcode, m->argv[0], m->argv[1], -1, 0.0);
+        EACH_NODE(m, a, OPCODE_MULTIPLY)
+            MATCH(REWRITE_INSIDE, OPCODE_MULTIPLY, opcode, m->argv[0], m->argv[1], -1, 0.0);
+        EACH_NODE(m, a, OPCODE_IMAGINARY)
+            MATCH(REWRITE_INSIDE, OPCODE_IMAGINARY, opcode, m->argv[0], -1, -1, 0.0);
+        break;
+    case OPCODE_MULTIPLE_INVERSE:
+        if (get_class_literal(egraph, a, &value) && value != 0.0 && isfinite(value)
+                && frexp(fabs(value), &exponent) == 0.5)
+            MATCH(REWRITE_LITERAL, opcode, opcode, -1, -1, -1, 1.0 / value);
+        EACH_NODE(m, a, OPCODE_MULTIPLE_INVERSE)
+            MATCH(REWRITE_SAME, opcode, opcode, m->argv[0], -1, -1, 0.0);
+        EACH_NODE(m, a, OPCODE_MULTIPLY)
+            MATCH(REWRITE_SPREAD, OPCODE_MULTIPLY, opcode, m->argv[0], m->argv[1], -1, 0.0);
+        EACH_NODE(m, a, OPCODE_ADDITIVE_INVERSE)
+            MATCH(REWRITE_OUTSIDE, opcode, OPCODE_ADDITIVE_INVERSE, m->argv[0], -1, -1, 0.0);
+        break;
+    case OPCODE_IMAGINARY:
+        EACH_NODE(m, a, OPCODE_IMAGINARY)
+            MATCH(REWRITE_APPLY, opcode, OPCODE_ADDITIVE_INVERSE, m->argv[0], -1, -1, 0.0);
+        EACH_NODE(m, a, OPCODE_ADDITIVE_INVERSE)
+            MATCH(REWRITE_OUTSIDE, opcode, OPCODE_ADDITIVE_INVERSE, m->argv[0], -1, -1, 0.0);
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+static void
+match_power(EGraph *egraph, int class, int a, int b, Match **matches, int *matchc, int *capacity)
+{
+    double base, exponent;
+
+    if (!get_class_literal(egraph, b, &exponent))
+        return;
+
+    if (exponent == 1.0)
+        MATCH(REWRITE_SAME, OPCODE_POWER, OPCODE_POWER, a, -1, -1, 0.0);
+    if (exponent == 0.0)
+        MATCH(REWRITE_LITERAL, OPCODE_POWER, OPCODE_POWER, -1, -1, -1, 1.0);
+    if (exponent >= 2.0 && exponent <= EGRAPH_UNFOLD && is_integer(exponent))
+        MATCH(REWRITE_UNFOLD, OPCODE_POWER, OPCODE_POWER, a, -1, -1, exponent - 1.0);
+    if (exponent < 0.0 && is_integer(exponent))
+        MATCH(REWRITE_INVERTED_POWER, OPCODE_POWER, OPCODE_POWER, a, -1, -1, -exponent);
+    if (get_class_literal(egraph, a, &base) && is_integer(exponent) && exponent > 0.0
+            && isfinite(pow(base, exponent)))
+        MATCH(REWRITE_LITERAL, OPCODE_POWER, OPCODE_POWER, -1, -1, -1, pow(base, exponent));
+    return;
+}
+
+// a class with a literal has its cheapest form already, rewriting it
+// further would only grow 1 into 1*1, 1^2, 1^3 and so on
+static void
+match_node(EGraph *egraph, int index, Match **matches, int *matchc, int *capacity)
+{
+    ENode node = egraph->nodes[index];
+    int class = find_class(egraph, node.class);
+    int a = node.argc > 0 ? find_class(egraph, node.argv[0]) : -1;
+    int b = node.argc > 1 ? find_class(egraph, node.argv[1]) : -1;
+
+    if (egraph->classes[class].literal >= 0)
+        return;
+
+    switch (node.opcode) {
+    case OPCODE_ADD:
+        match_add(egraph, class, a, b, matches, matchc, capacity);
+        break;
+    case OPCODE_MULTIPLY:
+        match_multiply(egraph, class, a, b, matches, matchc, capacity);
+        break;
+    case OPCODE_ADDITIVE_INVERSE:
+    case OPCODE_MULTIPLE_INVERSE:
+    case OPCODE_IMAGINARY:
+        match_unary(egraph, class, node.opcode, a, matches, matchc, capacity);
+        break;
+    case OPCODE_POWER:
+        match_power(egraph, class, a, b, matches, matchc, capacity);
+        break;
+    default:
+        break;
+    }
+    return;
+}
+
+static int
+add_operator(EGraph *egraph, Opcode opcode, int x, int y)
+{
+    return y < 0 ? add_unary(egraph, opcode, x) : add_binary(egraph, opcode, x, y);
+}
+
+static void
+apply_match(EGraph *egraph, Match *match)
+{
+    Opcode opcode = match->opcode, inner = match->inner;
+    int x = match->x, y = match->y, z = match->z, class;
+
+    switch (match->rewrite) {
+    case REWRITE_SAME:
+        class = x;
+        break;
+    case REWRITE_LITERAL:
+        class = add_literal(egraph, match->value);
+        break;
+    case REWRITE_SWAP:
+        class = add_binary(egraph, opcode, y, x);
+        break;
+    case REWRITE_ASSOCIATE_RIGHT:
+        class = add_binary(egraph, opcode, x, add_binary(egraph, opcode, y, z));
+        break;
+    case REWRITE_ASSOCIATE_LEFT:
+        class = add_binary(egraph, opcode, add_binary(egraph, opcode, x, y), z);
+        break;
+    case REWRITE_DISTRIBUTE:
+        class = add_binary(egraph, OPCODE_ADD, add_binary(egraph, OPCODE_MULTIPLY, x, y),
+                add_binary(egraph, OPCODE_MULTIPLY, x, z));
+        break;
+    case REWRITE_FACTOR:
+        class = add_binary(egraph, OPCODE_MULTIPLY, x, add_binary(egraph, OPCODE_ADD, y, z));
+        break;
+    case REWRITE_SCALE:
+        class = add_binary(egraph, OPCODE_MULTIPLY, add_literal(egraph, match->value), x);
+        break;
+    case REWRITE_COMBINE:
+        class = add_binary(egraph, OPCODE_MULTIPLY,
+                add_binary(egraph, OPCODE_ADD, x, add_literal(egraph, 1.0)), y);
+        break;
+    case REWRITE_POWER:
+        class = add_binary(egraph, OPCODE_POWER, x, add_literal(egraph, match->value));
+        break;
+    case REWRITE_INVERTED_POWER:
+        class = add_unary(egraph, OPCODE_MULTIPLE_INVERSE,
+                add_binary(egraph, OPCODE_POWER, x, add_literal(egraph, match->value)));
+        break;
+    case REWRITE_UNFOLD:
+        class = add_binary(egraph, OPCODE_MULTIPLY, x,
+                add_binary(egraph, OPCODE_POWER, x, add_literal(egraph, match->value)));
+        break;
+    case REWRITE_APPLY:
+        class = add_unary(egraph, inner, x);
+        break;
+    case REWRITE_OUTSIDE:
+        class = add_unary(egraph, inner, add_operator(egraph, opcode, x, y));
+        break;
+    case REWRITE_INSIDE:
+        class = add_operator(egraph, opcode, add_unary(egraph, inner, x), y);
+        break;
+    case REWRITE_SPREAD:
+        class = add_binary(egraph, opcode, add_unary(egraph, inner, x), add_unary(egraph, inner, y));
+        break;
+    default:
+        return;
+    }
+
+    merge_classes(egraph, match->class, class);
+    return;
+}
+
+// rounds of matching every live node against every rule and then adding
+// all right hand sides, so a round sees the graph as the last one left it
+void
+saturate_egraph(EGraph *egraph, int node_limit, double time_limit, Saturation *saturation)
+{
+    double begin = seconds();
+    Match *matches = NULL;
+    int capacity = 0;
+
+    saturation->is_saturated = false;
+    saturation->iterations = 0;
+    rebuild_egraph(egraph);
+
+    while (saturation->iterations < EGRAPH_ITERATIONS && egraph->nodec < node_limit
+            && seconds() - begin < time_limit) {
+        int nodec = egraph->nodec, matchc = 0;
+        long mergec = egraph->mergec;
+
+        for (int i = 0;i < nodec && matchc < EGRAPH_MATCHES * node_limit;i++) {
+            if (i % EGRAPH_CLOCK == 0 && seconds() - begin >= time_limit)
+                break;
+            if (egraph->nodes[i].is_live)
+                match_node(egraph, i, &matches, &matchc, &capacity);
+        }
+        for (int i = 0;i < matchc && egraph->nodec < node_limit;i++) {
+            if (i % EGRAPH_CLOCK == 0 && seconds() - begin >= time_limit)
+                break;
+            apply_match(egraph, &matches[i]);
+        }
+        rebuild_egraph(egraph);
+
+        saturation->iterations++;
+        if (egraph->nodec == nodec && egraph->mergec == mergec) {
+            saturation->is_saturated = true;
+            break;
+        }
+    }
+
+    saturation->nodec = egraph->nodec;
+    saturation->classc = 0;
+    for (int i = 0;i < egraph->classc;i++)
+        if (egraph->classes[i].parent == i)
+            saturation->classc++;
+    saturation->time = seconds() - begin;
+
+    free(matches);
+    return;
+}
+
+double
+count_node(EGraph *egraph, ENode *node, double *costs)
+{
+    double cost = 1.0;
+
+    (void) egraph;
+    for (int i = 0;i < node->argc;i++)
+        cost += costs[i];
+    return cost;
+}
+
+// additions and multiplications of an evaluation, an integer power by
+// squaring. A thousandth per node prefers the smaller of two forms that
+// take as many flops.
+double
+count_flops(EGraph *egraph, ENode *node, double *costs)
+{
+    double flops = 0.0, exponent;
+
+    switch (node->opcode) {
+    case OPCODE_ADD:
+    case OPCODE_MULTIPLY:
+    case OPCODE_ADDITIVE_INVERSE:
+    case OPCODE_IMAGINARY:
+        flops = 1.0;
+        break;
+    case OPCODE_MULTIPLE_INVERSE:
+        flops = EGRAPH_DIVISION;
+        break;
+    case OPCODE_POWER:
+        if (!get_class_literal(egraph, node->argv[1], &exponent) || !is_integer(exponent)) {
+            flops = EGRAPH_POWER;
+            break;
+        }
+        if (exponent < 0.0)
+            flops += EGRAPH_DIVISION;
+        for (long count = labs((long) exponent);count > 1;count >>= 1)
+            flops += (count & 1) ? 2.0 : 1.0;
+        break;
+    default:
+        break;
+    }
+
+    flops += 0.001;
+    for (int i = 0;i < node->argc;i++)
+        flops += costs[i];
+    return flops;
+}
+
+static Term *
+leaf_term(ENode *node)
+{
+    if (node->opcode == OPCODE_LITERAL)
+        return literal(node->value);
+    return copy_term(node->leaf);
+}
+
+static char *
+opcode_name(Opcode opcode)
+{
+    switch (opcode) {
+    case OPCODE_IMAGINARY:
+        return "imaginary";
+    case OPCODE_ADD:
+        return "+";
+    case OPCODE_ADDITIVE_INVERSE:
+        return "additive_inverse";
+    case OPCODE_MULTIPLY:
+        return "*";
+    case OPCODE_MULTIPLE_INVERSE:
+        return "multiple_inverse";
+    default:
+        return "^";
+    }
+}
+
+// the arguments of node, for a sum or product also those of the sums or
+// products chosen for its arguments, left to right
+static void
+begin_frame(EGraph *egraph, Frame *frame, int *best, int node)
+{
+    ENode *temp_node = &egraph->nodes[node];
+    int *stack = NULL, stackc = 0, stack_capacity = 0, capacity = 0;
+
+    frame->next = 0;
+    frame->operandc = 0;
+    frame->operands = NULL;
+    begin_operator(&frame->builder, opcode_name(temp_node->opcode), temp_node->argc);
+
+    if (temp_node->opcode != OPCODE_ADD && temp_node->opcode != OPCODE_MULTIPLY) {
+        for (int i = 0;i < temp_node->argc;i++)
+            push_index(&frame->operands, &frame->operandc, &capacity,
+                    find_class(egraph, temp_node->argv[i]));
+        return;
+    }
+
+    push_index(&stack, &stackc, &stack_capacity, find_class(egraph, temp_node->argv[1]));
+    push_index(&stack, &stackc, &stack_capacity, find_class(egraph, temp_node->argv[0]));
+    while (stackc > 0) {
+        int class = stack[--stackc];
+        ENode *chosen = &egraph->nodes[best[class]];
+
+        if (chosen->opcode != temp_node->opcode) {
+            push_index(&frame->operands, &frame->operandc, &capacity, class);
+            continue;
+        }
+        push_index(&stack, &stackc, &stack_capacity, find_class(egraph, chosen->argv[1]));
+        push_index(&stack, &stackc, &stack_capacity, find_class(egraph, chosen->argv[0]));
+    }
+
+    free(stack);
+    return;
+}
+
+// the cheapest cost of every class is relaxed over all live nodes until it
+// no longer drops, then the chosen nodes are built without recursion
+Term *
+extract_term(EGraph *egraph, int class, NodeCost cost)
+{
+    double *costs = (double *) malloc(sizeof(double) * (egraph->classc + 1));
+    int *best = (int *) malloc(sizeof(int) * (egraph->classc + 1));
+    Frame *frames = NULL;
+    int framec = 0, frame_capacity = 0;
+    bool is_changed = true;
+    Term *result = NULL;
+
+    rebuild_egraph(egraph);
+    for (int i = 0;i < egraph->classc;i++) {
+        costs[i] = INFINITY;
+        best[i] = -1;
+    }
+
+    while (is_changed) {
+        is_changed = false;
+        for (int i = 0;i < egraph->nodec;i++) {
+            ENode *node = &egraph->nodes[i];
+            int node_class = find_class(egraph, node->class);
+            double argument_costs[2], temp_cost;
+            int j;
+
+            if (!node->is_live)
+                continue;
+            for (j = 0;j < node->argc;j++) {
+                argument_costs[j] = costs[find_class(egraph, node->argv[j])];
+                if (isinf(argument_costs[j]))
+                    break;
+            }
+            if (j < node->argc)
+                continue;
+
+            temp_cost = cost(egraph, node, argument_costs);
+            if (temp_cost < costs[node_class]) {
+                costs[node_class] = temp_cost;
+                best[node_class] = i;
+                is_changed = true;
+            }
+        }
+    }
+
+    class = find_class(egraph, class);
+    if (best[class] < 0 || egraph->nodes[best[class]].argc == 0) {
+        if (best[class] >= 0)
+            result = leaf_term(&egraph->nodes[best[class]]);
+        free(costs);
+        free(best);
+        return result;
+    }
+
+    frame_capacity = 16;
+    frames = (Frame *) malloc(sizeof(Frame) * frame_capacity);
+    begin_frame(egraph, &frames[framec++], best, best[class]);
+    while (framec > 0) {
+        Frame *frame = &frames[framec - 1];
+        ENode *chosen;
+
+        if (frame->next >= frame->operandc) {
+            Term *term = finish_operator(&frame->builder);
+
+            free(frame->operands);
+            framec--;
+            if (framec == 0)
+                result = term;
+            else
+                push_argument(&frames[framec - 1].builder, term);
+            continue;
+        }
+
+        chosen = &egraph->nodes[best[frame->operands[frame->next++]]];
+        if (chosen->argc == 0) {
+            push_argument(&frame->builder, leaf_term(chosen));
+            continue;
+        }
+
+        if (framec >= frame_capacity) {
+            frame_capacity *= 2;
+            frames = (Frame *) realloc(frames, sizeof(Frame) * frame_capacity);
+        }
+        begin_frame(egraph, &frames[framec++], best, (int) (chosen - egraph->nodes));
+    }
+
+    free(frames);
+    free(costs);
+    free(best);
+    return result;
+}
+
+Term *
+cheapest_form(Term *term, NodeCost cost)
+{
+    EGraph *temp_egraph = egraph();
+    Saturation saturation;
+    int class = insert_term(temp_egraph, term);
+    Term *result;
+
+    saturate_egraph(temp_egraph, EGRAPH_NODES, EGRAPH_SECONDS, &saturation);
+    result = extract_term(temp_egraph, class, cost);
+    free_egraph(temp_egraph);
+
+    return result;
+}
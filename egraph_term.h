@@ -0,0 +1,104 @@
+#ifndef EGRAPH_TERM_H_
+#define EGRAPH_TERM_H_
+
+// limits of cheapest_form
+#define EGRAPH_NODES 20000
+#define EGRAPH_SECONDS 0.05
+// rounds of matching and rewriting of saturate_egraph
+#define EGRAPH_ITERATIONS 30
+
+typedef struct ENode ENode;
+typedef struct EClass EClass;
+typedef struct EGraph EGraph;
+typedef struct Saturation Saturation;
+
+// an operator with the opcode of a compiled program, sums and products
+// have two arguments. Literals keep their value, all other terms are
+// leaves with a copy of the term: constants, variables and operators
+// without rules, like D, as OPCODE_VARIABLE.
+struct ENode {
+    Opcode opcode;
+    bool is_live;   // false once a congruent node took its place
+    int argc;
+    int argv[2];    // classes of the arguments
+    double value;
+    Term *leaf;
+
+    int class;      // class the node was added to, see find_class
+    int next;       // chain of the hash table
+};
+
+// equal terms. nodes and parents may hold nodes that are no longer live,
+// parents are the nodes with this class as an argument.
+struct EClass {
+    int parent;
+    int literal;    // a literal node of the class, -1 without
+
+    int nodec;
+    int node_capacity;
+    int *nodes;
+
+    int parentc;
+    int parent_capacity;
+    int *parents;
+};
+
+// every node is unique up to the classes of its arguments, found through a
+// hash table. Merges leave the table stale until rebuild_egraph restores it
+// for the classes in pending.
+struct EGraph {
+    int nodec;
+    int node_capacity;
+    ENode *nodes;
+
+    int classc;
+    int class_capacity;
+    EClass *classes;
+
+    int tablec;
+    int bucketc;
+    int *buckets;
+
+    int pendingc;
+    int pending_capacity;
+    int *pending;
+
+    long mergec;
+};
+
+struct Saturation {
+    bool is_saturated;
+    int iterations;
+    int nodec;
+    int classc;
+    double time;
+};
+
+// cost of node given the cheapest cost of the class of every argument. It
+// has to be larger than each of those, extraction relies on it to never
+// pick a cycle.
+typedef double (*NodeCost)(EGraph *egraph, ENode *node, double *costs);
+
+EGraph *egraph(void);
+void free_egraph(EGraph *egraph);
+
+// class of term, term is copied where needed
+int insert_term(EGraph *egraph, Term *term);
+int find_class(EGraph *egraph, int class);
+int merge_classes(EGraph *egraph, int lhs, int rhs);
+void rebuild_egraph(EGraph *egraph);
+bool get_class_literal(EGraph *egraph, int class, double *value);
+
+// rewrites with commutativity, associativity, distributivity, the inverse
+// rules and literal folding until nothing changes or a limit is reached
+void saturate_egraph(EGraph *egraph, int node_limit, double time_limit, Saturation *saturation);
+
+double count_node(EGraph *egraph, ENode *node, double *costs);
+double count_flops(EGraph *egraph, ENode *node, double *costs);
+Term *extract_term(EGraph *egraph, int class, NodeCost cost);
+
+// the cheapest term equal to term the limits above find, term is not
+// changed
+Term *cheapest_form(Term *term, NodeCost cost);
+
+#endif // EGRAPH_TERM_H_
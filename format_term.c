@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include "term.h"
+#include "format_term.h"
+
+typedef struct Syntax Syntax;
+typedef struct Frame Frame;
+
+// text around the arguments of one operator. separators, if given, has
+// one entry per gap and order, if given, the argument printed at each
+// position.
+struct Syntax {
+    const char *open;
+    const char *separator;
+    const char *close;
+    const char *const *separators;
+    const int *order;
+};
+
+// operator whose arguments are still being printed
+struct Frame {
+    const Syntax *syntax;
+    int argc;
+    Term **argv;
+    int child;
+};
+
+typedef struct Rule Rule;
+
+struct Rule {
+    const char *name;
+    Syntax syntax[3];
+};
+
+static const int reversed_order[] = {1, 0};
+static const int limits_order[] = {3, 2, 0, 1};
+static const char *const limits_separators[] = {"}^{", "} ", " \\, d"};
+
+// infix is the form the parser reads back, one entry per Format
+static const Rule rules[] = {
+    {"imaginary", {{"i*", "", "", NULL, NULL},
+            {"i \\cdot ", "", "", NULL, NULL},
+            {"(i ", " ", ")", NULL, NULL}}},
+    {"+", {{"(", " + ", ")", NULL, NULL},
+            {"\\left(", " + ", "\\right)", NULL, NULL},
+            {"(+ ", " ", ")", NULL, NULL}}},
+    {"additive_inverse", {{"(-", "", ")", NULL, NULL},
+            {"\\left(-", "", "\\right)", NULL, NULL},
+            {"(neg ", " ", ")", NULL, NULL}}},
+    {"*", {{"(", " * ", ")", NULL, NULL},
+            {"\\left(", " \\cdot ", "\\right)", NULL, NULL},
+            {"(* ", " ", ")", NULL, NULL}}},
+    {"multiple_inverse", {{"(1.0/", "", ")", NULL, NULL},
+            {"\\frac{1}{", "", "}", NULL, NULL},
+            {"(inv ", " ", ")", NULL, NULL}}},
+    {"^", {{"(", ")^(", ")", NULL, NULL},
+            {"{", "}^{", "}", NULL, NULL},
+            {"(^ ", " ", ")", NULL, NULL}}},
+    {"D", {{"D[", ", ", "]", NULL, NULL},
+            {"\\frac{\\partial}{\\partial ", "}\\left(", "\\right)", NULL, reversed_order},
+            {"(D ", " ", ")", NULL, NULL}}},
+    {"I", {{"I[", ", ", "]", NULL, NULL},
+            {"\\int ", " \\, d", "", NULL, NULL},
+            {"(I ", " ", ")", NULL, NULL}}},
+    {"=", {{"", " = ", "", NULL, NULL},
+            {"", " = ", "", NULL, NULL},
+            {"(= ", " ", ")", NULL, NULL}}}
+};
+
+static const Syntax definite_integral_latex = {"\\int_{", "", "", limits_separators, limits_order};
+
+// written after the name of an indexed variable or an unknown operator
+static const Syntax index_syntax[3] = {
+    {"_{", ", ", "}", NULL, NULL},
+    {"_{", ", ", "}", NULL, NULL},
+    {" ", " ", ")", NULL, NULL}
+};
+static const Syntax call_syntax[3] = {
+    {"[", ", ", "]", NULL, NULL},
+    {"\\left(", ", ", "\\right)", NULL, NULL},
+    {" ", " ", ")", NULL, NULL}
+};
+
+static Output *
+output(FILE *file, int fd)
+{
+    Output *temp_output = (Output *) malloc(sizeof(Output));
+
+    temp_output->capacity = 256;
+    temp_output->length = 0;
+    temp_output->data = (char *) malloc(temp_output->capacity);
+    temp_output->file = file;
+    temp_output->fd = fd;
+    temp_output->is_failed = false;
+
+    return temp_output;
+}
+
+Output *
+output_buffer(void)
+{
+    return output(NULL, -1);
+}
+
+Output *
+output_file(FILE *file)
+{
+    return output(file, -1);
+}
+
+Output *
+output_fd(int fd)
+{
+    return output(NULL, fd);
+}
+
+// writes the buffer to the file or fd, a plain buffer is left alone
+bool
+flush_output(Output *temp_output)
+{
+    size_t written = 0;
+
+    if (temp_output->file == NULL && temp_output->fd < 0)
+        return !temp_output->is_failed;
+
+    if (temp_output->file != NULL) {
+        if (fwrite(temp_output->data, 1, temp_output->length, temp_output->file) != temp_output->length)
+            temp_output->is_failed = true;
+        temp_output->length = 0;
+        return !temp_output->is_failed;
+    }
+
+    while (written < temp_output->length) {
+        ssize_t count = write(temp_output->fd, &temp_output->data[written], temp_output->length - written);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            temp_output->is_failed = true;
+            break;
+        }
+        written += count;
+    }
+    temp_output->length = 0;
+
+    return !temp_output->is_failed;
+}
+
+void
+free_output(Output *temp_output)
+{
+    flush_output(temp_output);
+    free(temp_output->data);
+    free(temp_output);
+    return;
+}
+
+void
+write_string(Output *temp_output, const char *string, size_t length)
+{
+    bool is_sink = temp_output->file != NULL || temp_output->fd >= 0;
+
+    if (is_sink && temp_output->length + length > OUTPUT_BUFFER)
+        flush_output(temp_output);
+
+    if (temp_output->length + length > temp_output->capacity) {
+        while (temp_output->length + length > temp_output->capacity)
+            temp_output->capacity *= 2;
+        temp_output->data = (char *) realloc(temp_output->data, temp_output->capacity);
+    }
+
+    memcpy(&temp_output->data[temp_output->length], string, length);
+    temp_output->length += length;
+    return;
+}
+
+static void
+write_text(Output *temp_output, const char *string)
+{
+    write_string(temp_output, string, strlen(string));
+    return;
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+static void
+write_integer(Output *temp_output, long long integer)
+{
+    unsigned long long digits = integer < 0 ? -(unsigned long long) integer : (unsigned long long) integer;
+    char buffer[24];
+    int position = sizeof(buffer);
+
+    do {
+        buffer[--position] = '0' + digits % 10;
+        digits /= 10;
+    } while (digits != 0);
+    if (integer < 0)
+        buffer[--position] = '-';
+
+    write_string(temp_output, &buffer[position], sizeof(buffer) - position);
+    return;
+}
+
+// %.6g without snprintf for 1e-4 <= |value| < 1e6, where it prints six
+// significant digits in fixed notation. Returns false if the sixth digit
+// is too close to a tie to be rounded the way printf would.
+static bool
+write_fixed(Output *temp_output, double value)
+{
+    double magnitude = fabs(value), scaled, fraction;
+    long digits;
+    int exponent = -4, position = 0, point;
+    char buffer[24];
+
+    if (!(magnitude >= 1e-4 && magnitude < 1e6))
+        return false;
+    while (exponent < 5 && magnitude >= (exponent + 1 >= 0 ? powers_of_ten[exponent + 1] : 1.0 / powers_of_ten[-exponent - 1]))
+        exponent++;
+
+    scaled = magnitude * powers_of_ten[5 - exponent];
+    fraction = scaled - floor(scaled);
+    if (fabs(fraction - 0.5) < 1e-7)
+        return false;
+
+    digits = (long) floor(scaled) + (fraction > 0.5);
+    if (digits == 1000000) {
+        digits = 100000;
+        exponent++;
+        if (exponent == 6)
+            return false;
+    }
+
+    if (value < 0.0)
+        buffer[position++] = '-';
+    if (exponent < 0) {
+        buffer[position++] = '0';
+        buffer[position++] = '.';
+        for (int i = -1;i > exponent;i--)
+            buffer[position++] = '0';
+        point = -1;
+    } else {
+        point = exponent;
+    }
+
+    for (int i = 0;i < 6;i++) {
+        buffer[position++] = '0' + (int) (digits / (long) powers_of_ten[5 - i]) % 10;
+        if (i == point)
+            buffer[position++] = '.';
+    }
+
+    // trailing zeros of the fraction and a bare point are dropped
+    if (point < 5) {
+        while (buffer[position - 1] == '0')
+            position--;
+        if (buffer[position - 1] == '.')
+            position--;
+    } else {
+        position--;
+    }
+
+    write_string(temp_output, buffer, position);
+    return true;
+}
+
+// %.6g for infix and LaTeX, which is what print_term always printed, and
+// %.17g for S-expressions so that they keep every bit
+static void
+write_literal(Output *temp_output, double value, Format format)
+{
+    char buffer[40];
+    char *exponent;
+    int length;
+
+    if (value == floor(value) && fabs(value) < (format == FORMAT_SEXPR ? 1e17 : 1e6)
+            && (value != 0.0 || !signbit(value))) {
+        write_integer(temp_output, (long long) value);
+        return;
+    }
+    if (format != FORMAT_SEXPR && write_fixed(temp_output, value))
+        return;
+
+    length = snprintf(buffer, sizeof(buffer), format == FORMAT_SEXPR ? "%.17g" : "%.6g", value);
+
+    exponent = format == FORMAT_LATEX ? strchr(buffer, 'e') : NULL;
+    if (exponent == NULL) {
+        write_string(temp_output, buffer, length);
+        return;
+    }
+
+    // 1.5e+10 as 1.5 \cdot 10^{10}
+    write_string(temp_output, buffer, exponent - buffer);
+    write_text(temp_output, " \\cdot 10^{");
+    write_integer(temp_output, atoi(&exponent[1]));
+    write_text(temp_output, "}");
+    return;
+}
+
+// LaTeX wraps names longer than one letter in \mathrm and escapes them
+static void
+write_name(Output *temp_output, const char *name, Format format)
+{
+    if (format != FORMAT_LATEX || (name[0] != '\0' && name[1] == '\0' && name[0] != '#')) {
+        write_text(temp_output, name);
+        return;
+    }
+
+    write_text(temp_output, "\\mathrm{");
+    for (const char *c = name;*c != '\0';c++) {
+        if (strchr("_#%&${}", *c) != NULL)
+            write_string(temp_output, "\\", 1);
+        write_string(temp_output, c, 1);
+    }
+    write_text(temp_output, "}");
+    return;
+}
+
+// prints a leaf and returns false, or prints the opening text of an
+// operator or indexed variable and fills frame
+static bool
+enter(Output *temp_output, Frame *frame, Term *term, Format format)
+{
+    Operator *temp_operator;
+
+    if (strcmp(term->meaning, "literal") == 0) {
+        write_literal(temp_output, ((Literal *) term->content)->value, format);
+        return false;
+    }
+    if (strcmp(term->meaning, "constant") == 0) {
+        write_name(temp_output, ((Constant *) term->content)->name, format);
+        return false;
+    }
+    if (strcmp(term->meaning, "variable") == 0) {
+        Variable *temp_variable = term->content;
+
+        if (temp_variable->indec == 0) {
+            write_name(temp_output, temp_variable->name, format);
+            return false;
+        }
+
+        if (format == FORMAT_SEXPR)
+            write_text(temp_output, "(_ ");
+        write_name(temp_output, temp_variable->name, format);
+
+        frame->syntax = &index_syntax[format];
+        frame->argc = temp_variable->indec;
+        frame->argv = temp_variable->index;
+        frame->child = 0;
+        write_text(temp_output, frame->syntax->open);
+        return true;
+    }
+    if (strcmp(term->meaning, "operator") != 0)
+        return false;
+
+    temp_operator = term->content;
+    frame->syntax = NULL;
+    frame->argc = temp_operator->argc;
+    frame->argv = temp_operator->argv;
+    frame->child = 0;
+
+    for (int i = 0;i < (int) (sizeof(rules) / sizeof(rules[0]));i++) {
+        if (temp_operator->name[0] != rules[i].name[0] || strcmp(temp_operator->name, rules[i].name) != 0)
+            continue;
+        if (rules[i].syntax[format].order == reversed_order && temp_operator->argc != 2)
+            break;
+        frame->syntax = &rules[i].syntax[format];
+        break;
+    }
+
+    if (frame->syntax == NULL) {
+        if (format == FORMAT_SEXPR)
+            write_text(temp_output, "(");
+        else if (format == FORMAT_LATEX)
+            write_text(temp_output, "\\operatorname{");
+        write_name(temp_output, temp_operator->name, format == FORMAT_LATEX ? FORMAT_INFIX : format);
+        if (format == FORMAT_LATEX)
+            write_text(temp_output, "}");
+        frame->syntax = &call_syntax[format];
+    } else if (format == FORMAT_LATEX && temp_operator->argc == 4 && strcmp(temp_operator->name, "I") == 0) {
+        frame->syntax = &definite_integral_latex;
+    }
+
+    write_text(temp_output, frame->syntax->open);
+    return true;
+}
+
+// iterative over an explicit stack, so the depth of term is not limited
+// by the C stack
+void
+write_term(Output *temp_output, Term *term, Format format)
+{
+    int capacity = 64, depth = 0;
+    Frame *stack = (Frame *) malloc(sizeof(Frame) * capacity);
+
+    if (enter(temp_output, &stack[0], term, format))
+        depth = 1;
+
+    while (depth > 0) {
+        Frame *frame = &stack[depth - 1];
+        const Syntax *syntax = frame->syntax;
+        Term *child;
+
+        if (frame->child == frame->argc) {
+            write_text(temp_output, syntax->close);
+            depth--;
+            continue;
+        }
+
+        if (frame->child > 0)
+            write_text(temp_output, syntax->separators != NULL
+                    ? syntax->separators[frame->child - 1] : syntax->separator);
+
+        child = frame->argv[syntax->order != NULL ? syntax->order[frame->child] : frame->child];
+        frame->child++;
+
+        if (depth == capacity) {
+            capacity *= 2;
+            stack = (Frame *) realloc(stack, sizeof(Frame) * capacity);
+        }
+        if (enter(temp_output, &stack[depth], child, format))
+            depth++;
+    }
+
+    free(stack);
+    return;
+}
+
+// NUL terminated text of term, the caller frees it
+char *
+format_term(Term *term, Format format)
+{
+    Output *temp_output = output_buffer();
+    char *text;
+
+    write_term(temp_output, term, format);
+    write_string(temp_output, "", 1);
+
+    text = temp_output->data;
+    free(temp_output);
+
+    return text;
+}
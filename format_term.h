@@ -0,0 +1,36 @@
+#ifndef FORMAT_TERM_H_
+#define FORMAT_TERM_H_
+
+// bytes collected before a file or descriptor output is written
+#define OUTPUT_BUFFER 65536
+
+typedef struct Output Output;
+
+typedef enum {
+    FORMAT_INFIX,
+    FORMAT_LATEX,
+    FORMAT_SEXPR
+} Format;
+
+// growable buffer, flushed to file or fd if one of them is set
+struct Output {
+    char *data;
+    size_t length;
+    size_t capacity;
+
+    FILE *file;
+    int fd;
+    bool is_failed;
+};
+
+Output *output_buffer(void);
+Output *output_file(FILE *file);
+Output *output_fd(int fd);
+bool flush_output(Output *output);
+void free_output(Output *output);
+
+void write_string(Output *output, const char *string, size_t length);
+void write_term(Output *output, Term *term, Format format);
+char *format_term(Term *term, Format format);
+
+#endif // FORMAT_TERM_H_
@@ -0,0 +1,532 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "term.h"
+#include "compile_term.h"
+#include "format_term.h"
+#include "generate_term.h"
+
+// integer exponents up to this size are written out as products
+#define GENERATE_POWER 4
+
+typedef struct Generator Generator;
+
+struct Generator {
+    Output *output;
+    Program *program;
+    bool is_array;
+
+    // an inverse whose every use is a sum or product becomes a subtraction
+    // or division there instead of a temporary of its own
+    bool *is_fused;
+    // independent of the variables, hoisted in front of the loop
+    bool *is_invariant;
+};
+
+static void
+write_text(Output *output, const char *text)
+{
+    write_string(output, text, strlen(text));
+    return;
+}
+
+static void
+write_integer(Output *output, const char *prefix, long value, const char *suffix)
+{
+    char buffer[64];
+    int length = snprintf(buffer, sizeof(buffer), "%s%ld%s", prefix, value, suffix);
+
+    write_string(output, buffer, (size_t) length);
+    return;
+}
+
+// shortest text that reads back as the same double, always a floating
+// constant so that integer division can not sneak in
+static void
+write_number(Output *output, double value)
+{
+    char buffer[64];
+    int length = 0;
+
+    if (isnan(value)) {
+        write_text(output, "NAN");
+        return;
+    }
+    if (isinf(value)) {
+        write_text(output, value > 0.0 ? "INFINITY" : "(-INFINITY)");
+        return;
+    }
+
+    for (int precision = 15;precision <= 17;precision++) {
+        length = snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (strtod(buffer, NULL) == value)
+            break;
+    }
+    if (strpbrk(buffer, ".e") == NULL) {
+        memcpy(&buffer[length], ".0", 3);
+        length += 2;
+    }
+
+    if (value < 0.0 || (value == 0.0 && signbit(value))) {
+        write_text(output, "(");
+        write_string(output, buffer, (size_t) length);
+        write_text(output, ")");
+    } else {
+        write_string(output, buffer, (size_t) length);
+    }
+    return;
+}
+
+static bool
+is_inline(Instruction *instruction)
+{
+    return instruction->opcode == OPCODE_LITERAL || instruction->opcode == OPCODE_CONSTANT ||
+        instruction->opcode == OPCODE_VARIABLE;
+}
+
+static void
+write_operand(Generator *generator, int index)
+{
+    Instruction *instruction = &generator->program->instructions[index];
+
+    switch (instruction->opcode) {
+    case OPCODE_LITERAL:
+        write_number(generator->output, instruction->value);
+        break;
+    case OPCODE_CONSTANT:
+        write_integer(generator->output, "c", instruction->index, "");
+        break;
+    case OPCODE_VARIABLE:
+        if (generator->is_array)
+            write_integer(generator->output, "x", instruction->index, "[k]");
+        else
+            write_integer(generator->output, "values[", instruction->index, "]");
+        break;
+    default:
+        write_integer(generator->output, "t", index, "");
+        break;
+    }
+    return;
+}
+
+// argument of a fused inverse, -1 for any other operand
+static int
+fused_argument(Generator *generator, int index)
+{
+    Program *program = generator->program;
+
+    if (!generator->is_fused[index])
+        return -1;
+    return program->operands[program->instructions[index].first];
+}
+
+static void
+write_power(Generator *generator, int *operands)
+{
+    Program *program = generator->program;
+    Instruction *exponent = &program->instructions[operands[1]];
+    double value = exponent->value;
+    int n;
+
+    if (exponent->opcode != OPCODE_LITERAL || value != floor(value) || fabs(value) > GENERATE_POWER) {
+        write_text(generator->output, "pow(");
+        write_operand(generator, operands[0]);
+        write_text(generator->output, ", ");
+        write_operand(generator, operands[1]);
+        write_text(generator->output, ")");
+        return;
+    }
+
+    n = (int) fabs(value);
+    if (n == 0) {
+        write_text(generator->output, "1.0");
+        return;
+    }
+
+    if (value < 0.0)
+        write_text(generator->output, n > 1 ? "1.0 / (" : "1.0 / ");
+    for (int i = 0;i < n;i++) {
+        if (i > 0)
+            write_text(generator->output, " * ");
+        write_operand(generator, operands[0]);
+    }
+    if (value < 0.0 && n > 1)
+        write_text(generator->output, ")");
+    return;
+}
+
+static void
+write_expression(Generator *generator, int index)
+{
+    Program *program = generator->program;
+    Instruction *instruction = &program->instructions[index];
+    int *operands = &program->operands[instruction->first];
+    int numerators = 0, denominators = 0, argument;
+
+    switch (instruction->opcode) {
+    case OPCODE_IMAGINARY:
+        // not real valued, same as the interpreter
+        write_text(generator->output, "NAN");
+        break;
+    case OPCODE_ADD:
+        for (int i = 0;i < instruction->argc;i++) {
+            argument = fused_argument(generator, operands[i]);
+            if (argument >= 0) {
+                write_text(generator->output, i == 0 ? "-" : " - ");
+                write_operand(generator, argument);
+            } else {
+                if (i > 0)
+                    write_text(generator->output, " + ");
+                write_operand(generator, operands[i]);
+            }
+        }
+        break;
+    case OPCODE_ADDITIVE_INVERSE:
+        write_text(generator->output, "-");
+        write_operand(generator, operands[0]);
+        break;
+    case OPCODE_MULTIPLY:
+        // one division for all fused reciprocals of the product
+        for (int i = 0;i < instruction->argc;i++) {
+            if (fused_argument(generator, operands[i]) >= 0) {
+                denominators++;
+                continue;
+            }
+            if (numerators > 0)
+                write_text(generator->output, " * ");
+            write_operand(generator, operands[i]);
+            numerators++;
+        }
+        if (numerators == 0)
+            write_text(generator->output, "1.0");
+        if (denominators == 0)
+            break;
+
+        write_text(generator->output, denominators > 1 ? " / (" : " / ");
+        for (int i = 0, j = 0;i < instruction->argc;i++) {
+            argument = fused_argument(generator, operands[i]);
+            if (argument < 0)
+                continue;
+            if (j++ > 0)
+                write_text(generator->output, " * ");
+            write_operand(generator, argument);
+        }
+        if (denominators > 1)
+            write_text(generator->output, ")");
+        break;
+    case OPCODE_MULTIPLE_INVERSE:
+        write_text(generator->output, "1.0 / ");
+        write_operand(generator, operands[0]);
+        break;
+    case OPCODE_POWER:
+        write_power(generator, operands);
+        break;
+    default:
+        write_text(generator->output, "NAN");
+        break;
+    }
+    return;
+}
+
+static void
+write_temporaries(Generator *generator, bool is_invariant, const char *indent)
+{
+    Program *program = generator->program;
+
+    for (int i = 0;i < program->length;i++) {
+        if (is_inline(&program->instructions[i]) || generator->is_fused[i])
+            continue;
+        if (generator->is_array && generator->is_invariant[i] != is_invariant)
+            continue;
+
+        write_text(generator->output, indent);
+        write_integer(generator->output, "const double t", i, " = ");
+        write_expression(generator, i);
+        write_text(generator->output, ";\n");
+    }
+    return;
+}
+
+static void
+analyze(Generator *generator)
+{
+    Program *program = generator->program;
+    bool *is_blocked = (bool *) calloc(program->length + 1, sizeof(bool));
+
+    for (int i = 0;i < program->resultc;i++)
+        is_blocked[program->results[i]] = true;
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+
+        generator->is_invariant[i] = instruction->opcode != OPCODE_VARIABLE;
+        for (int j = 0;j < instruction->argc;j++) {
+            Opcode opcode = program->instructions[operands[j]].opcode;
+
+            if (!generator->is_invariant[operands[j]])
+                generator->is_invariant[i] = false;
+            if (opcode == OPCODE_MULTIPLE_INVERSE && instruction->opcode != OPCODE_MULTIPLY)
+                is_blocked[operands[j]] = true;
+            if (opcode == OPCODE_ADDITIVE_INVERSE && instruction->opcode != OPCODE_ADD)
+                is_blocked[operands[j]] = true;
+        }
+    }
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int argument = program->operands[instruction->first];
+
+        generator->is_fused[i] = false;
+        if (is_blocked[i])
+            continue;
+        if (instruction->opcode == OPCODE_ADDITIVE_INVERSE)
+            generator->is_fused[i] = true;
+        // the reciprocal of a loop invariant is computed once up front and
+        // multiplied, every other one is divided by where it is used
+        if (instruction->opcode == OPCODE_MULTIPLE_INVERSE)
+            generator->is_fused[i] = !generator->is_array || !generator->is_invariant[argument];
+    }
+
+    free(is_blocked);
+    return;
+}
+
+static void
+write_constants(Generator *generator)
+{
+    Program *program = generator->program;
+
+    for (int i = 0;i < program->constantc;i++) {
+        write_integer(generator->output, "    const double c", i, " = ");
+        write_number(generator->output, (program->constants[i]->upper_limit + program->constants[i]->lower_limit) / 2.0);
+        write_text(generator->output, "; // ");
+        write_text(generator->output, program->constants[i]->name);
+        write_text(generator->output, "\n");
+    }
+    return;
+}
+
+static void
+write_scalar(Generator *generator, char *name)
+{
+    Program *program = generator->program;
+    Output *output = generator->output;
+
+    write_text(output, "void\n");
+    write_text(output, name);
+    write_text(output, "(const double *values, double *results)\n{\n");
+
+    write_constants(generator);
+    write_temporaries(generator, false, "    ");
+    for (int i = 0;i < program->resultc;i++) {
+        write_integer(output, "    results[", i, "] = ");
+        write_operand(generator, program->results[i]);
+        write_text(output, ";\n");
+    }
+    write_text(output, "}\n");
+    return;
+}
+
+// the loop lives in a static kernel whose columns are restrict parameters,
+// gcc only trusts restrict there and then vectorizes without a runtime
+// aliasing check
+static void
+write_array(Generator *generator, char *name)
+{
+    Program *program = generator->program;
+    Output *output = generator->output;
+
+    write_text(output, "static void\n");
+    write_text(output, name);
+    write_text(output, "_columns(long count");
+    for (int i = 0;i < program->length;i++)
+        if (program->instructions[i].opcode == OPCODE_VARIABLE)
+            write_integer(output, ", const double *restrict x", program->instructions[i].index, "");
+    for (int i = 0;i < program->resultc;i++)
+        write_integer(output, ", double *restrict r", i, "");
+    write_text(output, ")\n{\n");
+
+    write_constants(generator);
+    write_temporaries(generator, true, "    ");
+    write_text(output, "    for (long k = 0;k < count;k++) {\n");
+    write_temporaries(generator, false, "        ");
+    for (int i = 0;i < program->resultc;i++) {
+        write_integer(output, "        r", i, "[k] = ");
+        write_operand(generator, program->results[i]);
+        write_text(output, ";\n");
+    }
+    write_text(output, "    }\n}\n\n");
+
+    write_text(output, "void\n");
+    write_text(output, name);
+    write_text(output, "(long count, const double *const *values, double *const *results)\n{\n    ");
+    write_text(output, name);
+    write_text(output, "_columns(count");
+    for (int i = 0;i < program->length;i++)
+        if (program->instructions[i].opcode == OPCODE_VARIABLE)
+            write_integer(output, ", values[", program->instructions[i].index, "]");
+    for (int i = 0;i < program->resultc;i++)
+        write_integer(output, ", results[", i, "]");
+    write_text(output, ");\n}\n");
+    return;
+}
+
+void
+write_c_function(Output *output, Program *program, char *name, bool is_array)
+{
+    Generator generator;
+
+    generator.output = output;
+    generator.program = program;
+    generator.is_array = is_array;
+    generator.is_fused = (bool *) malloc(sizeof(bool) * (program->length + 1));
+    generator.is_invariant = (bool *) malloc(sizeof(bool) * (program->length + 1));
+    analyze(&generator);
+
+    if (is_array)
+        write_array(&generator, name);
+    else
+        write_scalar(&generator, name);
+
+    free(generator.is_fused);
+    free(generator.is_invariant);
+    return;
+}
+
+char *
+generate_c(Program *program, char *name, bool is_array)
+{
+    Output *temp_output = output_buffer();
+    char *text;
+
+    write_text(temp_output, "#include <math.h>\n\n");
+    write_c_function(temp_output, program, name, is_array);
+    write_string(temp_output, "", 1);
+
+    text = temp_output->data;
+    free(temp_output);
+
+    return text;
+}
+
+// relative above magnitude one, absolute below it
+static double
+difference(double value, double expected)
+{
+    if (isnan(value) || isnan(expected))
+        return isnan(value) && isnan(expected) ? 0.0 : INFINITY;
+    if (value == expected)
+        return 0.0;
+
+    return fabs(value - expected) / fmax(fabs(expected), 1.0);
+}
+
+// generated.c: both forms of the program and a main printing the results of
+// every sample, first from the scalar then from the array function
+static bool
+write_check(char *path, Program *program, int samplec, double *samples)
+{
+    FILE *file = fopen(path, "w");
+    Output *temp_output;
+    int variablec = program->variablec, resultc = program->resultc;
+    bool is_written;
+
+    if (file == NULL)
+        return false;
+    temp_output = output_file(file);
+
+    write_text(temp_output, "#include <stdio.h>\n#include <math.h>\n\n");
+    write_c_function(temp_output, program, "generated", false);
+    write_text(temp_output, "\n");
+    write_c_function(temp_output, program, "generated_array", true);
+
+    write_text(temp_output, "\nstatic const double samples[] = {\n");
+    for (int i = 0;i < samplec * variablec;i++) {
+        write_text(temp_output, "    ");
+        write_number(temp_output, samples[i]);
+        write_text(temp_output, ",\n");
+    }
+    write_text(temp_output, "    0.0\n};\n\n");
+
+    write_integer(temp_output, "static double columns[", variablec + 1, "]");
+    write_integer(temp_output, "[", samplec + 1, "];\n");
+    write_integer(temp_output, "static double outputs[", resultc + 1, "]");
+    write_integer(temp_output, "[", samplec + 1, "];\n\n");
+
+    write_text(temp_output, "int\nmain(void)\n{\n");
+    write_integer(temp_output, "    const double *inputs[", variablec + 1, "];\n");
+    write_integer(temp_output, "    double *results[", resultc + 1, "];\n");
+    write_integer(temp_output, "    double scalar[", resultc + 1, "];\n\n");
+    write_integer(temp_output, "    for (int i = 0;i < ", samplec, ";i++) {\n");
+    write_integer(temp_output, "        generated(&samples[i * ", variablec, "], scalar);\n");
+    write_integer(temp_output, "        for (int j = 0;j < ", resultc, ";j++)\n");
+    write_text(temp_output, "            printf(\"%a\\n\", scalar[j]);\n");
+    write_integer(temp_output, "        for (int j = 0;j < ", variablec, ";j++)\n");
+    write_integer(temp_output, "            columns[j][i] = samples[i * ", variablec, " + j];\n");
+    write_text(temp_output, "    }\n");
+    write_integer(temp_output, "    for (int j = 0;j < ", variablec, ";j++)\n");
+    write_text(temp_output, "        inputs[j] = columns[j];\n");
+    write_integer(temp_output, "    for (int j = 0;j < ", resultc, ";j++)\n");
+    write_text(temp_output, "        results[j] = outputs[j];\n");
+    write_integer(temp_output, "    generated_array(", samplec, ", inputs, results);\n");
+    write_integer(temp_output, "    for (int i = 0;i < ", samplec, ";i++)\n");
+    write_integer(temp_output, "        for (int j = 0;j < ", resultc, ";j++)\n");
+    write_text(temp_output, "            printf(\"%a\\n\", outputs[j][i]);\n");
+    write_text(temp_output, "    return 0;\n}\n");
+
+    is_written = flush_output(temp_output) && !temp_output->is_failed;
+    free_output(temp_output);
+    return fclose(file) == 0 && is_written;
+}
+
+double
+check_generated_c(Program *program, int samplec, double *samples)
+{
+    char directory[] = "/tmp/algebra-generate-XXXXXX";
+    char source[64], binary[64], command[256], line[128];
+    char *compiler = getenv("CC") != NULL ? getenv("CC") : "gcc";
+    double *registers, *expected, worst = 0.0;
+    FILE *process;
+    int resultc = program->resultc, count = 0;
+
+    if (mkdtemp(directory) == NULL)
+        return NAN;
+    snprintf(source, sizeof(source), "%s/generated.c", directory);
+    snprintf(binary, sizeof(binary), "%s/generated", directory);
+    snprintf(command, sizeof(command), "%s -O2 -std=c99 -o %s %s -lm 2>/dev/null", compiler, binary, source);
+
+    if (!write_check(source, program, samplec, samples) || system(command) != 0 ||
+            (process = popen(binary, "r")) == NULL) {
+        unlink(source);
+        unlink(binary);
+        rmdir(directory);
+        return NAN;
+    }
+
+    registers = (double *) malloc(sizeof(double) * (program->length + 1));
+    expected = (double *) malloc(sizeof(double) * (samplec * resultc + 1));
+    for (int i = 0;i < samplec;i++)
+        evaluate_program(program, &samples[i * program->variablec], registers, &expected[i * resultc]);
+
+    // scalar results come sample by sample and so do the array results
+    while (fgets(line, sizeof(line), process) != NULL && count < 2 * samplec * resultc) {
+        double value = strtod(line, NULL);
+
+        worst = fmax(worst, difference(value, expected[count % (samplec * resultc)]));
+        count++;
+    }
+
+    if (pclose(process) != 0 || count != 2 * samplec * resultc)
+        worst = NAN;
+
+    free(registers);
+    free(expected);
+    unlink(source);
+    unlink(binary);
+    rmdir(directory);
+
+    return worst;
+}
@@ -0,0 +1,21 @@
+#ifndef GENERATE_TERM_H_
+#define GENERATE_TERM_H_
+
+// C source for the terms of a compiled program. Equal subterms are already
+// shared by the program, so every one of them becomes one temporary.
+//
+//   void name(const double *values, double *results)
+//   void name(long count, const double *const *values, double *const *results)
+//
+// the second form is emitted for is_array, values[i] and results[j] are
+// columns of count entries, everything that does not depend on a variable
+// is computed once in front of the loop.
+void write_c_function(Output *output, Program *program, char *name, bool is_array);
+char *generate_c(Program *program, char *name, bool is_array);
+
+// compiles both forms with the local gcc and evaluates them on samplec rows
+// of samples, variablec values each. Returns the largest relative
+// difference to evaluate_program, NAN if the code could not be built or run.
+double check_generated_c(Program *program, int samplec, double *samples);
+
+#endif // GENERATE_TERM_H_
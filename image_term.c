@@ -0,0 +1,871 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "term.h"
+#include "memory_term.h"
+#include "image_term.h"
+
+static const char image_magic[8] = "ALGTERM";
+
+typedef struct Table Table;
+typedef struct Writer Writer;
+typedef struct NodeKey NodeKey;
+typedef struct ConstantKey ConstantKey;
+typedef struct Frame Frame;
+
+// open addressed ids by hash, the caller compares the candidates
+struct Table {
+    int capacity;
+    int count;
+    uint64_t *hashes;
+    int *ids;
+};
+
+// image under construction, names point into the terms being written
+struct Writer {
+    int nodec;
+    int node_capacity;
+    uint32_t *kinds;
+    uint32_t *indices;
+    uint64_t *payloads;
+    Table nodes;
+
+    int operandc;
+    int operand_capacity;
+    uint32_t *operands;
+
+    int symbolc;
+    int symbol_capacity;
+    const char **names;
+    uint32_t *lengths;
+    uint32_t *offsets;
+    int *opcode_of_symbol;
+    size_t string_size;
+    Table symbols;
+
+    int opcodec;
+    uint32_t *opcodes;
+
+    int constantc;
+    int constant_capacity;
+    uint32_t *constant_symbols;
+    double *upper_limits;
+    double *lower_limits;
+    Table constants;
+};
+
+struct NodeKey {
+    uint32_t kind;
+    uint32_t index;
+    uint64_t bits;
+    int argc;
+    int *arguments;
+};
+
+struct ConstantKey {
+    uint32_t symbol;
+    double upper_limit;
+    double lower_limit;
+};
+
+// term whose arguments are being written
+struct Frame {
+    Term *term;
+    int argc;
+    Term **argv;
+    int child;
+};
+
+static void
+put_u32(unsigned char *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return;
+}
+
+static void
+put_u64(unsigned char *p, uint64_t value)
+{
+    put_u32(p, (uint32_t) value);
+    put_u32(&p[4], (uint32_t) (value >> 32));
+    return;
+}
+
+static uint32_t
+get_u32(const unsigned char *p)
+{
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t
+get_u64(const unsigned char *p)
+{
+    return (uint64_t) get_u32(p) | (uint64_t) get_u32(&p[4]) << 32;
+}
+
+static uint64_t
+bits_of_double(double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double
+double_of_bits(uint64_t bits)
+{
+    double value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint64_t
+mix(uint64_t hash, uint64_t value)
+{
+    hash = (hash ^ value) * 1099511628211ULL;
+    return hash ^ (hash >> 29);
+}
+
+static size_t
+align(size_t offset)
+{
+    return (offset + 7) & ~(size_t) 7;
+}
+
+// section offsets in the order of the TermImage fields, offsets[7] is the
+// total size
+static void
+image_layout(size_t rootc, size_t nodec, size_t operandc, size_t symbolc, size_t opcodec,
+        size_t constantc, size_t string_size, size_t *offsets)
+{
+    offsets[0] = IMAGE_HEADER;
+    offsets[1] = align(offsets[0] + 4 * rootc);
+    offsets[2] = offsets[1] + 16 * nodec;
+    offsets[3] = align(offsets[2] + 4 * operandc);
+    offsets[4] = offsets[3] + 8 * symbolc;
+    offsets[5] = align(offsets[4] + 4 * opcodec);
+    offsets[6] = offsets[5] + 24 * constantc;
+    offsets[7] = align(offsets[6] + string_size);
+    return;
+}
+
+static void
+table(Table *temp_table)
+{
+    temp_table->capacity = 64;
+    temp_table->count = 0;
+    temp_table->hashes = (uint64_t *) malloc(sizeof(uint64_t) * temp_table->capacity);
+    temp_table->ids = (int *) malloc(sizeof(int) * temp_table->capacity);
+    for (int i = 0;i < temp_table->capacity;i++)
+        temp_table->ids[i] = -1;
+    return;
+}
+
+static void
+free_table(Table *temp_table)
+{
+    free(temp_table->hashes);
+    free(temp_table->ids);
+    return;
+}
+
+// id of an entry with hash for which is_same holds, or -1
+static int
+find_id(Table *temp_table, uint64_t hash, bool (*is_same)(Writer *, int, void *), Writer *writer, void *key)
+{
+    int slot = (int) (hash & (temp_table->capacity - 1));
+
+    while (temp_table->ids[slot] != -1) {
+        if (temp_table->hashes[slot] == hash && is_same(writer, temp_table->ids[slot], key))
+            return temp_table->ids[slot];
+        slot = (slot + 1) & (temp_table->capacity - 1);
+    }
+    return -1;
+}
+
+static void
+insert_id(Table *temp_table, uint64_t hash, int id)
+{
+    int slot;
+
+    if (2 * (temp_table->count + 1) > temp_table->capacity) {
+        Table grown;
+
+        grown.capacity = 2 * temp_table->capacity;
+        grown.count = 0;
+        grown.hashes = (uint64_t *) malloc(sizeof(uint64_t) * grown.capacity);
+        grown.ids = (int *) malloc(sizeof(int) * grown.capacity);
+        for (int i = 0;i < grown.capacity;i++)
+            grown.ids[i] = -1;
+
+        for (int i = 0;i < temp_table->capacity;i++)
+            if (temp_table->ids[i] != -1)
+                insert_id(&grown, temp_table->hashes[i], temp_table->ids[i]);
+
+        free_table(temp_table);
+        *temp_table = grown;
+    }
+
+    slot = (int) (hash & (temp_table->capacity - 1));
+    while (temp_table->ids[slot] != -1)
+        slot = (slot + 1) & (temp_table->capacity - 1);
+
+    temp_table->hashes[slot] = hash;
+    temp_table->ids[slot] = id;
+    temp_table->count++;
+    return;
+}
+
+static bool
+is_same_symbol(Writer *writer, int id, void *key)
+{
+    const char *name = key;
+
+    return strcmp(writer->names[id], name) == 0;
+}
+
+static int
+intern_name(Writer *writer, const char *name)
+{
+    size_t length = strlen(name);
+    uint64_t hash = 14695981039346656037ULL;
+    int id;
+
+    for (size_t i = 0;i < length;i++)
+        hash = mix(hash, (unsigned char) name[i]);
+
+    id = find_id(&writer->symbols, hash, is_same_symbol, writer, (void *) name);
+    if (id != -1)
+        return id;
+
+    if (writer->symbolc == writer->symbol_capacity) {
+        writer->symbol_capacity *= 2;
+        writer->names = (const char **) realloc(writer->names, sizeof(char *) * writer->symbol_capacity);
+        writer->lengths = (uint32_t *) realloc(writer->lengths, sizeof(uint32_t) * writer->symbol_capacity);
+        writer->offsets = (uint32_t *) realloc(writer->offsets, sizeof(uint32_t) * writer->symbol_capacity);
+        writer->opcode_of_symbol = (int *) realloc(writer->opcode_of_symbol, sizeof(int) * writer->symbol_capacity);
+    }
+
+    id = writer->symbolc++;
+    writer->names[id] = name;
+    writer->lengths[id] = (uint32_t) length;
+    writer->offsets[id] = (uint32_t) writer->string_size;
+    writer->opcode_of_symbol[id] = -1;
+    writer->string_size += length + 1;
+
+    insert_id(&writer->symbols, hash, id);
+    return id;
+}
+
+static int
+intern_opcode(Writer *writer, const char *name)
+{
+    int symbol = intern_name(writer, name);
+
+    if (writer->opcode_of_symbol[symbol] == -1) {
+        writer->opcodes = (uint32_t *) realloc(writer->opcodes, sizeof(uint32_t) * (writer->opcodec + 1));
+        writer->opcodes[writer->opcodec] = symbol;
+        writer->opcode_of_symbol[symbol] = writer->opcodec++;
+    }
+    return writer->opcode_of_symbol[symbol];
+}
+
+static bool
+is_same_constant(Writer *writer, int id, void *key)
+{
+    ConstantKey *constant_key = key;
+
+    return writer->constant_symbols[id] == constant_key->symbol
+        && bits_of_double(writer->upper_limits[id]) == bits_of_double(constant_key->upper_limit)
+        && bits_of_double(writer->lower_limits[id]) == bits_of_double(constant_key->lower_limit);
+}
+
+static int
+intern_constant(Writer *writer, Constant *temp_constant)
+{
+    ConstantKey key = {0, temp_constant->upper_limit, temp_constant->lower_limit};
+    uint64_t hash;
+    int id;
+
+    key.symbol = intern_name(writer, temp_constant->name);
+    hash = mix(mix(mix(0, key.symbol), bits_of_double(key.upper_limit)), bits_of_double(key.lower_limit));
+
+    id = find_id(&writer->constants, hash, is_same_constant, writer, &key);
+    if (id != -1)
+        return id;
+
+    if (writer->constantc == writer->constant_capacity) {
+        writer->constant_capacity *= 2;
+        writer->constant_symbols = (uint32_t *) realloc(writer->constant_symbols,
+                sizeof(uint32_t) * writer->constant_capacity);
+        writer->upper_limits = (double *) realloc(writer->upper_limits, sizeof(double) * writer->constant_capacity);
+        writer->lower_limits = (double *) realloc(writer->lower_limits, sizeof(double) * writer->constant_capacity);
+    }
+
+    id = writer->constantc++;
+    writer->constant_symbols[id] = key.symbol;
+    writer->upper_limits[id] = key.upper_limit;
+    writer->lower_limits[id] = key.lower_limit;
+
+    insert_id(&writer->constants, hash, id);
+    return id;
+}
+
+static bool
+is_same_node(Writer *writer, int id, void *key)
+{
+    NodeKey *node_key = key;
+    uint32_t first;
+
+    if (writer->kinds[id] != node_key->kind || writer->indices[id] != node_key->index)
+        return false;
+    if (node_key->kind == IMAGE_LITERAL)
+        return writer->payloads[id] == node_key->bits;
+    if ((int) (writer->payloads[id] >> 32) != node_key->argc)
+        return false;
+
+    first = (uint32_t) writer->payloads[id];
+    for (int i = 0;i < node_key->argc;i++)
+        if ((int) writer->operands[first + i] != node_key->arguments[i])
+            return false;
+    return true;
+}
+
+// id of the node, equal nodes are stored once
+static int
+emit_node(Writer *writer, NodeKey *key)
+{
+    uint64_t hash = mix(mix(mix(0, key->kind), key->index), key->bits);
+    int id;
+
+    for (int i = 0;i < key->argc;i++)
+        hash = mix(hash, (uint64_t) key->arguments[i]);
+
+    id = find_id(&writer->nodes, hash, is_same_node, writer, key);
+    if (id != -1)
+        return id;
+
+    if (writer->nodec == writer->node_capacity) {
+        writer->node_capacity *= 2;
+        writer->kinds = (uint32_t *) realloc(writer->kinds, sizeof(uint32_t) * writer->node_capacity);
+        writer->indices = (uint32_t *) realloc(writer->indices, sizeof(uint32_t) * writer->node_capacity);
+        writer->payloads = (uint64_t *) realloc(writer->payloads, sizeof(uint64_t) * writer->node_capacity);
+    }
+    while (writer->operandc + key->argc > writer->operand_capacity) {
+        writer->operand_capacity *= 2;
+        writer->operands = (uint32_t *) realloc(writer->operands, sizeof(uint32_t) * writer->operand_capacity);
+    }
+
+    id = writer->nodec++;
+    writer->kinds[id] = key->kind;
+    writer->indices[id] = key->index;
+
+    if (key->kind == IMAGE_LITERAL) {
+        writer->payloads[id] = key->bits;
+    } else if (key->argc == 0) {
+        writer->payloads[id] = 0;
+    } else {
+        writer->payloads[id] = (uint64_t) writer->operandc | (uint64_t) key->argc << 32;
+        for (int i = 0;i < key->argc;i++)
+            writer->operands[writer->operandc++] = key->arguments[i];
+    }
+
+    insert_id(&writer->nodes, hash, id);
+    return id;
+}
+
+// literals, constants and variables without index have no arguments,
+// operators and indexed variables get a frame
+static bool
+enter(Writer *writer, Term *term, Frame *frame, int *id)
+{
+    NodeKey key = {0, 0, 0, 0, NULL};
+
+    if (strcmp(term->meaning, "literal") == 0) {
+        key.kind = IMAGE_LITERAL;
+        key.bits = bits_of_double(((Literal *) term->content)->value);
+    } else if (strcmp(term->meaning, "constant") == 0) {
+        key.kind = IMAGE_CONSTANT;
+        key.index = intern_constant(writer, term->content);
+    } else if (strcmp(term->meaning, "variable") == 0) {
+        Variable *temp_variable = term->content;
+
+        key.kind = IMAGE_VARIABLE;
+        key.index = intern_name(writer, temp_variable->name);
+        if (temp_variable->indec != 0) {
+            frame->term = term;
+            frame->argc = temp_variable->indec;
+            frame->argv = temp_variable->index;
+            frame->child = 0;
+            return true;
+        }
+    } else {
+        Operator *temp_operator = term->content;
+
+        frame->term = term;
+        frame->argc = temp_operator->argc;
+        frame->argv = temp_operator->argv;
+        frame->child = 0;
+        return true;
+    }
+
+    *id = emit_node(writer, &key);
+    return false;
+}
+
+static int
+write_node(Writer *writer, Term *term)
+{
+    int capacity = 64, depth = 0, resultc = 0, result_capacity = 64, id;
+    Frame *stack = (Frame *) malloc(sizeof(Frame) * capacity);
+    int *results = (int *) malloc(sizeof(int) * result_capacity);
+
+    if (enter(writer, term, &stack[0], &id))
+        depth = 1;
+    else
+        results[resultc++] = id;
+
+    while (depth > 0) {
+        Frame *frame = &stack[depth - 1];
+        Term *child;
+
+        if (frame->child == frame->argc) {
+            NodeKey key = {0, 0, 0, frame->argc, &results[resultc - frame->argc]};
+
+            if (strcmp(frame->term->meaning, "variable") == 0) {
+                key.kind = IMAGE_VARIABLE;
+                key.index = intern_name(writer, ((Variable *) frame->term->content)->name);
+            } else {
+                key.kind = IMAGE_OPERATOR;
+                key.index = intern_opcode(writer, ((Operator *) frame->term->content)->name);
+            }
+
+            id = emit_node(writer, &key);
+            resultc -= frame->argc;
+            results[resultc++] = id;
+            depth--;
+            continue;
+        }
+
+        child = frame->argv[frame->child++];
+        if (depth == capacity) {
+            capacity *= 2;
+            stack = (Frame *) realloc(stack, sizeof(Frame) * capacity);
+        }
+        if (enter(writer, child, &stack[depth], &id)) {
+            depth++;
+            continue;
+        }
+
+        if (resultc == result_capacity) {
+            result_capacity *= 2;
+            results = (int *) realloc(results, sizeof(int) * result_capacity);
+        }
+        results[resultc++] = id;
+    }
+
+    id = results[0];
+    free(stack);
+    free(results);
+
+    return id;
+}
+
+// image of terms in one malloc'ed buffer, subterms equal across all of
+// them are stored once
+unsigned char *
+serialize_terms(int termc, Term **terms, size_t *size)
+{
+    Writer writer;
+    unsigned char *data, *p;
+    int *roots = (int *) malloc(sizeof(int) * (termc > 0 ? termc : 1));
+    size_t offsets[8];
+
+    memset(&writer, 0, sizeof(Writer));
+    writer.node_capacity = writer.operand_capacity = writer.symbol_capacity = writer.constant_capacity = 64;
+    writer.kinds = (uint32_t *) malloc(sizeof(uint32_t) * 64);
+    writer.indices = (uint32_t *) malloc(sizeof(uint32_t) * 64);
+    writer.payloads = (uint64_t *) malloc(sizeof(uint64_t) * 64);
+    writer.operands = (uint32_t *) malloc(sizeof(uint32_t) * 64);
+    writer.names = (const char **) malloc(sizeof(char *) * 64);
+    writer.lengths = (uint32_t *) malloc(sizeof(uint32_t) * 64);
+    writer.offsets = (uint32_t *) malloc(sizeof(uint32_t) * 64);
+    writer.opcode_of_symbol = (int *) malloc(sizeof(int) * 64);
+    writer.constant_symbols = (uint32_t *) malloc(sizeof(uint32_t) * 64);
+    writer.upper_limits = (double *) malloc(sizeof(double) * 64);
+    writer.lower_limits = (double *) malloc(sizeof(double) * 64);
+    table(&writer.nodes);
+    table(&writer.symbols);
+    table(&writer.constants);
+
+    for (int i = 0;i < termc;i++)
+        roots[i] = write_node(&writer, terms[i]);
+
+    image_layout(termc, writer.nodec, writer.operandc, writer.symbolc, writer.opcodec,
+            writer.constantc, writer.string_size, offsets);
+    data = (unsigned char *) calloc(offsets[7], 1);
+
+    memcpy(data, image_magic, sizeof(image_magic));
+    put_u32(&data[8], IMAGE_VERSION);
+    put_u32(&data[12], termc);
+    put_u32(&data[16], writer.nodec);
+    put_u32(&data[20], writer.operandc);
+    put_u32(&data[24], writer.symbolc);
+    put_u32(&data[28], writer.opcodec);
+    put_u32(&data[32], writer.constantc);
+    put_u64(&data[40], writer.string_size);
+    put_u64(&data[48], offsets[7]);
+
+    for (int i = 0;i < termc;i++)
+        put_u32(&data[offsets[0] + 4 * i], roots[i]);
+
+    for (int i = 0;i < writer.nodec;i++) {
+        p = &data[offsets[1] + 16 * i];
+        put_u32(p, writer.kinds[i]);
+        put_u32(&p[4], writer.indices[i]);
+        put_u64(&p[8], writer.payloads[i]);
+    }
+
+    for (int i = 0;i < writer.operandc;i++)
+        put_u32(&data[offsets[2] + 4 * i], writer.operands[i]);
+
+    for (int i = 0;i < writer.symbolc;i++) {
+        put_u32(&data[offsets[3] + 8 * i], writer.offsets[i]);
+        put_u32(&data[offsets[3] + 8 * i + 4], writer.lengths[i]);
+        memcpy(&data[offsets[6] + writer.offsets[i]], writer.names[i], writer.lengths[i]);
+    }
+
+    for (int i = 0;i < writer.opcodec;i++)
+        put_u32(&data[offsets[4] + 4 * i], writer.opcodes[i]);
+
+    for (int i = 0;i < writer.constantc;i++) {
+        p = &data[offsets[5] + 24 * i];
+        put_u32(p, writer.constant_symbols[i]);
+        put_u64(&p[8], bits_of_double(writer.upper_limits[i]));
+        put_u64(&p[16], bits_of_double(writer.lower_limits[i]));
+    }
+
+    *size = offsets[7];
+
+    free(roots);
+    free(writer.kinds);
+    free(writer.indices);
+    free(writer.payloads);
+    free(writer.operands);
+    free(writer.names);
+    free(writer.lengths);
+    free(writer.offsets);
+    free(writer.opcode_of_symbol);
+    free(writer.opcodes);
+    free(writer.constant_symbols);
+    free(writer.upper_limits);
+    free(writer.lower_limits);
+    free_table(&writer.nodes);
+    free_table(&writer.symbols);
+    free_table(&writer.constants);
+
+    return data;
+}
+
+bool
+write_image(char *path, int termc, Term **terms)
+{
+    size_t size;
+    unsigned char *data = serialize_terms(termc, terms, &size);
+    FILE *file = fopen(path, "wb");
+    bool is_written;
+
+    if (file == NULL) {
+        free(data);
+        return false;
+    }
+
+    is_written = fwrite(data, 1, size, file) == size;
+    is_written = fclose(file) == 0 && is_written;
+    free(data);
+
+    return is_written;
+}
+
+// checks the header and the section bounds only, so opening costs the
+// same for any image size. data has to stay valid while the image is used.
+TermImage *
+image_of_buffer(const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    TermImage *image;
+    uint32_t counts[6];
+    size_t offsets[8];
+    uint64_t string_size;
+
+    if (size < IMAGE_HEADER || memcmp(bytes, image_magic, sizeof(image_magic)) != 0
+            || get_u32(&bytes[8]) != IMAGE_VERSION)
+        return NULL;
+
+    for (int i = 0;i < 6;i++) {
+        counts[i] = get_u32(&bytes[12 + 4 * i]);
+        if (counts[i] > INT_MAX)
+            return NULL;
+    }
+    string_size = get_u64(&bytes[40]);
+    if (string_size > size)
+        return NULL;
+
+    image_layout(counts[0], get_u32(&bytes[16]), get_u32(&bytes[20]), get_u32(&bytes[24]),
+            get_u32(&bytes[28]), get_u32(&bytes[32]), string_size, offsets);
+    if (offsets[7] > size || get_u64(&bytes[48]) != offsets[7])
+        return NULL;
+
+    image = (TermImage *) malloc(sizeof(TermImage));
+    image->data = bytes;
+    image->size = size;
+    image->is_mapped = false;
+
+    image->rootc = counts[0];
+    image->nodec = counts[1];
+    image->operandc = counts[2];
+    image->symbolc = counts[3];
+    image->opcodec = counts[4];
+    image->constantc = counts[5];
+
+    image->roots = &bytes[offsets[0]];
+    image->nodes = &bytes[offsets[1]];
+    image->operands = &bytes[offsets[2]];
+    image->symbols = &bytes[offsets[3]];
+    image->opcodes = &bytes[offsets[4]];
+    image->constants = &bytes[offsets[5]];
+    image->strings = (const char *) &bytes[offsets[6]];
+
+    return image;
+}
+
+TermImage *
+open_image(char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    TermImage *image;
+    void *data;
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    image = image_of_buffer(data, status.st_size);
+    if (image == NULL) {
+        munmap(data, status.st_size);
+        return NULL;
+    }
+    image->is_mapped = true;
+
+    return image;
+}
+
+// full check of every index, for images from untrusted sources. Arguments
+// must refer to earlier nodes, so the node table is a topological order.
+bool
+validate_image(TermImage *image)
+{
+    size_t string_size = get_u64(&image->data[40]);
+
+    for (int i = 0;i < image->symbolc;i++) {
+        uint64_t offset = get_u32(&image->symbols[8 * i]);
+        uint64_t length = get_u32(&image->symbols[8 * i + 4]);
+
+        if (offset + length >= string_size || image->strings[offset + length] != '\0'
+                || memchr(&image->strings[offset], '\0', length) != NULL)
+            return false;
+    }
+    for (int i = 0;i < image->opcodec;i++)
+        if (get_u32(&image->opcodes[4 * i]) >= (uint32_t) image->symbolc)
+            return false;
+    for (int i = 0;i < image->constantc;i++)
+        if (get_u32(&image->constants[24 * i]) >= (uint32_t) image->symbolc)
+            return false;
+    for (int i = 0;i < image->rootc;i++)
+        if (get_u32(&image->roots[4 * i]) >= (uint32_t) image->nodec)
+            return false;
+
+    for (int i = 0;i < image->nodec;i++) {
+        const unsigned char *p = &image->nodes[16 * i];
+        uint32_t kind = get_u32(p), index = get_u32(&p[4]);
+        uint64_t first = get_u32(&p[8]), argc = get_u32(&p[12]);
+
+        if (kind == IMAGE_LITERAL)
+            continue;
+        if (kind == IMAGE_CONSTANT && index < (uint32_t) image->constantc && first == 0 && argc == 0)
+            continue;
+        if (kind == IMAGE_VARIABLE && index >= (uint32_t) image->symbolc)
+            return false;
+        if (kind == IMAGE_OPERATOR && index >= (uint32_t) image->opcodec)
+            return false;
+        if (kind != IMAGE_VARIABLE && kind != IMAGE_OPERATOR)
+            return false;
+        if (first + argc > (uint64_t) image->operandc)
+            return false;
+
+        for (uint64_t j = first;j < first + argc;j++)
+            if (get_u32(&image->operands[4 * j]) >= (uint32_t) i)
+                return false;
+    }
+
+    return true;
+}
+
+void
+close_image(TermImage *image)
+{
+    if (image->is_mapped)
+        munmap((void *) image->data, image->size);
+    free(image);
+    return;
+}
+
+int
+image_root(TermImage *image, int index)
+{
+    return get_u32(&image->roots[4 * index]);
+}
+
+ImageKind
+image_kind(TermImage *image, int node)
+{
+    return get_u32(&image->nodes[16 * node]);
+}
+
+double
+image_value(TermImage *image, int node)
+{
+    return double_of_bits(get_u64(&image->nodes[16 * node + 8]));
+}
+
+// name of a constant, variable or operator
+const char *
+image_name(TermImage *image, int node)
+{
+    const unsigned char *p = &image->nodes[16 * node];
+    uint32_t index = get_u32(&p[4]), symbol;
+
+    switch (get_u32(p)) {
+    case IMAGE_CONSTANT:
+        symbol = get_u32(&image->constants[24 * index]);
+        break;
+    case IMAGE_VARIABLE:
+        symbol = index;
+        break;
+    case IMAGE_OPERATOR:
+        symbol = get_u32(&image->opcodes[4 * index]);
+        break;
+    default:
+        return NULL;
+    }
+
+    return &image->strings[get_u32(&image->symbols[8 * symbol])];
+}
+
+void
+image_limits(TermImage *image, int node, double *upper_limit, double *lower_limit)
+{
+    const unsigned char *p = &image->constants[24 * get_u32(&image->nodes[16 * node + 4])];
+
+    *upper_limit = double_of_bits(get_u64(&p[8]));
+    *lower_limit = double_of_bits(get_u64(&p[16]));
+    return;
+}
+
+int
+image_argc(TermImage *image, int node)
+{
+    if (image_kind(image, node) == IMAGE_LITERAL)
+        return 0;
+    return get_u32(&image->nodes[16 * node + 12]);
+}
+
+int
+image_argument(TermImage *image, int node, int index)
+{
+    return get_u32(&image->operands[4 * (get_u32(&image->nodes[16 * node + 8]) + index)]);
+}
+
+// Term tree of node, a shared node is copied for every use but the last
+Term *
+term_of_image(TermImage *image, int node)
+{
+    int *uses = (int *) calloc(node + 1, sizeof(int));
+    Term **built = (Term **) malloc(sizeof(Term *) * (node + 1));
+    Term *result;
+
+    uses[node] = 1;
+    for (int i = node;i >= 0;i--) {
+        if (uses[i] == 0)
+            continue;
+        for (int j = 0;j < image_argc(image, i);j++)
+            uses[image_argument(image, i, j)]++;
+    }
+
+    for (int i = 0;i <= node;i++) {
+        int argc;
+        Term **argv;
+
+        if (uses[i] == 0)
+            continue;
+
+        switch (image_kind(image, i)) {
+        case IMAGE_LITERAL:
+            built[i] = literal(image_value(image, i));
+            continue;
+        case IMAGE_CONSTANT: {
+            double upper_limit, lower_limit;
+
+            image_limits(image, i, &upper_limit, &lower_limit);
+            built[i] = constant((char *) image_name(image, i), upper_limit, lower_limit);
+            continue;
+        }
+        default:
+            break;
+        }
+
+        argc = image_argc(image, i);
+        if (image_kind(image, i) == IMAGE_VARIABLE && argc == 0) {
+            built[i] = variable((char *) image_name(image, i));
+            continue;
+        }
+
+        argv = (Term **) allocate(sizeof(Term *) * (argc > 0 ? argc : 1));
+        for (int j = 0;j < argc;j++) {
+            int argument = image_argument(image, i, j);
+
+            argv[j] = --uses[argument] == 0 ? built[argument] : copy_term(built[argument]);
+        }
+
+        if (image_kind(image, i) == IMAGE_VARIABLE)
+            built[i] = variable_with_index((char *) image_name(image, i), argc, argv);
+        else
+            built[i] = operator((char *) image_name(image, i), argc, argv);
+    }
+
+    result = built[node];
+    free(uses);
+    free(built);
+
+    return result;
+}
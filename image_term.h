@@ -0,0 +1,73 @@
+#ifndef IMAGE_TERM_H_
+#define IMAGE_TERM_H_
+
+#define IMAGE_VERSION 1
+#define IMAGE_HEADER 64
+
+typedef struct TermImage TermImage;
+
+typedef enum {
+    IMAGE_LITERAL,
+    IMAGE_CONSTANT,
+    IMAGE_VARIABLE,
+    IMAGE_OPERATOR
+} ImageKind;
+
+// read-only view of a serialized term image, either a caller owned buffer
+// or a mapped file. All sections point into data, nothing is decoded up
+// front. Layout, all integers little endian:
+//
+//   header     64 bytes: "ALGTERM\0", version, rootc, nodec, operandc,
+//              symbolc, opcodec, constantc, 0, string bytes, total size
+//   roots      u32 node per term
+//   nodes      16 bytes: u32 kind, u32 index, u32 first, u32 argc, a
+//              literal keeps its double in first and argc instead
+//   operands   u32 node per argument, always an earlier node
+//   symbols    u32 offset, u32 length into strings
+//   opcodes    u32 symbol per operator name
+//   constants  u32 symbol, u32 0, f64 upper limit, f64 lower limit
+//   strings    NUL terminated names
+//
+// sections start at multiples of 8. index is the constant of a constant,
+// the symbol of a variable and the opcode of an operator, first and argc
+// give the arguments of an operator or the index of a variable.
+struct TermImage {
+    const unsigned char *data;
+    size_t size;
+    bool is_mapped;
+
+    int rootc;
+    int nodec;
+    int operandc;
+    int symbolc;
+    int opcodec;
+    int constantc;
+
+    const unsigned char *roots;
+    const unsigned char *nodes;
+    const unsigned char *operands;
+    const unsigned char *symbols;
+    const unsigned char *opcodes;
+    const unsigned char *constants;
+    const char *strings;
+};
+
+unsigned char *serialize_terms(int termc, Term **terms, size_t *size);
+bool write_image(char *path, int termc, Term **terms);
+
+TermImage *image_of_buffer(const void *data, size_t size);
+TermImage *open_image(char *path);
+bool validate_image(TermImage *image);
+void close_image(TermImage *image);
+
+int image_root(TermImage *image, int index);
+ImageKind image_kind(TermImage *image, int node);
+double image_value(TermImage *image, int node);
+const char *image_name(TermImage *image, int node);
+void image_limits(TermImage *image, int node, double *upper_limit, double *lower_limit);
+int image_argc(TermImage *image, int node);
+int image_argument(TermImage *image, int node, int index);
+
+Term *term_of_image(TermImage *image, int node);
+
+#endif // IMAGE_TERM_H_
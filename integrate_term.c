@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <string.h>
+#include "term.h"
+#include "polynomial_term.h"
+#include "simplify_term.h"
+#include "integrate_term.h"
+
+static Term *
+fraction_of_polynomials(Polynomial *numerator, Polynomial *denominator, Term *variable)
+{
+    if (denominator->degree == 0)
+        return term_of_polynomial(numerator, variable);
+
+    return multiply(term_of_polynomial(numerator, variable),
+            multiple_inverse(term_of_polynomial(denominator, variable)));
+}
+
+static Term *
+add_summand(Term *sum, Term *summand)
+{
+    if (sum == NULL)
+        return summand;
+    return add(sum, summand);
+}
+
+// Hermite reduction of a proper fraction numerator / denominator in the
+// linear (Mack) form, it only needs gcds and one diophantine equation per
+// multiplicity instead of a system of undetermined coefficients. Returns
+// the rational part of the integral, or NULL if it is zero, and stores
+// the remaining numerator over the squarefree part of the denominator.
+Term *
+hermite_reduce(Polynomial *numerator, Polynomial *denominator, Term *variable,
+        Polynomial **remainder, Polynomial **squarefree)
+{
+    Polynomial *a = copy_polynomial(numerator);
+    Polynomial *derivative = polynomial_derivative(denominator);
+    Polynomial *d_minus = polynomial_gcd(denominator, derivative);
+    Polynomial *d_star = polynomial_divide(denominator, d_minus, NULL);
+    Term *rational = NULL;
+
+    free_polynomial(derivative);
+
+    while (d_minus->degree > 0) {
+        Polynomial *d_minus_derivative = polynomial_derivative(d_minus);
+        Polynomial *d_minus_2 = polynomial_gcd(d_minus, d_minus_derivative);
+        Polynomial *d_minus_star = polynomial_divide(d_minus, d_minus_2, NULL);
+        Polynomial *product, *factor, *negative, *b, *c, *b_derivative, *quotient, *correction;
+
+        // b * (-d_star * d_minus' / d_minus) + c * d_minus_star = a
+        product = polynomial_multiply(d_star, d_minus_derivative);
+        factor = polynomial_divide(product, d_minus, NULL);
+        negative = polynomial_scale(factor, -1.0);
+        b = polynomial_solve_diophantine(negative, d_minus_star, a, &c);
+
+        // a = c - b' * d_star / d_minus_star
+        b_derivative = polynomial_derivative(b);
+        quotient = polynomial_divide(d_star, d_minus_star, NULL);
+        free_polynomial(product);
+        product = polynomial_multiply(b_derivative, quotient);
+        correction = polynomial_subtract(c, product);
+
+        free_polynomial(a);
+        a = correction;
+
+        if (b->degree >= 0)
+            rational = add_summand(rational, fraction_of_polynomials(b, d_minus, variable));
+
+        free_polynomial(d_minus_derivative);
+        free_polynomial(d_minus_star);
+        free_polynomial(product);
+        free_polynomial(factor);
+        free_polynomial(negative);
+        free_polynomial(b);
+        free_polynomial(c);
+        free_polynomial(b_derivative);
+        free_polynomial(quotient);
+        free_polynomial(d_minus);
+        d_minus = d_minus_2;
+    }
+
+    free_polynomial(d_minus);
+
+    *remainder = a;
+    *squarefree = d_star;
+
+    return rational;
+}
+
+// antiderivative of a term that is rational in variable, as polynomial
+// part plus Hermite's rational part plus the logarithmic part. No
+// logarithm operator exists, so the logarithmic part stays an integral of
+// a proper fraction with squarefree denominator. Returns NULL if the term
+// is not rational or if nothing could be integrated.
+Term *
+integrate(Term *term, Term *variable)
+{
+    Polynomial *numerator, *denominator, *quotient, *proper, *monic_numerator, *monic_denominator;
+    Polynomial *remainder, *squarefree;
+    Term *result = NULL, *rational;
+    double leading;
+
+    if (strcmp(variable->meaning, "variable") != 0)
+        return NULL;
+    if (!rational_of_term(term, variable, &numerator, &denominator))
+        return NULL;
+
+    // work with a monic denominator
+    leading = denominator->coefficients[denominator->degree];
+    monic_numerator = polynomial_scale(numerator, 1.0 / leading);
+    monic_denominator = polynomial_scale(denominator, 1.0 / leading);
+    free_polynomial(numerator);
+    free_polynomial(denominator);
+
+    quotient = polynomial_divide(monic_numerator, monic_denominator, &proper);
+
+    if (quotient->degree >= 0) {
+        Polynomial *antiderivative = polynomial_integral(quotient);
+
+        result = term_of_polynomial(antiderivative, variable);
+        free_polynomial(antiderivative);
+    }
+
+    rational = NULL;
+    remainder = NULL;
+    squarefree = NULL;
+    if (proper->degree >= 0) {
+        rational = hermite_reduce(proper, monic_denominator, variable, &remainder, &squarefree);
+
+        if (rational == NULL && result == NULL) {
+            // already the integral of a logarithmic part
+            free_polynomial(remainder);
+            free_polynomial(squarefree);
+            free_polynomial(proper);
+            free_polynomial(quotient);
+            free_polynomial(monic_numerator);
+            free_polynomial(monic_denominator);
+            return NULL;
+        }
+
+        if (rational != NULL)
+            result = add_summand(result, rational);
+        if (remainder->degree >= 0)
+            result = add_summand(result, integral(
+                        fraction_of_polynomials(remainder, squarefree, variable), copy_term(variable)));
+
+        free_polynomial(remainder);
+        free_polynomial(squarefree);
+    }
+
+    free_polynomial(proper);
+    free_polynomial(quotient);
+    free_polynomial(monic_numerator);
+    free_polynomial(monic_denominator);
+
+    if (result == NULL)
+        return literal(0.0);
+
+    return simplify(result);
+}
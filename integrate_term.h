@@ -0,0 +1,8 @@
+#ifndef INTEGRATE_TERM_H_
+#define INTEGRATE_TERM_H_
+
+Term *integrate(Term *term, Term *variable);
+Term *hermite_reduce(Polynomial *numerator, Polynomial *denominator, Term *variable,
+        Polynomial **remainder, Polynomial **squarefree);
+
+#endif // INTEGRATE_TERM_H_
@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "term.h"
+#include "compile_term.h"
+#include "interval_term.h"
+
+// number of boxes evaluated together by the batch evaluator
+#define INTERVAL_BLOCK 256
+
+// every operation is computed rounded to nearest and then widened by at
+// least one ulp, which keeps the true result inside the enclosure,
+// infinite bounds stay infinite
+static inline double
+round_down(double value)
+{
+    return value - fmin(fabs(value) * (2.0 * DBL_EPSILON) + DBL_MIN, DBL_MAX);
+}
+
+static inline double
+round_up(double value)
+{
+    return value + fmin(fabs(value) * (2.0 * DBL_EPSILON) + DBL_MIN, DBL_MAX);
+}
+
+static Interval
+entire(void)
+{
+    return interval(-INFINITY, INFINITY);
+}
+
+Interval
+interval(double lower, double upper)
+{
+    Interval interval;
+
+    interval.lower = lower;
+    interval.upper = upper;
+
+    return interval;
+}
+
+Interval
+interval_of_constant(Constant *constant)
+{
+    if (constant->lower_limit <= constant->upper_limit)
+        return interval(constant->lower_limit, constant->upper_limit);
+    return interval(constant->upper_limit, constant->lower_limit);
+}
+
+Interval
+interval_add(Interval lhs, Interval rhs)
+{
+    return interval(round_down(lhs.lower + rhs.lower), round_up(lhs.upper + rhs.upper));
+}
+
+Interval
+interval_additive_inverse(Interval operand)
+{
+    return interval(-operand.upper, -operand.lower);
+}
+
+Interval
+interval_multiply(Interval lhs, Interval rhs)
+{
+    double a = lhs.lower * rhs.lower;
+    double b = lhs.lower * rhs.upper;
+    double c = lhs.upper * rhs.lower;
+    double d = lhs.upper * rhs.upper;
+
+    // 0 * inf only happens with a point zero, whose product is zero
+    if (isnan(a) || isnan(b) || isnan(c) || isnan(d)) {
+        if (lhs.lower == 0.0 && lhs.upper == 0.0)
+            return interval(0.0, 0.0);
+        if (rhs.lower == 0.0 && rhs.upper == 0.0)
+            return interval(0.0, 0.0);
+        return entire();
+    }
+
+    return interval(round_down(fmin(fmin(a, b), fmin(c, d))),
+            round_up(fmax(fmax(a, b), fmax(c, d))));
+}
+
+Interval
+interval_multiple_inverse(Interval operand)
+{
+    if (operand.lower > 0.0 || operand.upper < 0.0)
+        return interval(round_down(1.0 / operand.upper), round_up(1.0 / operand.lower));
+    if (operand.lower == 0.0 && operand.upper > 0.0)
+        return interval(round_down(1.0 / operand.upper), INFINITY);
+    if (operand.upper == 0.0 && operand.lower < 0.0)
+        return interval(-INFINITY, round_up(1.0 / operand.lower));
+
+    return entire();
+}
+
+static Interval
+interval_integer_power(Interval base, long exponent)
+{
+    Interval result;
+    double lower, upper;
+
+    if (exponent == 0)
+        return interval(1.0, 1.0);
+    if (exponent < 0)
+        return interval_multiple_inverse(interval_integer_power(base, -exponent));
+
+    lower = pow(base.lower, (double) exponent);
+    upper = pow(base.upper, (double) exponent);
+
+    if (exponent % 2 == 1)
+        result = interval(lower, upper);
+    else if (base.lower >= 0.0)
+        result = interval(lower, upper);
+    else if (base.upper <= 0.0)
+        result = interval(upper, lower);
+    else
+        result = interval(0.0, fmax(lower, upper));
+
+    // pow is not correctly rounded, allow an additional ulp
+    result = interval(round_down(round_down(result.lower)), round_up(round_up(result.upper)));
+
+    // even powers never become negative
+    if (exponent % 2 == 0 && result.lower < 0.0)
+        result.lower = 0.0;
+
+    return result;
+}
+
+Interval
+interval_power(Interval base, Interval exponent)
+{
+    double a, b, c, d;
+
+    if (exponent.lower == exponent.upper &&
+        exponent.lower == floor(exponent.lower) &&
+        fabs(exponent.lower) < 1e15)
+        return interval_integer_power(base, (long) exponent.lower);
+
+    // a real power with a non integer exponent is only defined for a non
+    // negative base, so the negative part of the base is dropped
+    if (base.upper < 0.0)
+        return entire();
+    if (base.lower < 0.0)
+        base.lower = 0.0;
+
+    a = pow(base.lower, exponent.lower);
+    b = pow(base.lower, exponent.upper);
+    c = pow(base.upper, exponent.lower);
+    d = pow(base.upper, exponent.upper);
+
+    if (isnan(a) || isnan(b) || isnan(c) || isnan(d))
+        return entire();
+
+    // a power of a non negative base never becomes negative
+    return interval(fmax(round_down(round_down(fmin(fmin(a, b), fmin(c, d)))), 0.0),
+            round_up(round_up(fmax(fmax(a, b), fmax(c, d)))));
+}
+
+bool
+is_positive_interval(Interval operand)
+{
+    if (operand.lower > 0.0)
+        return true;
+    return false;
+}
+
+bool
+is_negative_interval(Interval operand)
+{
+    if (operand.upper < 0.0)
+        return true;
+    return false;
+}
+
+bool
+excludes_zero(Interval operand)
+{
+    if (is_positive_interval(operand) || is_negative_interval(operand))
+        return true;
+    return false;
+}
+
+void
+evaluate_program_interval(Program *program, Interval *values, Interval *registers, Interval *results)
+{
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        Interval value;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+            value = interval(instruction->value, instruction->value);
+            break;
+        case OPCODE_CONSTANT:
+            value = interval_of_constant(program->constants[instruction->index]);
+            break;
+        case OPCODE_VARIABLE:
+            value = values[instruction->index];
+            break;
+        case OPCODE_ADD:
+            value = registers[operands[0]];
+            for (int j = 1;j < instruction->argc;j++)
+                value = interval_add(value, registers[operands[j]]);
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            value = interval_additive_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_MULTIPLY:
+            value = registers[operands[0]];
+            for (int j = 1;j < instruction->argc;j++)
+                value = interval_multiply(value, registers[operands[j]]);
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            value = interval_multiple_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_POWER:
+            value = interval_power(registers[operands[0]], registers[operands[1]]);
+            break;
+        default:
+            // imaginary terms have no real enclosure
+            value = entire();
+            break;
+        }
+
+        registers[i] = value;
+    }
+
+    for (int i = 0;i < program->resultc;i++)
+        results[i] = registers[program->results[i]];
+    return;
+}
+
+// the lane loops below are kept free of branches on the common
+// operations so that the compiler can vectorize them
+static void
+add_lanes(int count, double *lower, double *upper, double *lhs_lower, double *lhs_upper,
+        double *rhs_lower, double *rhs_upper)
+{
+    for (int k = 0;k < count;k++) {
+        lower[k] = round_down(lhs_lower[k] + rhs_lower[k]);
+        upper[k] = round_up(lhs_upper[k] + rhs_upper[k]);
+    }
+}
+
+static void
+multiply_lanes(int count, double *lower, double *upper, double *lhs_lower, double *lhs_upper,
+        double *rhs_lower, double *rhs_upper)
+{
+    for (int k = 0;k < count;k++) {
+        double a = lhs_lower[k] * rhs_lower[k];
+        double b = lhs_lower[k] * rhs_upper[k];
+        double c = lhs_upper[k] * rhs_lower[k];
+        double d = lhs_upper[k] * rhs_upper[k];
+
+        if (isnan(a + b + c + d)) {
+            Interval value = interval_multiply(interval(lhs_lower[k], lhs_upper[k]),
+                    interval(rhs_lower[k], rhs_upper[k]));
+
+            lower[k] = value.lower;
+            upper[k] = value.upper;
+            continue;
+        }
+
+        lower[k] = round_down(fmin(fmin(a, b), fmin(c, d)));
+        upper[k] = round_up(fmax(fmax(a, b), fmax(c, d)));
+    }
+}
+
+static void
+evaluate_block(Program *program, int offset, int count, double **lower, double **upper,
+        double **result_lower, double **result_upper, double *registers)
+{
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double *register_lower = &registers[(2 * i) * INTERVAL_BLOCK];
+        double *register_upper = &registers[(2 * i + 1) * INTERVAL_BLOCK];
+        double *lhs_lower, *lhs_upper;
+        Interval value;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+        case OPCODE_CONSTANT:
+            if (instruction->opcode == OPCODE_LITERAL)
+                value = interval(instruction->value, instruction->value);
+            else
+                value = interval_of_constant(program->constants[instruction->index]);
+            for (int k = 0;k < count;k++) {
+                register_lower[k] = value.lower;
+                register_upper[k] = value.upper;
+            }
+            break;
+        case OPCODE_VARIABLE:
+            for (int k = 0;k < count;k++) {
+                register_lower[k] = lower[instruction->index][offset + k];
+                register_upper[k] = upper[instruction->index][offset + k];
+            }
+            break;
+        case OPCODE_ADD:
+        case OPCODE_MULTIPLY:
+            lhs_lower = &registers[(2 * operands[0]) * INTERVAL_BLOCK];
+            lhs_upper = &registers[(2 * operands[0] + 1) * INTERVAL_BLOCK];
+            for (int k = 0;k < count;k++) {
+                register_lower[k] = lhs_lower[k];
+                register_upper[k] = lhs_upper[k];
+            }
+            for (int j = 1;j < instruction->argc;j++) {
+                double *rhs_lower = &registers[(2 * operands[j]) * INTERVAL_BLOCK];
+                double *rhs_upper = &registers[(2 * operands[j] + 1) * INTERVAL_BLOCK];
+
+                if (instruction->opcode == OPCODE_ADD)
+                    add_lanes(count, register_lower, register_upper,
+                            register_lower, register_upper, rhs_lower, rhs_upper);
+                else
+                    multiply_lanes(count, register_lower, register_upper,
+                            register_lower, register_upper, rhs_lower, rhs_upper);
+            }
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            lhs_lower = &registers[(2 * operands[0]) * INTERVAL_BLOCK];
+            lhs_upper = &registers[(2 * operands[0] + 1) * INTERVAL_BLOCK];
+            for (int k = 0;k < count;k++) {
+                register_lower[k] = -lhs_upper[k];
+                register_upper[k] = -lhs_lower[k];
+            }
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            lhs_lower = &registers[(2 * operands[0]) * INTERVAL_BLOCK];
+            lhs_upper = &registers[(2 * operands[0] + 1) * INTERVAL_BLOCK];
+            for (int k = 0;k < count;k++) {
+                value = interval_multiple_inverse(interval(lhs_lower[k], lhs_upper[k]));
+                register_lower[k] = value.lower;
+                register_upper[k] = value.upper;
+            }
+            break;
+        case OPCODE_POWER:
+            lhs_lower = &registers[(2 * operands[0]) * INTERVAL_BLOCK];
+            lhs_upper = &registers[(2 * operands[0] + 1) * INTERVAL_BLOCK];
+            for (int k = 0;k < count;k++) {
+                value = interval_power(interval(lhs_lower[k], lhs_upper[k]),
+                        interval(registers[(2 * operands[1]) * INTERVAL_BLOCK + k],
+                            registers[(2 * operands[1] + 1) * INTERVAL_BLOCK + k]));
+                register_lower[k] = value.lower;
+                register_upper[k] = value.upper;
+            }
+            break;
+        default:
+            for (int k = 0;k < count;k++) {
+                register_lower[k] = -INFINITY;
+                register_upper[k] = INFINITY;
+            }
+            break;
+        }
+    }
+
+    for (int i = 0;i < program->resultc;i++) {
+        int result = program->results[i];
+
+        for (int k = 0;k < count;k++) {
+            result_lower[i][offset + k] = registers[(2 * result) * INTERVAL_BLOCK + k];
+            result_upper[i][offset + k] = registers[(2 * result + 1) * INTERVAL_BLOCK + k];
+        }
+    }
+    return;
+}
+
+// lower[v][k] and upper[v][k] bound variable slot v in box k
+void
+evaluate_program_interval_batch(Program *program, int count,
+        double **lower, double **upper, double **result_lower, double **result_upper)
+{
+    double *registers = (double *) malloc(sizeof(double) * 2 * INTERVAL_BLOCK * (program->length + 1));
+
+    for (int offset = 0;offset < count;offset += INTERVAL_BLOCK) {
+        int block = count - offset < INTERVAL_BLOCK ? count - offset : INTERVAL_BLOCK;
+
+        evaluate_block(program, offset, block, lower, upper, result_lower, result_upper, registers);
+    }
+
+    free(registers);
+    return;
+}
+
+Interval
+interval_of_term(Term *term, int variablec, Term **variables, Interval *bounds)
+{
+    Program *program = compile_term(term, variablec, variables);
+    Interval *registers, result;
+
+    if (program == NULL)
+        return entire();
+
+    registers = (Interval *) malloc(sizeof(Interval) * program->length);
+    evaluate_program_interval(program, bounds, registers, &result);
+
+    free(registers);
+    free_program(program);
+
+    return result;
+}
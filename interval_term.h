@@ -0,0 +1,30 @@
+#ifndef INTERVAL_TERM_H_
+#define INTERVAL_TERM_H_
+
+typedef struct Interval Interval;
+
+struct Interval {
+    double lower;
+    double upper;
+};
+
+Interval interval(double lower, double upper);
+Interval interval_of_constant(Constant *constant);
+
+Interval interval_add(Interval lhs, Interval rhs);
+Interval interval_additive_inverse(Interval operand);
+Interval interval_multiply(Interval lhs, Interval rhs);
+Interval interval_multiple_inverse(Interval operand);
+Interval interval_power(Interval base, Interval exponent);
+
+bool is_positive_interval(Interval operand);
+bool is_negative_interval(Interval operand);
+bool excludes_zero(Interval operand);
+
+void evaluate_program_interval(Program *program, Interval *values, Interval *registers, Interval *results);
+void evaluate_program_interval_batch(Program *program, int count,
+        double **lower, double **upper, double **result_lower, double **result_upper);
+
+Interval interval_of_term(Term *term, int variablec, Term **variables, Interval *bounds);
+
+#endif // INTERVAL_TERM_H_
@@ -0,0 +1,1321 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "term.h"
+#include "compare_term.h"
+#include "compile_term.h"
+#include "interval_term.h"
+#include "simplify_term.h"
+#include "builder_term.h"
+#include "sparse_term.h"
+#include "modular_term.h"
+#include "linear_term.h"
+
+// threshold of the sparse pivot search
+#define LINEAR_PIVOT_THRESHOLD 0.1
+// integer powers up to this one are expanded by Bareiss elimination,
+// higher ones are kept whole as atoms
+#define LINEAR_EXPANDED_POWER 16
+// numeric systems with rational coefficients up to this many unknowns are
+// solved exactly, larger ones by sparse LU
+#define LINEAR_EXACT_SIZE 64
+// 2^53, integral literals up to it are exact doubles
+#define LINEAR_EXACT_INTEGER 9007199254740992.0
+
+typedef struct LinearForm LinearForm;
+typedef struct Lookup Lookup;
+typedef struct Entry Entry;
+typedef struct Fraction Fraction;
+typedef struct Multivariate Multivariate;
+typedef struct Atoms Atoms;
+
+// sum of coefficients[k] * variables[slots[k]] plus constant, a NULL
+// constant is zero
+struct LinearForm {
+    int length;
+    int capacity;
+    int *slots;
+    Term **coefficients;
+    Term *constant;
+};
+
+// the unknowns sorted for binary search, sorted[k] points into variables
+struct Lookup {
+    int variablec;
+    Term **variables;
+    Term ***sorted;
+};
+
+struct Entry {
+    int slot;
+    Term *coefficient;
+};
+
+// numerator / denominator in lowest terms with a positive denominator. A
+// denominator of 0 marks a result that does not fit into long long, every
+// operation on it gives it again.
+struct Fraction {
+    long long numerator;
+    long long denominator;
+};
+
+// sum of coefficients[k] times the product of atoms[a]^exponents[k atomc + a]
+// over the atoms of an Atoms. Monomials are sorted in decreasing
+// lexicographic order of their exponents and no coefficient is zero.
+struct Multivariate {
+    int length;
+    int capacity;
+    Fraction *coefficients;
+    int *exponents;
+};
+
+// the subterms of coefficients that are not rational numbers, sums,
+// products, additive inverses or small integer powers. They are taken as
+// independent unknowns, an identity of polynomials in them holds for the
+// terms they stand for as well.
+struct Atoms {
+    int atomc;
+    int capacity;
+    Term **atoms;
+};
+
+static int
+compare_variables(const void *lhs, const void *rhs)
+{
+    Term *lhs_variable = **(Term ***) lhs, *rhs_variable = **(Term ***) rhs;
+
+    if (is_less(lhs_variable, rhs_variable))
+        return -1;
+    if (is_greater(lhs_variable, rhs_variable))
+        return 1;
+    return 0;
+}
+
+static int
+compare_entries(const void *lhs, const void *rhs)
+{
+    return ((Entry *) lhs)->slot - ((Entry *) rhs)->slot;
+}
+
+static int
+find_slot(Lookup *lookup, Term *term)
+{
+    int lower = 0, upper = lookup->variablec - 1;
+
+    while (lower <= upper) {
+        int middle = (lower + upper) / 2;
+        Term *candidate = *lookup->sorted[middle];
+
+        if (is_less(term, candidate))
+            upper = middle - 1;
+        else if (is_greater(term, candidate))
+            lower = middle + 1;
+        else
+            return (int) (lookup->sorted[middle] - lookup->variables);
+    }
+    return -1;
+}
+
+static bool
+depends_on(Term *term, Lookup *lookup)
+{
+    if (strcmp(term->meaning, "variable") == 0)
+        return find_slot(lookup, term) >= 0;
+
+    if (strcmp(term->meaning, "operator") == 0) {
+        Operator *temp_operator = term->content;
+
+        for (int i = 0;i < temp_operator->argc;i++)
+            if (depends_on(temp_operator->argv[i], lookup))
+                return true;
+    }
+    return false;
+}
+
+static LinearForm *
+linear_form_constant(Term *constant)
+{
+    LinearForm *form = (LinearForm *) malloc(sizeof(LinearForm));
+
+    form->length = 0;
+    form->capacity = 0;
+    form->slots = NULL;
+    form->coefficients = NULL;
+    form->constant = constant;
+
+    return form;
+}
+
+static void
+free_linear_form(LinearForm *form)
+{
+    for (int k = 0;k < form->length;k++)
+        free_term(form->coefficients[k]);
+    if (form->constant != NULL)
+        free_term(form->constant);
+    free(form->slots);
+    free(form->coefficients);
+    free(form);
+    return;
+}
+
+static void
+append_coefficient(LinearForm *form, int slot, Term *coefficient)
+{
+    if (form->length == form->capacity) {
+        form->capacity = 2 * form->capacity + 4;
+        form->slots = (int *) realloc(form->slots, sizeof(int) * form->capacity);
+        form->coefficients = (Term **) realloc(form->coefficients, sizeof(Term *) * form->capacity);
+    }
+    form->slots[form->length] = slot;
+    form->coefficients[form->length] = coefficient;
+    form->length++;
+    return;
+}
+
+// adds source to form and frees source
+static void
+merge_linear_forms(LinearForm *form, LinearForm *source)
+{
+    for (int k = 0;k < source->length;k++)
+        append_coefficient(form, source->slots[k], source->coefficients[k]);
+    source->length = 0;
+
+    if (source->constant != NULL)
+        form->constant = form->constant == NULL ? source->constant : add(form->constant, source->constant);
+    source->constant = NULL;
+
+    free_linear_form(source);
+    return;
+}
+
+// applies a unary operator such as additive_inverse to every part
+static void
+map_linear_form(LinearForm *form, Term *(*map)(Term *))
+{
+    for (int k = 0;k < form->length;k++)
+        form->coefficients[k] = map(form->coefficients[k]);
+    if (form->constant != NULL)
+        form->constant = map(form->constant);
+    return;
+}
+
+static void
+scale_linear_form(LinearForm *form, Term *factor)
+{
+    for (int k = 0;k < form->length;k++)
+        form->coefficients[k] = multiply(form->coefficients[k], copy_term(factor));
+    if (form->constant != NULL)
+        form->constant = multiply(form->constant, copy_term(factor));
+    return;
+}
+
+static LinearForm *linear_form(Term *term, Lookup *lookup);
+
+// a product is linear if at most one factor depends on the unknowns, the
+// other factors scale it
+static LinearForm *
+linear_form_of_product(Operator *temp_operator, Lookup *lookup)
+{
+    LinearForm *form = NULL;
+    Term *scale = NULL;
+    bool is_zero = false;
+
+    for (int i = 0;i < temp_operator->argc;i++) {
+        Term *factor = temp_operator->argv[i];
+
+        if (!depends_on(factor, lookup)) {
+            scale = scale == NULL ? copy_term(factor) : multiply(scale, copy_term(factor));
+            continue;
+        }
+
+        if (form != NULL) {
+            free_linear_form(form);
+            if (scale != NULL)
+                free_term(scale);
+            return NULL;
+        }
+
+        form = linear_form(factor, lookup);
+        if (form == NULL) {
+            if (scale != NULL)
+                free_term(scale);
+            return NULL;
+        }
+        is_zero = form->length == 0 && form->constant == NULL;
+    }
+
+    if (form == NULL)
+        return linear_form_constant(scale);
+
+    if (scale != NULL && !is_zero)
+        scale_linear_form(form, scale);
+    if (scale != NULL)
+        free_term(scale);
+
+    return form;
+}
+
+// coefficients of the unknowns in a term that is linear in them, NULL if
+// the term is not linear
+static LinearForm *
+linear_form(Term *term, Lookup *lookup)
+{
+    Operator *temp_operator;
+    LinearForm *form;
+
+    if (!depends_on(term, lookup))
+        return linear_form_constant(copy_term(term));
+
+    if (strcmp(term->meaning, "variable") == 0) {
+        form = linear_form_constant(NULL);
+        append_coefficient(form, find_slot(lookup, term), literal(1.0));
+        return form;
+    }
+
+    temp_operator = term->content;
+
+    if (strcmp(temp_operator->name, "+") == 0) {
+        form = linear_form_constant(NULL);
+        for (int i = 0;i < temp_operator->argc;i++) {
+            LinearForm *summand = linear_form(temp_operator->argv[i], lookup);
+
+            if (summand == NULL) {
+                free_linear_form(form);
+                return NULL;
+            }
+            merge_linear_forms(form, summand);
+        }
+        return form;
+    }
+
+    if (strcmp(temp_operator->name, "*") == 0)
+        return linear_form_of_product(temp_operator, lookup);
+
+    if (strcmp(temp_operator->name, "additive_inverse") == 0 ||
+            strcmp(temp_operator->name, "imaginary") == 0) {
+        form = linear_form(temp_operator->argv[0], lookup);
+        if (form != NULL)
+            map_linear_form(form, strcmp(temp_operator->name, "imaginary") == 0 ? imaginary : additive_inverse);
+        return form;
+    }
+
+    // powers, inverses, D, I and = of the unknowns are not linear
+    return NULL;
+}
+
+static bool
+is_number(Term *term)
+{
+    if (strcmp(term->meaning, "literal") == 0)
+        return true;
+
+    if (strcmp(term->meaning, "operator") == 0) {
+        Operator *temp_operator = term->content;
+
+        if (strcmp(temp_operator->name, "imaginary") == 0 ||
+                strcmp(temp_operator->name, "D") == 0 ||
+                strcmp(temp_operator->name, "I") == 0 ||
+                strcmp(temp_operator->name, "=") == 0)
+            return false;
+        for (int i = 0;i < temp_operator->argc;i++)
+            if (!is_number(temp_operator->argv[i]))
+                return false;
+        return true;
+    }
+    return false;
+}
+
+// extracts matrix x = rhs from equations that are linear in variables,
+// equations are "=" terms or terms meant to be zero. Returns NULL if an
+// equation is not linear in the variables.
+LinearSystem *
+linear_system(int equationc, Term **equations, int variablec, Term **variables)
+{
+    LinearSystem *system;
+    LinearForm **forms = (LinearForm **) malloc(sizeof(LinearForm *) * (equationc + 1));
+    Lookup lookup;
+    int nonzeroc = 0;
+
+    lookup.variablec = variablec;
+    lookup.variables = variables;
+    lookup.sorted = (Term ***) malloc(sizeof(Term **) * (variablec + 1));
+    for (int i = 0;i < variablec;i++)
+        lookup.sorted[i] = &variables[i];
+    qsort(lookup.sorted, variablec, sizeof(Term **), compare_variables);
+
+    for (int i = 0;i < equationc;i++) {
+        Operator *temp_operator = is_operator(equations[i], "=");
+        Entry *entries;
+        int length = 0;
+
+        if (temp_operator != NULL) {
+            LinearForm *rhs = linear_form(temp_operator->argv[1], &lookup);
+
+            forms[i] = linear_form(temp_operator->argv[0], &lookup);
+            if (forms[i] != NULL && rhs != NULL) {
+                map_linear_form(rhs, additive_inverse);
+                merge_linear_forms(forms[i], rhs);
+            } else if (rhs != NULL) {
+                free_linear_form(rhs);
+            } else if (forms[i] != NULL) {
+                free_linear_form(forms[i]);
+                forms[i] = NULL;
+            }
+        } else {
+            forms[i] = linear_form(equations[i], &lookup);
+        }
+
+        if (forms[i] == NULL) {
+            for (int j = 0;j < i;j++)
+                free_linear_form(forms[j]);
+            free(forms);
+            free(lookup.sorted);
+            return NULL;
+        }
+
+        // one entry per unknown, sorted by slot
+        entries = (Entry *) malloc(sizeof(Entry) * (forms[i]->length + 1));
+        for (int k = 0;k < forms[i]->length;k++) {
+            entries[k].slot = forms[i]->slots[k];
+            entries[k].coefficient = forms[i]->coefficients[k];
+        }
+        qsort(entries, forms[i]->length, sizeof(Entry), compare_entries);
+
+        for (int k = 0;k < forms[i]->length;k++) {
+            if (length > 0 && entries[length - 1].slot == entries[k].slot)
+                entries[length - 1].coefficient = add(entries[length - 1].coefficient, entries[k].coefficient);
+            else
+                entries[length++] = entries[k];
+        }
+        for (int k = 0;k < length;k++) {
+            forms[i]->slots[k] = entries[k].slot;
+            forms[i]->coefficients[k] = entries[k].coefficient;
+        }
+        forms[i]->length = length;
+        nonzeroc += length;
+
+        free(entries);
+    }
+
+    system = (LinearSystem *) malloc(sizeof(LinearSystem));
+    system->equationc = equationc;
+    system->variablec = variablec;
+    system->matrix = sparse(equationc, variablec, nonzeroc);
+    system->coefficients = (Term **) malloc(sizeof(Term *) * (nonzeroc + 1));
+    system->rhs = (Term **) malloc(sizeof(Term *) * (equationc + 1));
+    system->values = (double *) malloc(sizeof(double) * (equationc + 1));
+    system->is_numeric = true;
+
+    nonzeroc = 0;
+    for (int i = 0;i < equationc;i++) {
+        LinearForm *form = forms[i];
+
+        for (int k = 0;k < form->length;k++) {
+            system->matrix->columns[nonzeroc] = form->slots[k];
+            system->coefficients[nonzeroc] = form->coefficients[k];
+            if (!is_number(form->coefficients[k]))
+                system->is_numeric = false;
+            nonzeroc++;
+        }
+        system->matrix->rows[i + 1] = nonzeroc;
+
+        system->rhs[i] = form->constant == NULL ? literal(0.0) : additive_inverse(form->constant);
+        if (!is_number(system->rhs[i]))
+            system->is_numeric = false;
+
+        form->length = 0;
+        form->constant = NULL;
+        free_linear_form(form);
+    }
+
+    if (system->is_numeric) {
+        for (int k = 0;k < nonzeroc;k++)
+            system->matrix->values[k] = evaluate_term(system->coefficients[k], 0, NULL, NULL);
+        for (int i = 0;i < equationc;i++)
+            system->values[i] = evaluate_term(system->rhs[i], 0, NULL, NULL);
+    } else {
+        for (int k = 0;k < nonzeroc;k++)
+            system->coefficients[k] = simplify(system->coefficients[k]);
+        for (int i = 0;i < equationc;i++)
+            system->rhs[i] = simplify(system->rhs[i]);
+    }
+
+    free(forms);
+    free(lookup.sorted);
+
+    return system;
+}
+
+void
+free_linear_system(LinearSystem *system)
+{
+    for (int k = 0;k < system->matrix->nonzeroc;k++)
+        free_term(system->coefficients[k]);
+    for (int i = 0;i < system->equationc;i++)
+        free_term(system->rhs[i]);
+    free(system->coefficients);
+    free(system->rhs);
+    free(system->values);
+    free_sparse(system->matrix);
+    free(system);
+    return;
+}
+
+// floating point solution of a square numeric system by sparse LU, the
+// Markowitz pivot search keeps the fill low
+Term **
+solve_linear_sparse(LinearSystem *system)
+{
+    SparseLU *lu;
+    Term **solutions;
+    double *solution;
+
+    if (!system->is_numeric || system->equationc != system->variablec)
+        return NULL;
+
+    lu = sparse_lu(system->matrix, LINEAR_PIVOT_THRESHOLD);
+    if (lu == NULL)
+        return NULL;
+
+    solution = (double *) malloc(sizeof(double) * (system->variablec + 1));
+    sparse_lu_solve(lu, system->values, solution);
+
+    solutions = (Term **) malloc(sizeof(Term *) * (system->variablec + 1));
+    for (int i = 0;i < system->variablec;i++)
+        solutions[i] = literal(solution[i]);
+
+    free(solution);
+    free_sparse_lu(lu);
+
+    return solutions;
+}
+
+static long long
+greatest_common_divisor(long long lhs, long long rhs)
+{
+    lhs = llabs(lhs);
+    rhs = llabs(rhs);
+    while (rhs != 0) {
+        long long remainder = lhs % rhs;
+
+        lhs = rhs;
+        rhs = remainder;
+    }
+    return lhs;
+}
+
+// the checks keep every value within -LLONG_MAX .. LLONG_MAX, so llabs is safe
+static bool
+multiply_exactly(long long lhs, long long rhs, long long *product)
+{
+    if (lhs != 0 && llabs(rhs) > LLONG_MAX / llabs(lhs))
+        return false;
+    *product = lhs * rhs;
+    return true;
+}
+
+static bool
+add_exactly(long long lhs, long long rhs, long long *sum)
+{
+    if ((rhs > 0 && lhs > LLONG_MAX - rhs) || (rhs < 0 && lhs < -LLONG_MAX - rhs))
+        return false;
+    *sum = lhs + rhs;
+    return true;
+}
+
+// numerator / denominator in lowest terms, a denominator of 0 gives the
+// overflow mark
+static Fraction
+fraction(long long numerator, long long denominator)
+{
+    Fraction result = {1, 0};
+    long long divisor;
+
+    if (denominator == 0)
+        return result;
+    if (denominator < 0) {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+
+    divisor = greatest_common_divisor(numerator, denominator);
+    result.numerator = numerator / divisor;
+    result.denominator = denominator / divisor;
+    return result;
+}
+
+static bool
+is_zero_fraction(Fraction value)
+{
+    return value.numerator == 0 && value.denominator != 0;
+}
+
+static Fraction
+add_fractions(Fraction lhs, Fraction rhs)
+{
+    long long divisor, left, right, numerator, denominator;
+
+    if (lhs.denominator == 0 || rhs.denominator == 0)
+        return fraction(1, 0);
+
+    divisor = greatest_common_divisor(lhs.denominator, rhs.denominator);
+    if (!multiply_exactly(lhs.numerator, rhs.denominator / divisor, &left) ||
+            !multiply_exactly(rhs.numerator, lhs.denominator / divisor, &right) ||
+            !add_exactly(left, right, &numerator) ||
+            !multiply_exactly(lhs.denominator / divisor, rhs.denominator, &denominator))
+        return fraction(1, 0);
+
+    return fraction(numerator, denominator);
+}
+
+// factors common to a numerator and the other denominator are divided out
+// first, so that the products stay small
+static Fraction
+multiply_fractions(Fraction lhs, Fraction rhs)
+{
+    long long left, right, numerator, denominator;
+
+    if (lhs.denominator == 0 || rhs.denominator == 0)
+        return fraction(1, 0);
+    if (lhs.numerator == 0 || rhs.numerator == 0)
+        return fraction(0, 1);
+
+    left = greatest_common_divisor(lhs.numerator, rhs.denominator);
+    right = greatest_common_divisor(rhs.numerator, lhs.denominator);
+    if (!multiply_exactly(lhs.numerator / left, rhs.numerator / right, &numerator) ||
+            !multiply_exactly(lhs.denominator / right, rhs.denominator / left, &denominator))
+        return fraction(1, 0);
+
+    return fraction(numerator, denominator);
+}
+
+// rhs is not zero
+static Fraction
+divide_fractions(Fraction lhs, Fraction rhs)
+{
+    if (rhs.denominator == 0)
+        return fraction(1, 0);
+
+    return multiply_fractions(lhs, fraction(rhs.denominator, rhs.numerator));
+}
+
+// integral literals are read as they are, others as the fraction of
+// smallest denominator that rounds to them, so 0.1 is 1/10
+static bool
+fraction_of_literal(double value, Fraction *result)
+{
+    long long numerator, denominator;
+
+    if (!isfinite(value))
+        return false;
+
+    if (value == floor(value)) {
+        if (fabs(value) > LINEAR_EXACT_INTEGER)
+            return false;
+        *result = fraction((long long) value, 1);
+        return true;
+    }
+
+    if (!simplest_fraction(fabs(value), &numerator, &denominator))
+        return false;
+    *result = fraction(value < 0.0 ? -numerator : numerator, denominator);
+    return true;
+}
+
+// exact value of a term built from literals by +, *, additive_inverse,
+// multiple_inverse and integer powers, false for every other term and for
+// values that do not fit into a Fraction
+static bool
+fraction_of_term(Term *term, Fraction *result)
+{
+    Operator *temp_operator;
+    Fraction value;
+    double exponent;
+
+    if (strcmp(term->meaning, "literal") == 0)
+        return fraction_of_literal(((Literal *) term->content)->value, result);
+    if (strcmp(term->meaning, "operator") != 0)
+        return false;
+
+    temp_operator = term->content;
+    if (strcmp(temp_operator->name, "+") == 0 || strcmp(temp_operator->name, "*") == 0) {
+        bool is_sum = strcmp(temp_operator->name, "+") == 0;
+
+        *result = fraction(is_sum ? 0 : 1, 1);
+        for (int i = 0;i < temp_operator->argc;i++) {
+            if (!fraction_of_term(temp_operator->argv[i], &value))
+                return false;
+            *result = is_sum ? add_fractions(*result, value) : multiply_fractions(*result, value);
+        }
+        return result->denominator != 0;
+    }
+    if (strcmp(temp_operator->name, "additive_inverse") == 0) {
+        if (!fraction_of_term(temp_operator->argv[0], &value))
+            return false;
+        *result = fraction(-value.numerator, value.denominator);
+        return true;
+    }
+    if (strcmp(temp_operator->name, "multiple_inverse") == 0) {
+        if (!fraction_of_term(temp_operator->argv[0], &value) || value.numerator == 0)
+            return false;
+        *result = fraction(value.denominator, value.numerator);
+        return true;
+    }
+    if (strcmp(temp_operator->name, "^") == 0) {
+        if (strcmp(temp_operator->argv[1]->meaning, "literal") != 0)
+            return false;
+        exponent = ((Literal *) temp_operator->argv[1]->content)->value;
+        if (exponent != floor(exponent) || fabs(exponent) > LINEAR_EXPANDED_POWER)
+            return false;
+        if (!fraction_of_term(temp_operator->argv[0], &value))
+            return false;
+        if (exponent < 0.0) {
+            if (value.numerator == 0)
+                return false;
+            value = fraction(value.denominator, value.numerator);
+        }
+
+        *result = fraction(1, 1);
+        for (int i = 0;i < (int) fabs(exponent);i++)
+            *result = multiply_fractions(*result, value);
+        return result->denominator != 0;
+    }
+    return false;
+}
+
+static Multivariate *
+multivariate(void)
+{
+    Multivariate *polynomial = (Multivariate *) malloc(sizeof(Multivariate));
+
+    polynomial->length = 0;
+    polynomial->capacity = 0;
+    polynomial->coefficients = NULL;
+    polynomial->exponents = NULL;
+
+    return polynomial;
+}
+
+static void
+free_multivariate(Multivariate *polynomial)
+{
+    free(polynomial->coefficients);
+    free(polynomial->exponents);
+    free(polynomial);
+    return;
+}
+
+// exponents NULL is the monomial 1
+static void
+append_monomial(Multivariate *polynomial, int atomc, Fraction coefficient, int *exponents)
+{
+    if (polynomial->length == polynomial->capacity) {
+        polynomial->capacity = 2 * polynomial->capacity + 4;
+        polynomial->coefficients = (Fraction *) realloc(polynomial->coefficients,
+                sizeof(Fraction) * polynomial->capacity);
+        polynomial->exponents = (int *) realloc(polynomial->exponents,
+                sizeof(int) * (polynomial->capacity * atomc + 1));
+    }
+    polynomial->coefficients[polynomial->length] = coefficient;
+    for (int a = 0;a < atomc;a++)
+        polynomial->exponents[polynomial->length * atomc + a] = exponents != NULL ? exponents[a] : 0;
+    polynomial->length++;
+    return;
+}
+
+static Multivariate *
+constant_multivariate(Fraction value, int atomc)
+{
+    Multivariate *polynomial = multivariate();
+
+    if (!is_zero_fraction(value))
+        append_monomial(polynomial, atomc, value, NULL);
+    return polynomial;
+}
+
+static bool
+is_constant_multivariate(Multivariate *polynomial, int atomc)
+{
+    if (polynomial->length != 1)
+        return polynomial->length == 0;
+    for (int a = 0;a < atomc;a++)
+        if (polynomial->exponents[a] != 0)
+            return false;
+    return true;
+}
+
+static bool
+is_overflowed_multivariate(Multivariate *polynomial)
+{
+    for (int k = 0;k < polynomial->length;k++)
+        if (polynomial->coefficients[k].denominator == 0)
+            return true;
+    return false;
+}
+
+// lexicographic order of the exponents
+static int
+compare_monomials(int *lhs, int *rhs, int atomc)
+{
+    for (int a = 0;a < atomc;a++)
+        if (lhs[a] != rhs[a])
+            return lhs[a] > rhs[a] ? 1 : -1;
+    return 0;
+}
+
+// lhs + rhs, or lhs - rhs if is_subtracted, by merging the sorted monomials
+static Multivariate *
+combine_multivariate(Multivariate *lhs, Multivariate *rhs, bool is_subtracted, int atomc)
+{
+    Multivariate *result = multivariate();
+    int i = 0, j = 0;
+
+    while (i < lhs->length || j < rhs->length) {
+        Fraction right;
+        int order;
+
+        if (i == lhs->length)
+            order = -1;
+        else if (j == rhs->length)
+            order = 1;
+        else
+            order = compare_monomials(&lhs->exponents[i * atomc], &rhs->exponents[j * atomc], atomc);
+
+        if (order > 0) {
+            append_monomial(result, atomc, lhs->coefficients[i], &lhs->exponents[i * atomc]);
+            i++;
+            continue;
+        }
+
+        right = rhs->coefficients[j];
+        if (is_subtracted)
+            right.numerator = -right.numerator;
+
+        if (order < 0) {
+            append_monomial(result, atomc, right, &rhs->exponents[j * atomc]);
+        } else {
+            Fraction sum = add_fractions(lhs->coefficients[i], right);
+
+            if (!is_zero_fraction(sum))
+                append_monomial(result, atomc, sum, &lhs->exponents[i * atomc]);
+            i++;
+        }
+        j++;
+    }
+    return result;
+}
+
+// polynomial times coefficient atoms^exponents, which keeps the order
+static Multivariate *
+scale_multivariate(Multivariate *polynomial, Fraction coefficient, int *exponents, int atomc)
+{
+    Multivariate *result = multivariate();
+    int *monomial = (int *) malloc(sizeof(int) * (atomc + 1));
+
+    for (int k = 0;k < polynomial->length;k++) {
+        for (int a = 0;a < atomc;a++)
+            monomial[a] = polynomial->exponents[k * atomc + a] + (exponents != NULL ? exponents[a] : 0);
+        append_monomial(result, atomc, multiply_fractions(coefficient, polynomial->coefficients[k]), monomial);
+    }
+
+    free(monomial);
+    return result;
+}
+
+static Multivariate *
+multiply_multivariate(Multivariate *lhs, Multivariate *rhs, int atomc)
+{
+    Multivariate *result = multivariate();
+
+    for (int k = 0;k < lhs->length;k++) {
+        Multivariate *product = scale_multivariate(rhs, lhs->coefficients[k], &lhs->exponents[k * atomc], atomc);
+        Multivariate *sum = combine_multivariate(result, product, false, atomc);
+
+        free_multivariate(result);
+        free_multivariate(product);
+        result = sum;
+    }
+    return result;
+}
+
+static void
+drop_leading_monomial(Multivariate *polynomial, int atomc)
+{
+    polynomial->length--;
+    memmove(polynomial->coefficients, polynomial->coefficients + 1, sizeof(Fraction) * polynomial->length);
+    memmove(polynomial->exponents, polynomial->exponents + atomc, sizeof(int) * polynomial->length * atomc);
+    return;
+}
+
+// lhs / rhs for a nonzero rhs, NULL if rhs does not divide lhs or a
+// coefficient overflows. The leading monomials of the quotient decrease
+// like those of the remainder, so it comes out sorted.
+static Multivariate *
+divide_multivariate(Multivariate *lhs, Multivariate *rhs, int atomc)
+{
+    Multivariate *quotient = multivariate();
+    Multivariate *remainder = scale_multivariate(lhs, fraction(1, 1), NULL, atomc);
+    int *monomial = (int *) malloc(sizeof(int) * (atomc + 1));
+    bool is_exact = !is_overflowed_multivariate(lhs) && !is_overflowed_multivariate(rhs);
+
+    while (remainder->length > 0 && is_exact) {
+        Multivariate *product, *difference;
+        Fraction coefficient;
+
+        for (int a = 0;a < atomc;a++) {
+            monomial[a] = remainder->exponents[a] - rhs->exponents[a];
+            if (monomial[a] < 0)
+                is_exact = false;
+        }
+        if (!is_exact)
+            break;
+
+        coefficient = divide_fractions(remainder->coefficients[0], rhs->coefficients[0]);
+        if (coefficient.denominator == 0) {
+            is_exact = false;
+            break;
+        }
+        append_monomial(quotient, atomc, coefficient, monomial);
+
+        // the leading monomials cancel by construction
+        product = scale_multivariate(rhs, coefficient, monomial, atomc);
+        drop_leading_monomial(product, atomc);
+        drop_leading_monomial(remainder, atomc);
+        difference = combine_multivariate(remainder, product, true, atomc);
+        free_multivariate(remainder);
+        free_multivariate(product);
+        remainder = difference;
+        if (is_overflowed_multivariate(remainder))
+            is_exact = false;
+    }
+
+    free(monomial);
+    free_multivariate(remainder);
+    if (is_exact && !is_overflowed_multivariate(quotient))
+        return quotient;
+
+    free_multivariate(quotient);
+    return NULL;
+}
+
+// exponent of a power that is expanded, -1 for every other term
+static int
+expanded_exponent(Term *term)
+{
+    Operator *temp_operator = is_operator(term, "^");
+    double value;
+
+    if (temp_operator == NULL || strcmp(temp_operator->argv[1]->meaning, "literal") != 0)
+        return -1;
+
+    value = ((Literal *) temp_operator->argv[1]->content)->value;
+    if (value < 0.0 || value > LINEAR_EXPANDED_POWER || value != floor(value))
+        return -1;
+    return (int) value;
+}
+
+static bool
+is_expanded_operator(Term *term)
+{
+    return is_operator(term, "+") != NULL || is_operator(term, "*") != NULL ||
+        is_operator(term, "additive_inverse") != NULL;
+}
+
+static int
+find_atom(Atoms *atoms, Term *term)
+{
+    for (int a = 0;a < atoms->atomc;a++)
+        if (is_equal(atoms->atoms[a], term))
+            return a;
+    return -1;
+}
+
+static void
+collect_atoms(Term *term, Atoms *atoms)
+{
+    Fraction value;
+
+    if (fraction_of_term(term, &value))
+        return;
+
+    if (is_expanded_operator(term)) {
+        Operator *temp_operator = term->content;
+
+        for (int i = 0;i < temp_operator->argc;i++)
+            collect_atoms(temp_operator->argv[i], atoms);
+        return;
+    }
+    if (expanded_exponent(term) >= 0) {
+        collect_atoms(((Operator *) term->content)->argv[0], atoms);
+        return;
+    }
+
+    if (find_atom(atoms, term) >= 0)
+        return;
+    if (atoms->atomc == atoms->capacity) {
+        atoms->capacity = 2 * atoms->capacity + 4;
+        atoms->atoms = (Term **) realloc(atoms->atoms, sizeof(Term *) * atoms->capacity);
+    }
+    atoms->atoms[atoms->atomc++] = term;
+    return;
+}
+
+// term expanded in atoms, which holds every atom of term
+static Multivariate *
+multivariate_of_term(Term *term, Atoms *atoms)
+{
+    Multivariate *result, *factor, *product;
+    Operator *temp_operator;
+    Fraction value;
+    int atomc = atoms->atomc, exponent;
+
+    if (fraction_of_term(term, &value))
+        return constant_multivariate(value, atomc);
+
+    if ((temp_operator = is_operator(term, "+")) != NULL) {
+        result = multivariate();
+        for (int i = 0;i < temp_operator->argc;i++) {
+            Multivariate *summand = multivariate_of_term(temp_operator->argv[i], atoms);
+            Multivariate *sum = combine_multivariate(result, summand, false, atomc);
+
+            free_multivariate(result);
+            free_multivariate(summand);
+            result = sum;
+        }
+        return result;
+    }
+
+    if ((temp_operator = is_operator(term, "*")) != NULL) {
+        result = constant_multivariate(fraction(1, 1), atomc);
+        for (int i = 0;i < temp_operator->argc;i++) {
+            factor = multivariate_of_term(temp_operator->argv[i], atoms);
+            product = multiply_multivariate(result, factor, atomc);
+            free_multivariate(result);
+            free_multivariate(factor);
+            result = product;
+        }
+        return result;
+    }
+
+    if ((temp_operator = is_operator(term, "additive_inverse")) != NULL) {
+        factor = multivariate_of_term(temp_operator->argv[0], atoms);
+        result = scale_multivariate(factor, fraction(-1, 1), NULL, atomc);
+        free_multivariate(factor);
+        return result;
+    }
+
+    if ((exponent = expanded_exponent(term)) >= 0) {
+        factor = multivariate_of_term(((Operator *) term->content)->argv[0], atoms);
+        result = constant_multivariate(fraction(1, 1), atomc);
+        for (int i = 0;i < exponent;i++) {
+            product = multiply_multivariate(result, factor, atomc);
+            free_multivariate(result);
+            result = product;
+        }
+        free_multivariate(factor);
+        return result;
+    }
+
+    result = multivariate();
+    append_monomial(result, atomc, fraction(1, 1), NULL);
+    result->exponents[find_atom(atoms, term)] = 1;
+    return result;
+}
+
+// |numerator| / denominator as a factor, NULL for 1
+static Term *
+term_of_fraction(Fraction value)
+{
+    long long numerator = llabs(value.numerator);
+
+    if (value.denominator == 1)
+        return numerator == 1 ? NULL : literal((double) numerator);
+    if (numerator == 1)
+        return multiple_inverse(literal((double) value.denominator));
+
+    return multiply(literal((double) numerator), multiple_inverse(literal((double) value.denominator)));
+}
+
+// sum of the monomials of polynomial, each one multiplied by a copy of
+// factor unless it is NULL. The simplifier does not tidy up the products
+// it gets from distributing a factor over a sum, so it is done here.
+static Term *
+term_of_multivariate(Multivariate *polynomial, Atoms *atoms, Term *factor)
+{
+    TermBuilder sum;
+
+    begin_operator(&sum, "+", polynomial->length);
+    for (int k = 0;k < polynomial->length;k++) {
+        Fraction coefficient = polynomial->coefficients[k];
+        Term *number = term_of_fraction(coefficient);
+        TermBuilder product;
+        Term *monomial;
+
+        begin_operator(&product, "*", atoms->atomc + 2);
+        if (number != NULL)
+            push_argument(&product, number);
+        for (int a = 0;a < atoms->atomc;a++) {
+            int exponent = polynomial->exponents[k * atoms->atomc + a];
+
+            if (exponent == 1)
+                push_copy(&product, atoms->atoms[a]);
+            else if (exponent > 1)
+                push_argument(&product, power(copy_term(atoms->atoms[a]), literal((double) exponent)));
+        }
+        if (factor != NULL)
+            push_copy(&product, factor);
+
+        monomial = finish_operator(&product);
+        push_argument(&sum, coefficient.numerator < 0 ? additive_inverse(monomial) : monomial);
+    }
+    return finish_operator(&sum);
+}
+
+// numerator / denominator, simplified. Both are divided by the leading
+// coefficient of the denominator, so a number is divided out and
+// otherwise the denominator is monic.
+static Term *
+quotient_term(Multivariate *numerator, Multivariate *denominator, Atoms *atoms)
+{
+    Fraction scale = divide_fractions(fraction(1, 1), denominator->coefficients[0]);
+    Multivariate *scaled;
+    Term *inverse = NULL, *result;
+
+    if (!is_constant_multivariate(denominator, atoms->atomc)) {
+        scaled = scale_multivariate(denominator, scale, NULL, atoms->atomc);
+        inverse = multiple_inverse(term_of_multivariate(scaled, atoms, NULL));
+        free_multivariate(scaled);
+    }
+
+    scaled = scale_multivariate(numerator, scale, NULL, atoms->atomc);
+    result = term_of_multivariate(scaled, atoms, inverse);
+    free_multivariate(scaled);
+    if (inverse != NULL)
+        free_term(inverse);
+
+    return simplify(result);
+}
+
+// enclosure of polynomial when every atom lies in bounds[a]
+static Interval
+interval_of_multivariate(Multivariate *polynomial, Interval *bounds, int atomc)
+{
+    Interval result = interval(0.0, 0.0);
+
+    for (int k = 0;k < polynomial->length;k++) {
+        Fraction coefficient = polynomial->coefficients[k];
+        Interval monomial = interval_multiply(interval(coefficient.numerator, coefficient.numerator),
+                interval_multiple_inverse(interval(coefficient.denominator, coefficient.denominator)));
+
+        for (int a = 0;a < atomc;a++) {
+            int exponent = polynomial->exponents[k * atomc + a];
+
+            if (exponent != 0)
+                monomial = interval_multiply(monomial, interval_power(bounds[a], interval(exponent, exponent)));
+        }
+        result = interval_add(result, monomial);
+    }
+
+    return result;
+}
+
+// exact solution of a square system by fraction-free (Bareiss)
+// elimination. Coefficients are expanded into polynomials with rational
+// coefficients in their atoms, and every step divides exactly by the
+// previous pivot, so integer coefficients stay integers and symbolic ones
+// stay polynomials. The last pivot is the determinant d, back
+// substitution finds the numerators n_i of x_i = n_i / d, which are
+// polynomials as well. Returns NULL if the system is singular or a
+// coefficient outgrows long long. The elimination is dense and meant for
+// small systems. is_singular tells the two failures apart.
+static Term **
+bareiss(LinearSystem *system, bool *is_singular)
+{
+    int size = system->variablec, atomc;
+    Multivariate ***matrix, **numerators, *first, *previous;
+    Atoms atoms = {0, 0, NULL};
+    Interval *bounds;
+    Term **solutions = NULL;
+    bool is_failed = false;
+
+    *is_singular = false;
+    if (system->equationc != size)
+        return NULL;
+
+    for (int k = 0;k < system->matrix->nonzeroc;k++)
+        collect_atoms(system->coefficients[k], &atoms);
+    for (int i = 0;i < size;i++)
+        collect_atoms(system->rhs[i], &atoms);
+    atomc = atoms.atomc;
+
+    // constants range over their limits, every other atom is unbounded
+    bounds = (Interval *) malloc(sizeof(Interval) * (atomc + 1));
+    for (int a = 0;a < atomc;a++)
+        bounds[a] = interval_of_term(atoms.atoms[a], 0, NULL, NULL);
+
+    // augmented dense matrix
+    matrix = (Multivariate ***) malloc(sizeof(Multivariate **) * (size + 1));
+    for (int i = 0;i < size;i++) {
+        matrix[i] = (Multivariate **) malloc(sizeof(Multivariate *) * (size + 1));
+        for (int j = 0;j < size;j++)
+            matrix[i][j] = NULL;
+        for (int k = system->matrix->rows[i];k < system->matrix->rows[i + 1];k++)
+            matrix[i][system->matrix->columns[k]] = multivariate_of_term(system->coefficients[k], &atoms);
+        for (int j = 0;j < size;j++)
+            if (matrix[i][j] == NULL)
+                matrix[i][j] = multivariate();
+        matrix[i][size] = multivariate_of_term(system->rhs[i], &atoms);
+    }
+
+    first = constant_multivariate(fraction(1, 1), atomc);
+    previous = first;
+    for (int k = 0;k < size && !is_failed;k++) {
+        int pivot = k;
+
+        while (pivot < size && matrix[pivot][k]->length == 0)
+            pivot++;
+        if (pivot == size) {
+            *is_singular = true;
+            is_failed = true;
+            break;
+        }
+
+        // a symbolic pivot may vanish for some values of its constants,
+        // prefer one that is nonzero on all of their limits
+        for (int i = pivot;i < size;i++) {
+            if (matrix[i][k]->length == 0)
+                continue;
+            if (excludes_zero(interval_of_multivariate(matrix[i][k], bounds, atomc))) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot != k) {
+            Multivariate **temp = matrix[k];
+
+            matrix[k] = matrix[pivot];
+            matrix[pivot] = temp;
+        }
+
+        for (int i = k + 1;i < size && !is_failed;i++) {
+            for (int j = k + 1;j <= size && !is_failed;j++) {
+                Multivariate *lhs = multiply_multivariate(matrix[k][k], matrix[i][j], atomc);
+                Multivariate *rhs = multiply_multivariate(matrix[i][k], matrix[k][j], atomc);
+                Multivariate *difference = combine_multivariate(lhs, rhs, true, atomc);
+                Multivariate *quotient = divide_multivariate(difference, previous, atomc);
+
+                free_multivariate(lhs);
+                free_multivariate(rhs);
+                free_multivariate(difference);
+                if (quotient == NULL) {
+                    is_failed = true;
+                    break;
+                }
+                free_multivariate(matrix[i][j]);
+                matrix[i][j] = quotient;
+            }
+            free_multivariate(matrix[i][k]);
+            matrix[i][k] = multivariate();
+        }
+        previous = matrix[k][k];
+    }
+
+    if (!is_failed) {
+        numerators = (Multivariate **) malloc(sizeof(Multivariate *) * (size + 1));
+
+        for (int i = size - 1;i >= 0;i--) {
+            Multivariate *sum;
+
+            numerators[i] = NULL;
+            if (is_failed)
+                continue;
+
+            sum = multiply_multivariate(previous, matrix[i][size], atomc);
+
+            for (int j = i + 1;j < size;j++) {
+                Multivariate *product = multiply_multivariate(matrix[i][j], numerators[j], atomc);
+                Multivariate *difference = combine_multivariate(sum, product, true, atomc);
+
+                free_multivariate(sum);
+                free_multivariate(product);
+                sum = difference;
+            }
+            numerators[i] = divide_multivariate(sum, matrix[i][i], atomc);
+            free_multivariate(sum);
+            if (numerators[i] == NULL)
+                is_failed = true;
+        }
+
+        if (!is_failed) {
+            solutions = (Term **) malloc(sizeof(Term *) * (size + 1));
+            for (int i = 0;i < size;i++)
+                solutions[i] = quotient_term(numerators[i], previous, &atoms);
+        }
+        for (int i = 0;i < size;i++)
+            if (numerators[i] != NULL)
+                free_multivariate(numerators[i]);
+        free(numerators);
+    }
+
+    for (int i = 0;i < size;i++) {
+        for (int j = 0;j <= size;j++)
+            free_multivariate(matrix[i][j]);
+        free(matrix[i]);
+    }
+    free(matrix);
+    free_multivariate(first);
+    free(bounds);
+    free(atoms.atoms);
+
+    return solutions;
+}
+
+Term **
+solve_linear_bareiss(LinearSystem *system)
+{
+    bool is_singular;
+
+    return bareiss(system, &is_singular);
+}
+
+// every coefficient and right hand side is a rational number
+static bool
+is_rational_system(LinearSystem *system)
+{
+    Fraction value;
+
+    for (int k = 0;k < system->matrix->nonzeroc;k++)
+        if (!fraction_of_term(system->coefficients[k], &value))
+            return false;
+    for (int i = 0;i < system->equationc;i++)
+        if (!fraction_of_term(system->rhs[i], &value))
+            return false;
+    return true;
+}
+
+// solutions of a square linear system, one term per variable, or NULL if
+// the system is not linear or singular. Symbolic systems and small ones
+// with rational coefficients are solved exactly by Bareiss elimination,
+// the others by sparse LU. A rational system whose coefficients outgrow
+// long long falls back to sparse LU as well.
+Term **
+solve_linear(int equationc, Term **equations, int variablec, Term **variables)
+{
+    LinearSystem *system = linear_system(equationc, equations, variablec, variables);
+    Term **solutions = NULL;
+    bool is_singular = false;
+
+    if (system == NULL)
+        return NULL;
+
+    if (!system->is_numeric || (variablec <= LINEAR_EXACT_SIZE && is_rational_system(system)))
+        solutions = bareiss(system, &is_singular);
+    if (solutions == NULL && system->is_numeric && !is_singular)
+        solutions = solve_linear_sparse(system);
+
+    free_linear_system(system);
+
+    return solutions;
+}
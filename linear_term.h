@@ -0,0 +1,26 @@
+#ifndef LINEAR_TERM_H_
+#define LINEAR_TERM_H_
+
+typedef struct LinearSystem LinearSystem;
+
+// equations as matrix x = rhs, coefficients[k] is the term of the entry
+// at matrix->columns[k]. If every coefficient and right hand side is a
+// number, is_numeric is set and matrix->values and values hold them.
+struct LinearSystem {
+    int equationc;
+    int variablec;
+    Sparse *matrix;
+    Term **coefficients;
+    Term **rhs;
+    double *values;
+    bool is_numeric;
+};
+
+LinearSystem *linear_system(int equationc, Term **equations, int variablec, Term **variables);
+void free_linear_system(LinearSystem *system);
+
+Term **solve_linear_sparse(LinearSystem *system);
+Term **solve_linear_bareiss(LinearSystem *system);
+Term **solve_linear(int equationc, Term **equations, int variablec, Term **variables);
+
+#endif // LINEAR_TERM_H_
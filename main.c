@@ -1,6 +1,13 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "term.h"
-#include "simplify_term.h"
+#include "memory_term.h"
+#include "format_term.h"
+#include "compile_term.h"
+#include "egraph_term.h"
+#include "stream_term.h"
 
 // 1. TODO: polinomial factoring
 // 2. TODO: Integral
@@ -40,20 +47,105 @@
 // I .......... integral .............. {term, term [, term, term]} (term, variable [, term, term])
 // = .......... equal ................. {term, term}
 
-int main()
+static void
+usage(char *name)
 {
-    Term *l = literal(3.0);
-    Term *x = variable("x");
+    fprintf(stderr, "usage: %s [-j threads] [-q capacity] [-u] [-s] [-f format] [-c cache] [-m megabytes] [-o cost] [file ...]\n", name);
+    fprintf(stderr, "  simplifies one term per line from the files or stdin\n");
+    fprintf(stderr, "  -j  simplifying threads, one per processor by default\n");
+    fprintf(stderr, "  -q  capacity of the queues between the stages\n");
+    fprintf(stderr, "  -u  write results as they finish instead of in input order\n");
+    fprintf(stderr, "  -s  print throughput and latency to stderr\n");
+    fprintf(stderr, "  -f  infix (default), latex or sexpr\n");
+    fprintf(stderr, "  -c  file caching simplified terms across runs and processes\n");
+    fprintf(stderr, "  -m  size limit of the cache file, unlimited by default\n");
+    fprintf(stderr, "  -o  nodes or flops, rewrites results to their cheapest form by this cost\n");
+    fprintf(stderr, "  %s=1 reports term memory still alive at exit\n", MEMORY_ENVIRONMENT);
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    StreamOptions options = {0, STREAM_QUEUE, true, FORMAT_INFIX, NULL, 0, NULL};
+    StreamStatistics statistics;
+    bool is_summary = false, is_success;
+    FILE **inputs;
+    int inputc, option;
+
+    while ((option = getopt(argc, argv, "j:q:usf:c:m:o:h")) != -1) {
+        switch (option) {
+        case 'j':
+            options.threadc = atoi(optarg);
+            break;
+        case 'q':
+            options.capacity = atoi(optarg);
+            break;
+        case 'u':
+            options.is_ordered = false;
+            break;
+        case 's':
+            is_summary = true;
+            break;
+        case 'f':
+            if (strcmp(optarg, "infix") == 0) {
+                options.format = FORMAT_INFIX;
+            } else if (strcmp(optarg, "latex") == 0) {
+                options.format = FORMAT_LATEX;
+            } else if (strcmp(optarg, "sexpr") == 0) {
+                options.format = FORMAT_SEXPR;
+            } else {
+                usage(argv[0]);
+                return 0x01;
+            }
+            break;
+        case 'c':
+            options.cache_path = optarg;
+            break;
+        case 'm':
+            options.cache_limit = (size_t) atol(optarg) << 20;
+            break;
+        case 'o':
+            if (strcmp(optarg, "nodes") == 0) {
+                options.cost = count_node;
+            } else if (strcmp(optarg, "flops") == 0) {
+                options.cost = count_flops;
+            } else {
+                usage(argv[0]);
+                return 0x01;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0x00 : 0x01;
+        }
+    }
+
+    inputc = argc - optind;
+    inputs = (FILE **) malloc(sizeof(FILE *) * (inputc > 0 ? inputc : 1));
+    if (inputc == 0) {
+        inputs[0] = stdin;
+        inputc = 1;
+    } else {
+        for (int i = 0;i < inputc;i++) {
+            char *name = argv[optind + i];
+
+            inputs[i] = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+            if (inputs[i] == NULL) {
+                fprintf(stderr, "%s: cannot open %s\n", argv[0], name);
+                return 0x01;
+            }
+        }
+    }
 
-    print_term(l);
-    printf("\n");
+    is_success = process_stream(inputc, inputs, &options, &statistics);
 
-    print_term(x);
-    printf("\n");
+    if (is_summary)
+        print_stream_statistics(stderr, &statistics);
 
-    Term *t = multiply(l, x);
+    for (int i = 0;i < inputc;i++)
+        if (inputs[i] != stdin)
+            fclose(inputs[i]);
+    free(inputs);
 
-    print_term(simplify(t));
-    printf("\n");
-    return 0x00;
+    return is_success ? 0x00 : 0x01;
 }
@@ -0,0 +1,554 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "term.h"
+#include "memory_term.h"
+
+typedef struct Block Block;
+typedef struct Tracker Tracker;
+typedef struct Chunk Chunk;
+
+// in front of every tracked allocation, two words keep the payload aligned
+// for doubles
+struct Block {
+    size_t size;
+    long site;
+};
+
+// in front of every arena allocation, the size lets reallocate copy
+struct Chunk {
+    size_t size;
+};
+
+// data follows the header, an ArenaBlock is as large as a Block so it is
+// aligned for doubles as well
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+};
+
+// sites are found through an open addressed table on file and line
+struct Tracker {
+    pthread_mutex_t mutex;
+
+    long live;
+    long bytes;
+    long peak_bytes;
+    long allocations;
+    long releases;
+
+    int sitec;
+    int site_capacity;
+    AllocationSite *sites;
+
+    int table_capacity;
+    int *table;
+};
+
+static void *
+system_allocate(void *context, size_t size, const char *file, int line)
+{
+    (void) context;
+    (void) file;
+    (void) line;
+    return malloc(size);
+}
+
+static void *
+system_reallocate(void *context, void *pointer, size_t size, const char *file, int line)
+{
+    (void) context;
+    (void) file;
+    (void) line;
+    return realloc(pointer, size);
+}
+
+static void
+system_release(void *context, void *pointer)
+{
+    (void) context;
+    free(pointer);
+    return;
+}
+
+static unsigned long long
+hash_site(const char *file, int line)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for (const char *c = file;*c != '\0';c++)
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+    hash = (hash ^ (unsigned long long) line) * 1099511628211ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+static void
+grow_sites(Tracker *tracker)
+{
+    int capacity = tracker->table_capacity > 0 ? tracker->table_capacity * 2 : 256;
+    int *table = (int *) malloc(sizeof(int) * capacity);
+
+    for (int i = 0;i < capacity;i++)
+        table[i] = -1;
+
+    for (int i = 0;i < tracker->sitec;i++) {
+        AllocationSite *site = &tracker->sites[i];
+        int slot = (int) (hash_site(site->file, site->line) & (unsigned long long) (capacity - 1));
+
+        while (table[slot] != -1)
+            slot = (slot + 1) & (capacity - 1);
+        table[slot] = i;
+    }
+
+    free(tracker->table);
+    tracker->table = table;
+    tracker->table_capacity = capacity;
+    return;
+}
+
+// index of the site of file and line, created on first use. Called with
+// the mutex held.
+static int
+find_site(Tracker *tracker, const char *file, int line)
+{
+    int slot;
+
+    if (2 * (tracker->sitec + 1) > tracker->table_capacity)
+        grow_sites(tracker);
+
+    slot = (int) (hash_site(file, line) & (unsigned long long) (tracker->table_capacity - 1));
+    while (tracker->table[slot] != -1) {
+        AllocationSite *site = &tracker->sites[tracker->table[slot]];
+
+        if (site->line == line && (site->file == file || strcmp(site->file, file) == 0))
+            return tracker->table[slot];
+        slot = (slot + 1) & (tracker->table_capacity - 1);
+    }
+
+    if (tracker->sitec == tracker->site_capacity) {
+        tracker->site_capacity = tracker->site_capacity > 0 ? tracker->site_capacity * 2 : 64;
+        tracker->sites = (AllocationSite *) realloc(tracker->sites,
+                sizeof(AllocationSite) * tracker->site_capacity);
+    }
+
+    tracker->sites[tracker->sitec].file = file;
+    tracker->sites[tracker->sitec].line = line;
+    tracker->sites[tracker->sitec].live = 0;
+    tracker->sites[tracker->sitec].bytes = 0;
+    tracker->sites[tracker->sitec].allocations = 0;
+    tracker->table[slot] = tracker->sitec;
+
+    return tracker->sitec++;
+}
+
+static void
+count_allocation(Tracker *tracker, Block *block, const char *file, int line)
+{
+    AllocationSite *site;
+
+    pthread_mutex_lock(&tracker->mutex);
+    block->site = find_site(tracker, file, line);
+    site = &tracker->sites[block->site];
+    site->live++;
+    site->bytes += (long) block->size;
+    site->allocations++;
+
+    tracker->live++;
+    tracker->bytes += (long) block->size;
+    tracker->allocations++;
+    if (tracker->bytes > tracker->peak_bytes)
+        tracker->peak_bytes = tracker->bytes;
+    pthread_mutex_unlock(&tracker->mutex);
+    return;
+}
+
+static void
+count_release(Tracker *tracker, Block *block)
+{
+    AllocationSite *site;
+
+    pthread_mutex_lock(&tracker->mutex);
+    site = &tracker->sites[block->site];
+    site->live--;
+    site->bytes -= (long) block->size;
+
+    tracker->live--;
+    tracker->bytes -= (long) block->size;
+    tracker->releases++;
+    pthread_mutex_unlock(&tracker->mutex);
+    return;
+}
+
+static void *
+track_allocate(void *context, size_t size, const char *file, int line)
+{
+    Block *block = (Block *) malloc(sizeof(Block) + size);
+
+    if (block == NULL)
+        return NULL;
+
+    block->size = size;
+    count_allocation(context, block, file, line);
+
+    return block + 1;
+}
+
+static void
+track_release(void *context, void *pointer)
+{
+    Block *block;
+
+    if (pointer == NULL)
+        return;
+
+    block = (Block *) pointer - 1;
+    count_release(context, block);
+    free(block);
+    return;
+}
+
+// a moved block is counted as released at its old site and allocated at
+// the new one
+static void *
+track_reallocate(void *context, void *pointer, size_t size, const char *file, int line)
+{
+    Block *block;
+
+    if (pointer == NULL)
+        return track_allocate(context, size, file, line);
+
+    block = (Block *) pointer - 1;
+    count_release(context, block);
+    block = (Block *) realloc(block, sizeof(Block) + size);
+    if (block == NULL)
+        return NULL;
+
+    block->size = size;
+    count_allocation(context, block, file, line);
+
+    return block + 1;
+}
+
+// sizes are rounded up to keep the chunks aligned for doubles
+static size_t
+chunk_size(size_t size)
+{
+    return sizeof(Chunk) + ((size + sizeof(double) - 1) & ~(sizeof(double) - 1));
+}
+
+static ArenaBlock *
+arena_block(size_t size)
+{
+    ArenaBlock *block = (ArenaBlock *) malloc(sizeof(ArenaBlock) + size);
+
+    if (block == NULL)
+        return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    return block;
+}
+
+static void
+free_arena_blocks(ArenaBlock *block)
+{
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+
+        free(block);
+        block = next;
+    }
+    return;
+}
+
+static void
+enter_block(Arena *arena, ArenaBlock *block)
+{
+    arena->block = block;
+    arena->next = (char *) (block + 1);
+    arena->end = arena->next + block->size;
+    return;
+}
+
+// the next block of the chain, kept from before the last reset or new
+static bool
+next_block(Arena *arena)
+{
+    if (arena->block->next == NULL) {
+        ArenaBlock *block = arena_block(ARENA_BLOCK);
+
+        if (block == NULL)
+            return false;
+        arena->block->next = block;
+    }
+
+    enter_block(arena, arena->block->next);
+    return true;
+}
+
+static void *
+arena_allocate(void *context, size_t size, const char *file, int line)
+{
+    Arena *arena = context;
+    size_t needed = chunk_size(size);
+    Chunk *chunk;
+
+    (void) file;
+    (void) line;
+
+    if (needed > ARENA_BLOCK / 4) {
+        ArenaBlock *block = arena_block(needed);
+
+        if (block == NULL)
+            return NULL;
+        block->next = arena->large;
+        arena->large = block;
+        chunk = (Chunk *) (block + 1);
+    } else {
+        if ((size_t) (arena->end - arena->next) < needed && !next_block(arena))
+            return NULL;
+        chunk = (Chunk *) arena->next;
+        arena->next += needed;
+    }
+
+    arena->allocations++;
+    arena->bytes += (long) size;
+    chunk->size = size;
+    return chunk + 1;
+}
+
+// the last chunk of the block grows in place, others are copied
+static void *
+arena_reallocate(void *context, void *pointer, size_t size, const char *file, int line)
+{
+    Arena *arena = context;
+    Chunk *chunk;
+    void *result;
+
+    if (pointer == NULL)
+        return arena_allocate(context, size, file, line);
+
+    chunk = (Chunk *) pointer - 1;
+    if ((char *) chunk + chunk_size(chunk->size) == arena->next
+            && chunk_size(size) <= (size_t) (arena->end - (char *) chunk)) {
+        arena->bytes += (long) size - (long) chunk->size;
+        arena->next = (char *) chunk + chunk_size(size);
+        chunk->size = size;
+        return pointer;
+    }
+
+    result = arena_allocate(context, size, file, line);
+    if (result != NULL)
+        memcpy(result, pointer, chunk->size < size ? chunk->size : size);
+    return result;
+}
+
+static void
+arena_release(void *context, void *pointer)
+{
+    (void) context;
+    (void) pointer;
+    return;
+}
+
+Arena *
+arena(void)
+{
+    Arena *arena = (Arena *) malloc(sizeof(Arena));
+
+    arena->allocator.allocate_memory = arena_allocate;
+    arena->allocator.reallocate_memory = arena_reallocate;
+    arena->allocator.release_memory = arena_release;
+    arena->allocator.context = arena;
+
+    arena->blocks = arena_block(ARENA_BLOCK);
+    arena->large = NULL;
+    enter_block(arena, arena->blocks);
+
+    arena->allocations = 0;
+    arena->bytes = 0;
+
+    return arena;
+}
+
+Allocator *
+arena_allocator(Arena *arena)
+{
+    return &arena->allocator;
+}
+
+void
+reset_arena(Arena *arena)
+{
+    free_arena_blocks(arena->large);
+    arena->large = NULL;
+    enter_block(arena, arena->blocks);
+
+    arena->allocations = 0;
+    arena->bytes = 0;
+    return;
+}
+
+void
+free_arena(Arena *arena)
+{
+    free_arena_blocks(arena->blocks);
+    free_arena_blocks(arena->large);
+    free(arena);
+    return;
+}
+
+static Allocator system_allocator = {system_allocate, system_reallocate, system_release, NULL};
+
+static Tracker tracker = {PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, 0, 0, 0, NULL, 0, NULL};
+static Allocator tracking_allocator = {track_allocate, track_reallocate, track_release, &tracker};
+
+// the allocator of a thread that did not set one, chosen once for the
+// process. A thread that sets an allocator keeps it under allocator_key.
+static Allocator *default_allocator = &system_allocator;
+static pthread_key_t allocator_key;
+static pthread_once_t allocator_once = PTHREAD_ONCE_INIT;
+
+// the environment is read once, at the first allocation of the process
+static void
+initialize_allocator(void)
+{
+    const char *value = getenv(MEMORY_ENVIRONMENT);
+
+    pthread_key_create(&allocator_key, NULL);
+    if (value != NULL && value[0] != '\0' && strcmp(value, "0") != 0)
+        track_allocations();
+    return;
+}
+
+static Allocator *
+get_allocator(void)
+{
+    Allocator *allocator;
+
+    pthread_once(&allocator_once, initialize_allocator);
+    allocator = pthread_getspecific(allocator_key);
+
+    return allocator != NULL ? allocator : default_allocator;
+}
+
+void *
+allocate_at(size_t size, const char *file, int line)
+{
+    Allocator *allocator = get_allocator();
+
+    return allocator->allocate_memory(allocator->context, size, file, line);
+}
+
+void *
+reallocate_at(void *pointer, size_t size, const char *file, int line)
+{
+    Allocator *allocator = get_allocator();
+
+    return allocator->reallocate_memory(allocator->context, pointer, size, file, line);
+}
+
+void
+release(void *pointer)
+{
+    Allocator *allocator = get_allocator();
+
+    allocator->release_memory(allocator->context, pointer);
+    return;
+}
+
+Allocator *
+set_allocator(Allocator *allocator)
+{
+    Allocator *previous;
+
+    pthread_once(&allocator_once, initialize_allocator);
+    previous = pthread_getspecific(allocator_key);
+    pthread_setspecific(allocator_key, allocator);
+
+    return previous;
+}
+
+static void
+report_at_exit(void)
+{
+    print_memory_report(stderr);
+    return;
+}
+
+void
+track_allocations(void)
+{
+    static bool is_registered = false;
+
+    default_allocator = &tracking_allocator;
+    if (!is_registered) {
+        atexit(report_at_exit);
+        is_registered = true;
+    }
+    return;
+}
+
+static int
+compare_sites(const void *lhs, const void *rhs)
+{
+    const AllocationSite *a = lhs, *b = rhs;
+
+    if (a->bytes != b->bytes)
+        return a->bytes < b->bytes ? 1 : -1;
+    return a->live < b->live ? 1 : (a->live > b->live ? -1 : 0);
+}
+
+void
+memory_statistics(MemoryStatistics *statistics)
+{
+    memset(statistics, 0, sizeof(MemoryStatistics));
+    pthread_once(&allocator_once, initialize_allocator);
+    if (default_allocator != &tracking_allocator)
+        return;
+
+    pthread_mutex_lock(&tracker.mutex);
+    statistics->is_tracking = true;
+    statistics->live = tracker.live;
+    statistics->bytes = tracker.bytes;
+    statistics->peak_bytes = tracker.peak_bytes;
+    statistics->allocations = tracker.allocations;
+    statistics->releases = tracker.releases;
+    statistics->sitec = tracker.sitec;
+    statistics->sites = (AllocationSite *) malloc(sizeof(AllocationSite) * (tracker.sitec + 1));
+    memcpy(statistics->sites, tracker.sites, sizeof(AllocationSite) * tracker.sitec);
+    pthread_mutex_unlock(&tracker.mutex);
+
+    qsort(statistics->sites, statistics->sitec, sizeof(AllocationSite), compare_sites);
+    return;
+}
+
+// totals and the sites that still hold memory
+void
+print_memory_report(FILE *file)
+{
+    MemoryStatistics statistics;
+
+    memory_statistics(&statistics);
+    if (!statistics.is_tracking) {
+        fprintf(file, "memory: not tracked, set %s=1\n", MEMORY_ENVIRONMENT);
+        return;
+    }
+
+    fprintf(file, "memory: %ld blocks (%ld bytes) alive, %ld allocations, %ld releases, peak %ld bytes\n",
+            statistics.live, statistics.bytes, statistics.allocations, statistics.releases,
+            statistics.peak_bytes);
+    for (int i = 0;i < statistics.sitec && i < MEMORY_REPORT;i++) {
+        AllocationSite *site = &statistics.sites[i];
+
+        if (site->live == 0)
+            break;
+        fprintf(file, "  %s:%d: %ld blocks (%ld bytes) alive of %ld\n",
+                site->file, site->line, site->live, site->bytes, site->allocations);
+    }
+
+    free(statistics.sites);
+    return;
+}
@@ -0,0 +1,97 @@
+#ifndef MEMORY_TERM_H_
+#define MEMORY_TERM_H_
+
+// setting this environment variable to anything but 0 tracks every term
+// allocation of the process and reports what is still alive at exit
+#define MEMORY_ENVIRONMENT "ALGEBRA_TRACK_MEMORY"
+// allocation sites listed by a report, largest first
+#define MEMORY_REPORT 20
+// bytes of a block of an arena, larger allocations get a block of their own
+#define ARENA_BLOCK 262144
+
+typedef struct Allocator Allocator;
+typedef struct AllocationSite AllocationSite;
+typedef struct MemoryStatistics MemoryStatistics;
+typedef struct ArenaBlock ArenaBlock;
+typedef struct Arena Arena;
+
+// every term, literal, constant, variable and operator, their names and
+// their argument and index arrays are allocated through the current
+// allocator. file and line are the source position of the caller.
+struct Allocator {
+    void *(*allocate_memory)(void *context, size_t size, const char *file, int line);
+    void *(*reallocate_memory)(void *context, void *pointer, size_t size, const char *file, int line);
+    void (*release_memory)(void *context, void *pointer);
+    void *context;
+};
+
+struct AllocationSite {
+    const char *file;
+    int line;
+
+    long live;
+    long bytes;
+    long allocations;
+};
+
+// counts of the tracking allocator, all 0 without it. sites holds sitec
+// copies ordered by live bytes and has to be freed by the caller.
+struct MemoryStatistics {
+    bool is_tracking;
+
+    long live;
+    long bytes;
+    long peak_bytes;
+    long allocations;
+    long releases;
+
+    int sitec;
+    AllocationSite *sites;
+};
+
+// bump allocator for terms that die together, like the terms parsed and
+// simplified for one line of input. release does nothing and reset_arena
+// takes back every allocation at once, keeping the blocks for the next
+// line. An arena is not locked, it belongs to the one thread that set it.
+struct Arena {
+    Allocator allocator;
+
+    ArenaBlock *blocks;     // the first block, filled in order
+    ArenaBlock *block;      // the block being filled
+    ArenaBlock *large;      // allocations above a quarter block
+    char *next;
+    char *end;
+
+    long allocations;
+    long bytes;
+};
+
+#define allocate(size) allocate_at((size), __FILE__, __LINE__)
+#define reallocate(pointer, size) reallocate_at((pointer), (size), __FILE__, __LINE__)
+
+void *allocate_at(size_t size, const char *file, int line);
+void *reallocate_at(void *pointer, size_t size, const char *file, int line);
+void release(void *pointer);
+
+// sets the allocator of the calling thread, other threads keep theirs.
+// Memory has to be released through the allocator it came from, terms
+// built before a switch may stay alive but are freed only once their
+// allocator is current again. NULL restores the allocator of the process,
+// malloc or the tracking one. What the thread had set before is returned,
+// NULL if nothing, so that it can be set again.
+Allocator *set_allocator(Allocator *allocator);
+// switches the threads that set no allocator of their own to the tracking
+// allocator and reports leaks at exit, before any other thread starts
+void track_allocations(void);
+
+Arena *arena(void);
+// the allocator to pass to set_allocator
+Allocator *arena_allocator(Arena *arena);
+// every term allocated in arena is gone afterwards
+void reset_arena(Arena *arena);
+void free_arena(Arena *arena);
+
+void memory_statistics(MemoryStatistics *statistics);
+void print_memory_report(FILE *file);
+
+#endif // MEMORY_TERM_H_
@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <math.h>
+#include "term.h"
+#include "compare_term.h"
+#include "variable_term.h"
+#include "compile_term.h"
+#include "modular_term.h"
+
+// seed of the points, fixed so that an answer can be reproduced
+#define MODULAR_SEED 0x9e3779b97f4a7c15ULL
+// 2^53, integers up to it are exact doubles
+#define MODULAR_EXACT 9007199254740992.0
+
+static inline unsigned long long
+add_modulo(unsigned long long lhs, unsigned long long rhs)
+{
+    unsigned long long sum = lhs + rhs;
+
+    return sum >= MODULUS ? sum - MODULUS : sum;
+}
+
+static inline unsigned long long
+negate_modulo(unsigned long long operand)
+{
+    return operand == 0 ? 0 : MODULUS - operand;
+}
+
+// the 122 bit product is split into 32 bit halves, 2^64 is 8 modulo 2^61 - 1
+static inline unsigned long long
+multiply_modulo(unsigned long long lhs, unsigned long long rhs)
+{
+    unsigned long long lhs_low = lhs & 0xffffffffULL, lhs_high = lhs >> 32;
+    unsigned long long rhs_low = rhs & 0xffffffffULL, rhs_high = rhs >> 32;
+    unsigned long long low_low = lhs_low * rhs_low, low_high = lhs_low * rhs_high;
+    unsigned long long high_low = lhs_high * rhs_low, high_high = lhs_high * rhs_high;
+    unsigned long long middle = (low_low >> 32) + (low_high & 0xffffffffULL) + (high_low & 0xffffffffULL);
+    unsigned long long low = (middle << 32) | (low_low & 0xffffffffULL);
+    unsigned long long high = high_high + (low_high >> 32) + (high_low >> 32) + (middle >> 32);
+    unsigned long long sum = (low & MODULUS) + (low >> 61) + (high << 3);
+
+    sum = (sum & MODULUS) + (sum >> 61);
+    return sum >= MODULUS ? sum - MODULUS : sum;
+}
+
+static unsigned long long
+power_modulo(unsigned long long base, unsigned long long exponent)
+{
+    unsigned long long result = 1;
+
+    while (exponent > 0) {
+        if (exponent & 1)
+            result = multiply_modulo(result, base);
+        base = multiply_modulo(base, base);
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+// 2^exponent for any integer exponent, 2^61 is 1
+static unsigned long long
+power_of_two(long exponent)
+{
+    long shift = exponent % 61;
+
+    return 1ULL << (shift < 0 ? shift + 61 : shift);
+}
+
+static unsigned long long
+next_point(unsigned long long *state)
+{
+    unsigned long long value;
+
+    *state += 0x9e3779b97f4a7c15ULL;
+    value = *state;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    value = (value ^ (value >> 31)) >> 3;
+
+    return value >= MODULUS ? value - MODULUS : value;
+}
+
+Residue
+residue(unsigned long long real, unsigned long long imaginary)
+{
+    Residue residue;
+
+    residue.real = real;
+    residue.imaginary = imaginary;
+
+    return residue;
+}
+
+// convergents of the continued fraction of value, the first one that
+// rounds back to value is the fraction of smallest denominator that does
+bool
+simplest_fraction(double value, long long *numerator, long long *denominator)
+{
+    long long h0 = 0, h1 = 1, k0 = 1, k1 = 0;
+    double remainder = value;
+
+    for (int i = 0;i < 64;i++) {
+        double whole = floor(remainder), h, k;
+
+        h = whole * (double) h1 + (double) h0;
+        k = whole * (double) k1 + (double) k0;
+        if (h > MODULAR_EXACT || k > (double) MODULAR_DENOMINATOR)
+            return false;
+
+        h0 = h1;
+        k0 = k1;
+        h1 = (long long) h;
+        k1 = (long long) k;
+        if ((double) h1 / (double) k1 == value) {
+            *numerator = h1;
+            *denominator = k1;
+            return true;
+        }
+
+        if (remainder == whole)
+            return false;
+        remainder = 1.0 / (remainder - whole);
+    }
+
+    return false;
+}
+
+Residue
+residue_of_literal(double value)
+{
+    double magnitude = fabs(value), mantissa;
+    long long numerator, denominator;
+    unsigned long long real;
+    int exponent;
+
+    if (magnitude == floor(magnitude) || !simplest_fraction(magnitude, &numerator, &denominator)) {
+        // magnitude is mantissa 2^(exponent - 53) with an integral mantissa
+        mantissa = ldexp(frexp(magnitude, &exponent), 53);
+        real = multiply_modulo((unsigned long long) mantissa, power_of_two((long) exponent - 53));
+    } else {
+        real = multiply_modulo((unsigned long long) numerator,
+                power_modulo((unsigned long long) denominator, MODULUS - 2));
+    }
+
+    return residue(value < 0.0 ? negate_modulo(real) : real, 0);
+}
+
+Residue
+residue_add(Residue lhs, Residue rhs)
+{
+    return residue(add_modulo(lhs.real, rhs.real), add_modulo(lhs.imaginary, rhs.imaginary));
+}
+
+Residue
+residue_additive_inverse(Residue operand)
+{
+    return residue(negate_modulo(operand.real), negate_modulo(operand.imaginary));
+}
+
+Residue
+residue_multiply(Residue lhs, Residue rhs)
+{
+    return residue(add_modulo(multiply_modulo(lhs.real, rhs.real),
+                    negate_modulo(multiply_modulo(lhs.imaginary, rhs.imaginary))),
+            add_modulo(multiply_modulo(lhs.real, rhs.imaginary),
+                    multiply_modulo(lhs.imaginary, rhs.real)));
+}
+
+// (a - b i) / (a^2 + b^2), the norm is 0 only for 0 since -1 is no square
+Residue
+residue_multiple_inverse(Residue operand)
+{
+    unsigned long long norm = add_modulo(multiply_modulo(operand.real, operand.real),
+            multiply_modulo(operand.imaginary, operand.imaginary));
+    unsigned long long inverse = power_modulo(norm, MODULUS - 2);
+
+    return residue(multiply_modulo(operand.real, inverse),
+            negate_modulo(multiply_modulo(operand.imaginary, inverse)));
+}
+
+Residue
+residue_power(Residue base, long long exponent)
+{
+    Residue result = residue(1, 0);
+    unsigned long long count;
+
+    if (exponent < 0) {
+        base = residue_multiple_inverse(base);
+        count = (unsigned long long) -exponent;
+    } else {
+        count = (unsigned long long) exponent;
+    }
+
+    while (count > 0) {
+        if (count & 1)
+            result = residue_multiply(result, base);
+        base = residue_multiply(base, base);
+        count >>= 1;
+    }
+
+    return result;
+}
+
+bool
+is_zero_residue(Residue operand)
+{
+    return operand.real == 0 && operand.imaginary == 0;
+}
+
+static bool
+is_same_residue(Residue lhs, Residue rhs)
+{
+    return lhs.real == rhs.real && lhs.imaginary == rhs.imaginary;
+}
+
+// the exponent of a power, a literal under any number of additive inverses
+static bool
+integer_exponent(Program *program, int index, long long *exponent)
+{
+    Instruction *instruction = &program->instructions[index];
+    bool is_negative = false;
+    double value;
+
+    while (instruction->opcode == OPCODE_ADDITIVE_INVERSE) {
+        instruction = &program->instructions[program->operands[instruction->first]];
+        is_negative = !is_negative;
+    }
+    if (instruction->opcode != OPCODE_LITERAL)
+        return false;
+
+    value = instruction->value;
+    if (value != floor(value) || fabs(value) > 4611686018427387904.0)
+        return false;
+
+    *exponent = is_negative ? -(long long) value : (long long) value;
+    return true;
+}
+
+bool
+evaluate_program_modular(Program *program, Residue *values, Residue *constants,
+        Residue *registers, Residue *results)
+{
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        long long exponent;
+        Residue value;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+            if (!isfinite(instruction->value))
+                return false;
+            value = residue_of_literal(instruction->value);
+            break;
+        case OPCODE_CONSTANT:
+            value = constants[instruction->index];
+            break;
+        case OPCODE_VARIABLE:
+            value = values[instruction->index];
+            break;
+        case OPCODE_IMAGINARY:
+            value = residue(negate_modulo(registers[operands[0]].imaginary), registers[operands[0]].real);
+            break;
+        case OPCODE_ADD:
+            value = registers[operands[0]];
+            for (int j = 1;j < instruction->argc;j++)
+                value = residue_add(value, registers[operands[j]]);
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            value = residue_additive_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_MULTIPLY:
+            value = registers[operands[0]];
+            for (int j = 1;j < instruction->argc;j++)
+                value = residue_multiply(value, registers[operands[j]]);
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            if (is_zero_residue(registers[operands[0]]))
+                return false;
+            value = residue_multiple_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_POWER:
+            if (!integer_exponent(program, operands[1], &exponent))
+                return false;
+            if (exponent < 0 && is_zero_residue(registers[operands[0]]))
+                return false;
+            value = residue_power(registers[operands[0]], exponent);
+            break;
+        default:
+            return false;
+        }
+
+        registers[i] = value;
+    }
+
+    for (int i = 0;i < program->resultc;i++)
+        results[i] = registers[program->results[i]];
+    return true;
+}
+
+// a program only some points are undefined for, those are skipped
+static bool
+is_exact_program(Program *program)
+{
+    long long exponent;
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+
+        if (instruction->opcode == OPCODE_LITERAL && !isfinite(instruction->value))
+            return false;
+        if (instruction->opcode == OPCODE_POWER
+                && !integer_exponent(program, program->operands[instruction->first + 1], &exponent))
+            return false;
+    }
+
+    return true;
+}
+
+// the first result against the second one, or against 0 if there is one
+static Equivalence
+test_program(Program *program, int trials)
+{
+    Residue *values, *constants, *registers, results[2];
+    unsigned long long state = MODULAR_SEED;
+    Equivalence equivalence = EQUIVALENCE_UNKNOWN;
+    int passed = 0;
+
+    if (!is_exact_program(program))
+        return EQUIVALENCE_UNKNOWN;
+
+    values = (Residue *) malloc(sizeof(Residue) * (program->variablec + 1));
+    constants = (Residue *) malloc(sizeof(Residue) * (program->constantc + 1));
+    registers = (Residue *) malloc(sizeof(Residue) * (program->length + 1));
+    results[1] = residue(0, 0);
+
+    for (int i = 0;i < 2 * trials && passed < trials;i++) {
+        for (int j = 0;j < program->variablec;j++)
+            values[j] = residue(next_point(&state), next_point(&state));
+        for (int j = 0;j < program->constantc;j++)
+            constants[j] = residue(next_point(&state), next_point(&state));
+
+        if (!evaluate_program_modular(program, values, constants, registers, results))
+            continue;
+        if (!is_same_residue(results[0], results[1])) {
+            equivalence = EQUIVALENCE_DIFFERENT;
+            break;
+        }
+
+        equivalence = EQUIVALENCE_EQUAL;
+        passed++;
+    }
+
+    free(values);
+    free(constants);
+    free(registers);
+
+    return equivalence;
+}
+
+static void
+free_variables(Term **variables, int variablec)
+{
+    for (int i = 0;i < variablec;i++)
+        free_term(variables[i]);
+    free(variables);
+    return;
+}
+
+Equivalence
+test_equivalence(Term *lhs, Term *rhs, int trials)
+{
+    Term *terms[2] = {lhs, rhs}, **variables, **rhs_variables;
+    int variablec, rhs_variablec;
+    Equivalence equivalence;
+    Program *program;
+
+    variables = get_variables(lhs, &variablec);
+    rhs_variables = get_variables(rhs, &rhs_variablec);
+    variables = (Term **) realloc(variables, sizeof(Term *) * (variablec + rhs_variablec + 1));
+    for (int i = 0;i < rhs_variablec;i++) {
+        int j;
+
+        for (j = 0;j < variablec;j++)
+            if (is_equal(variables[j], rhs_variables[i]))
+                break;
+
+        if (j < variablec) {
+            free_term(rhs_variables[i]);
+        } else {
+            variables[variablec++] = rhs_variables[i];
+        }
+    }
+    free(rhs_variables);
+
+    program = compile_terms(2, terms, variablec, variables);
+    free_variables(variables, variablec);
+    if (program == NULL)
+        return EQUIVALENCE_UNKNOWN;
+
+    equivalence = test_program(program, trials);
+    free_program(program);
+
+    return equivalence;
+}
+
+Equivalence
+test_zero(Term *term, int trials)
+{
+    Term **variables;
+    int variablec;
+    Equivalence equivalence;
+    Program *program;
+
+    variables = get_variables(term, &variablec);
+    program = compile_term(term, variablec, variables);
+    free_variables(variables, variablec);
+    if (program == NULL)
+        return EQUIVALENCE_UNKNOWN;
+
+    equivalence = test_program(program, trials);
+    free_program(program);
+
+    return equivalence;
+}
+
+bool
+is_probably_equal(Term *lhs, Term *rhs)
+{
+    return test_equivalence(lhs, rhs, MODULAR_TRIALS) == EQUIVALENCE_EQUAL;
+}
+
+bool
+is_certainly_different(Term *lhs, Term *rhs)
+{
+    return test_equivalence(lhs, rhs, MODULAR_TRIALS) == EQUIVALENCE_DIFFERENT;
+}
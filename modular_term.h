@@ -0,0 +1,63 @@
+#ifndef MODULAR_TERM_H_
+#define MODULAR_TERM_H_
+
+// the Mersenne prime 2^61 - 1. It is 3 modulo 4, so -1 has no square root
+// modulo it and the pairs a + b i form a field of MODULUS^2 elements.
+#define MODULUS 2305843009213693951ULL
+// points tried by is_probably_equal and is_certainly_different
+#define MODULAR_TRIALS 4
+// largest denominator of the fraction a literal is read as
+#define MODULAR_DENOMINATOR 4294967296LL
+
+typedef struct Residue Residue;
+
+typedef enum {
+    EQUIVALENCE_DIFFERENT,
+    EQUIVALENCE_EQUAL,
+    EQUIVALENCE_UNKNOWN
+} Equivalence;
+
+// real + imaginary i modulo MODULUS, both parts below MODULUS
+struct Residue {
+    unsigned long long real;
+    unsigned long long imaginary;
+};
+
+// numerator / denominator of smallest denominator up to
+// MODULAR_DENOMINATOR that rounds to value, false if there is none.
+// value has to be positive and finite.
+bool simplest_fraction(double value, long long *numerator, long long *denominator);
+
+Residue residue(unsigned long long real, unsigned long long imaginary);
+// the fraction of smallest denominator that rounds to value, 0.1 is 1/10.
+// Values no such fraction rounds to are read as the binary fraction they
+// are. value has to be finite.
+Residue residue_of_literal(double value);
+
+Residue residue_add(Residue lhs, Residue rhs);
+Residue residue_additive_inverse(Residue operand);
+Residue residue_multiply(Residue lhs, Residue rhs);
+// 0 for 0
+Residue residue_multiple_inverse(Residue operand);
+Residue residue_power(Residue base, long long exponent);
+bool is_zero_residue(Residue operand);
+
+// values[i] belongs to variable slot i and constants[i] to constant slot i,
+// constants are taken as unknowns. False where the program divides by zero
+// or raises to a power that is not an integer literal.
+bool evaluate_program_modular(Program *program, Residue *values, Residue *constants,
+        Residue *registers, Residue *results);
+
+// evaluates both terms exactly at trials random points, variables and
+// constants are taken as unknowns. EQUIVALENCE_DIFFERENT is certain,
+// EQUIVALENCE_EQUAL is wrong with probability at most (degree / MODULUS)
+// per trial for rational terms. EQUIVALENCE_UNKNOWN is returned for terms
+// with other operators, powers that are not integer literals or no point
+// both terms are defined at.
+Equivalence test_equivalence(Term *lhs, Term *rhs, int trials);
+Equivalence test_zero(Term *term, int trials);
+
+bool is_probably_equal(Term *lhs, Term *rhs);
+bool is_certainly_different(Term *lhs, Term *rhs);
+
+#endif // MODULAR_TERM_H_
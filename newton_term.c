@@ -0,0 +1,500 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "term.h"
+#include "compile_term.h"
+#include "sparse_term.h"
+#include "tape_term.h"
+#include "differentiate_term.h"
+#include "newton_term.h"
+
+// smallest damping factor the line search tries
+#define NEWTON_MINIMUM_STEP 1e-10
+// a factorization is kept while every step shrinks the residual by this
+#define NEWTON_CONTRACTION 0.1
+// threshold of the sparse pivot search
+#define NEWTON_PIVOT_THRESHOLD 0.1
+
+typedef struct System System;
+
+// residuals of a square system with a factorization of its jacobian at
+// the last point passed to jacobian
+struct System {
+    int size;
+    void (*residual)(System *system, double *values, double *residuals);
+    void (*jacobian)(System *system, double *values, double *residuals);
+    bool (*factor)(System *system);
+    void (*solve)(System *system, double *rhs, double *step);
+
+    Derivative *derivative;
+    double *matrix;
+    int *pivots;
+
+    Tape *tape;
+    Sparse *pattern;
+    int colorc;
+    int *colors;
+    SparseLU *lu;
+};
+
+static double
+seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static double
+maximum_norm(double *vector, int size)
+{
+    double norm = 0.0;
+
+    for (int i = 0;i < size;i++) {
+        if (isnan(vector[i]))
+            return NAN;
+        if (fabs(vector[i]) > norm)
+            norm = fabs(vector[i]);
+    }
+    return norm;
+}
+
+static double
+squared_norm(double *vector, int size)
+{
+    double sum = 0.0;
+
+    for (int i = 0;i < size;i++)
+        sum += vector[i] * vector[i];
+    return sum;
+}
+
+// lhs - rhs for an equation, a copy of the term otherwise
+static Term *
+residual_of_equation(Term *term)
+{
+    Operator *temp_operator = is_operator(term, "=");
+
+    if (temp_operator == NULL)
+        return copy_term(term);
+
+    return add(copy_term(temp_operator->argv[0]), additive_inverse(copy_term(temp_operator->argv[1])));
+}
+
+static void
+dense_residual(System *system, double *values, double *residuals)
+{
+    system->derivative->evaluate(system->derivative->context, values, residuals, NULL);
+    return;
+}
+
+static void
+dense_jacobian(System *system, double *values, double *residuals)
+{
+    system->derivative->evaluate(system->derivative->context, values, residuals, system->matrix);
+    return;
+}
+
+static bool
+dense_factor(System *system)
+{
+    return dense_lu(system->size, system->matrix, system->pivots);
+}
+
+static void
+dense_solve(System *system, double *rhs, double *step)
+{
+    dense_lu_solve(system->size, system->matrix, system->pivots, rhs, step);
+    return;
+}
+
+static void
+sparse_residual(System *system, double *values, double *residuals)
+{
+    forward_tape(system->tape, values, residuals);
+    return;
+}
+
+static void
+sparse_jacobian(System *system, double *values, double *residuals)
+{
+    sparse_jacobian_tape(system->tape, values, residuals, system->pattern, system->colorc, system->colors);
+    return;
+}
+
+// the pivot sequence of the first factorization is reused as long as its
+// pivots stay acceptable
+static bool
+sparse_factor(System *system)
+{
+    if (system->lu != NULL) {
+        if (sparse_lu_refactor(system->lu, system->pattern, NEWTON_PIVOT_THRESHOLD))
+            return true;
+        free_sparse_lu(system->lu);
+    }
+
+    system->lu = sparse_lu(system->pattern, NEWTON_PIVOT_THRESHOLD);
+
+    return system->lu != NULL;
+}
+
+static void
+sparse_solve(System *system, double *rhs, double *step)
+{
+    sparse_lu_solve(system->lu, rhs, step);
+    return;
+}
+
+// damped Newton iteration, the step is halved until the squared residual
+// decreases sufficiently and the factorization is reused (chord steps)
+// until a step is damped or converges slower than NEWTON_CONTRACTION
+static bool
+iterate(System *system, double *values, double tolerance, NewtonStatistics *statistics)
+{
+    int size = system->size;
+    double *residuals = (double *) malloc(sizeof(double) * (size + 1));
+    double *trial = (double *) malloc(sizeof(double) * (size + 1));
+    double *trial_residuals = (double *) malloc(sizeof(double) * (size + 1));
+    double *rhs = (double *) malloc(sizeof(double) * (size + 1));
+    double *step = (double *) malloc(sizeof(double) * (size + 1));
+    double start = seconds(), time, norm, merit;
+    bool has_factor = false, is_current = false, is_kept = false;
+
+    time = seconds();
+    system->residual(system, values, residuals);
+    statistics->evaluate_time += seconds() - time;
+    statistics->evaluations++;
+
+    norm = maximum_norm(residuals, size);
+    merit = squared_norm(residuals, size);
+
+    for (int iteration = 0;iteration <= NEWTON_ITERATIONS;iteration++) {
+        double iteration_start = seconds(), lambda = 1.0, trial_norm = 0.0, trial_merit = 0.0;
+        bool is_accepted = false;
+
+        statistics->residuals[iteration] = norm;
+        statistics->iterations = iteration;
+
+        if (norm <= tolerance) {
+            statistics->is_converged = true;
+            break;
+        }
+        if (iteration == NEWTON_ITERATIONS || isnan(norm))
+            break;
+
+        if (!has_factor || !is_kept) {
+            time = seconds();
+            system->jacobian(system, values, residuals);
+            statistics->jacobian_time += seconds() - time;
+            statistics->jacobians++;
+
+            time = seconds();
+            has_factor = system->factor(system);
+            statistics->factor_time += seconds() - time;
+            statistics->factorizations++;
+
+            if (!has_factor)
+                break;
+            is_current = true;
+            is_kept = true;
+        }
+
+        time = seconds();
+        for (int i = 0;i < size;i++)
+            rhs[i] = -residuals[i];
+        system->solve(system, rhs, step);
+        statistics->solve_time += seconds() - time;
+
+        while (lambda >= NEWTON_MINIMUM_STEP) {
+            for (int i = 0;i < size;i++)
+                trial[i] = values[i] + lambda * step[i];
+
+            time = seconds();
+            system->residual(system, trial, trial_residuals);
+            statistics->evaluate_time += seconds() - time;
+            statistics->evaluations++;
+
+            trial_norm = maximum_norm(trial_residuals, size);
+            trial_merit = squared_norm(trial_residuals, size);
+            if (!isnan(trial_norm) && trial_merit <= (1.0 - 2e-4 * lambda) * merit) {
+                is_accepted = true;
+                break;
+            }
+            lambda *= 0.5;
+        }
+
+        statistics->times[iteration] = seconds() - iteration_start;
+
+        if (!is_accepted) {
+            // a stale factorization gets one more chance after a refresh
+            if (is_current)
+                break;
+            is_kept = false;
+            continue;
+        }
+
+        is_current = false;
+        is_kept = lambda == 1.0 && trial_norm <= NEWTON_CONTRACTION * norm;
+        memcpy(values, trial, sizeof(double) * size);
+        memcpy(residuals, trial_residuals, sizeof(double) * size);
+        norm = trial_norm;
+        merit = trial_merit;
+    }
+
+    statistics->residual = norm;
+    statistics->total_time += seconds() - start;
+
+    free(residuals);
+    free(trial);
+    free(trial_residuals);
+    free(rhs);
+    free(step);
+
+    return statistics->is_converged;
+}
+
+static void
+clear_statistics(NewtonStatistics *statistics)
+{
+    memset(statistics, 0, sizeof(NewtonStatistics));
+    statistics->is_converged = false;
+    statistics->is_sparse = false;
+    return;
+}
+
+// solves residuals(values) = 0 for a square system given by derivative,
+// values holds the start point and receives the solution
+bool
+newton(Derivative *derivative, double *values, double tolerance, NewtonStatistics *statistics)
+{
+    NewtonStatistics local;
+    System system;
+    bool is_converged;
+
+    if (statistics == NULL)
+        statistics = &local;
+    clear_statistics(statistics);
+
+    if (derivative->resultc != derivative->variablec)
+        return false;
+
+    memset(&system, 0, sizeof(System));
+    system.size = derivative->variablec;
+    system.residual = dense_residual;
+    system.jacobian = dense_jacobian;
+    system.factor = dense_factor;
+    system.solve = dense_solve;
+    system.derivative = derivative;
+    system.matrix = (double *) malloc(sizeof(double) * (system.size * system.size + 1));
+    system.pivots = (int *) malloc(sizeof(int) * (system.size + 1));
+
+    is_converged = iterate(&system, values, tolerance, statistics);
+
+    free(system.matrix);
+    free(system.pivots);
+
+    return is_converged;
+}
+
+static bool
+newton_sparse(Tape *tape, double *values, double tolerance, NewtonStatistics *statistics)
+{
+    System system;
+    bool is_converged;
+
+    memset(&system, 0, sizeof(System));
+    system.size = tape->program->variablec;
+    system.residual = sparse_residual;
+    system.jacobian = sparse_jacobian;
+    system.factor = sparse_factor;
+    system.solve = sparse_solve;
+    system.tape = tape;
+    system.pattern = jacobian_pattern(tape);
+    system.colors = (int *) malloc(sizeof(int) * (system.size + 1));
+    system.colorc = color_columns(system.pattern, system.colors);
+    system.lu = NULL;
+
+    statistics->is_sparse = true;
+    is_converged = iterate(&system, values, tolerance, statistics);
+
+    if (system.lu != NULL)
+        free_sparse_lu(system.lu);
+    free_sparse(system.pattern);
+    free(system.colors);
+
+    return is_converged;
+}
+
+// equations are "=" terms or terms meant to be zero, one per variable.
+// The residuals are compiled once and the jacobian comes from the tape,
+// large systems get a sparse jacobian and a sparse factorization.
+bool
+solve_system(int equationc, Term **equations, int variablec, Term **variables, double *values,
+        double tolerance, NewtonStatistics *statistics)
+{
+    NewtonStatistics local;
+    Term **residuals;
+    Program *program;
+    Tape *tape;
+    bool is_converged;
+
+    if (statistics == NULL)
+        statistics = &local;
+    clear_statistics(statistics);
+
+    if (equationc != variablec)
+        return false;
+
+    residuals = (Term **) malloc(sizeof(Term *) * (equationc + 1));
+    for (int i = 0;i < equationc;i++)
+        residuals[i] = residual_of_equation(equations[i]);
+
+    program = compile_terms(equationc, residuals, variablec, variables);
+
+    for (int i = 0;i < equationc;i++)
+        free_term(residuals[i]);
+    free(residuals);
+
+    if (program == NULL)
+        return false;
+
+    tape = record_tape(program);
+
+    if (variablec >= NEWTON_SPARSE_SIZE) {
+        is_converged = newton_sparse(tape, values, tolerance, statistics);
+    } else {
+        Derivative derivative = tape_derivative(tape);
+
+        is_converged = newton(&derivative, values, tolerance, statistics);
+    }
+
+    free_tape(tape);
+    free_program(program);
+
+    return is_converged;
+}
+
+// Halley's method for one equation in one variable with symbolic first
+// and second derivatives, falls back to Newton's method on the tape if
+// the term cannot be differentiated symbolically
+bool
+halley(Term *term, Term *variable, double *value, double tolerance, NewtonStatistics *statistics)
+{
+    NewtonStatistics local;
+    Term *residual;
+    Program *program;
+    double results[3], trial_results[3], *registers;
+    double start, x = *value, norm;
+
+    if (statistics == NULL)
+        statistics = &local;
+    clear_statistics(statistics);
+
+    residual = residual_of_equation(term);
+    program = compile_term(residual, 1, &variable);
+    if (program == NULL) {
+        free_term(residual);
+        return false;
+    }
+
+    // both derivatives are emitted into the program of the residual and
+    // share its instructions
+    program->results = (int *) realloc(program->results, sizeof(int) * 3);
+    program->resultc = 3;
+    program->results[1] = differentiate_instruction(program, program->results[0], 0);
+    program->results[2] = -1;
+    if (program->results[1] >= 0)
+        program->results[2] = differentiate_instruction(program, program->results[1], 0);
+
+    if (program->results[2] < 0) {
+        bool is_converged = solve_system(1, &residual, 1, &variable, value, tolerance, statistics);
+
+        free_term(residual);
+        free_program(program);
+        return is_converged;
+    }
+    free_term(residual);
+
+    registers = (double *) malloc(sizeof(double) * (program->length + 1));
+    start = seconds();
+
+    evaluate_program(program, &x, registers, results);
+    statistics->evaluations++;
+    statistics->jacobians++;
+    norm = fabs(results[0]);
+
+    for (int iteration = 0;iteration <= NEWTON_ITERATIONS;iteration++) {
+        double iteration_start = seconds(), f = results[0];
+        double d = results[1], dd = results[2];
+        double denominator = 2.0 * d * d - f * dd, step, lambda = 1.0, trial = x;
+        bool is_accepted = false;
+
+        statistics->residuals[iteration] = norm;
+        statistics->iterations = iteration;
+
+        if (norm <= tolerance) {
+            statistics->is_converged = true;
+            break;
+        }
+        if (iteration == NEWTON_ITERATIONS || isnan(norm))
+            break;
+
+        if (denominator != 0.0 && !isnan(denominator))
+            step = -2.0 * f * d / denominator;
+        else if (d != 0.0)
+            step = -f / d;
+        else
+            break;
+
+        while (lambda >= NEWTON_MINIMUM_STEP) {
+            trial = x + lambda * step;
+            evaluate_program(program, &trial, registers, trial_results);
+            statistics->evaluations++;
+            statistics->jacobians++;
+
+            if (fabs(trial_results[0]) < norm || fabs(trial_results[0]) <= tolerance) {
+                is_accepted = true;
+                break;
+            }
+            lambda *= 0.5;
+        }
+
+        statistics->times[iteration] = seconds() - iteration_start;
+        if (!is_accepted)
+            break;
+
+        x = trial;
+        memcpy(results, trial_results, sizeof(double) * 3);
+        norm = fabs(results[0]);
+    }
+
+    statistics->residual = norm;
+    statistics->total_time = seconds() - start;
+    statistics->evaluate_time = statistics->total_time;
+    *value = x;
+
+    free(registers);
+    free_program(program);
+
+    return statistics->is_converged;
+}
+
+void
+print_newton_statistics(NewtonStatistics *statistics)
+{
+    printf("%s after %d iterations, residual %g%s\n", statistics->is_converged ? "converged" : "not converged",
+            statistics->iterations, statistics->residual, statistics->is_sparse ? " (sparse)" : "");
+    printf("%d evaluations, %d jacobians, %d factorizations\n",
+            statistics->evaluations, statistics->jacobians, statistics->factorizations);
+    printf("evaluate %.6fs, jacobian %.6fs, factor %.6fs, solve %.6fs, total %.6fs\n",
+            statistics->evaluate_time, statistics->jacobian_time, statistics->factor_time,
+            statistics->solve_time, statistics->total_time);
+
+    for (int i = 0;i < statistics->iterations;i++)
+        printf("%4d %12.6e %.6fs\n", i, statistics->residuals[i], statistics->times[i]);
+    printf("%4d %12.6e\n", statistics->iterations, statistics->residuals[statistics->iterations]);
+    return;
+}
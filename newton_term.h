@@ -0,0 +1,39 @@
+#ifndef NEWTON_TERM_H_
+#define NEWTON_TERM_H_
+
+// iterations before a solver gives up
+#define NEWTON_ITERATIONS 100
+// systems with at least this many unknowns use the sparse factorization
+#define NEWTON_SPARSE_SIZE 64
+
+typedef struct NewtonStatistics NewtonStatistics;
+
+// times are in seconds, residuals are max norms, residuals[k] is the
+// residual before iteration k and times[k] the time iteration k took
+struct NewtonStatistics {
+    bool is_converged;
+    bool is_sparse;
+    int iterations;
+    int evaluations;
+    int jacobians;
+    int factorizations;
+    double residual;
+
+    double evaluate_time;
+    double jacobian_time;
+    double factor_time;
+    double solve_time;
+    double total_time;
+
+    double residuals[NEWTON_ITERATIONS + 1];
+    double times[NEWTON_ITERATIONS];
+};
+
+bool newton(Derivative *derivative, double *values, double tolerance, NewtonStatistics *statistics);
+bool solve_system(int equationc, Term **equations, int variablec, Term **variables, double *values,
+        double tolerance, NewtonStatistics *statistics);
+bool halley(Term *term, Term *variable, double *value, double tolerance, NewtonStatistics *statistics);
+
+void print_newton_statistics(NewtonStatistics *statistics);
+
+#endif // NEWTON_TERM_H_
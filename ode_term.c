@@ -0,0 +1,840 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "term.h"
+#include "compare_term.h"
+#include "compile_term.h"
+#include "sparse_term.h"
+#include "tape_term.h"
+#include "ode_term.h"
+
+// step size control shared by both methods
+#define ODE_SAFETY 0.9
+#define ODE_MINIMUM_FACTOR 0.2
+#define ODE_MAXIMUM_FACTOR 10.0
+
+// highest order and Newton iterations per step of the BDF method
+#define BDF_ORDER 5
+#define BDF_ITERATIONS 4
+
+typedef struct Integrator Integrator;
+
+// state shared by the methods while one integration runs
+struct Integrator {
+    Ode *ode;
+    double start;
+    double end;
+    double direction;
+    double relative;
+    double absolute;
+
+    double *point;
+    double *registers;
+
+    OdeOutput *output;
+    double interval;
+    int sample;
+    bool is_sampled;
+
+    OdeStatistics *statistics;
+};
+
+// Dormand-Prince 5(4) tableau, error weights and the coefficients of its
+// fourth order continuous extension
+static const double dopri_c[6] = { 0.0, 1.0 / 5.0, 3.0 / 10.0, 4.0 / 5.0, 8.0 / 9.0, 1.0 };
+
+static const double dopri_a[6][5] = {
+    { 0.0 },
+    { 1.0 / 5.0 },
+    { 3.0 / 40.0, 9.0 / 40.0 },
+    { 44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0 },
+    { 19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0 },
+    { 9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0 }
+};
+
+static const double dopri_b[6] = {
+    35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0
+};
+
+static const double dopri_e[7] = {
+    -71.0 / 57600.0, 0.0, 71.0 / 16695.0, -71.0 / 1920.0, 17253.0 / 339200.0, -22.0 / 525.0, 1.0 / 40.0
+};
+
+static const double dopri_p[7][4] = {
+    { 1.0, -8048581381.0 / 2820520608.0, 8663915743.0 / 2820520608.0, -12715105075.0 / 11282082432.0 },
+    { 0.0, 0.0, 0.0, 0.0 },
+    { 0.0, 131558114200.0 / 32700410799.0, -68118460800.0 / 10900136933.0, 87487479700.0 / 32700410799.0 },
+    { 0.0, -1754552775.0 / 470086768.0, 14199869525.0 / 1410260304.0, -10690763975.0 / 1880347072.0 },
+    { 0.0, 127303824393.0 / 49829197408.0, -318862633887.0 / 49829197408.0, 701980252875.0 / 199316789632.0 },
+    { 0.0, -282668133.0 / 205662961.0, 2019193451.0 / 616988883.0, -1453857185.0 / 822651844.0 },
+    { 0.0, 40617522.0 / 29380423.0, -110615467.0 / 29380423.0, 69997945.0 / 29380423.0 }
+};
+
+// the equations are D[state, time] = right hand side with the derivative
+// on either side, every state has to be a variable
+Ode *
+compile_ode(int equationc, Term **equations, Term *time)
+{
+    Ode *ode;
+    Term **variables = (Term **) malloc(sizeof(Term *) * (equationc + 1));
+    Term **sides = (Term **) malloc(sizeof(Term *) * (equationc + 1));
+
+    variables[0] = time;
+    for (int i = 0;i < equationc;i++) {
+        Operator *equation = is_operator(equations[i], "=");
+        Operator *derivative = NULL;
+        int side = 0;
+
+        if (equation != NULL) {
+            derivative = is_operator(equation->argv[0], "D");
+            if (derivative == NULL) {
+                derivative = is_operator(equation->argv[1], "D");
+                side = 1;
+            }
+        }
+
+        if (derivative == NULL || strcmp(derivative->argv[0]->meaning, "variable") != 0 ||
+                !is_equal(derivative->argv[1], time)) {
+            free(variables);
+            free(sides);
+            return NULL;
+        }
+
+        variables[i + 1] = derivative->argv[0];
+        sides[i] = equation->argv[1 - side];
+    }
+
+    ode = (Ode *) malloc(sizeof(Ode));
+    ode->statec = equationc;
+    ode->program = compile_terms(equationc, sides, equationc + 1, variables);
+    free(sides);
+
+    if (ode->program == NULL) {
+        free(variables);
+        free(ode);
+        return NULL;
+    }
+
+    ode->time = copy_term(time);
+    ode->states = (Term **) malloc(sizeof(Term *) * (equationc + 1));
+    for (int i = 0;i < equationc;i++)
+        ode->states[i] = copy_term(variables[i + 1]);
+    ode->tape = record_tape(ode->program);
+
+    free(variables);
+
+    return ode;
+}
+
+void
+free_ode(Ode *ode)
+{
+    for (int i = 0;i < ode->statec;i++)
+        free_term(ode->states[i]);
+    free(ode->states);
+    free_term(ode->time);
+    free_tape(ode->tape);
+    free_program(ode->program);
+    free(ode);
+    return;
+}
+
+OdeOutput *
+ode_output(int statec, int capacity,
+        void (*flush)(void *context, int count, double *times, double *states), void *context)
+{
+    OdeOutput *output = (OdeOutput *) malloc(sizeof(OdeOutput));
+
+    if (capacity < 1)
+        capacity = 1;
+
+    output->statec = statec;
+    output->capacity = capacity;
+    output->count = 0;
+    output->times = (double *) malloc(sizeof(double) * capacity);
+    output->states = (double *) malloc(sizeof(double) * capacity * (statec + 1));
+    output->context = context;
+    output->flush = flush;
+
+    return output;
+}
+
+void
+flush_ode_output(OdeOutput *output)
+{
+    if (output->flush == NULL || output->count == 0)
+        return;
+
+    output->flush(output->context, output->count, output->times, output->states);
+    output->count = 0;
+    return;
+}
+
+void
+free_ode_output(OdeOutput *output)
+{
+    free(output->times);
+    free(output->states);
+    free(output);
+    return;
+}
+
+static void
+append_sample(Integrator *integrator, double time, double *states)
+{
+    OdeOutput *output = integrator->output;
+    int statec = integrator->ode->statec;
+
+    if (output->count == output->capacity) {
+        if (output->flush != NULL) {
+            flush_ode_output(output);
+        } else {
+            output->capacity *= 2;
+            output->times = (double *) realloc(output->times, sizeof(double) * output->capacity);
+            output->states = (double *) realloc(output->states,
+                    sizeof(double) * output->capacity * (statec + 1));
+        }
+    }
+
+    output->times[output->count] = time;
+    memcpy(&output->states[output->count * statec], states, sizeof(double) * statec);
+    output->count++;
+    integrator->statistics->samples++;
+    return;
+}
+
+// time of the next sample on the grid start + k interval, the last sample
+// is at end
+static bool
+next_sample(Integrator *integrator, double reached, double *time)
+{
+    if (integrator->output == NULL || integrator->interval <= 0.0 || integrator->is_sampled)
+        return false;
+
+    *time = integrator->start + integrator->direction * integrator->sample * integrator->interval;
+    if (integrator->direction * (*time - integrator->end) >= 0.0)
+        *time = integrator->end;
+
+    return integrator->direction * (*time - reached) <= 0.0;
+}
+
+static void
+take_sample(Integrator *integrator, double time, double *states)
+{
+    append_sample(integrator, time, states);
+    if (time == integrator->end)
+        integrator->is_sampled = true;
+    integrator->sample++;
+    return;
+}
+
+// without a sample interval every accepted step is written out
+static void
+sample_step(Integrator *integrator, double time, double *states)
+{
+    if (integrator->output != NULL && integrator->interval <= 0.0)
+        append_sample(integrator, time, states);
+    return;
+}
+
+static void
+evaluate_rhs(Integrator *integrator, double time, double *states, double *derivatives)
+{
+    Ode *ode = integrator->ode;
+
+    integrator->point[0] = time;
+    memcpy(&integrator->point[1], states, sizeof(double) * ode->statec);
+    evaluate_program(ode->program, integrator->point, integrator->registers, derivatives);
+    integrator->statistics->evaluations++;
+    return;
+}
+
+static double
+rms_norm(double *vector, double *scale, int size)
+{
+    double sum = 0.0;
+
+    if (size == 0)
+        return 0.0;
+
+    for (int i = 0;i < size;i++)
+        sum += (vector[i] / scale[i]) * (vector[i] / scale[i]);
+    return sqrt(sum / size);
+}
+
+static double
+minimum_step(double time, double direction)
+{
+    return 10.0 * fabs(nextafter(time, direction * INFINITY) - time);
+}
+
+// Hairer's starting step for a method whose error estimate has the given
+// order
+static double
+initial_step(Integrator *integrator, double time, double *states, double *derivatives, int order)
+{
+    int statec = integrator->ode->statec;
+    double *scale = (double *) malloc(sizeof(double) * (statec + 1));
+    double *trial = (double *) malloc(sizeof(double) * (statec + 1));
+    double *trial_derivatives = (double *) malloc(sizeof(double) * (statec + 1));
+    double d0, d1, d2, h0, h1;
+
+    if (statec == 0) {
+        free(scale);
+        free(trial);
+        free(trial_derivatives);
+        return INFINITY;
+    }
+
+    for (int i = 0;i < statec;i++)
+        scale[i] = integrator->absolute + fabs(states[i]) * integrator->relative;
+
+    d0 = rms_norm(states, scale, statec);
+    d1 = rms_norm(derivatives, scale, statec);
+    h0 = d0 < 1e-5 || d1 < 1e-5 ? 1e-6 : 0.01 * d0 / d1;
+
+    for (int i = 0;i < statec;i++)
+        trial[i] = states[i] + h0 * integrator->direction * derivatives[i];
+    evaluate_rhs(integrator, time + h0 * integrator->direction, trial, trial_derivatives);
+
+    for (int i = 0;i < statec;i++)
+        trial[i] = trial_derivatives[i] - derivatives[i];
+    d2 = rms_norm(trial, scale, statec) / h0;
+
+    if (d1 <= 1e-15 && d2 <= 1e-15)
+        h1 = fmax(1e-6, h0 * 1e-3);
+    else
+        h1 = pow(0.01 / fmax(d1, d2), 1.0 / (order + 1));
+
+    free(scale);
+    free(trial);
+    free(trial_derivatives);
+
+    return fmin(100.0 * h0, h1);
+}
+
+// explicit Dormand-Prince 5(4) with first same as last stages and dense
+// output from the fourth order continuous extension
+static bool
+integrate_rk45(Integrator *integrator, double *states)
+{
+    int statec = integrator->ode->statec;
+    double direction = integrator->direction, time = integrator->start;
+    double *stages = (double *) malloc(sizeof(double) * (7 * statec + 1));
+    double *next = (double *) malloc(sizeof(double) * (statec + 1));
+    double *stage = (double *) malloc(sizeof(double) * (statec + 1));
+    double *scale = (double *) malloc(sizeof(double) * (statec + 1));
+    double *error = (double *) malloc(sizeof(double) * (statec + 1));
+    double *dense = (double *) malloc(sizeof(double) * (statec + 1));
+    double step_size;
+    bool is_failed = false;
+
+    evaluate_rhs(integrator, time, states, &stages[0]);
+    step_size = initial_step(integrator, time, states, &stages[0], 4);
+
+    while (direction * (time - integrator->end) < 0.0) {
+        double step = 0.0, next_time = time, sample_time, error_norm;
+        bool is_rejected = false, is_accepted = false;
+
+        if (step_size < minimum_step(time, direction))
+            step_size = minimum_step(time, direction);
+
+        while (!is_accepted) {
+            if (step_size < minimum_step(time, direction)) {
+                is_failed = true;
+                break;
+            }
+
+            step = step_size * direction;
+            next_time = time + step;
+            if (direction * (next_time - integrator->end) > 0.0)
+                next_time = integrator->end;
+            step = next_time - time;
+            step_size = fabs(step);
+
+            for (int s = 1;s < 6;s++) {
+                for (int i = 0;i < statec;i++) {
+                    double sum = 0.0;
+
+                    for (int j = 0;j < s;j++)
+                        sum += dopri_a[s][j] * stages[j * statec + i];
+                    stage[i] = states[i] + step * sum;
+                }
+                evaluate_rhs(integrator, time + dopri_c[s] * step, stage, &stages[s * statec]);
+            }
+
+            for (int i = 0;i < statec;i++) {
+                double sum = 0.0;
+
+                for (int j = 0;j < 6;j++)
+                    sum += dopri_b[j] * stages[j * statec + i];
+                next[i] = states[i] + step * sum;
+            }
+            evaluate_rhs(integrator, next_time, next, &stages[6 * statec]);
+
+            for (int i = 0;i < statec;i++) {
+                double sum = 0.0;
+
+                for (int j = 0;j < 7;j++)
+                    sum += dopri_e[j] * stages[j * statec + i];
+                error[i] = step * sum;
+                scale[i] = integrator->absolute + fmax(fabs(states[i]), fabs(next[i])) * integrator->relative;
+            }
+            error_norm = rms_norm(error, scale, statec);
+
+            if (error_norm < 1.0) {
+                double factor = error_norm == 0.0 ? ODE_MAXIMUM_FACTOR :
+                    fmin(ODE_MAXIMUM_FACTOR, ODE_SAFETY * pow(error_norm, -0.2));
+
+                if (is_rejected)
+                    factor = fmin(1.0, factor);
+                step_size *= factor;
+                is_accepted = true;
+            } else if (isnan(error_norm)) {
+                is_failed = true;
+                break;
+            } else {
+                step_size *= fmax(ODE_MINIMUM_FACTOR, ODE_SAFETY * pow(error_norm, -0.2));
+                is_rejected = true;
+                integrator->statistics->rejected++;
+            }
+        }
+
+        if (is_failed)
+            break;
+
+        while (next_sample(integrator, next_time, &sample_time)) {
+            double x = (sample_time - time) / step;
+
+            for (int i = 0;i < statec;i++) {
+                double sum = 0.0, power = 1.0;
+
+                for (int k = 0;k < 4;k++) {
+                    double q = 0.0;
+
+                    power *= x;
+                    for (int j = 0;j < 7;j++)
+                        q += stages[j * statec + i] * dopri_p[j][k];
+                    sum += q * power;
+                }
+                dense[i] = states[i] + step * sum;
+            }
+            take_sample(integrator, sample_time, dense);
+        }
+
+        time = next_time;
+        memcpy(states, next, sizeof(double) * statec);
+        memcpy(&stages[0], &stages[6 * statec], sizeof(double) * statec);
+        integrator->statistics->steps++;
+        sample_step(integrator, time, states);
+    }
+
+    free(stages);
+    free(next);
+    free(stage);
+    free(scale);
+    free(error);
+    free(dense);
+
+    return !is_failed;
+}
+
+// R with R[i][j] = prod_{k <= i} (k - 1 - factor j) / k, it moves the
+// backward differences of BDF to a step size scaled by factor
+static void
+difference_matrix(int order, double factor, double matrix[BDF_ORDER + 1][BDF_ORDER + 1])
+{
+    for (int j = 0;j <= order;j++)
+        matrix[0][j] = 1.0;
+    for (int i = 1;i <= order;i++) {
+        matrix[i][0] = 0.0;
+        for (int j = 1;j <= order;j++)
+            matrix[i][j] = matrix[i - 1][j] * (i - 1 - factor * j) / i;
+    }
+    return;
+}
+
+static void
+change_differences(double *differences, int statec, int order, double factor)
+{
+    double r[BDF_ORDER + 1][BDF_ORDER + 1], u[BDF_ORDER + 1][BDF_ORDER + 1];
+    double ru[BDF_ORDER + 1][BDF_ORDER + 1];
+    double *changed = (double *) malloc(sizeof(double) * ((order + 1) * statec + 1));
+
+    difference_matrix(order, factor, r);
+    difference_matrix(order, 1.0, u);
+
+    for (int i = 0;i <= order;i++)
+        for (int j = 0;j <= order;j++) {
+            ru[i][j] = 0.0;
+            for (int k = 0;k <= order;k++)
+                ru[i][j] += r[i][k] * u[k][j];
+        }
+
+    // differences = ru^T differences
+    for (int j = 0;j <= order;j++)
+        for (int s = 0;s < statec;s++) {
+            double sum = 0.0;
+
+            for (int i = 0;i <= order;i++)
+                sum += ru[i][j] * differences[i * statec + s];
+            changed[j * statec + s] = sum;
+        }
+
+    memcpy(differences, changed, sizeof(double) * (order + 1) * statec);
+    free(changed);
+    return;
+}
+
+// jacobian of the right hand sides with respect to the states
+static void
+state_jacobian(Integrator *integrator, double time, double *states, double *jacobian, double *full)
+{
+    Ode *ode = integrator->ode;
+    int statec = ode->statec;
+
+    integrator->point[0] = time;
+    memcpy(&integrator->point[1], states, sizeof(double) * statec);
+    jacobian_tape(ode->tape, integrator->point, integrator->registers, full);
+
+    for (int i = 0;i < statec;i++)
+        memcpy(&jacobian[i * statec], &full[i * (statec + 1) + 1], sizeof(double) * statec);
+    integrator->statistics->jacobians++;
+    return;
+}
+
+// variable order, quasi constant step BDF in backward difference form
+// (Shampine and Reichelt) with the jacobian from the tape, the Newton
+// iteration keeps its factorization until it stops converging
+static bool
+integrate_bdf(Integrator *integrator, double *states)
+{
+    int statec = integrator->ode->statec, order = 1, equal_steps = 0;
+    double direction = integrator->direction, time = integrator->start;
+    double gamma[BDF_ORDER + 2], error_constants[BDF_ORDER + 2];
+    double *differences = (double *) calloc((BDF_ORDER + 3) * statec + 1, sizeof(double));
+    double *jacobian = (double *) malloc(sizeof(double) * (statec * statec + 1));
+    double *full = (double *) malloc(sizeof(double) * (statec * (statec + 1) + 1));
+    double *matrix = (double *) malloc(sizeof(double) * (statec * statec + 1));
+    int *pivots = (int *) malloc(sizeof(int) * (statec + 1));
+    double *derivatives = (double *) malloc(sizeof(double) * (statec + 1));
+    double *predicted = (double *) malloc(sizeof(double) * (statec + 1));
+    double *next = (double *) malloc(sizeof(double) * (statec + 1));
+    double *correction = (double *) malloc(sizeof(double) * (statec + 1));
+    double *psi = (double *) malloc(sizeof(double) * (statec + 1));
+    double *rhs = (double *) malloc(sizeof(double) * (statec + 1));
+    double *delta = (double *) malloc(sizeof(double) * (statec + 1));
+    double *scale = (double *) malloc(sizeof(double) * (statec + 1));
+    double *error = (double *) malloc(sizeof(double) * (statec + 1));
+    double *dense = (double *) malloc(sizeof(double) * (statec + 1));
+    double step_size, newton_tolerance;
+    bool has_factor = false, is_failed = false;
+
+    gamma[0] = 0.0;
+    for (int k = 1;k <= BDF_ORDER + 1;k++)
+        gamma[k] = gamma[k - 1] + 1.0 / k;
+    for (int k = 0;k <= BDF_ORDER + 1;k++)
+        error_constants[k] = 1.0 / (k + 1);
+
+    newton_tolerance = fmax(10.0 * DBL_EPSILON / integrator->relative, fmin(0.03, sqrt(integrator->relative)));
+
+    evaluate_rhs(integrator, time, states, derivatives);
+    step_size = initial_step(integrator, time, states, derivatives, 1);
+
+    state_jacobian(integrator, time, states, jacobian, full);
+    memcpy(&differences[0], states, sizeof(double) * statec);
+    for (int i = 0;i < statec;i++)
+        differences[statec + i] = derivatives[i] * step_size * direction;
+
+    while (direction * (time - integrator->end) < 0.0) {
+        double step = 0.0, next_time = time, c = 0.0, error_norm = 0.0, safety = ODE_SAFETY, sample_time;
+        bool is_current = false, is_accepted = false;
+        int iterations = 0;
+
+        if (step_size < minimum_step(time, direction)) {
+            change_differences(differences, statec, order, minimum_step(time, direction) / step_size);
+            step_size = minimum_step(time, direction);
+            equal_steps = 0;
+        }
+
+        while (!is_accepted) {
+            bool is_converged = false;
+
+            if (step_size < minimum_step(time, direction)) {
+                is_failed = true;
+                break;
+            }
+
+            step = step_size * direction;
+            next_time = time + step;
+            if (direction * (next_time - integrator->end) > 0.0) {
+                next_time = integrator->end;
+                change_differences(differences, statec, order, fabs(next_time - time) / step_size);
+                equal_steps = 0;
+                has_factor = false;
+            }
+            step = next_time - time;
+            step_size = fabs(step);
+
+            for (int i = 0;i < statec;i++) {
+                double sum = 0.0, weighted = 0.0;
+
+                for (int k = 0;k <= order;k++)
+                    sum += differences[k * statec + i];
+                for (int k = 1;k <= order;k++)
+                    weighted += gamma[k] * differences[k * statec + i];
+                predicted[i] = sum;
+                psi[i] = weighted / gamma[order];
+                scale[i] = integrator->absolute + integrator->relative * fabs(sum);
+            }
+
+            c = step / gamma[order];
+
+            while (!is_converged) {
+                double previous_norm = -1.0;
+
+                // the factorization is kept across steps as long as the
+                // iteration converges, c may have changed since then
+                if (!has_factor) {
+                    for (int i = 0;i < statec;i++)
+                        for (int j = 0;j < statec;j++)
+                            matrix[i * statec + j] = (i == j ? 1.0 : 0.0) - c * jacobian[i * statec + j];
+                    has_factor = dense_lu(statec, matrix, pivots);
+                    integrator->statistics->factorizations++;
+                    if (!has_factor)
+                        break;
+                }
+
+                memcpy(next, predicted, sizeof(double) * statec);
+                memset(correction, 0, sizeof(double) * statec);
+
+                for (iterations = 1;iterations <= BDF_ITERATIONS;iterations++) {
+                    double norm, rate = -1.0;
+                    bool is_finite = true;
+
+                    evaluate_rhs(integrator, next_time, next, derivatives);
+                    for (int i = 0;i < statec;i++)
+                        if (!isfinite(derivatives[i]))
+                            is_finite = false;
+                    if (!is_finite)
+                        break;
+
+                    for (int i = 0;i < statec;i++)
+                        rhs[i] = c * derivatives[i] - psi[i] - correction[i];
+                    dense_lu_solve(statec, matrix, pivots, rhs, delta);
+                    norm = rms_norm(delta, scale, statec);
+
+                    if (previous_norm >= 0.0)
+                        rate = norm / previous_norm;
+                    if (rate >= 0.0 && (rate >= 1.0 ||
+                                pow(rate, BDF_ITERATIONS - iterations + 1) / (1.0 - rate) * norm > newton_tolerance))
+                        break;
+
+                    for (int i = 0;i < statec;i++) {
+                        next[i] += delta[i];
+                        correction[i] += delta[i];
+                    }
+
+                    if (norm == 0.0 || (rate >= 0.0 && rate / (1.0 - rate) * norm < newton_tolerance)) {
+                        is_converged = true;
+                        break;
+                    }
+                    previous_norm = norm;
+                }
+
+                if (is_converged || is_current)
+                    break;
+
+                state_jacobian(integrator, next_time, predicted, jacobian, full);
+                has_factor = false;
+                is_current = true;
+            }
+
+            if (!is_converged) {
+                step_size *= 0.5;
+                change_differences(differences, statec, order, 0.5);
+                equal_steps = 0;
+                has_factor = false;
+                integrator->statistics->rejected++;
+                continue;
+            }
+
+            safety = ODE_SAFETY * (2 * BDF_ITERATIONS + 1) / (2 * BDF_ITERATIONS + iterations);
+
+            for (int i = 0;i < statec;i++) {
+                scale[i] = integrator->absolute + integrator->relative * fabs(next[i]);
+                error[i] = error_constants[order] * correction[i];
+            }
+            error_norm = rms_norm(error, scale, statec);
+
+            if (error_norm > 1.0 || isnan(error_norm)) {
+                double factor = isnan(error_norm) ? ODE_MINIMUM_FACTOR :
+                    fmax(ODE_MINIMUM_FACTOR, safety * pow(error_norm, -1.0 / (order + 1)));
+
+                step_size *= factor;
+                change_differences(differences, statec, order, factor);
+                equal_steps = 0;
+                integrator->statistics->rejected++;
+            } else {
+                is_accepted = true;
+            }
+        }
+
+        if (is_failed)
+            break;
+
+        equal_steps++;
+        integrator->statistics->steps++;
+
+        for (int i = 0;i < statec;i++) {
+            differences[(order + 2) * statec + i] = correction[i] - differences[(order + 1) * statec + i];
+            differences[(order + 1) * statec + i] = correction[i];
+        }
+        for (int k = order;k >= 0;k--)
+            for (int i = 0;i < statec;i++)
+                differences[k * statec + i] += differences[(k + 1) * statec + i];
+
+        // order and step size change after order + 1 steps of equal size
+        if (equal_steps >= order + 1) {
+            double norms[3], factors[3], best;
+            int change = 0;
+
+            norms[0] = INFINITY;
+            norms[1] = error_norm;
+            norms[2] = INFINITY;
+            if (order > 1) {
+                for (int i = 0;i < statec;i++)
+                    error[i] = error_constants[order - 1] * differences[order * statec + i];
+                norms[0] = rms_norm(error, scale, statec);
+            }
+            if (order < BDF_ORDER) {
+                for (int i = 0;i < statec;i++)
+                    error[i] = error_constants[order + 1] * differences[(order + 2) * statec + i];
+                norms[2] = rms_norm(error, scale, statec);
+            }
+
+            for (int k = 0;k < 3;k++)
+                factors[k] = pow(norms[k], -1.0 / (order + k));
+            for (int k = 1;k < 3;k++)
+                if (factors[k] > factors[change])
+                    change = k;
+            best = factors[change];
+
+            order += change - 1;
+            best = fmin(ODE_MAXIMUM_FACTOR, safety * best);
+            step_size *= best;
+            change_differences(differences, statec, order, best);
+            equal_steps = 0;
+            has_factor = false;
+        }
+
+        // the interpolating polynomial through the backward differences
+        while (next_sample(integrator, next_time, &sample_time)) {
+            double h = step_size * direction;
+
+            for (int i = 0;i < statec;i++)
+                dense[i] = differences[i];
+            {
+                double product = 1.0;
+
+                for (int k = 1;k <= order;k++) {
+                    product *= (sample_time - (next_time - h * (k - 1))) / (h * k);
+                    for (int i = 0;i < statec;i++)
+                        dense[i] += differences[k * statec + i] * product;
+                }
+            }
+            take_sample(integrator, sample_time, dense);
+        }
+
+        time = next_time;
+        memcpy(states, differences, sizeof(double) * statec);
+        sample_step(integrator, time, states);
+    }
+
+    free(differences);
+    free(jacobian);
+    free(full);
+    free(matrix);
+    free(pivots);
+    free(derivatives);
+    free(predicted);
+    free(next);
+    free(correction);
+    free(psi);
+    free(rhs);
+    free(delta);
+    free(scale);
+    free(error);
+    free(dense);
+
+    return !is_failed;
+}
+
+// integrates from start to end, values holds the initial states and
+// receives the final ones. With interval > 0 the dense output is sampled
+// every interval and at end, otherwise every accepted step is written.
+bool
+integrate_ode(Ode *ode, OdeMethod method, double start, double end, double *values,
+        double interval, double relative, double absolute, OdeOutput *output, OdeStatistics *statistics)
+{
+    OdeStatistics local;
+    Integrator integrator;
+    double sample_time;
+
+    if (statistics == NULL)
+        statistics = &local;
+    memset(statistics, 0, sizeof(OdeStatistics));
+    statistics->is_success = false;
+
+    integrator.ode = ode;
+    integrator.start = start;
+    integrator.end = end;
+    integrator.direction = end >= start ? 1.0 : -1.0;
+    integrator.relative = fmax(relative, 100.0 * DBL_EPSILON);
+    integrator.absolute = absolute;
+    integrator.point = (double *) malloc(sizeof(double) * (ode->statec + 2));
+    integrator.registers = (double *) malloc(sizeof(double) * (ode->program->length + 1));
+    integrator.output = output;
+    integrator.interval = interval;
+    integrator.sample = 0;
+    integrator.is_sampled = false;
+    integrator.statistics = statistics;
+
+    if (output != NULL) {
+        if (interval > 0.0 && next_sample(&integrator, start, &sample_time))
+            take_sample(&integrator, sample_time, values);
+        else
+            sample_step(&integrator, start, values);
+    }
+
+    if (method == ODE_BDF)
+        statistics->is_success = integrate_bdf(&integrator, values);
+    else
+        statistics->is_success = integrate_rk45(&integrator, values);
+
+    if (output != NULL)
+        flush_ode_output(output);
+
+    free(integrator.point);
+    free(integrator.registers);
+
+    return statistics->is_success;
+}
+
+bool
+solve_differential(int equationc, Term **equations, Term *time, OdeMethod method,
+        double start, double end, double *values, double interval, double relative, double absolute,
+        OdeOutput *output, OdeStatistics *statistics)
+{
+    Ode *ode = compile_ode(equationc, equations, time);
+    bool is_success;
+
+    if (ode == NULL)
+        return false;
+
+    is_success = integrate_ode(ode, method, start, end, values, interval, relative, absolute, output, statistics);
+    free_ode(ode);
+
+    return is_success;
+}
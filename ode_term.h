@@ -0,0 +1,60 @@
+#ifndef ODE_TERM_H_
+#define ODE_TERM_H_
+
+typedef struct Ode Ode;
+typedef struct OdeOutput OdeOutput;
+typedef struct OdeStatistics OdeStatistics;
+
+typedef enum {
+    ODE_RK45,
+    ODE_BDF
+} OdeMethod;
+
+// D[states[i], time] = right hand side i, the right hand sides are
+// compiled over time followed by the states
+struct Ode {
+    int statec;
+    Term *time;
+    Term **states;
+    Program *program;
+    Tape *tape;
+};
+
+// block of dense output samples, sample k is times[k] with the states
+// states[k * statec .. k * statec + statec - 1]. A full block is handed
+// to flush and reused, without flush the block grows instead.
+struct OdeOutput {
+    int statec;
+    int capacity;
+    int count;
+    double *times;
+    double *states;
+    void *context;
+    void (*flush)(void *context, int count, double *times, double *states);
+};
+
+struct OdeStatistics {
+    bool is_success;
+    int steps;
+    int rejected;
+    int evaluations;
+    int jacobians;
+    int factorizations;
+    int samples;
+};
+
+Ode *compile_ode(int equationc, Term **equations, Term *time);
+void free_ode(Ode *ode);
+
+OdeOutput *ode_output(int statec, int capacity,
+        void (*flush)(void *context, int count, double *times, double *states), void *context);
+void flush_ode_output(OdeOutput *output);
+void free_ode_output(OdeOutput *output);
+
+bool integrate_ode(Ode *ode, OdeMethod method, double start, double end, double *values,
+        double interval, double relative, double absolute, OdeOutput *output, OdeStatistics *statistics);
+bool solve_differential(int equationc, Term **equations, Term *time, OdeMethod method,
+        double start, double end, double *values, double interval, double relative, double absolute,
+        OdeOutput *output, OdeStatistics *statistics);
+
+#endif // ODE_TERM_H_
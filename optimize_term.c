@@ -0,0 +1,636 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
+#include "term.h"
+#include "memory_term.h"
+#include "compare_term.h"
+#include "compile_term.h"
+#include "sparse_term.h"
+#include "tape_term.h"
+#include "optimize_term.h"
+
+// sufficient decrease and curvature constants of the line search
+#define OPTIMIZE_DECREASE 1e-4
+#define OPTIMIZE_CURVATURE 0.9
+// trial steps of one line search
+#define OPTIMIZE_TRIALS 40
+// random starts are spread this many times 1 + |start| around the start
+// in unbounded directions
+#define OPTIMIZE_SPREAD 2.0
+
+typedef struct Search Search;
+typedef struct OptimizeJob OptimizeJob;
+
+// scratch space of one local search, s and y hold the correction pairs
+// in a ring of OPTIMIZE_MEMORY rows
+struct Search {
+    Tape *tape;
+    int size;
+    double *lower;
+    double *upper;
+    bool is_bounded;
+    double tolerance;
+
+    int memoryc;
+    int newest;
+    double *s;
+    double *y;
+    double *rho;
+    double *alpha;
+
+    double *gradient;
+    double *projected;
+    double *direction;
+    double *trial;
+    double *trial_gradient;
+    double trial_value;
+
+    int iterations;
+    int evaluations;
+};
+
+struct OptimizeJob {
+    pthread_mutex_t mutex;
+    int next;
+    int count;
+    int size;
+    Program *program;
+    double *lower;
+    double *upper;
+    bool is_bounded;
+    double tolerance;
+
+    double *points;
+    double *values;
+    bool *is_converged;
+    int *iterations;
+    int *evaluations;
+};
+
+static double
+seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// splitmix64, uniform in [0, 1)
+static double
+random_uniform(unsigned long long *state)
+{
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+
+    return (z >> 11) / 9007199254740992.0;
+}
+
+static double
+dot(double *lhs, double *rhs, int size)
+{
+    double sum = 0.0;
+
+    for (int i = 0;i < size;i++)
+        sum += lhs[i] * rhs[i];
+    return sum;
+}
+
+static double
+clamp(double value, double lower, double upper)
+{
+    return value < lower ? lower : value > upper ? upper : value;
+}
+
+static double
+evaluate_objective(Search *search, double *point, double *gradient)
+{
+    double value = gradient_tape(search->tape, point, gradient);
+
+    search->evaluations++;
+    return isnan(value) ? INFINITY : value;
+}
+
+// gradient with the components removed that would leave the box
+static double
+project_gradient(Search *search, double *point)
+{
+    double norm = 0.0;
+
+    for (int i = 0;i < search->size;i++) {
+        double g = search->gradient[i];
+
+        if ((point[i] <= search->lower[i] && g > 0.0) || (point[i] >= search->upper[i] && g < 0.0))
+            g = 0.0;
+        search->projected[i] = g;
+        if (fabs(g) > norm)
+            norm = fabs(g);
+    }
+    return norm;
+}
+
+// direction = -H projected by the two loop recursion, H0 is scaled by
+// s^T y / y^T y of the newest pair
+static void
+two_loop(Search *search)
+{
+    int size = search->size;
+    double *q = search->direction;
+
+    memcpy(q, search->projected, sizeof(double) * size);
+
+    for (int k = 0;k < search->memoryc;k++) {
+        int row = (search->newest - k + OPTIMIZE_MEMORY) % OPTIMIZE_MEMORY;
+        double *s = &search->s[row * size], *y = &search->y[row * size];
+
+        search->alpha[row] = search->rho[row] * dot(s, q, size);
+        for (int i = 0;i < size;i++)
+            q[i] -= search->alpha[row] * y[i];
+    }
+
+    if (search->memoryc > 0) {
+        double *y = &search->y[search->newest * size];
+        double scale = 1.0 / (search->rho[search->newest] * dot(y, y, size));
+
+        for (int i = 0;i < size;i++)
+            q[i] *= scale;
+    }
+
+    for (int k = search->memoryc - 1;k >= 0;k--) {
+        int row = (search->newest - k + OPTIMIZE_MEMORY) % OPTIMIZE_MEMORY;
+        double *s = &search->s[row * size], *y = &search->y[row * size];
+        double beta = search->rho[row] * dot(y, q, size);
+
+        for (int i = 0;i < size;i++)
+            q[i] += (search->alpha[row] - beta) * s[i];
+    }
+
+    for (int i = 0;i < size;i++)
+        q[i] = search->projected[i] == 0.0 && search->is_bounded ? 0.0 : -q[i];
+    return;
+}
+
+static double
+trial_step(Search *search, double *point, double step, double *slope)
+{
+    double value;
+
+    for (int i = 0;i < search->size;i++)
+        search->trial[i] = point[i] + step * search->direction[i];
+
+    value = evaluate_objective(search, search->trial, search->trial_gradient);
+    *slope = dot(search->trial_gradient, search->direction, search->size);
+    search->trial_value = value;
+
+    return value;
+}
+
+// minimizer of the cubic through two points with slopes, bisection if it
+// falls outside the inner part of the interval
+static double
+interpolate(double a, double fa, double da, double b, double fb, double db)
+{
+    double d1 = da + db - 3.0 * (fa - fb) / (a - b), discriminant = d1 * d1 - da * db;
+    double lower = fmin(a, b), upper = fmax(a, b), width = upper - lower, d2, step;
+
+    if (discriminant >= 0.0 && isfinite(fb)) {
+        d2 = (b > a ? 1.0 : -1.0) * sqrt(discriminant);
+        step = b - (b - a) * (db + d2 - d1) / (db - da + 2.0 * d2);
+        if (step >= lower + 0.1 * width && step <= upper - 0.1 * width)
+            return step;
+    }
+    return (a + b) / 2.0;
+}
+
+// strong Wolfe line search (Nocedal and Wright, algorithms 3.5 and 3.6),
+// on success search->trial and trial_gradient hold the accepted point
+static bool
+wolfe_search(Search *search, double *point, double value, double step, double *accepted)
+{
+    double slope = dot(search->gradient, search->direction, search->size);
+    double previous = 0.0, previous_value = value, previous_slope = slope;
+    double low = 0.0, low_value = value, low_slope = slope, high = 0.0, high_value = value, high_slope = slope;
+    double trial_value = value, trial_slope = slope;
+
+    for (int k = 0;k < OPTIMIZE_TRIALS;k++) {
+        trial_value = trial_step(search, point, step, &trial_slope);
+
+        if (trial_value > value + OPTIMIZE_DECREASE * step * slope || (k > 0 && trial_value >= previous_value)) {
+            low = previous, low_value = previous_value, low_slope = previous_slope;
+            high = step, high_value = trial_value, high_slope = trial_slope;
+            break;
+        }
+        if (fabs(trial_slope) <= -OPTIMIZE_CURVATURE * slope) {
+            *accepted = step;
+            return true;
+        }
+        if (trial_slope >= 0.0) {
+            low = step, low_value = trial_value, low_slope = trial_slope;
+            high = previous, high_value = previous_value, high_slope = previous_slope;
+            break;
+        }
+
+        previous = step;
+        previous_value = trial_value;
+        previous_slope = trial_slope;
+        step *= 2.0;
+
+        if (k == OPTIMIZE_TRIALS - 1)
+            return false;
+    }
+
+    // zoom into [low, high], low always satisfies sufficient decrease
+    for (int k = 0;k < OPTIMIZE_TRIALS;k++) {
+        step = interpolate(low, low_value, low_slope, high, high_value, high_slope);
+        trial_value = trial_step(search, point, step, &trial_slope);
+
+        if (trial_value > value + OPTIMIZE_DECREASE * step * slope || trial_value >= low_value) {
+            high = step, high_value = trial_value, high_slope = trial_slope;
+        } else {
+            if (fabs(trial_slope) <= -OPTIMIZE_CURVATURE * slope) {
+                *accepted = step;
+                return true;
+            }
+            if (trial_slope * (high - low) >= 0.0) {
+                high = low, high_value = low_value, high_slope = low_slope;
+            }
+            low = step, low_value = trial_value, low_slope = trial_slope;
+        }
+
+        if (fabs(high - low) <= DBL_EPSILON * fabs(low))
+            break;
+    }
+
+    // fall back to the best point with sufficient decrease
+    if (low <= 0.0)
+        return false;
+    trial_step(search, point, low, &trial_slope);
+    *accepted = low;
+    return true;
+}
+
+// backtracking along the projected path P(point + step direction) with
+// the Armijo condition on the actual displacement
+static bool
+projected_search(Search *search, double *point, double value, double step, double *accepted)
+{
+    for (int k = 0;k < OPTIMIZE_TRIALS;k++) {
+        double decrease = 0.0, trial_value;
+
+        for (int i = 0;i < search->size;i++) {
+            search->trial[i] = clamp(point[i] + step * search->direction[i], search->lower[i], search->upper[i]);
+            decrease += search->gradient[i] * (search->trial[i] - point[i]);
+        }
+
+        trial_value = evaluate_objective(search, search->trial, search->trial_gradient);
+        if (trial_value <= value + OPTIMIZE_DECREASE * decrease && decrease < 0.0) {
+            search->trial_value = trial_value;
+            *accepted = step;
+            return true;
+        }
+        step *= 0.5;
+    }
+    return false;
+}
+
+// L-BFGS from point, with bounds the gradient is projected, active
+// variables are held fixed and the line search follows the projected
+// path. Returns the final value and leaves the minimizer in point.
+static double
+local_search(Search *search, double *point, bool *is_converged)
+{
+    int size = search->size;
+    double value, step;
+
+    *is_converged = false;
+    search->memoryc = 0;
+    search->newest = OPTIMIZE_MEMORY - 1;
+    search->iterations = 0;
+    search->evaluations = 0;
+
+    for (int i = 0;i < size;i++)
+        point[i] = clamp(point[i], search->lower[i], search->upper[i]);
+    value = evaluate_objective(search, point, search->gradient);
+
+    while (search->iterations < OPTIMIZE_ITERATIONS && isfinite(value)) {
+        double norm = project_gradient(search, point), slope, trial_value;
+        bool is_found;
+
+        if (norm <= search->tolerance) {
+            *is_converged = true;
+            break;
+        }
+
+        two_loop(search);
+        slope = dot(search->gradient, search->direction, size);
+        if (!(slope < 0.0)) {
+            // not a descent direction, start over with steepest descent
+            search->memoryc = 0;
+            two_loop(search);
+            slope = dot(search->gradient, search->direction, size);
+        }
+
+        step = search->memoryc == 0 ? fmin(1.0, 1.0 / norm) : 1.0;
+        if (search->is_bounded)
+            is_found = projected_search(search, point, value, step, &step);
+        else
+            is_found = wolfe_search(search, point, value, step, &step);
+
+        search->iterations++;
+
+        if (!is_found) {
+            if (search->memoryc == 0)
+                break;
+            search->memoryc = 0;
+            continue;
+        }
+
+        trial_value = search->trial_value;
+
+        // store the correction pair if it keeps H positive definite
+        {
+            int row = (search->newest + 1) % OPTIMIZE_MEMORY;
+            double *s = &search->s[row * size], *y = &search->y[row * size], curvature;
+
+            for (int i = 0;i < size;i++) {
+                s[i] = search->trial[i] - point[i];
+                y[i] = search->trial_gradient[i] - search->gradient[i];
+            }
+            curvature = dot(s, y, size);
+            if (curvature > DBL_EPSILON * dot(y, y, size)) {
+                search->rho[row] = 1.0 / curvature;
+                search->newest = row;
+                if (search->memoryc < OPTIMIZE_MEMORY)
+                    search->memoryc++;
+            }
+        }
+
+        memcpy(point, search->trial, sizeof(double) * size);
+        memcpy(search->gradient, search->trial_gradient, sizeof(double) * size);
+
+        if (value - trial_value <= 10.0 * DBL_EPSILON * fmax(fmax(fabs(value), fabs(trial_value)), 1.0)) {
+            value = trial_value;
+            *is_converged = true;
+            break;
+        }
+        value = trial_value;
+    }
+
+    return value;
+}
+
+static void *
+run_optimize_job(void *argument)
+{
+    OptimizeJob *job = argument;
+    int size = job->size;
+    Search search;
+
+    search.tape = record_tape(job->program);
+    search.size = size;
+    search.lower = job->lower;
+    search.upper = job->upper;
+    search.is_bounded = job->is_bounded;
+    search.tolerance = job->tolerance;
+    search.s = (double *) malloc(sizeof(double) * (OPTIMIZE_MEMORY * size + 1));
+    search.y = (double *) malloc(sizeof(double) * (OPTIMIZE_MEMORY * size + 1));
+    search.rho = (double *) malloc(sizeof(double) * OPTIMIZE_MEMORY);
+    search.alpha = (double *) malloc(sizeof(double) * OPTIMIZE_MEMORY);
+    search.gradient = (double *) malloc(sizeof(double) * (size + 1));
+    search.projected = (double *) malloc(sizeof(double) * (size + 1));
+    search.direction = (double *) malloc(sizeof(double) * (size + 1));
+    search.trial = (double *) malloc(sizeof(double) * (size + 1));
+    search.trial_gradient = (double *) malloc(sizeof(double) * (size + 1));
+
+    for (;;) {
+        int index;
+
+        pthread_mutex_lock(&job->mutex);
+        index = job->next++;
+        pthread_mutex_unlock(&job->mutex);
+
+        if (index >= job->count)
+            break;
+
+        job->values[index] = local_search(&search, &job->points[index * size], &job->is_converged[index]);
+        job->iterations[index] = search.iterations;
+        job->evaluations[index] = search.evaluations;
+    }
+
+    free_tape(search.tape);
+    free(search.s);
+    free(search.y);
+    free(search.rho);
+    free(search.alpha);
+    free(search.gradient);
+    free(search.projected);
+    free(search.direction);
+    free(search.trial);
+    free(search.trial_gradient);
+
+    return NULL;
+}
+
+// copy of term with every constant that is one of the unknowns replaced
+// by its placeholder variable
+static Term *
+replace_constants(Term *term, int variablec, Term **variables, Term **placeholders)
+{
+    Operator *temp_operator;
+    Term **argv;
+
+    if (strcmp(term->meaning, "constant") == 0) {
+        for (int i = 0;i < variablec;i++)
+            if (is_equal(term, variables[i]))
+                return copy_term(placeholders[i]);
+        return copy_term(term);
+    }
+
+    if (strcmp(term->meaning, "operator") != 0)
+        return copy_term(term);
+
+    temp_operator = term->content;
+    argv = (Term **) allocate(sizeof(Term *) * temp_operator->argc);
+    for (int i = 0;i < temp_operator->argc;i++)
+        argv[i] = replace_constants(temp_operator->argv[i], variablec, variables, placeholders);
+
+    return operator(temp_operator->name, temp_operator->argc, argv);
+}
+
+// the unknowns are variables or constants, a constant is optimized
+// within its limits. lower and upper may be NULL or hold infinities.
+// Start 0 is start (or the middle of the box), the others are random.
+static Optimization *
+optimize(Term *term, int variablec, Term **variables, double *start, double *lower, double *upper,
+        int startc, int threadc, double tolerance, bool is_maximum)
+{
+    Optimization *optimization;
+    OptimizeJob job;
+    Term **placeholders, *objective;
+    pthread_t *threads;
+    double *center, begin = seconds();
+    unsigned long long state = 0x5eed;
+
+    if (startc < 1)
+        startc = 1;
+    if (threadc < 1)
+        threadc = 1;
+    if (threadc > startc)
+        threadc = startc;
+
+    placeholders = (Term **) malloc(sizeof(Term *) * (variablec + 1));
+    for (int i = 0;i < variablec;i++) {
+        char name[32];
+
+        if (strcmp(variables[i]->meaning, "constant") == 0) {
+            sprintf(name, "#optimize_%d", i);
+            placeholders[i] = variable(name);
+        } else {
+            placeholders[i] = copy_term(variables[i]);
+        }
+    }
+
+    objective = replace_constants(term, variablec, variables, placeholders);
+    if (is_maximum)
+        objective = additive_inverse(objective);
+
+    job.program = compile_term(objective, variablec, placeholders);
+    free_term(objective);
+    for (int i = 0;i < variablec;i++)
+        free_term(placeholders[i]);
+    free(placeholders);
+
+    if (job.program == NULL)
+        return NULL;
+
+    job.size = variablec;
+    job.lower = (double *) malloc(sizeof(double) * (variablec + 1));
+    job.upper = (double *) malloc(sizeof(double) * (variablec + 1));
+    job.is_bounded = false;
+    center = (double *) malloc(sizeof(double) * (variablec + 1));
+
+    for (int i = 0;i < variablec;i++) {
+        job.lower[i] = lower != NULL ? lower[i] : -INFINITY;
+        job.upper[i] = upper != NULL ? upper[i] : INFINITY;
+
+        if (strcmp(variables[i]->meaning, "constant") == 0) {
+            Constant *limits = variables[i]->content;
+
+            job.lower[i] = fmax(job.lower[i], limits->lower_limit);
+            job.upper[i] = fmin(job.upper[i], limits->upper_limit);
+        }
+        if (isfinite(job.lower[i]) || isfinite(job.upper[i]))
+            job.is_bounded = true;
+
+        if (start != NULL)
+            center[i] = start[i];
+        else if (isfinite(job.lower[i]) && isfinite(job.upper[i]))
+            center[i] = (job.lower[i] + job.upper[i]) / 2.0;
+        else if (isfinite(job.lower[i]))
+            center[i] = job.lower[i];
+        else if (isfinite(job.upper[i]))
+            center[i] = job.upper[i];
+        else
+            center[i] = 0.0;
+    }
+
+    job.count = startc;
+    job.next = 0;
+    job.tolerance = tolerance;
+    job.points = (double *) malloc(sizeof(double) * (startc * variablec + 1));
+    job.values = (double *) malloc(sizeof(double) * startc);
+    job.is_converged = (bool *) malloc(sizeof(bool) * startc);
+    job.iterations = (int *) malloc(sizeof(int) * startc);
+    job.evaluations = (int *) malloc(sizeof(int) * startc);
+
+    for (int k = 0;k < startc;k++)
+        for (int i = 0;i < variablec;i++) {
+            double *point = &job.points[k * variablec + i], u;
+
+            if (k == 0) {
+                *point = center[i];
+                continue;
+            }
+
+            u = random_uniform(&state);
+            if (isfinite(job.lower[i]) && isfinite(job.upper[i]))
+                *point = job.lower[i] + u * (job.upper[i] - job.lower[i]);
+            else
+                *point = clamp(center[i] + (2.0 * u - 1.0) * OPTIMIZE_SPREAD * (1.0 + fabs(center[i])),
+                        job.lower[i], job.upper[i]);
+        }
+
+    pthread_mutex_init(&job.mutex, NULL);
+    threads = (pthread_t *) malloc(sizeof(pthread_t) * threadc);
+    for (int i = 1;i < threadc;i++)
+        pthread_create(&threads[i], NULL, run_optimize_job, &job);
+    run_optimize_job(&job);
+    for (int i = 1;i < threadc;i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_mutex_destroy(&job.mutex);
+
+    optimization = (Optimization *) malloc(sizeof(Optimization));
+    optimization->variablec = variablec;
+    optimization->point = (double *) malloc(sizeof(double) * (variablec + 1));
+    optimization->startc = startc;
+    optimization->best_start = 0;
+    optimization->converged = 0;
+    optimization->iterations = 0;
+    optimization->evaluations = 0;
+
+    for (int k = 0;k < startc;k++) {
+        if (job.values[k] < job.values[optimization->best_start])
+            optimization->best_start = k;
+        if (job.is_converged[k])
+            optimization->converged++;
+        optimization->iterations += job.iterations[k];
+        optimization->evaluations += job.evaluations[k];
+    }
+
+    optimization->is_converged = job.is_converged[optimization->best_start];
+    optimization->value = is_maximum ? -job.values[optimization->best_start] : job.values[optimization->best_start];
+    memcpy(optimization->point, &job.points[optimization->best_start * variablec], sizeof(double) * variablec);
+    optimization->time = seconds() - begin;
+
+    free(center);
+    free(job.lower);
+    free(job.upper);
+    free(job.points);
+    free(job.values);
+    free(job.is_converged);
+    free(job.iterations);
+    free(job.evaluations);
+    free_program(job.program);
+
+    return optimization;
+}
+
+Optimization *
+minimize(Term *term, int variablec, Term **variables, double *start,
+        double *lower, double *upper, int startc, int threadc, double tolerance)
+{
+    return optimize(term, variablec, variables, start, lower, upper, startc, threadc, tolerance, false);
+}
+
+Optimization *
+maximize(Term *term, int variablec, Term **variables, double *start,
+        double *lower, double *upper, int startc, int threadc, double tolerance)
+{
+    return optimize(term, variablec, variables, start, lower, upper, startc, threadc, tolerance, true);
+}
+
+void
+free_optimization(Optimization *optimization)
+{
+    free(optimization->point);
+    free(optimization);
+    return;
+}
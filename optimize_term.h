@@ -0,0 +1,34 @@
+#ifndef OPTIMIZE_TERM_H_
+#define OPTIMIZE_TERM_H_
+
+// correction pairs kept by L-BFGS
+#define OPTIMIZE_MEMORY 10
+// iterations of one local search
+#define OPTIMIZE_ITERATIONS 1000
+
+typedef struct Optimization Optimization;
+
+// best of all local searches, point has one value per variable. The
+// counts are summed over all starts and time is the wall clock time in
+// seconds.
+struct Optimization {
+    bool is_converged;
+    double value;
+    double *point;
+    int variablec;
+
+    int startc;
+    int best_start;
+    int converged;
+    int iterations;
+    int evaluations;
+    double time;
+};
+
+Optimization *minimize(Term *term, int variablec, Term **variables, double *start,
+        double *lower, double *upper, int startc, int threadc, double tolerance);
+Optimization *maximize(Term *term, int variablec, Term **variables, double *start,
+        double *lower, double *upper, int startc, int threadc, double tolerance);
+void free_optimization(Optimization *optimization);
+
+#endif // OPTIMIZE_TERM_H_
@@ -0,0 +1,641 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "term.h"
+#include "memory_term.h"
+#include "parse_term.h"
+
+typedef struct Parser Parser;
+
+// reads directly from text, only identifiers are copied once into the
+// symbol table
+struct Parser {
+    const char *text;
+    size_t length;
+    size_t position;
+    SymbolTable *table;
+    int depth;
+
+    const char *message;
+    size_t error_position;
+};
+
+// binding powers, unary minus sits between products and powers so that
+// -x^2 = -(x^2) and x^-1 parses
+#define BINDING_EQUAL 1
+#define BINDING_SUM 2
+#define BINDING_PRODUCT 3
+#define BINDING_UNARY 4
+#define BINDING_POWER 5
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static unsigned long long
+hash_name(const char *name, int length)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for (int i = 0;i < length;i++)
+        hash = (hash ^ (unsigned char) name[i]) * 1099511628211ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+SymbolTable *
+symbol_table(void)
+{
+    SymbolTable *table = (SymbolTable *) malloc(sizeof(SymbolTable));
+
+    table->capacity = 64;
+    table->count = 0;
+    table->symbols = (Symbol **) calloc(table->capacity, sizeof(Symbol *));
+
+    return table;
+}
+
+void
+free_symbol_table(SymbolTable *table)
+{
+    for (int i = 0;i < table->capacity;i++) {
+        if (table->symbols[i] == NULL)
+            continue;
+        free(table->symbols[i]->name);
+        free(table->symbols[i]);
+    }
+    free(table->symbols);
+    free(table);
+    return;
+}
+
+static void
+grow_symbol_table(SymbolTable *table)
+{
+    int capacity = 2 * table->capacity;
+    Symbol **symbols = (Symbol **) calloc(capacity, sizeof(Symbol *));
+
+    for (int i = 0;i < table->capacity;i++) {
+        Symbol *symbol = table->symbols[i];
+        int slot;
+
+        if (symbol == NULL)
+            continue;
+
+        slot = (int) (symbol->hash & (capacity - 1));
+        while (symbols[slot] != NULL)
+            slot = (slot + 1) & (capacity - 1);
+        symbols[slot] = symbol;
+    }
+
+    free(table->symbols);
+    table->symbols = symbols;
+    table->capacity = capacity;
+    return;
+}
+
+// name does not have to be terminated, a new symbol is a variable
+Symbol *
+intern_symbol(SymbolTable *table, const char *name, int length)
+{
+    unsigned long long hash = hash_name(name, length);
+    int slot = (int) (hash & (table->capacity - 1));
+    Symbol *symbol;
+
+    while ((symbol = table->symbols[slot]) != NULL) {
+        if (symbol->hash == hash && symbol->length == length
+                && memcmp(symbol->name, name, length) == 0)
+            return symbol;
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    symbol = (Symbol *) malloc(sizeof(Symbol));
+    symbol->name = (char *) malloc(length + 1);
+    memcpy(symbol->name, name, length);
+    symbol->name[length] = '\0';
+    symbol->length = length;
+    symbol->hash = hash;
+    symbol->is_constant = false;
+    symbol->upper_limit = 0.0;
+    symbol->lower_limit = 0.0;
+
+    table->symbols[slot] = symbol;
+    table->count++;
+    if (2 * table->count >= table->capacity)
+        grow_symbol_table(table);
+
+    return symbol;
+}
+
+Symbol *
+declare_constant(SymbolTable *table, char *name, double upper_limit, double lower_limit)
+{
+    Symbol *symbol = intern_symbol(table, name, (int) strlen(name));
+
+    symbol->is_constant = true;
+    symbol->upper_limit = upper_limit;
+    symbol->lower_limit = lower_limit;
+
+    return symbol;
+}
+
+static void
+fail(Parser *parser, const char *message)
+{
+    if (parser->message != NULL)
+        return;
+
+    parser->message = message;
+    parser->error_position = parser->position;
+    return;
+}
+
+static bool
+is_digit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool
+is_letter(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// next character after white space, -1 at the end of the input
+static int
+peek(Parser *parser)
+{
+    while (parser->position < parser->length) {
+        char c = parser->text[parser->position];
+
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            return (unsigned char) c;
+        parser->position++;
+    }
+    return -1;
+}
+
+static bool
+expect(Parser *parser, int c, const char *message)
+{
+    if (peek(parser) != c) {
+        fail(parser, message);
+        return false;
+    }
+    parser->position++;
+    return true;
+}
+
+// decimal literal, exact when the significand fits into 53 bits and the
+// power of ten into a double, otherwise the token goes through strtod
+static bool
+scan_number(Parser *parser, double *value)
+{
+    const char *text = parser->text;
+    size_t start = parser->position, i = start, end = parser->length;
+    unsigned long long mantissa = 0;
+    int significant = 0, exponent = 0, digits = 0;
+    bool is_fast = true;
+
+    for (;i < end && is_digit(text[i]);i++, digits++) {
+        if (significant < 19) {
+            mantissa = 10 * mantissa + (text[i] - '0');
+            significant += mantissa != 0;
+        } else {
+            is_fast = false;
+        }
+    }
+
+    if (i < end && text[i] == '.') {
+        for (i++;i < end && is_digit(text[i]);i++, digits++) {
+            if (significant < 19) {
+                mantissa = 10 * mantissa + (text[i] - '0');
+                significant += mantissa != 0;
+                exponent--;
+            } else {
+                is_fast = false;
+            }
+        }
+    }
+
+    if (digits == 0) {
+        fail(parser, "expected a number");
+        return false;
+    }
+
+    if (i + 1 < end && (text[i] == 'e' || text[i] == 'E')) {
+        size_t j = i + 1;
+        int sign = 1, power = 0;
+
+        if (text[j] == '+' || text[j] == '-') {
+            sign = text[j] == '-' ? -1 : 1;
+            j++;
+        }
+        if (j < end && is_digit(text[j])) {
+            for (;j < end && is_digit(text[j]);j++)
+                if (power < 100000)
+                    power = 10 * power + (text[j] - '0');
+            exponent += sign * power;
+            i = j;
+        }
+    }
+
+    parser->position = i;
+
+    if (is_fast && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        if (exponent < 0)
+            *value = (double) mantissa / powers_of_ten[-exponent];
+        else
+            *value = (double) mantissa * powers_of_ten[exponent];
+        return true;
+    }
+
+    if (i - start < 64) {
+        char buffer[64];
+
+        memcpy(buffer, &text[start], i - start);
+        buffer[i - start] = '\0';
+        *value = strtod(buffer, NULL);
+    } else {
+        char *buffer = (char *) malloc(i - start + 1);
+
+        memcpy(buffer, &text[start], i - start);
+        buffer[i - start] = '\0';
+        *value = strtod(buffer, NULL);
+        free(buffer);
+    }
+    return true;
+}
+
+// -literal folds into the literal, everything else is wrapped
+static Term *
+negate(Term *operand)
+{
+    if (strcmp(operand->meaning, "literal") == 0) {
+        Literal *temp_literal = operand->content;
+
+        temp_literal->value = -temp_literal->value;
+        return operand;
+    }
+    return additive_inverse(operand);
+}
+
+static Term *parse_expression(Parser *parser, int binding);
+
+static void
+free_arguments(Term **argv, int argc)
+{
+    for (int i = 0;i < argc;i++)
+        free_term(argv[i]);
+    release(argv);
+    return;
+}
+
+// comma separated terms up to close, at most limit of them
+static Term **
+parse_arguments(Parser *parser, int close, int limit, int *argc)
+{
+    int capacity = 4;
+    Term **argv = (Term **) allocate(sizeof(Term *) * capacity);
+
+    *argc = 0;
+    while (true) {
+        Term *argument;
+        int c;
+
+        if (*argc == limit) {
+            fail(parser, "too many arguments");
+            break;
+        }
+
+        argument = parse_expression(parser, 0);
+        if (argument == NULL)
+            break;
+        if (*argc == capacity) {
+            capacity *= 2;
+            argv = (Term **) reallocate(argv, sizeof(Term *) * capacity);
+        }
+        argv[(*argc)++] = argument;
+
+        c = peek(parser);
+        parser->position++;
+        if (c == close)
+            return argv;
+        if (c != ',') {
+            parser->position--;
+            fail(parser, close == ']' ? "expected ',' or ']'" : "expected ',' or '}'");
+            break;
+        }
+    }
+
+    free_arguments(argv, *argc);
+    return NULL;
+}
+
+// D[term, variable], I[term, variable] and I[term, variable, upper, lower]
+static Term *
+parse_bracket(Parser *parser, char name)
+{
+    Term **argv;
+    int argc;
+
+    parser->position++;
+    argv = parse_arguments(parser, ']', 4, &argc);
+    if (argv == NULL)
+        return NULL;
+
+    if (name == 'D' && argc == 2) {
+        Term *result = differential(argv[0], argv[1]);
+
+        release(argv);
+        return result;
+    }
+    if (name == 'I' && argc == 2) {
+        Term *result = integral(argv[0], argv[1]);
+
+        release(argv);
+        return result;
+    }
+    if (name == 'I' && argc == 4)
+        return operator("I", 4, argv);
+
+    fail(parser, "wrong number of arguments");
+    free_arguments(argv, argc);
+    return NULL;
+}
+
+static Term *
+parse_identifier(Parser *parser)
+{
+    const char *text = parser->text;
+    size_t start = parser->position, end = parser->length;
+    Symbol *symbol;
+    int length;
+
+    while (parser->position < end
+            && (is_letter(text[parser->position]) || is_digit(text[parser->position]))) {
+        if (text[parser->position] == '_' && parser->position + 1 < end
+                && text[parser->position + 1] == '{')
+            break;
+        parser->position++;
+    }
+    length = (int) (parser->position - start);
+
+    if (length == 1 && (text[start] == 'D' || text[start] == 'I') && peek(parser) == '[')
+        return parse_bracket(parser, text[start]);
+
+    // i*x is printed for imaginary(x), a bare i is the imaginary unit
+    if (length == 1 && text[start] == 'i') {
+        if (peek(parser) == '*') {
+            Term *operand;
+
+            parser->position++;
+            operand = parse_expression(parser, BINDING_PRODUCT);
+            return operand == NULL ? NULL : imaginary(operand);
+        }
+        return imaginary(literal(1.0));
+    }
+
+    if (length == 3 && memcmp(&text[start], "inf", 3) == 0)
+        return literal(INFINITY);
+    if (length == 3 && memcmp(&text[start], "nan", 3) == 0)
+        return literal(NAN);
+
+    symbol = intern_symbol(parser->table, &text[start], length);
+    if (symbol->is_constant)
+        return constant(symbol->name, symbol->upper_limit, symbol->lower_limit);
+
+    // x_{j, k}, the index has to follow the name directly
+    if (parser->position + 1 < end && text[parser->position] == '_'
+            && text[parser->position + 1] == '{') {
+        Term **index;
+        int indec;
+
+        parser->position += 2;
+        index = parse_arguments(parser, '}', PARSE_DEPTH, &indec);
+        if (index == NULL)
+            return NULL;
+        return variable_with_index(symbol->name, indec, index);
+    }
+
+    return variable(symbol->name);
+}
+
+static Term *
+parse_prefix(Parser *parser)
+{
+    int c = peek(parser);
+    Term *operand;
+    double value;
+
+    if (c == '(') {
+        parser->position++;
+        operand = parse_expression(parser, 0);
+        if (operand != NULL && !expect(parser, ')', "expected ')'")) {
+            free_term(operand);
+            return NULL;
+        }
+        return operand;
+    }
+
+    if (c == '-' || c == '+') {
+        parser->position++;
+        operand = parse_expression(parser, BINDING_UNARY);
+        if (operand == NULL || c == '+')
+            return operand;
+        return negate(operand);
+    }
+
+    if (is_digit(c) || c == '.') {
+        if (!scan_number(parser, &value))
+            return NULL;
+        return literal(value);
+    }
+
+    if (is_letter(c))
+        return parse_identifier(parser);
+
+    fail(parser, c == -1 ? "unexpected end of input" : "expected a term");
+    return NULL;
+}
+
+static int
+infix_binding(int c)
+{
+    switch (c) {
+    case '=':
+        return BINDING_EQUAL;
+    case '+':
+    case '-':
+        return BINDING_SUM;
+    case '*':
+    case '/':
+        return BINDING_PRODUCT;
+    case '^':
+        return BINDING_POWER;
+    default:
+        return 0;
+    }
+}
+
+// appends operand to a chain of name, operands that are name operators
+// themselves are spliced in the way add() and multiply() flatten them
+static void
+push_operand(Term ***argv, int *argc, int *capacity, Term *operand, char *name)
+{
+    Operator *temp_operator = is_operator(operand, name);
+    int count = temp_operator == NULL ? 1 : temp_operator->argc;
+
+    if (*argc + count > *capacity) {
+        while (*argc + count > *capacity)
+            *capacity *= 2;
+        *argv = (Term **) reallocate(*argv, sizeof(Term *) * *capacity);
+    }
+
+    if (temp_operator == NULL) {
+        (*argv)[(*argc)++] = operand;
+        return;
+    }
+
+    for (int i = 0;i < temp_operator->argc;i++)
+        (*argv)[(*argc)++] = temp_operator->argv[i];
+
+    free_shell(operand);
+    return;
+}
+
+// a + b - c ... or a * b / c ... collected into one n-ary operator
+// instead of flattening pairwise
+static Term *
+parse_chain(Parser *parser, Term *lhs, int binding)
+{
+    char *name = binding == BINDING_SUM ? "+" : "*";
+    int argc = 0, capacity = 4;
+    Term **argv = (Term **) allocate(sizeof(Term *) * capacity);
+
+    push_operand(&argv, &argc, &capacity, lhs, name);
+
+    while (infix_binding(peek(parser)) == binding) {
+        int c = parser->text[parser->position++];
+        Term *rhs = parse_expression(parser, binding);
+
+        if (rhs == NULL) {
+            free_arguments(argv, argc);
+            return NULL;
+        }
+
+        if (c == '-') {
+            rhs = negate(rhs);
+        } else if (c == '/') {
+            // 1/x is printed for multiple_inverse(x)
+            if (argc == 1 && strcmp(argv[0]->meaning, "literal") == 0
+                    && ((Literal *) argv[0]->content)->value == 1.0) {
+                free_term(argv[0]);
+                argv[0] = multiple_inverse(rhs);
+                continue;
+            }
+            rhs = multiple_inverse(rhs);
+        }
+        push_operand(&argv, &argc, &capacity, rhs, name);
+    }
+
+    if (argc == 1) {
+        lhs = argv[0];
+        release(argv);
+        return lhs;
+    }
+    return operator(name, argc, argv);
+}
+
+// Pratt loop, binds infix operators stronger than binding to the left
+// operand. ^ associates to the right and = does not chain.
+static Term *
+parse_expression(Parser *parser, int binding)
+{
+    Term *lhs;
+
+    if (++parser->depth > PARSE_DEPTH) {
+        fail(parser, "nesting too deep");
+        parser->depth--;
+        return NULL;
+    }
+
+    lhs = parse_prefix(parser);
+
+    while (lhs != NULL) {
+        int c = peek(parser), left = infix_binding(c);
+        Term *rhs;
+
+        if (left <= binding)
+            break;
+
+        if (left == BINDING_SUM || left == BINDING_PRODUCT) {
+            lhs = parse_chain(parser, lhs, left);
+            continue;
+        }
+
+        parser->position++;
+        rhs = parse_expression(parser, c == '^' ? left - 1 : left);
+        if (rhs == NULL) {
+            free_term(lhs);
+            lhs = NULL;
+            break;
+        }
+
+        if (c == '^') {
+            lhs = power(lhs, rhs);
+            continue;
+        }
+
+        lhs = equal(lhs, rhs);
+        if (peek(parser) == '=') {
+            fail(parser, "chained equations");
+            free_term(lhs);
+            lhs = NULL;
+        }
+    }
+
+    parser->depth--;
+    return lhs;
+}
+
+// parses text[0 .. length - 1] without copying it. Identifiers are
+// interned into table, a temporary table is used if it is NULL. Returns
+// NULL and fills error, if given, on malformed input. Nodes come from the
+// allocator of the calling thread, the stream workers set an Arena there
+// and drop everything a line allocated with reset_arena.
+Term *
+parse_term(const char *text, size_t length, SymbolTable *table, ParseError *error)
+{
+    Parser parser = {text, length, 0, table, 0, NULL, 0};
+    Term *result;
+
+    if (table == NULL)
+        parser.table = symbol_table();
+
+    result = parse_expression(&parser, 0);
+    if (result != NULL && peek(&parser) != -1) {
+        fail(&parser, "unexpected input after term");
+        free_term(result);
+        result = NULL;
+    }
+
+    if (error != NULL) {
+        error->position = parser.error_position;
+        error->message = parser.message;
+    }
+
+    if (table == NULL)
+        free_symbol_table(parser.table);
+
+    return result;
+}
+
+Term *
+parse_string(char *text)
+{
+    return parse_term(text, strlen(text), NULL, NULL);
+}
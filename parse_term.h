@@ -0,0 +1,42 @@
+#ifndef PARSE_TERM_H_
+#define PARSE_TERM_H_
+
+// nesting deeper than this is rejected instead of overflowing the stack
+#define PARSE_DEPTH 4096
+
+typedef struct Symbol Symbol;
+typedef struct SymbolTable SymbolTable;
+typedef struct ParseError ParseError;
+
+// interned identifier, names declared as constants parse to constant terms
+struct Symbol {
+    char *name;
+    int length;
+    unsigned long long hash;
+
+    bool is_constant;
+    double upper_limit;
+    double lower_limit;
+};
+
+struct SymbolTable {
+    int capacity;
+    int count;
+    Symbol **symbols;
+};
+
+// position is the byte offset of the token the parser stopped at
+struct ParseError {
+    size_t position;
+    const char *message;
+};
+
+SymbolTable *symbol_table(void);
+void free_symbol_table(SymbolTable *table);
+Symbol *intern_symbol(SymbolTable *table, const char *name, int length);
+Symbol *declare_constant(SymbolTable *table, char *name, double upper_limit, double lower_limit);
+
+Term *parse_term(const char *text, size_t length, SymbolTable *table, ParseError *error);
+Term *parse_string(char *text);
+
+#endif // PARSE_TERM_H_
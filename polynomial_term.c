@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "term.h"
+#include "compare_term.h"
+#include "polynomial_term.h"
+
+// coefficients below this fraction of the largest one count as zero
+#define POLYNOMIAL_TOLERANCE 1e-10
+
+Polynomial *
+polynomial(int degree)
+{
+    Polynomial *polynomial = (Polynomial *) malloc(sizeof(Polynomial));
+
+    polynomial->degree = degree;
+    polynomial->coefficients = (double *) calloc(degree + 2, sizeof(double));
+
+    return polynomial;
+}
+
+Polynomial *
+polynomial_constant(double value)
+{
+    Polynomial *constant;
+
+    if (value == 0.0)
+        return polynomial(-1);
+
+    constant = polynomial(0);
+    constant->coefficients[0] = value;
+
+    return constant;
+}
+
+void
+free_polynomial(Polynomial *polynomial)
+{
+    free(polynomial->coefficients);
+    free(polynomial);
+    return;
+}
+
+Polynomial *
+copy_polynomial(Polynomial *polynomial_0)
+{
+    Polynomial *copy = polynomial(polynomial_0->degree);
+
+    for (int i = 0;i <= polynomial_0->degree;i++)
+        copy->coefficients[i] = polynomial_0->coefficients[i];
+
+    return copy;
+}
+
+static double
+norm_of_polynomial(Polynomial *polynomial)
+{
+    double norm = 0.0;
+
+    for (int i = 0;i <= polynomial->degree;i++)
+        norm = fmax(norm, fabs(polynomial->coefficients[i]));
+
+    return norm;
+}
+
+// drops leading coefficients that are not larger than tolerance
+void
+trim_polynomial(Polynomial *polynomial, double tolerance)
+{
+    while (polynomial->degree >= 0 &&
+           fabs(polynomial->coefficients[polynomial->degree]) <= tolerance) {
+        polynomial->coefficients[polynomial->degree] = 0.0;
+        polynomial->degree--;
+    }
+    return;
+}
+
+Polynomial *
+polynomial_add(Polynomial *lhs, Polynomial *rhs)
+{
+    int degree = lhs->degree > rhs->degree ? lhs->degree : rhs->degree;
+    Polynomial *sum = polynomial(degree);
+
+    for (int i = 0;i <= lhs->degree;i++)
+        sum->coefficients[i] += lhs->coefficients[i];
+    for (int i = 0;i <= rhs->degree;i++)
+        sum->coefficients[i] += rhs->coefficients[i];
+
+    trim_polynomial(sum, POLYNOMIAL_TOLERANCE * fmax(norm_of_polynomial(lhs), norm_of_polynomial(rhs)));
+
+    return sum;
+}
+
+Polynomial *
+polynomial_subtract(Polynomial *lhs, Polynomial *rhs)
+{
+    Polynomial *negative = polynomial_scale(rhs, -1.0);
+    Polynomial *difference = polynomial_add(lhs, negative);
+
+    free_polynomial(negative);
+
+    return difference;
+}
+
+Polynomial *
+polynomial_multiply(Polynomial *lhs, Polynomial *rhs)
+{
+    Polynomial *product;
+
+    if (lhs->degree < 0 || rhs->degree < 0)
+        return polynomial(-1);
+
+    product = polynomial(lhs->degree + rhs->degree);
+    for (int i = 0;i <= lhs->degree;i++)
+        for (int j = 0;j <= rhs->degree;j++)
+            product->coefficients[i + j] += lhs->coefficients[i] * rhs->coefficients[j];
+
+    return product;
+}
+
+Polynomial *
+polynomial_scale(Polynomial *polynomial_0, double factor)
+{
+    Polynomial *scaled = copy_polynomial(polynomial_0);
+
+    for (int i = 0;i <= scaled->degree;i++)
+        scaled->coefficients[i] *= factor;
+    trim_polynomial(scaled, 0.0);
+
+    return scaled;
+}
+
+Polynomial *
+polynomial_derivative(Polynomial *polynomial_0)
+{
+    Polynomial *derivative;
+
+    if (polynomial_0->degree <= 0)
+        return polynomial(-1);
+
+    derivative = polynomial(polynomial_0->degree - 1);
+    for (int i = 1;i <= polynomial_0->degree;i++)
+        derivative->coefficients[i - 1] = i * polynomial_0->coefficients[i];
+
+    return derivative;
+}
+
+Polynomial *
+polynomial_integral(Polynomial *polynomial_0)
+{
+    Polynomial *integral;
+
+    if (polynomial_0->degree < 0)
+        return polynomial(-1);
+
+    integral = polynomial(polynomial_0->degree + 1);
+    for (int i = 0;i <= polynomial_0->degree;i++)
+        integral->coefficients[i + 1] = polynomial_0->coefficients[i] / (i + 1);
+
+    return integral;
+}
+
+// quotient of lhs / rhs, the remainder is stored if requested
+Polynomial *
+polynomial_divide(Polynomial *lhs, Polynomial *rhs, Polynomial **remainder)
+{
+    Polynomial *quotient, *rest;
+    double leading, tolerance;
+
+    if (rhs->degree < 0)
+        return NULL;
+
+    rest = copy_polynomial(lhs);
+    tolerance = POLYNOMIAL_TOLERANCE * norm_of_polynomial(lhs);
+    leading = rhs->coefficients[rhs->degree];
+
+    if (lhs->degree < rhs->degree) {
+        quotient = polynomial(-1);
+    } else {
+        quotient = polynomial(lhs->degree - rhs->degree);
+        for (int i = lhs->degree - rhs->degree;i >= 0;i--) {
+            double factor = rest->coefficients[i + rhs->degree] / leading;
+
+            quotient->coefficients[i] = factor;
+            for (int j = 0;j <= rhs->degree;j++)
+                rest->coefficients[i + j] -= factor * rhs->coefficients[j];
+            rest->coefficients[i + rhs->degree] = 0.0;
+        }
+        rest->degree = rhs->degree - 1;
+    }
+    trim_polynomial(rest, tolerance);
+    trim_polynomial(quotient, 0.0);
+
+    if (remainder != NULL)
+        *remainder = rest;
+    else
+        free_polynomial(rest);
+
+    return quotient;
+}
+
+// monic greatest common divisor by the euclidean algorithm
+Polynomial *
+polynomial_gcd(Polynomial *lhs, Polynomial *rhs)
+{
+    Polynomial *a = copy_polynomial(lhs);
+    Polynomial *b = copy_polynomial(rhs);
+    Polynomial *monic;
+
+    while (b->degree >= 0) {
+        Polynomial *remainder;
+
+        free_polynomial(polynomial_divide(a, b, &remainder));
+        free_polynomial(a);
+        a = b;
+        b = remainder;
+
+        // normalizing keeps the remainders from under- or overflowing
+        if (b->degree >= 0) {
+            Polynomial *normalized = polynomial_scale(b, 1.0 / norm_of_polynomial(b));
+
+            free_polynomial(b);
+            b = normalized;
+        }
+    }
+    free_polynomial(b);
+
+    if (a->degree < 0)
+        return a;
+
+    monic = polynomial_scale(a, 1.0 / a->coefficients[a->degree]);
+    free_polynomial(a);
+
+    return monic;
+}
+
+// solves s * a + t * b = c with deg(s) < deg(b) for coprime a and b,
+// returns s and stores t
+Polynomial *
+polynomial_solve_diophantine(Polynomial *a, Polynomial *b, Polynomial *c, Polynomial **t)
+{
+    Polynomial *r0 = copy_polynomial(a), *r1 = copy_polynomial(b);
+    Polynomial *s0 = polynomial_constant(1.0), *s1 = polynomial(-1);
+    Polynomial *s, *quotient, *remainder, *rest;
+
+    // half extended euclid, s0 * a = r0 (mod b)
+    while (r1->degree >= 0) {
+        Polynomial *next_s, *product;
+
+        quotient = polynomial_divide(r0, r1, &remainder);
+        product = polynomial_multiply(quotient, s1);
+        next_s = polynomial_subtract(s0, product);
+
+        free_polynomial(product);
+        free_polynomial(quotient);
+        free_polynomial(r0);
+        free_polynomial(s0);
+        r0 = r1;
+        r1 = remainder;
+        s0 = s1;
+        s1 = next_s;
+    }
+
+    // r0 is the constant gcd, s = s0 * c / r0 reduced modulo b
+    quotient = polynomial_scale(s0, 1.0 / r0->coefficients[0]);
+    rest = polynomial_multiply(quotient, c);
+    free_polynomial(quotient);
+    free_polynomial(polynomial_divide(rest, b, &s));
+    free_polynomial(rest);
+
+    if (t != NULL) {
+        Polynomial *product = polynomial_multiply(s, a);
+        Polynomial *difference = polynomial_subtract(c, product);
+
+        *t = polynomial_divide(difference, b, NULL);
+        free_polynomial(product);
+        free_polynomial(difference);
+    }
+
+    free_polynomial(r0);
+    free_polynomial(r1);
+    free_polynomial(s0);
+    free_polynomial(s1);
+
+    return s;
+}
+
+double
+evaluate_polynomial(Polynomial *polynomial, double value)
+{
+    double result = 0.0;
+
+    for (int i = polynomial->degree;i >= 0;i--)
+        result = result * value + polynomial->coefficients[i];
+
+    return result;
+}
+
+static Polynomial *
+polynomial_power(Polynomial *base, int exponent)
+{
+    Polynomial *result = polynomial_constant(1.0);
+
+    for (int i = 0;i < exponent;i++) {
+        Polynomial *product = polynomial_multiply(result, base);
+
+        free_polynomial(result);
+        result = product;
+    }
+
+    return result;
+}
+
+// numerator / denominator of a term that is rational in variable with
+// numeric coefficients, false if the term is not of that form
+bool
+rational_of_term(Term *term, Term *variable, Polynomial **numerator, Polynomial **denominator)
+{
+    Operator *operator;
+
+    if (strcmp(term->meaning, "literal") == 0) {
+        Literal *literal = term->content;
+
+        *numerator = polynomial_constant(literal->value);
+        *denominator = polynomial_constant(1.0);
+        return true;
+    }
+    if (strcmp(term->meaning, "variable") == 0) {
+        if (!is_equal(term, variable))
+            return false;
+
+        *numerator = polynomial(1);
+        (*numerator)->coefficients[1] = 1.0;
+        *denominator = polynomial_constant(1.0);
+        return true;
+    }
+    if (strcmp(term->meaning, "operator") != 0)
+        return false;
+
+    operator = term->content;
+
+    if (strcmp(operator->name, "+") == 0 || strcmp(operator->name, "*") == 0) {
+        bool is_sum = strcmp(operator->name, "+") == 0;
+
+        if (!rational_of_term(operator->argv[0], variable, numerator, denominator))
+            return false;
+
+        for (int i = 1;i < operator->argc;i++) {
+            Polynomial *n, *d, *temp_numerator, *temp_denominator;
+
+            if (!rational_of_term(operator->argv[i], variable, &n, &d)) {
+                free_polynomial(*numerator);
+                free_polynomial(*denominator);
+                return false;
+            }
+
+            if (is_sum) {
+                // n0 / d0 + n / d over the least common denominator
+                Polynomial *g = polynomial_gcd(*denominator, d);
+                Polynomial *d0_part = polynomial_divide(*denominator, g, NULL);
+                Polynomial *d_part = polynomial_divide(d, g, NULL);
+                Polynomial *lhs = polynomial_multiply(*numerator, d_part);
+                Polynomial *rhs = polynomial_multiply(n, d0_part);
+
+                temp_numerator = polynomial_add(lhs, rhs);
+                temp_denominator = polynomial_multiply(*denominator, d_part);
+
+                free_polynomial(g);
+                free_polynomial(d0_part);
+                free_polynomial(d_part);
+                free_polynomial(lhs);
+                free_polynomial(rhs);
+            } else {
+                temp_numerator = polynomial_multiply(*numerator, n);
+                temp_denominator = polynomial_multiply(*denominator, d);
+            }
+
+            free_polynomial(*numerator);
+            free_polynomial(*denominator);
+            free_polynomial(n);
+            free_polynomial(d);
+            *numerator = temp_numerator;
+            *denominator = temp_denominator;
+        }
+        return true;
+    }
+    if (strcmp(operator->name, "additive_inverse") == 0) {
+        Polynomial *negative;
+
+        if (!rational_of_term(operator->argv[0], variable, numerator, denominator))
+            return false;
+
+        negative = polynomial_scale(*numerator, -1.0);
+        free_polynomial(*numerator);
+        *numerator = negative;
+        return true;
+    }
+    if (strcmp(operator->name, "multiple_inverse") == 0) {
+        Polynomial *temp;
+
+        if (!rational_of_term(operator->argv[0], variable, numerator, denominator))
+            return false;
+
+        if ((*numerator)->degree < 0) {
+            free_polynomial(*numerator);
+            free_polynomial(*denominator);
+            return false;
+        }
+
+        temp = *numerator;
+        *numerator = *denominator;
+        *denominator = temp;
+        return true;
+    }
+    if (strcmp(operator->name, "^") == 0) {
+        Literal *exponent;
+        Polynomial *n, *d;
+        int count;
+
+        if (strcmp(operator->argv[1]->meaning, "literal") != 0)
+            return false;
+
+        exponent = operator->argv[1]->content;
+        if (exponent->value != floor(exponent->value) || fabs(exponent->value) > 1000.0)
+            return false;
+
+        if (!rational_of_term(operator->argv[0], variable, &n, &d))
+            return false;
+
+        count = (int) fabs(exponent->value);
+        if (exponent->value < 0.0) {
+            if (n->degree < 0) {
+                free_polynomial(n);
+                free_polynomial(d);
+                return false;
+            }
+            *numerator = polynomial_power(d, count);
+            *denominator = polynomial_power(n, count);
+        } else {
+            *numerator = polynomial_power(n, count);
+            *denominator = polynomial_power(d, count);
+        }
+
+        free_polynomial(n);
+        free_polynomial(d);
+        return true;
+    }
+
+    return false;
+}
+
+Polynomial *
+polynomial_of_term(Term *term, Term *variable)
+{
+    Polynomial *numerator, *denominator, *quotient;
+
+    if (!rational_of_term(term, variable, &numerator, &denominator))
+        return NULL;
+
+    quotient = NULL;
+    if (denominator->degree == 0)
+        quotient = polynomial_scale(numerator, 1.0 / denominator->coefficients[0]);
+
+    free_polynomial(numerator);
+    free_polynomial(denominator);
+
+    return quotient;
+}
+
+Term *
+term_of_polynomial(Polynomial *polynomial, Term *variable)
+{
+    Term *result = NULL;
+
+    for (int i = 0;i <= polynomial->degree;i++) {
+        double coefficient = polynomial->coefficients[i];
+        Term *monomial;
+
+        if (coefficient == 0.0)
+            continue;
+
+        if (i == 0)
+            monomial = literal(coefficient);
+        else if (i == 1)
+            monomial = copy_term(variable);
+        else
+            monomial = power(copy_term(variable), literal((double) i));
+
+        if (i != 0 && coefficient != 1.0)
+            monomial = multiply(literal(coefficient), monomial);
+
+        if (result == NULL)
+            result = monomial;
+        else
+            result = add(result, monomial);
+    }
+
+    if (result == NULL)
+        return literal(0.0);
+
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef POLYNOMIAL_TERM_H_
+#define POLYNOMIAL_TERM_H_
+
+typedef struct Polynomial Polynomial;
+
+// coefficients[i] belongs to x^i, the zero polynomial has degree -1
+struct Polynomial {
+    int degree;
+    double *coefficients;
+};
+
+Polynomial *polynomial(int degree);
+Polynomial *polynomial_constant(double value);
+void free_polynomial(Polynomial *polynomial);
+Polynomial *copy_polynomial(Polynomial *polynomial);
+void trim_polynomial(Polynomial *polynomial, double tolerance);
+
+Polynomial *polynomial_add(Polynomial *lhs, Polynomial *rhs);
+Polynomial *polynomial_subtract(Polynomial *lhs, Polynomial *rhs);
+Polynomial *polynomial_multiply(Polynomial *lhs, Polynomial *rhs);
+Polynomial *polynomial_scale(Polynomial *polynomial, double factor);
+Polynomial *polynomial_derivative(Polynomial *polynomial);
+Polynomial *polynomial_integral(Polynomial *polynomial);
+Polynomial *polynomial_divide(Polynomial *lhs, Polynomial *rhs, Polynomial **remainder);
+Polynomial *polynomial_gcd(Polynomial *lhs, Polynomial *rhs);
+Polynomial *polynomial_solve_diophantine(Polynomial *a, Polynomial *b, Polynomial *c, Polynomial **t);
+double evaluate_polynomial(Polynomial *polynomial, double value);
+
+Polynomial *polynomial_of_term(Term *term, Term *variable);
+bool rational_of_term(Term *term, Term *variable, Polynomial **numerator, Polynomial **denominator);
+Term *term_of_polynomial(Polynomial *polynomial, Term *variable);
+
+#endif // POLYNOMIAL_TERM_H_
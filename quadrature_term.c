@@ -0,0 +1,509 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <pthread.h>
+#include "term.h"
+#include "memory_term.h"
+#include "compile_term.h"
+#include "quadrature_term.h"
+
+// upper bound of subintervals kept by one adaptive integration
+#define QUADRATURE_LIMIT 20000
+
+typedef struct Segment Segment;
+typedef struct Worker Worker;
+typedef struct Pool Pool;
+
+struct Segment {
+    double lower;
+    double upper;
+    double result;
+    double error;
+};
+
+// scratch space of one thread evaluating the integrand
+struct Worker {
+    Quadrature *quadrature;
+    double tolerance;
+    double *point;
+    double *registers;
+    Pool *pool;
+};
+
+struct Pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int generation;
+    bool is_stopped;
+
+    Segment *segments;
+    int count;
+    int next;
+    int pending;
+};
+
+// Gauss-Kronrod 15 point nodes and weights, the Gauss 7 point rule uses
+// every second node
+static const double kronrod_nodes[8] = {
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+    0.000000000000000000000000000000000
+};
+
+static const double kronrod_weights[8] = {
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714
+};
+
+static const double gauss_weights[4] = {
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327
+};
+
+static Term *
+replace_integrals(Term *term, Quadrature *quadrature, int variablec, Term **variables, bool *is_failed)
+{
+    Operator *temp_operator;
+    Term **argv;
+
+    if (strcmp(term->meaning, "operator") != 0)
+        return copy_term(term);
+
+    temp_operator = is_operator(term, "I");
+    if (temp_operator != NULL) {
+        Quadrature *inner = compile_quadrature(term, variablec, variables);
+        char name[32];
+
+        if (inner == NULL) {
+            *is_failed = true;
+            return literal(0.0);
+        }
+
+        quadrature->integrals = (Quadrature **) realloc(quadrature->integrals,
+                sizeof(Quadrature *) * (quadrature->integralc + 1));
+        quadrature->integrals[quadrature->integralc] = inner;
+
+        sprintf(name, "#integral_%d", quadrature->integralc);
+        quadrature->integralc++;
+
+        return variable(name);
+    }
+
+    temp_operator = term->content;
+    argv = (Term **) allocate(sizeof(Term *) * temp_operator->argc);
+    for (int i = 0;i < temp_operator->argc;i++)
+        argv[i] = replace_integrals(temp_operator->argv[i], quadrature, variablec, variables, is_failed);
+
+    return operator(temp_operator->name, temp_operator->argc, argv);
+}
+
+Quadrature *
+compile_quadrature(Term *term, int variablec, Term **variables)
+{
+    Operator *operator = is_operator(term, "I");
+    Quadrature *quadrature;
+    Term **inner_variables, *integrand;
+    bool is_failed = false;
+
+    if (operator == NULL || operator->argc != 4)
+        return NULL;
+    if (strcmp(operator->argv[1]->meaning, "variable") != 0)
+        return NULL;
+
+    quadrature = (Quadrature *) malloc(sizeof(Quadrature));
+    quadrature->variablec = variablec;
+    quadrature->integralc = 0;
+    quadrature->integrals = NULL;
+    quadrature->integrand = NULL;
+
+    quadrature->limits = compile_terms(2, &operator->argv[2], variablec, variables);
+    if (quadrature->limits == NULL) {
+        free_quadrature(quadrature);
+        return NULL;
+    }
+
+    inner_variables = (Term **) malloc(sizeof(Term *) * (variablec + 1));
+    for (int i = 0;i < variablec;i++)
+        inner_variables[i] = variables[i];
+    inner_variables[variablec] = operator->argv[1];
+
+    integrand = replace_integrals(operator->argv[0], quadrature, variablec + 1, inner_variables, &is_failed);
+
+    if (!is_failed) {
+        inner_variables = (Term **) realloc(inner_variables,
+                sizeof(Term *) * (variablec + 1 + quadrature->integralc));
+        for (int i = 0;i < quadrature->integralc;i++) {
+            char name[32];
+
+            sprintf(name, "#integral_%d", i);
+            inner_variables[variablec + 1 + i] = variable(name);
+        }
+
+        quadrature->integrand = compile_term(integrand,
+                variablec + 1 + quadrature->integralc, inner_variables);
+
+        for (int i = 0;i < quadrature->integralc;i++)
+            free_term(inner_variables[variablec + 1 + i]);
+    }
+
+    free(inner_variables);
+    free_term(integrand);
+
+    if (quadrature->integrand == NULL) {
+        free_quadrature(quadrature);
+        return NULL;
+    }
+
+    return quadrature;
+}
+
+void
+free_quadrature(Quadrature *quadrature)
+{
+    for (int i = 0;i < quadrature->integralc;i++)
+        free_quadrature(quadrature->integrals[i]);
+
+    if (quadrature->limits != NULL)
+        free_program(quadrature->limits);
+    if (quadrature->integrand != NULL)
+        free_program(quadrature->integrand);
+
+    free(quadrature->integrals);
+    free(quadrature);
+    return;
+}
+
+static double
+evaluate_integrand(Worker *worker, double value)
+{
+    Quadrature *quadrature = worker->quadrature;
+    int variablec = quadrature->variablec;
+    double result;
+
+    worker->point[variablec] = value;
+
+    // nested integrals only see the outer variables and this one
+    for (int i = 0;i < quadrature->integralc;i++)
+        worker->point[variablec + 1 + i] = evaluate_quadrature(quadrature->integrals[i],
+                worker->point, worker->tolerance, 1, NULL);
+
+    evaluate_program(quadrature->integrand, worker->point, worker->registers, &result);
+
+    return result;
+}
+
+static void
+gauss_kronrod(Worker *worker, Segment *segment)
+{
+    double center = 0.5 * (segment->lower + segment->upper);
+    double half_length = 0.5 * (segment->upper - segment->lower);
+    double center_value = evaluate_integrand(worker, center);
+    double kronrod = center_value * kronrod_weights[7];
+    double gauss = center_value * gauss_weights[3];
+    double absolute = fabs(kronrod);
+    double values_lower[7], values_upper[7];
+    double mean, deviation, error;
+
+    for (int i = 0;i < 7;i++) {
+        double offset = half_length * kronrod_nodes[i];
+
+        values_lower[i] = evaluate_integrand(worker, center - offset);
+        values_upper[i] = evaluate_integrand(worker, center + offset);
+
+        kronrod += kronrod_weights[i] * (values_lower[i] + values_upper[i]);
+        absolute += kronrod_weights[i] * (fabs(values_lower[i]) + fabs(values_upper[i]));
+        if (i % 2 == 1)
+            gauss += gauss_weights[i / 2] * (values_lower[i] + values_upper[i]);
+    }
+
+    mean = 0.5 * kronrod;
+    deviation = kronrod_weights[7] * fabs(center_value - mean);
+    for (int i = 0;i < 7;i++)
+        deviation += kronrod_weights[i] * (fabs(values_lower[i] - mean) + fabs(values_upper[i] - mean));
+
+    // error scaling as done by QUADPACK
+    error = fabs((kronrod - gauss) * half_length);
+    deviation *= fabs(half_length);
+    if (deviation != 0.0 && error != 0.0)
+        error = deviation * fmin(1.0, pow(200.0 * error / deviation, 1.5));
+    if (absolute * fabs(half_length) > DBL_MIN / (50.0 * DBL_EPSILON))
+        error = fmax(50.0 * DBL_EPSILON * absolute * fabs(half_length), error);
+
+    segment->result = kronrod * half_length;
+    segment->error = error;
+    return;
+}
+
+static void
+run_jobs(Worker *worker)
+{
+    Pool *pool = worker->pool;
+
+    for (;;) {
+        int index;
+
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->next >= pool->count) {
+            pthread_mutex_unlock(&pool->mutex);
+            return;
+        }
+        index = pool->next++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        gauss_kronrod(worker, &pool->segments[index]);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->pending--;
+        if (pool->pending == 0)
+            pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+static void *
+run_worker(void *argument)
+{
+    Worker *worker = argument;
+    Pool *pool = worker->pool;
+    int generation = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->generation == generation && !pool->is_stopped)
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        if (pool->is_stopped) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_jobs(worker);
+    }
+}
+
+// evaluates all segments, the calling thread works as the first worker
+static void
+evaluate_segments(Worker *worker, Segment *segments, int count)
+{
+    Pool *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->segments = segments;
+    pool->count = count;
+    pool->next = 0;
+    pool->pending = count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_jobs(worker);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+    return;
+}
+
+// max heap of segments ordered by their error estimate
+static void
+push_segment(Segment *heap, int *size, Segment segment)
+{
+    int i = (*size)++;
+
+    while (i > 0 && heap[(i - 1) / 2].error < segment.error) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = segment;
+    return;
+}
+
+static Segment
+pop_segment(Segment *heap, int *size)
+{
+    Segment top = heap[0];
+    Segment last = heap[--(*size)];
+    int i = 0;
+
+    for (;;) {
+        int child = 2 * i + 1;
+
+        if (child >= *size)
+            break;
+        if (child + 1 < *size && heap[child + 1].error > heap[child].error)
+            child++;
+        if (heap[child].error <= last.error)
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*size > 0)
+        heap[i] = last;
+
+    return top;
+}
+
+// global adaptive integration, in every round the worst segments are
+// bisected and all halves are evaluated in parallel until the sum of the
+// error estimates fits into the tolerance
+double
+evaluate_quadrature(Quadrature *quadrature, double *values, double tolerance, int threadc, double *error)
+{
+    Pool pool;
+    Worker *workers;
+    pthread_t *threads;
+    Segment *heap, *round;
+    double limits[2], *registers, result, total_error;
+    int pointc = quadrature->variablec + 1 + quadrature->integralc;
+    int size = 0, roundc;
+
+    registers = (double *) malloc(sizeof(double) * quadrature->limits->length);
+    evaluate_program(quadrature->limits, values, registers, limits);
+    free(registers);
+
+    if (!isfinite(limits[0]) || !isfinite(limits[1])) {
+        if (error != NULL)
+            *error = INFINITY;
+        return NAN;
+    }
+
+    if (threadc < 1)
+        threadc = 1;
+
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.start, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.generation = 0;
+    pool.is_stopped = false;
+
+    workers = (Worker *) malloc(sizeof(Worker) * threadc);
+    for (int i = 0;i < threadc;i++) {
+        workers[i].quadrature = quadrature;
+        workers[i].tolerance = tolerance * 0.1;
+        workers[i].point = (double *) malloc(sizeof(double) * pointc);
+        workers[i].registers = (double *) malloc(sizeof(double) * quadrature->integrand->length);
+        workers[i].pool = &pool;
+        for (int j = 0;j < quadrature->variablec;j++)
+            workers[i].point[j] = values[j];
+    }
+
+    threads = (pthread_t *) malloc(sizeof(pthread_t) * threadc);
+    for (int i = 1;i < threadc;i++)
+        pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+
+    heap = (Segment *) malloc(sizeof(Segment) * (QUADRATURE_LIMIT + 2 * threadc));
+    round = (Segment *) malloc(sizeof(Segment) * 2 * threadc);
+
+    // start with one segment per thread
+    for (int i = 0;i < threadc;i++) {
+        round[i].lower = limits[1] + (limits[0] - limits[1]) * i / threadc;
+        round[i].upper = limits[1] + (limits[0] - limits[1]) * (i + 1) / threadc;
+    }
+    evaluate_segments(&workers[0], round, threadc);
+
+    result = 0.0;
+    total_error = 0.0;
+    for (int i = 0;i < threadc;i++) {
+        push_segment(heap, &size, round[i]);
+        result += round[i].result;
+        total_error += round[i].error;
+    }
+
+    while (total_error > fmax(tolerance, tolerance * fabs(result))) {
+        if (size + threadc > QUADRATURE_LIMIT)
+            break;
+
+        roundc = 0;
+        for (int i = 0;i < threadc && size > 0;i++) {
+            Segment segment = pop_segment(heap, &size);
+            double middle = 0.5 * (segment.lower + segment.upper);
+
+            result -= segment.result;
+            total_error -= segment.error;
+
+            round[roundc] = segment;
+            round[roundc++].upper = middle;
+            round[roundc] = segment;
+            round[roundc++].lower = middle;
+        }
+        evaluate_segments(&workers[0], round, roundc);
+
+        for (int i = 0;i < roundc;i++) {
+            push_segment(heap, &size, round[i]);
+            result += round[i].result;
+            total_error += round[i].error;
+        }
+    }
+
+    // sum again to drop the rounding drift of the running totals
+    result = 0.0;
+    total_error = 0.0;
+    for (int i = 0;i < size;i++) {
+        result += heap[i].result;
+        total_error += heap[i].error;
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.is_stopped = true;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+    for (int i = 1;i < threadc;i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0;i < threadc;i++) {
+        free(workers[i].point);
+        free(workers[i].registers);
+    }
+    free(workers);
+    free(threads);
+    free(heap);
+    free(round);
+
+    pthread_mutex_destroy(&pool.mutex);
+    pthread_cond_destroy(&pool.start);
+    pthread_cond_destroy(&pool.done);
+
+    if (error != NULL)
+        *error = total_error;
+
+    return result;
+}
+
+double
+integrate_definite(Term *term, int variablec, Term **variables, double *values,
+        double tolerance, int threadc, double *error)
+{
+    Quadrature *quadrature = compile_quadrature(term, variablec, variables);
+    double result;
+
+    if (quadrature == NULL) {
+        if (error != NULL)
+            *error = INFINITY;
+        return NAN;
+    }
+
+    result = evaluate_quadrature(quadrature, values, tolerance, threadc, error);
+
+    free_quadrature(quadrature);
+
+    return result;
+}
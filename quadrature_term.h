@@ -0,0 +1,24 @@
+#ifndef QUADRATURE_TERM_H_
+#define QUADRATURE_TERM_H_
+
+typedef struct Quadrature Quadrature;
+
+// a compiled definite integral I[integrand, variable, upper, lower], the
+// integrand is compiled over the outer variables, the integration variable
+// and one slot per nested definite integral
+struct Quadrature {
+    int variablec;
+    Program *limits;
+    Program *integrand;
+    int integralc;
+    Quadrature **integrals;
+};
+
+Quadrature *compile_quadrature(Term *term, int variablec, Term **variables);
+void free_quadrature(Quadrature *quadrature);
+
+double evaluate_quadrature(Quadrature *quadrature, double *values, double tolerance, int threadc, double *error);
+double integrate_definite(Term *term, int variablec, Term **variables, double *values,
+        double tolerance, int threadc, double *error);
+
+#endif // QUADRATURE_TERM_H_
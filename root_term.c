@@ -0,0 +1,535 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <pthread.h>
+#include "term.h"
+#include "compile_term.h"
+#include "complex_term.h"
+#include "polynomial_term.h"
+#include "root_term.h"
+
+// iterations before the simultaneous iteration gives up
+#define ROOT_ITERATIONS 100
+// the approximations of a multiple root are closer to each other than
+// this fraction of the distance to the next one
+#define ROOT_CLUSTER_GAP 0.1
+
+typedef struct RootJob RootJob;
+typedef struct Neighbour Neighbour;
+
+struct RootJob {
+    pthread_mutex_t mutex;
+    int next;
+    int count;
+    Polynomial **polynomials;
+    Complex **roots;
+    int *rootc;
+    double tolerance;
+};
+
+struct Neighbour {
+    double distance;
+    int index;
+};
+
+// Newton correction p(z) / p'(z), evaluated on the reversed polynomial
+// outside the unit circle so that Horner's scheme stays stable, is_root
+// is set if |p(z)| is below its rounding error bound
+static Complex
+newton_correction(double *coefficients, int degree, Complex z, bool *is_root)
+{
+    double modulus = hypot(z.real, z.imaginary);
+    double p_real = 0.0, p_imaginary = 0.0, d_real = 0.0, d_imaginary = 0.0;
+    double bound = 0.0, x, y, r;
+    bool is_reversed = modulus > 1.0;
+
+    if (is_reversed) {
+        r = 1.0 / (modulus * modulus);
+        x = z.real * r;
+        y = -z.imaginary * r;
+        modulus = 1.0 / modulus;
+    } else {
+        x = z.real;
+        y = z.imaginary;
+    }
+
+    for (int i = 0;i <= degree;i++) {
+        double coefficient = is_reversed ? coefficients[i] : coefficients[degree - i];
+        double temp;
+
+        temp = d_real * x - d_imaginary * y + p_real;
+        d_imaginary = d_real * y + d_imaginary * x + p_imaginary;
+        d_real = temp;
+
+        temp = p_real * x - p_imaginary * y + coefficient;
+        p_imaginary = p_real * y + p_imaginary * x;
+        p_real = temp;
+
+        bound = bound * modulus + fabs(coefficient);
+    }
+
+    *is_root = hypot(p_real, p_imaginary) <= 4.0 * DBL_EPSILON * bound;
+
+    if (!is_reversed) {
+        Complex p = complex_number(p_real, p_imaginary);
+        Complex d = complex_number(d_real, d_imaginary);
+
+        return complex_multiply(p, complex_multiple_inverse(d));
+    }
+
+    // p / p' = 1 / (n y - y^2 q'(y) / q(y)) with y = 1 / z
+    {
+        Complex w = complex_number(x, y);
+        Complex q = complex_number(p_real, p_imaginary);
+        Complex dq = complex_number(d_real, d_imaginary);
+        Complex ratio = complex_multiply(dq, complex_multiple_inverse(q));
+        Complex denominator = complex_add(complex_number(degree * x, degree * y),
+                complex_additive_inverse(complex_multiply(complex_multiply(w, w), ratio)));
+
+        return complex_multiple_inverse(denominator);
+    }
+}
+
+// initial approximations on circles whose radii come from the upper convex
+// hull of the points (i, log |a_i|), as proposed by Bini
+static void
+initial_roots(double *coefficients, int degree, Complex *roots)
+{
+    int *hull = (int *) malloc(sizeof(int) * (degree + 1));
+    int hullc = 0, k = 0;
+
+    for (int i = 0;i <= degree;i++) {
+        if (coefficients[i] == 0.0)
+            continue;
+
+        while (hullc >= 2) {
+            int a = hull[hullc - 2], b = hull[hullc - 1];
+            double cross = (b - a) * (log(fabs(coefficients[i])) - log(fabs(coefficients[a]))) -
+                (i - a) * (log(fabs(coefficients[b])) - log(fabs(coefficients[a])));
+
+            if (cross < 0.0)
+                break;
+            hullc--;
+        }
+        hull[hullc++] = i;
+    }
+
+    for (int i = 0;i + 1 < hullc;i++) {
+        int m = hull[i + 1] - hull[i];
+        double radius = pow(fabs(coefficients[hull[i]] / coefficients[hull[i + 1]]), 1.0 / m);
+
+        for (int j = 0;j < m;j++, k++) {
+            double angle = 2.0 * M_PI * j / m + 2.0 * M_PI * i / degree + 0.7;
+
+            roots[k] = complex_number(radius * cos(angle), radius * sin(angle));
+        }
+    }
+
+    free(hull);
+    return;
+}
+
+// all complex roots by the Aberth-Ehrlich iteration, roots that have
+// converged are frozen so that late iterations only touch the rest
+Complex *
+polynomial_roots(Polynomial *polynomial, double tolerance, int *rootc)
+{
+    Complex *roots;
+    bool *is_converged;
+    double *coefficients;
+    int degree = polynomial->degree, zeros = 0, remaining;
+
+    // leading zero coefficients do not add roots
+    while (degree > 0 && polynomial->coefficients[degree] == 0.0)
+        degree--;
+
+    *rootc = degree > 0 ? degree : 0;
+    roots = (Complex *) malloc(sizeof(Complex) * (*rootc + 1));
+    if (degree <= 0)
+        return roots;
+
+    // roots at zero divide off exactly
+    while (polynomial->coefficients[zeros] == 0.0) {
+        roots[zeros] = complex_number(0.0, 0.0);
+        zeros++;
+    }
+    coefficients = &polynomial->coefficients[zeros];
+    degree -= zeros;
+    if (degree == 0)
+        return roots;
+
+    is_converged = (bool *) calloc(degree, sizeof(bool));
+    initial_roots(coefficients, degree, &roots[zeros]);
+
+    remaining = degree;
+    for (int iteration = 0;iteration < ROOT_ITERATIONS && remaining > 0;iteration++) {
+        for (int k = 0;k < degree;k++) {
+            Complex *z = &roots[zeros + k];
+            Complex ratio, correction;
+            double sum_real = 0.0, sum_imaginary = 0.0;
+            bool is_root;
+
+            if (is_converged[k])
+                continue;
+
+            ratio = newton_correction(coefficients, degree, *z, &is_root);
+            if (is_root) {
+                is_converged[k] = true;
+                remaining--;
+                continue;
+            }
+
+            for (int j = 0;j < degree;j++) {
+                double real, imaginary, scale;
+
+                if (j == k)
+                    continue;
+
+                real = z->real - roots[zeros + j].real;
+                imaginary = z->imaginary - roots[zeros + j].imaginary;
+                scale = 1.0 / (real * real + imaginary * imaginary);
+                sum_real += real * scale;
+                sum_imaginary -= imaginary * scale;
+            }
+
+            // w = ratio / (1 - ratio * sum)
+            correction = complex_multiply(ratio, complex_multiple_inverse(complex_add(complex_number(1.0, 0.0),
+                            complex_additive_inverse(complex_multiply(ratio,
+                                    complex_number(sum_real, sum_imaginary))))));
+
+            z->real -= correction.real;
+            z->imaginary -= correction.imaginary;
+
+            if (hypot(correction.real, correction.imaginary) <= tolerance * hypot(z->real, z->imaginary)) {
+                is_converged[k] = true;
+                remaining--;
+            }
+        }
+    }
+
+    free(is_converged);
+
+    return roots;
+}
+
+// Newton steps in extended precision until the relative change is below
+// precision
+static Complex
+refine_root(Polynomial *polynomial, Complex z, double precision)
+{
+    long double x = z.real, y = z.imaginary;
+
+    for (int iteration = 0;iteration < 8;iteration++) {
+        long double p_real = 0.0L, p_imaginary = 0.0L, d_real = 0.0L, d_imaginary = 0.0L;
+        long double temp, scale, step_real, step_imaginary;
+
+        for (int i = polynomial->degree;i >= 0;i--) {
+            temp = d_real * x - d_imaginary * y + p_real;
+            d_imaginary = d_real * y + d_imaginary * x + p_imaginary;
+            d_real = temp;
+
+            temp = p_real * x - p_imaginary * y + polynomial->coefficients[i];
+            p_imaginary = p_real * y + p_imaginary * x;
+            p_real = temp;
+        }
+
+        scale = d_real * d_real + d_imaginary * d_imaginary;
+        if (scale == 0.0L)
+            break;
+
+        step_real = (p_real * d_real + p_imaginary * d_imaginary) / scale;
+        step_imaginary = (p_imaginary * d_real - p_real * d_imaginary) / scale;
+        x -= step_real;
+        y -= step_imaginary;
+
+        if (hypotl(step_real, step_imaginary) <= precision * hypotl(x, y))
+            break;
+    }
+
+    return complex_number((double) x, (double) y);
+}
+
+// p(z) and the bound sum |a_i| |z|^i of its rounding error, without the
+// unit roundoff
+static double
+residual_of_root(Polynomial *polynomial, Complex z, double *bound)
+{
+    double modulus = hypot(z.real, z.imaginary);
+    double p_real = 0.0, p_imaginary = 0.0, temp;
+
+    *bound = 0.0;
+    for (int i = polynomial->degree;i >= 0;i--) {
+        temp = p_real * z.real - p_imaginary * z.imaginary + polynomial->coefficients[i];
+        p_imaginary = p_real * z.imaginary + p_imaginary * z.real;
+        p_real = temp;
+
+        *bound = *bound * modulus + fabs(polynomial->coefficients[i]);
+    }
+
+    return hypot(p_real, p_imaginary);
+}
+
+// every root lies in one of the discs around the roots[k] with radius
+// n (|p(z_k)| + e_k) / |a_n prod_{j != k} (z_k - z_j)|, e_k the rounding
+// error of p(z_k). The discs are far too wide to tell the roots of an ill
+// conditioned polynomial apart, they only decide which roots are real.
+static double
+inclusion_radius(Polynomial *polynomial, int degree, Complex *roots, int rootc, int k)
+{
+    Complex z = roots[k];
+    double bound, residual, logarithm = log(fabs(polynomial->coefficients[degree]));
+
+    // the product under- or overflows easily, it is taken in logarithms
+    residual = residual_of_root(polynomial, z, &bound);
+    residual += 2.0 * (degree + 1) * DBL_EPSILON * bound;
+    if (residual == 0.0)
+        return 0.0;
+
+    for (int j = 0;j < rootc;j++)
+        if (j != k && (roots[j].real != z.real || roots[j].imaginary != z.imaginary))
+            logarithm += log(hypot(z.real - roots[j].real, z.imaginary - roots[j].imaginary));
+
+    return exp(log(degree * residual) - logarithm);
+}
+
+static int
+compare_neighbours(const void *lhs, const void *rhs)
+{
+    const Neighbour *a = lhs, *b = rhs;
+
+    if (a->distance < b->distance)
+        return -1;
+    return a->distance > b->distance;
+}
+
+// the approximations members[0 ... m - 1] are one root of multiplicity m
+// if Newton's method on p^(m-1), started at their mean, stays among them
+// and reaches a point at which p, ..., p^(m-2) vanish up to rounding,
+// center is set to it. A cluster that meets the real axis stays on it.
+static bool
+is_multiple_root(Polynomial *polynomial, Complex *roots, double *radii, int *members, int m,
+        double spread, double precision, Complex *center)
+{
+    Polynomial **derivatives;
+    Complex mean = complex_number(0.0, 0.0);
+    bool is_real = false, is_multiple;
+
+    for (int i = 0;i < m;i++) {
+        mean = complex_add(mean, roots[members[i]]);
+        if (fabs(roots[members[i]].imaginary) <= radii[members[i]])
+            is_real = true;
+    }
+    mean = complex_number(mean.real / m, is_real ? 0.0 : mean.imaginary / m);
+
+    derivatives = (Polynomial **) malloc(sizeof(Polynomial *) * m);
+    derivatives[0] = polynomial;
+    for (int j = 1;j < m;j++)
+        derivatives[j] = polynomial_derivative(derivatives[j - 1]);
+
+    *center = refine_root(derivatives[m - 1], mean, precision);
+    is_multiple = hypot(center->real - mean.real, center->imaginary - mean.imaginary) <= spread;
+    for (int j = 0;j < m - 1 && is_multiple;j++) {
+        double bound, residual = residual_of_root(derivatives[j], *center, &bound);
+
+        is_multiple = residual <= 8.0 * (derivatives[j]->degree + 1) * DBL_EPSILON * bound;
+    }
+
+    for (int j = 1;j < m;j++)
+        free_polynomial(derivatives[j]);
+    free(derivatives);
+
+    return is_multiple;
+}
+
+// approximations of a multiple root converge slowly and stay scattered
+// around it, near real roots keep a tiny imaginary part. The m - 1
+// nearest neighbours of an approximation form a cluster with it if they
+// are much closer than the m-th and pass is_multiple_root, the cluster
+// is replaced by its center. A simple root whose disc meets the real
+// axis is real.
+static void
+cluster_roots(Polynomial *polynomial, Complex *roots, int rootc, double precision)
+{
+    int degree = polynomial->degree, *members;
+    Neighbour *neighbours;
+    double *radii;
+    bool *is_clustered;
+
+    while (degree > 0 && polynomial->coefficients[degree] == 0.0)
+        degree--;
+    if (rootc == 0 || degree != rootc)
+        return;
+
+    radii = (double *) malloc(sizeof(double) * rootc);
+    is_clustered = (bool *) calloc(rootc, sizeof(bool));
+    neighbours = (Neighbour *) malloc(sizeof(Neighbour) * rootc);
+    members = (int *) malloc(sizeof(int) * rootc);
+
+    for (int k = 0;k < rootc;k++)
+        radii[k] = inclusion_radius(polynomial, degree, roots, rootc, k);
+
+    for (int k = 0;k < rootc;k++) {
+        int neighbourc = 0;
+
+        if (is_clustered[k])
+            continue;
+
+        for (int j = 0;j < rootc;j++) {
+            if (j == k)
+                continue;
+            neighbours[neighbourc].distance = hypot(roots[k].real - roots[j].real,
+                    roots[k].imaginary - roots[j].imaginary);
+            neighbours[neighbourc].index = j;
+            neighbourc++;
+        }
+        qsort(neighbours, neighbourc, sizeof(Neighbour), compare_neighbours);
+
+        members[0] = k;
+        for (int m = 2;m <= rootc;m++) {
+            double spread = neighbours[m - 2].distance;
+            double next = m - 1 < neighbourc ? neighbours[m - 1].distance : INFINITY;
+            bool is_free = true;
+            Complex center;
+
+            // all roots as one cluster look the same from every root
+            if (m == rootc && k > 0)
+                break;
+
+            members[m - 1] = neighbours[m - 2].index;
+            if (!(spread < ROOT_CLUSTER_GAP * next))
+                continue;
+
+            for (int i = 1;i < m;i++)
+                if (is_clustered[members[i]])
+                    is_free = false;
+            if (!is_free)
+                break;
+            if (!is_multiple_root(polynomial, roots, radii, members, m, spread, precision, &center))
+                continue;
+
+            for (int i = 0;i < m;i++) {
+                roots[members[i]] = center;
+                is_clustered[members[i]] = true;
+            }
+            break;
+        }
+    }
+
+    for (int k = 0;k < rootc;k++)
+        if (!is_clustered[k] && fabs(roots[k].imaginary) <= radii[k])
+            roots[k].imaginary = 0.0;
+
+    free(members);
+    free(neighbours);
+    free(is_clustered);
+    free(radii);
+    return;
+}
+
+// every root refined by refine_root, then approximations of the same
+// multiple root are merged
+void
+refine_roots(Polynomial *polynomial, Complex *roots, int rootc, double precision)
+{
+    for (int k = 0;k < rootc;k++)
+        roots[k] = refine_root(polynomial, roots[k], precision);
+
+    cluster_roots(polynomial, roots, rootc, precision);
+    return;
+}
+
+static void *
+run_root_job(void *argument)
+{
+    RootJob *job = argument;
+
+    for (;;) {
+        int index;
+
+        pthread_mutex_lock(&job->mutex);
+        index = job->next++;
+        pthread_mutex_unlock(&job->mutex);
+
+        if (index >= job->count)
+            return NULL;
+
+        job->roots[index] = polynomial_roots(job->polynomials[index], job->tolerance, &job->rootc[index]);
+    }
+}
+
+// roots of many polynomials, the polynomials are handed out to threadc
+// threads one by one
+void
+solve_polynomials(int count, Polynomial **polynomials, Complex **roots, int *rootc,
+        double tolerance, int threadc)
+{
+    RootJob job;
+    pthread_t *threads;
+
+    if (threadc < 1)
+        threadc = 1;
+
+    pthread_mutex_init(&job.mutex, NULL);
+    job.next = 0;
+    job.count = count;
+    job.polynomials = polynomials;
+    job.roots = roots;
+    job.rootc = rootc;
+    job.tolerance = tolerance;
+
+    threads = (pthread_t *) malloc(sizeof(pthread_t) * threadc);
+    for (int i = 1;i < threadc;i++)
+        pthread_create(&threads[i], NULL, run_root_job, &job);
+
+    run_root_job(&job);
+
+    for (int i = 1;i < threadc;i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&job.mutex);
+    return;
+}
+
+// roots in variable of a polynomial equation lhs = rhs, or of term = 0,
+// real roots are returned as literals and complex ones as a + i*b
+Term **
+solve(Term *term, Term *variable, int *solutionc)
+{
+    Operator *operator = is_operator(term, "=");
+    Polynomial *polynomial;
+    Complex *roots;
+    Term **solutions, *difference;
+
+    *solutionc = 0;
+
+    if (operator != NULL) {
+        difference = add(copy_term(operator->argv[0]), additive_inverse(copy_term(operator->argv[1])));
+        polynomial = polynomial_of_term(difference, variable);
+        free_term(difference);
+    } else {
+        polynomial = polynomial_of_term(term, variable);
+    }
+
+    if (polynomial == NULL)
+        return NULL;
+
+    roots = polynomial_roots(polynomial, 4.0 * DBL_EPSILON, solutionc);
+    refine_roots(polynomial, roots, *solutionc, DBL_EPSILON);
+
+    solutions = (Term **) malloc(sizeof(Term *) * (*solutionc + 1));
+    for (int i = 0;i < *solutionc;i++) {
+        Complex root = roots[i];
+
+        if (fabs(root.imaginary) <= 1e-12 * fmax(1.0, fabs(root.real)))
+            solutions[i] = literal(root.real);
+        else
+            solutions[i] = add(literal(root.real), imaginary(literal(root.imaginary)));
+    }
+
+    free(roots);
+    free_polynomial(polynomial);
+
+    return solutions;
+}
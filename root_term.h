@@ -0,0 +1,11 @@
+#ifndef ROOT_TERM_H_
+#define ROOT_TERM_H_
+
+Complex *polynomial_roots(Polynomial *polynomial, double tolerance, int *rootc);
+void refine_roots(Polynomial *polynomial, Complex *roots, int rootc, double precision);
+void solve_polynomials(int count, Polynomial **polynomials, Complex **roots, int *rootc,
+        double tolerance, int threadc);
+
+Term **solve(Term *term, Term *variable, int *solutionc);
+
+#endif // ROOT_TERM_H_
@@ -0,0 +1,545 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "term.h"
+#include "compile_term.h"
+#include "polynomial_term.h"
+#include "series_term.h"
+
+Series *
+power_series(int length)
+{
+    Series *series = (Series *) malloc(sizeof(Series));
+
+    if (length < 1)
+        length = 1;
+
+    series->length = length;
+    series->coefficients = (double *) calloc(length, sizeof(double));
+
+    return series;
+}
+
+Series *
+series_constant(double value, int length)
+{
+    Series *series = power_series(length);
+
+    series->coefficients[0] = value;
+    return series;
+}
+
+void
+free_series(Series *series)
+{
+    free(series->coefficients);
+    free(series);
+    return;
+}
+
+Series *
+copy_series(Series *series)
+{
+    Series *copy = power_series(series->length);
+
+    memcpy(copy->coefficients, series->coefficients, sizeof(double) * series->length);
+    return copy;
+}
+
+// copy truncated or padded with zeros to length
+static Series *
+resize_series(Series *series, int length)
+{
+    Series *resized = power_series(length);
+
+    memcpy(resized->coefficients, series->coefficients,
+            sizeof(double) * (length < series->length ? length : series->length));
+    return resized;
+}
+
+static bool
+is_constant_series(Series *series)
+{
+    for (int i = 1;i < series->length;i++)
+        if (series->coefficients[i] != 0.0)
+            return false;
+    return true;
+}
+
+Series *
+series_add(Series *lhs, Series *rhs)
+{
+    int length = lhs->length < rhs->length ? lhs->length : rhs->length;
+    Series *result = power_series(length);
+
+    for (int i = 0;i < length;i++)
+        result->coefficients[i] = lhs->coefficients[i] + rhs->coefficients[i];
+    return result;
+}
+
+Series *
+series_additive_inverse(Series *series)
+{
+    Series *result = power_series(series->length);
+
+    for (int i = 0;i < series->length;i++)
+        result->coefficients[i] = -series->coefficients[i];
+    return result;
+}
+
+// full product of two coefficient vectors of equal length into result
+// with 2 length - 1 entries, Karatsuba above SERIES_KARATSUBA
+static void
+multiply_coefficients(double *lhs, double *rhs, int length, double *result)
+{
+    int half = length / 2, upper = length - half;
+    double *low, *high, *middle, *lhs_sum, *rhs_sum;
+
+    if (length < SERIES_KARATSUBA) {
+        memset(result, 0, sizeof(double) * (2 * length - 1));
+        for (int i = 0;i < length;i++) {
+            if (lhs[i] == 0.0)
+                continue;
+            for (int j = 0;j < length;j++)
+                result[i + j] += lhs[i] * rhs[j];
+        }
+        return;
+    }
+
+    // lhs = l0 + x^half l1, where l1 has the upper length - half entries
+    low = (double *) malloc(sizeof(double) * (2 * half - 1));
+    high = (double *) malloc(sizeof(double) * (2 * upper - 1));
+    middle = (double *) malloc(sizeof(double) * (2 * upper - 1));
+    lhs_sum = (double *) malloc(sizeof(double) * upper);
+    rhs_sum = (double *) malloc(sizeof(double) * upper);
+
+    multiply_coefficients(lhs, rhs, half, low);
+    multiply_coefficients(&lhs[half], &rhs[half], upper, high);
+
+    for (int i = 0;i < upper;i++) {
+        lhs_sum[i] = lhs[half + i] + (i < half ? lhs[i] : 0.0);
+        rhs_sum[i] = rhs[half + i] + (i < half ? rhs[i] : 0.0);
+    }
+    multiply_coefficients(lhs_sum, rhs_sum, upper, middle);
+
+    for (int i = 0;i < 2 * half - 1;i++)
+        middle[i] -= low[i];
+    for (int i = 0;i < 2 * upper - 1;i++)
+        middle[i] -= high[i];
+
+    memset(result, 0, sizeof(double) * (2 * length - 1));
+    for (int i = 0;i < 2 * half - 1;i++)
+        result[i] += low[i];
+    for (int i = 0;i < 2 * upper - 1;i++) {
+        result[half + i] += middle[i];
+        result[2 * half + i] += high[i];
+    }
+
+    free(low);
+    free(high);
+    free(middle);
+    free(lhs_sum);
+    free(rhs_sum);
+    return;
+}
+
+Series *
+series_multiply(Series *lhs, Series *rhs)
+{
+    int length = lhs->length < rhs->length ? lhs->length : rhs->length;
+    Series *result = power_series(length);
+    double *product = (double *) malloc(sizeof(double) * (2 * length - 1));
+
+    multiply_coefficients(lhs->coefficients, rhs->coefficients, length, product);
+    memcpy(result->coefficients, product, sizeof(double) * length);
+
+    free(product);
+    return result;
+}
+
+// Newton iteration g = g (2 - f g) doubling the number of correct terms,
+// so the inverse costs a constant number of multiplications. Returns NULL
+// if the constant term is zero.
+Series *
+series_multiple_inverse(Series *series)
+{
+    Series *inverse;
+
+    if (series->coefficients[0] == 0.0)
+        return NULL;
+
+    inverse = series_constant(1.0 / series->coefficients[0], 1);
+
+    for (int length = 1;length < series->length;) {
+        Series *truncated, *padded, *product, *correction;
+
+        length = 2 * length < series->length ? 2 * length : series->length;
+
+        truncated = resize_series(series, length);
+        padded = resize_series(inverse, length);
+        product = series_multiply(truncated, padded);
+
+        correction = series_additive_inverse(product);
+        correction->coefficients[0] += 2.0;
+
+        free_series(inverse);
+        inverse = series_multiply(padded, correction);
+
+        free_series(truncated);
+        free_series(padded);
+        free_series(product);
+        free_series(correction);
+    }
+
+    return inverse;
+}
+
+Series *
+series_derivative(Series *series)
+{
+    Series *result = power_series(series->length > 1 ? series->length - 1 : 1);
+
+    for (int i = 1;i < series->length;i++)
+        result->coefficients[i - 1] = i * series->coefficients[i];
+    return result;
+}
+
+Series *
+series_integral(Series *series, double constant)
+{
+    Series *result = power_series(series->length + 1);
+
+    result->coefficients[0] = constant;
+    for (int i = 0;i < series->length;i++)
+        result->coefficients[i + 1] = series->coefficients[i] / (i + 1);
+    return result;
+}
+
+// log f = log f0 + I[f' / f], NULL unless f0 > 0
+Series *
+series_logarithm(Series *series)
+{
+    Series *derivative, *truncated, *inverse, *quotient, *result;
+
+    if (!(series->coefficients[0] > 0.0))
+        return NULL;
+    if (series->length == 1)
+        return series_constant(log(series->coefficients[0]), 1);
+
+    derivative = series_derivative(series);
+    truncated = resize_series(series, series->length - 1);
+    inverse = series_multiple_inverse(truncated);
+    quotient = series_multiply(derivative, inverse);
+    result = series_integral(quotient, log(series->coefficients[0]));
+
+    free_series(derivative);
+    free_series(truncated);
+    free_series(inverse);
+    free_series(quotient);
+
+    return result;
+}
+
+// Newton iteration g = g (1 - log g + h) on h - h0, scaled by exp(h0)
+Series *
+series_exponential(Series *series)
+{
+    Series *result = series_constant(1.0, 1);
+
+    for (int length = 1;length < series->length;) {
+        Series *padded, *logarithm, *correction;
+
+        length = 2 * length < series->length ? 2 * length : series->length;
+
+        padded = resize_series(result, length);
+        logarithm = series_logarithm(padded);
+        correction = power_series(length);
+        for (int i = 1;i < length;i++)
+            correction->coefficients[i] = series->coefficients[i] - logarithm->coefficients[i];
+        correction->coefficients[0] = 1.0;
+
+        free_series(result);
+        result = series_multiply(padded, correction);
+
+        free_series(padded);
+        free_series(logarithm);
+        free_series(correction);
+    }
+
+    for (int i = 0;i < result->length;i++)
+        result->coefficients[i] *= exp(series->coefficients[0]);
+
+    return result;
+}
+
+// base^a = base0^a exp(a log(base / base0)) for a constant exponent, a
+// base with leading zeros needs a natural exponent. A varying exponent
+// needs base0 > 0. Returns NULL if the power has no real power series.
+Series *
+series_power(Series *base, Series *exponent)
+{
+    int length = base->length < exponent->length ? base->length : exponent->length;
+    int valuation = 0, shift;
+    double a = exponent->coefficients[0], leading, scale;
+    Series *unit, *logarithm, *result;
+
+    if (!is_constant_series(exponent)) {
+        Series *product;
+
+        logarithm = series_logarithm(base);
+        if (logarithm == NULL)
+            return NULL;
+        product = series_multiply(logarithm, exponent);
+        result = series_exponential(product);
+
+        free_series(logarithm);
+        free_series(product);
+        return result;
+    }
+
+    while (valuation < length && base->coefficients[valuation] == 0.0)
+        valuation++;
+
+    if (a == 0.0)
+        return series_constant(1.0, length);
+    if (valuation == length)
+        return a > 0.0 ? power_series(length) : NULL;
+    if (valuation > 0 && (a < 0.0 || a != floor(a)))
+        return NULL;
+
+    result = power_series(length);
+    if (valuation * a >= length)
+        return result;
+    shift = valuation * (int) a;
+
+    // the unit part base / (base_v x^v) to the remaining length
+    leading = base->coefficients[valuation];
+    scale = pow(leading, a);
+    if (isnan(scale)) {
+        free_series(result);
+        return NULL;
+    }
+
+    unit = power_series(length - shift);
+    for (int i = 0;i < unit->length && valuation + i < length;i++)
+        unit->coefficients[i] = base->coefficients[valuation + i] / leading;
+
+    logarithm = series_logarithm(unit);
+    for (int i = 0;i < logarithm->length;i++)
+        logarithm->coefficients[i] *= a;
+    free_series(unit);
+    unit = series_exponential(logarithm);
+
+    for (int i = 0;i + shift < length && i < unit->length;i++)
+        result->coefficients[i + shift] = scale * unit->coefficients[i];
+
+    free_series(unit);
+    free_series(logarithm);
+
+    return result;
+}
+
+// outer(inner) by Horner's scheme, inner must have no constant term
+Series *
+series_compose(Series *outer, Series *inner)
+{
+    int length = inner->length;
+    Series *result;
+
+    if (inner->coefficients[0] != 0.0)
+        return NULL;
+
+    result = series_constant(outer->coefficients[outer->length - 1], length);
+    for (int i = outer->length - 2;i >= 0;i--) {
+        Series *product = series_multiply(result, inner);
+
+        product->coefficients[0] += outer->coefficients[i];
+        free_series(result);
+        result = product;
+    }
+
+    return result;
+}
+
+// compositional inverse g with f(g(x)) = x by Newton's iteration
+// g = g - (f(g) - x) / f'(g), f needs f0 = 0 and f1 != 0
+Series *
+series_revert(Series *series)
+{
+    Series *result;
+
+    if (series->coefficients[0] != 0.0 || series->length < 2 || series->coefficients[1] == 0.0)
+        return NULL;
+
+    result = power_series(2);
+    result->coefficients[1] = 1.0 / series->coefficients[1];
+
+    for (int length = 2;length < series->length;) {
+        Series *padded, *outer, *extended, *derivative, *value, *slope, *inverse, *step;
+
+        length = 2 * length < series->length ? 2 * length : series->length;
+
+        padded = resize_series(result, length);
+        outer = resize_series(series, length);
+        extended = resize_series(series, length + 1);
+        derivative = series_derivative(extended);
+
+        value = series_compose(outer, padded);
+        value->coefficients[1] -= 1.0;
+        slope = series_compose(derivative, padded);
+        inverse = series_multiple_inverse(slope);
+        step = series_multiply(value, inverse);
+
+        free_series(result);
+        result = power_series(length);
+        for (int i = 0;i < length;i++)
+            result->coefficients[i] = padded->coefficients[i] - step->coefficients[i];
+
+        free_series(padded);
+        free_series(outer);
+        free_series(extended);
+        free_series(derivative);
+        free_series(value);
+        free_series(slope);
+        free_series(inverse);
+        free_series(step);
+    }
+
+    return result;
+}
+
+static void
+free_registers(Series **registers, int count)
+{
+    for (int i = 0;i < count;i++)
+        if (registers[i] != NULL)
+            free_series(registers[i]);
+    free(registers);
+    return;
+}
+
+// expansion of the first result around variable slot 0 = point, every
+// instruction is evaluated once as a truncated series. Returns NULL if
+// some subterm has no real power series at point.
+Series *
+evaluate_program_series(Program *program, double point, int length)
+{
+    Series **registers = (Series **) calloc(program->length + 1, sizeof(Series *));
+    Series *result;
+
+    if (length < 2)
+        length = 2;
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        Series *value = NULL;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+        case OPCODE_CONSTANT:
+            value = series_constant(instruction->value, length);
+            break;
+        case OPCODE_VARIABLE:
+            value = series_constant(instruction->index == 0 ? point : NAN, length);
+            if (instruction->index == 0)
+                value->coefficients[1] = 1.0;
+            break;
+        case OPCODE_ADD:
+            value = copy_series(registers[operands[0]]);
+            for (int j = 1;j < instruction->argc;j++) {
+                Series *sum = series_add(value, registers[operands[j]]);
+
+                free_series(value);
+                value = sum;
+            }
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            value = series_additive_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_MULTIPLY:
+            value = copy_series(registers[operands[0]]);
+            for (int j = 1;j < instruction->argc;j++) {
+                Series *product = series_multiply(value, registers[operands[j]]);
+
+                free_series(value);
+                value = product;
+            }
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            value = series_multiple_inverse(registers[operands[0]]);
+            break;
+        case OPCODE_POWER:
+            value = series_power(registers[operands[0]], registers[operands[1]]);
+            break;
+        default:
+            // imaginary terms have no real series
+            break;
+        }
+
+        if (value == NULL) {
+            free_registers(registers, program->length);
+            return NULL;
+        }
+        registers[i] = value;
+    }
+
+    result = copy_series(registers[program->results[0]]);
+    free_registers(registers, program->length);
+
+    return result;
+}
+
+Series *
+series_of_term(Term *term, Term *variable, double point, int length)
+{
+    Program *program = compile_term(term, 1, &variable);
+    Series *result;
+
+    if (program == NULL)
+        return NULL;
+
+    result = evaluate_program_series(program, point, length);
+    free_program(program);
+
+    return result;
+}
+
+// sum of coefficients[i] (variable - point)^i
+Term *
+term_of_series(Series *series, Term *variable, double point)
+{
+    Polynomial *truncated = polynomial(series->length - 1);
+    Term *base, *result;
+
+    memcpy(truncated->coefficients, series->coefficients, sizeof(double) * series->length);
+
+    if (point == 0.0)
+        base = copy_term(variable);
+    else
+        base = add(copy_term(variable), literal(-point));
+
+    result = term_of_polynomial(truncated, base);
+
+    free_term(base);
+    free_polynomial(truncated);
+
+    return result;
+}
+
+// Taylor polynomial of term in variable around point up to order, or NULL
+// if term has no real power series there
+Term *
+series(Term *term, Term *variable, double point, int order)
+{
+    Series *expansion = series_of_term(term, variable, point, order + 1);
+    Term *result;
+
+    if (expansion == NULL)
+        return NULL;
+
+    result = term_of_series(expansion, variable, point);
+    free_series(expansion);
+
+    return result;
+}
@@ -0,0 +1,38 @@
+#ifndef SERIES_TERM_H_
+#define SERIES_TERM_H_
+
+// products below this length are computed by the schoolbook method
+#define SERIES_KARATSUBA 32
+
+typedef struct Series Series;
+
+// power series truncated after x^(length - 1), coefficients[i] belongs
+// to x^i
+struct Series {
+    int length;
+    double *coefficients;
+};
+
+Series *power_series(int length);
+Series *series_constant(double value, int length);
+void free_series(Series *series);
+Series *copy_series(Series *series);
+
+Series *series_add(Series *lhs, Series *rhs);
+Series *series_additive_inverse(Series *series);
+Series *series_multiply(Series *lhs, Series *rhs);
+Series *series_multiple_inverse(Series *series);
+Series *series_derivative(Series *series);
+Series *series_integral(Series *series, double constant);
+Series *series_logarithm(Series *series);
+Series *series_exponential(Series *series);
+Series *series_power(Series *base, Series *exponent);
+Series *series_compose(Series *outer, Series *inner);
+Series *series_revert(Series *series);
+
+Series *evaluate_program_series(Program *program, double point, int length);
+Series *series_of_term(Term *term, Term *variable, double point, int length);
+Term *term_of_series(Series *series, Term *variable, double point);
+Term *series(Term *term, Term *variable, double point, int order);
+
+#endif // SERIES_TERM_H_
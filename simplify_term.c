@@ -1,33 +1,34 @@
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include "term.h"
+#include "memory_term.h"
+#include "builder_term.h"
+#include "traverse_term.h"
 #include "compare_term.h"
 #include "sort_term.h"
 #include "simplify_term.h"
 #include "variable_term.h"
+#include "compile_term.h"
+#include "differentiate_term.h"
+#include "polynomial_term.h"
+#include "integrate_term.h"
+#include "modular_term.h"
 
 // TODO: simplify teilbare polynome like (x*x-1)=(x-1.0)*(x+1.0)*1/(x-1.0) => (x+1.0) (Polynomdivision)
 // Term *simplify_polynom_division(Term *term);
 
 
 // simplify_multiply_equal_variables (exponential)
-// simplify differential
-// simplify integral
 
-Term *
-simplify(Term *term)
+// every rule in order on an operator whose arguments are simple already
+static Term *
+apply_rules(Term *term)
 {
-    Operator *operator;
-    Term *simple;
-
-    if(strcmp(term->meaning, "operator") != 0)
-        return term;
+    Term *simple = term;
 
-    operator = term->content;
-    for(int i = 0;i < operator->argc;i++)
-        operator->argv[i] = simplify(operator->argv[i]);
-
-    simple = term;
+    simple = simplify_differential(simple);
+    simple = simplify_integral(simple);
 
     simple = simplify_double_imaginary(simple);
     simple = simplify_double_additive_inverse(simple);
@@ -44,6 +45,7 @@ simplify(Term *term)
     simple = simplify_imaginary_add(simple);
     simple = simplify_added_zero(simple);
     simple = simplify_combine_added_neutral_terms(simple);
+    simple = simplify_vanishing_sum(simple);
     simple = simplify_additive_assoziativity(simple);
     simple = simplify_order_added_terms(simple);
 
@@ -70,6 +72,42 @@ simplify(Term *term)
     return simple;
 }
 
+// post order over an explicit stack instead of recursion, every visit
+// keeps the slot its simplified operator goes to in other. Rules that
+// simplify their result again start a traversal of their own, so the C
+// stack grows with nested rewrites, not with the depth of term.
+Term *
+simplify(Term *term)
+{
+    Traversal temp_traversal;
+    Term *simple = term;
+
+    if(strcmp(term->meaning, "operator") != 0)
+        return term;
+
+    begin_traversal(&temp_traversal);
+    push_visit(&temp_traversal, term, &simple);
+
+    while (temp_traversal.depth > 0) {
+        Visit *visit = top_visit(&temp_traversal);
+        Term **slot;
+
+        if (visit->child == visit->childc) {
+            slot = visit->other;
+            pop_visit(&temp_traversal);
+            *slot = apply_rules(*slot);
+            continue;
+        }
+
+        slot = &visit->childv[visit->child++];
+        if (strcmp((*slot)->meaning, "operator") == 0)
+            push_visit(&temp_traversal, *slot, slot);
+    }
+
+    end_traversal(&temp_traversal);
+    return simple;
+}
+
 Term *
 simplify_double_imaginary(Term *term)
 {
@@ -197,213 +235,148 @@ simplify_imaginary_zero(Term * term)
     return literal(0.0);
 }
 
-Term *
-add_literals(Term *term)
+// value of a literal or of the additive inverse of one
+static bool
+literal_part(Term *term, double *value)
 {
-    Operator *operator;
-    Term *lhs_term, *rhs_term, *simple;
-
-    int lhs_index, rhs_index;
-    double lhs_value, rhs_value;
-
-    operator = is_operator(term, "+");
-    if (operator == NULL)
-        return term;
-
-    for (lhs_index = 0;lhs_index < operator->argc;lhs_index++) {
-        lhs_term = operator->argv[lhs_index];
+    Operator *temp_operator;
+    Literal *temp_literal;
 
-        if (strcmp(lhs_term->meaning, "literal") == 0) {
-            Literal *temp_literal;
+    if (strcmp(term->meaning, "literal") == 0) {
+        temp_literal = term->content;
+        *value = temp_literal->value;
+        return true;
+    }
 
-            temp_literal = lhs_term->content;
-            lhs_value = temp_literal->value;
-            break;
-        }
-        if (strcmp(lhs_term->meaning, "constant") == 0)
-            continue;
-        if (strcmp(lhs_term->meaning, "variable") == 0)
-            continue;
-        if (strcmp(lhs_term->meaning, "operator") == 0) {
-            Operator *temp_operator;
-            Term *temp_term;
-            Literal *temp_literal;
+    temp_operator = is_operator(term, "additive_inverse");
+    if (temp_operator == NULL || strcmp(temp_operator->argv[0]->meaning, "literal") != 0)
+        return false;
 
-            temp_operator = lhs_term->content;
-            if (strcmp(temp_operator->name, "additive_inverse") != 0)
-                continue;
+    temp_literal = temp_operator->argv[0]->content;
+    *value = -temp_literal->value;
+    return true;
+}
 
-            temp_term = temp_operator->argv[0];
-            if (strcmp(temp_term->meaning, "literal") != 0)
-                continue;
+static bool
+imaginary_part(Term *term, double *value)
+{
+    Operator *temp_operator;
 
-            temp_literal = temp_term->content;
-            lhs_value = -(temp_literal->value);
-            break;
-        }
-    }
-    if(lhs_index >= operator->argc)
-        return term;
+    temp_operator = is_operator(term, "imaginary");
+    if (temp_operator == NULL)
+        return false;
 
-    for (rhs_index = lhs_index + 1;rhs_index < operator->argc;rhs_index++) {
-        if (lhs_index == rhs_index)
-            continue;
+    return literal_part(temp_operator->argv[0], value);
+}
 
-        rhs_term = operator->argv[rhs_index];
+static bool
+factor_part(Term *term, double *value)
+{
+    Literal *temp_literal;
 
-        if (strcmp(rhs_term->meaning, "literal") == 0) {
-            Literal *temp_literal;
+    if (strcmp(term->meaning, "literal") != 0)
+        return false;
 
-            temp_literal = rhs_term->content;
-            rhs_value = temp_literal->value;
-            break;
-        }
-        if (strcmp(rhs_term->meaning, "constant") == 0)
-            continue;
-        if (strcmp(rhs_term->meaning, "variable") == 0)
-            continue;
-        if (strcmp(rhs_term->meaning, "operator") == 0) {
-            Operator *temp_operator;
-            Term *temp_term;
-            Literal *temp_literal;
+    temp_literal = term->content;
+    *value = temp_literal->value;
+    return true;
+}
 
-            temp_operator = rhs_term->content;
-            if (strcmp(temp_operator->name, "additive_inverse") != 0)
-                continue;
+// frees every argument of term for which is_folded holds and puts folded in
+// front of the others, in a single sweep over argv. A NULL folded is left
+// out, so a vanishing sum does not stay behind as a zero summand. The
+// operator is only simplified again if at most one argument is left of it,
+// everything else is up to the rules after the caller.
+static Term *
+replace_folded(Term *term, Term *folded, bool (*is_folded)(Term *, double *))
+{
+    Operator *operator = term->content;
+    Term *simple;
 
-            temp_term = temp_operator->argv[0];
-            if (strcmp(temp_term->meaning, "literal") != 0)
-                continue;
+    int index = operator->argc;
+    double value;
 
-            temp_literal = temp_term->content;
-            rhs_value = -(temp_literal->value);
-            break;
-        }
+    for (int i = operator->argc - 1;i >= 0;i--) {
+        if (is_folded(operator->argv[i], &value))
+            free_term(operator->argv[i]);
+        else
+            operator->argv[--index] = operator->argv[i];
     }
-    if(rhs_index >= operator->argc)
-        return term;
+    if (folded != NULL)
+        operator->argv[--index] = folded;
 
-    simple = literal(lhs_value + rhs_value);
+    memmove(operator->argv, operator->argv + index, sizeof(Term *) * (operator->argc - index));
+    operator->argc -= index;
 
-    for(int i = 0;i < operator->argc;i++) {
-        if (i == lhs_index || i == rhs_index)
-            continue;
+    if (operator->argc > 1)
+        return term;
 
-        simple = add(simple, copy_term(operator->argv[i]));
+    if (operator->argc == 0) {
+        free_term(term);
+        return literal(0.0);
     }
 
+    simple = take_argument(term, 0);
     free_term(term);
 
     return simplify(simple);
 }
 
+// the sum is accumulated in argument order, as folding pair by pair did
 Term *
-add_imaginary_literals(Term *term)
+add_literals(Term *term)
 {
-    Operator *operator, *imaginary_operator;
-    Term *lhs_term, *rhs_term, *simple;
+    Operator *operator;
 
-    int lhs_index, rhs_index;
-    double lhs_value, rhs_value;
+    int count = 0;
+    double value, sum = 0.0;
 
     operator = is_operator(term, "+");
     if (operator == NULL)
         return term;
 
-    for (lhs_index = 0;lhs_index < operator->argc;lhs_index++) {
-        imaginary_operator = is_operator(operator->argv[lhs_index], "imaginary");
-        if (imaginary_operator == NULL)
-            continue;
-
-        lhs_term = imaginary_operator->argv[0];
-
-        if (strcmp(lhs_term->meaning, "literal") == 0) {
-            Literal *temp_literal;
-            temp_literal = lhs_term->content;
-            lhs_value = temp_literal->value;
-            break;
-        }
-        if (strcmp(lhs_term->meaning, "constant") == 0)
-            continue;
-        if (strcmp(lhs_term->meaning, "variable") == 0)
+    for (int i = 0;i < operator->argc;i++) {
+        if (!literal_part(operator->argv[i], &value))
             continue;
-        if (strcmp(lhs_term->meaning, "operator") == 0) {
-            Operator *temp_operator;
-            Term *temp_term;
-            Literal *temp_literal;
-
-            temp_operator = lhs_term->content;
-            if (strcmp(temp_operator->name, "additive_inverse") != 0)
-                continue;
 
-            temp_term = temp_operator->argv[0];
-            if (strcmp(temp_term->meaning, "literal") != 0)
-                continue;
-
-            temp_literal = temp_term->content;
-            lhs_value = -temp_literal->value;
-            break;
-        }
+        sum = count == 0 ? value : sum + value;
+        count++;
     }
-
-    if(lhs_index >= operator->argc)
+    if (count < 2)
         return term;
 
-    for (rhs_index = lhs_index + 1;rhs_index < operator->argc;rhs_index++) {
-        if (lhs_index == rhs_index)
-            continue;
-
-        imaginary_operator = is_operator(operator->argv[rhs_index], "imaginary");
-        if (imaginary_operator == NULL)
-            continue;
-
-        rhs_term = imaginary_operator->argv[0];
+    if (sum == 0.0)
+        return replace_folded(term, NULL, literal_part);
 
-        if (strcmp(rhs_term->meaning, "literal") == 0) {
-            Literal *temp_literal;
-
-            temp_literal = rhs_term->content;
-            rhs_value = temp_literal->value;
-            break;
-        }
-        if (strcmp(rhs_term->meaning, "constant") == 0)
-            continue;
-        if (strcmp(rhs_term->meaning, "variable") == 0)
-            continue;
-        if (strcmp(rhs_term->meaning, "operator") == 0) {
-            Operator *temp_operator;
-            Term *temp_term;
-            Literal *temp_literal;
-
-            temp_operator = rhs_term->content;
-            if (strcmp(temp_operator->name, "additive_inverse") != 0)
-                continue;
+    return replace_folded(term, literal(sum), literal_part);
+}
 
-            temp_term = temp_operator->argv[0];
-            if (strcmp(temp_term->meaning, "literal") != 0)
-                continue;
+Term *
+add_imaginary_literals(Term *term)
+{
+    Operator *operator;
 
-            temp_literal = temp_term->content;
-            rhs_value = -temp_literal->value;
-            break;
-        }
-    }
+    int count = 0;
+    double value, sum = 0.0;
 
-    if(rhs_index >= operator->argc)
+    operator = is_operator(term, "+");
+    if (operator == NULL)
         return term;
 
-    simple = imaginary(literal(lhs_value + rhs_value));
-
-    for(int i = 0;i < operator->argc;i++) {
-        if (i == lhs_index || i == rhs_index)
+    for (int i = 0;i < operator->argc;i++) {
+        if (!imaginary_part(operator->argv[i], &value))
             continue;
 
-        simple = add(simple, copy_term(operator->argv[i]));
+        sum = count == 0 ? value : sum + value;
+        count++;
     }
+    if (count < 2)
+        return term;
 
-    free_term(term);
+    if (sum == 0.0)
+        return replace_folded(term, NULL, imaginary_part);
 
-    return simplify(simple);
+    return replace_folded(term, simplify_imaginary_zero(imaginary(literal(sum))), imaginary_part);
 }
 
 Term *simplify_additive_inverse_add(Term *term)
@@ -457,8 +430,8 @@ simplify_added_zero(Term *term)
 {
     Operator *operator;
     Literal *literal;
-    Term *simple;
-    int i, j;
+    TermBuilder temp_builder;
+    int i;
 
     operator = is_operator(term, "+");
     if (operator == NULL)
@@ -475,23 +448,18 @@ simplify_added_zero(Term *term)
     if (literal->value != 0.0)
         return term;
 
-    if (i == 0)
-        j = 1;
-    else
-        j = 0;
-
-    simple = copy_term(operator->argv[j]);
-
+    // everything but the neutral literal, in order
+    begin_operator(&temp_builder, "+", operator->argc - 1);
     for (int k = 0;k < operator->argc;k++) {
-        if (i == k || j == k)
+        if (i == k)
             continue;
 
-        simple = add(simple, copy_term(operator->argv[k]));
+        push_argument(&temp_builder, take_argument(term, k));
     }
 
     free_term(term);
 
-    return simplify(simple);
+    return simplify(finish_operator(&temp_builder));
 }
 
 Term *
@@ -500,6 +468,7 @@ simplify_combine_added_neutral_terms(Term *term)
     Operator *operator_0, *operator_1;
     Term *term_1;
     int i, j;
+    bool is_combined = false;
 
     operator_0 = is_operator(term, "+");
     if (operator_0 == NULL)
@@ -528,18 +497,47 @@ simplify_combine_added_neutral_terms(Term *term)
         free_term(operator_0->argv[i]);
         operator_0->argv[j] = literal(0.0);
         operator_0->argv[i] = literal(0.0);
+        is_combined = true;
     }
-    if(i >= operator_0->argc)
+    if (!is_combined)
         return term;
 
     return simplify(term);
 }
 
+// sums that only cancel once their arguments are expanded, like
+// x*(y+1) + -(x*y + x), are found by evaluating them at random points.
+// Only sums that subtract an operator are tested, the others cancel above.
+Term *
+simplify_vanishing_sum(Term *term)
+{
+    Operator *operator_0, *operator_1;
+    int i;
+
+    operator_0 = is_operator(term, "+");
+    if (operator_0 == NULL)
+        return term;
+
+    for (i = 0;i < operator_0->argc;i++) {
+        operator_1 = is_operator(operator_0->argv[i], "additive_inverse");
+        if (operator_1 != NULL && strcmp(operator_1->argv[0]->meaning, "operator") == 0)
+            break;
+    }
+    if (i >= operator_0->argc)
+        return term;
+
+    if (test_zero(term, MODULAR_TRIALS) != EQUIVALENCE_EQUAL)
+        return term;
+
+    free_term(term);
+    return literal(0.0);
+}
+
 Term *
 simplify_additive_assoziativity(Term *term)
 {
     Operator *operator_0, *operator_1;
-    Term *simple;
+    TermBuilder temp_builder;
     int i;
 
     operator_0 = is_operator(term, "+");
@@ -556,14 +554,10 @@ simplify_additive_assoziativity(Term *term)
     if (i >= operator_0->argc)
         return term;
 
-    simple = add(copy_term(operator_0->argv[0]), copy_term(operator_0->argv[1]));
-
-    for (int i = 2;i < operator_0->argc;i++)
-        simple = add(simple, copy_term(operator_0->argv[i]));
-
-    free_term(term);
+    begin_operator(&temp_builder, "+", 2 * operator_0->argc);
+    push_arguments(&temp_builder, term);
 
-    return simplify(simple);
+    return simplify(finish_operator(&temp_builder));
 }
 
 Term *simplify_order_added_terms(Term *term)
@@ -583,59 +577,32 @@ Term *
 multiply_literals(Term *term)
 {
     Operator *operator;
-    Term *simple;
+
+    int count = 0;
+    double value, product = 1.0;
 
     operator = is_operator(term, "*");
     if (operator == NULL)
         return term;
 
-    int lhs_index, rhs_index;
-    Literal *lhs_literal, *rhs_literal;
-
-    for (lhs_index = 0;lhs_index < operator->argc;lhs_index++) {
-        if (strcmp(operator->argv[lhs_index]->meaning, "literal") != 0)
-            continue;
-
-        lhs_literal = operator->argv[lhs_index]->content;
-        break;
-    }
-
-    if(lhs_index >= operator->argc)
-        return term;
-
-    for (rhs_index = 0;rhs_index < operator->argc;rhs_index++) {
-        if (lhs_index == rhs_index)
-            continue;
-
-        if (strcmp(operator->argv[rhs_index]->meaning, "literal") != 0)
+    for (int i = 0;i < operator->argc;i++) {
+        if (!factor_part(operator->argv[i], &value))
             continue;
 
-        rhs_literal = operator->argv[rhs_index]->content;
-        break;
+        product = count == 0 ? value : product * value;
+        count++;
     }
-
-    if(rhs_index >= operator->argc)
+    if (count < 2)
         return term;
 
-    simple = literal(lhs_literal->value * rhs_literal->value);
-
-    for(int i = 0;i < operator->argc;i++) {
-        if (i == lhs_index || i == rhs_index)
-            continue;
-
-        simple = multiply(simple, copy_term(operator->argv[i]));
-    }
-
-    free_term(term);
-
-    return simplify(simple);
+    return replace_folded(term, literal(product), factor_part);
 }
 
 Term *
 simplify_multiple_assoziativity(Term *term)
 {
     Operator *operator;
-    Term *simple;
+    TermBuilder temp_builder;
     int i;
 
     operator = is_operator(term, "*");
@@ -652,14 +619,10 @@ simplify_multiple_assoziativity(Term *term)
     if (i >= operator->argc)
         return term;
 
-    simple = multiply(copy_term(operator->argv[0]), copy_term(operator->argv[1]));
+    begin_operator(&temp_builder, "*", 2 * operator->argc);
+    push_arguments(&temp_builder, term);
 
-    for (int i = 2;i < operator->argc;i++)
-        simple = multiply(simple, copy_term(operator->argv[i]));
-
-    free_term(term);
-
-    return simplify(simple);
+    return simplify(finish_operator(&temp_builder));
 }
 
 Term *
@@ -767,8 +730,8 @@ simplify_multiplied_one(Term *term)
     Operator *operator;
     Literal *literal;
 
-    Term *simple;
-    int i, j;
+    TermBuilder temp_builder;
+    int i;
 
     operator = is_operator(term, "*");
     if (operator == NULL)
@@ -786,23 +749,18 @@ simplify_multiplied_one(Term *term)
     if (literal->value != 1.0)
         return term;
 
-    if (i == 0)
-        j = 1;
-    else
-        j = 0;
-
-    simple = copy_term(operator->argv[j]);
-
+    // everything but the neutral literal, in order
+    begin_operator(&temp_builder, "*", operator->argc - 1);
     for (int k = 0;k < operator->argc;k++) {
-        if (i == k || j == k)
+        if (i == k)
             continue;
 
-        simple = multiply(simple, copy_term(operator->argv[k]));
+        push_argument(&temp_builder, take_argument(term, k));
     }
 
     free_term(term);
 
-    return simplify(simple);
+    return simplify(finish_operator(&temp_builder));
 }
 
 Term *
@@ -857,14 +815,12 @@ simplify_combine_multiplied_multiple_inverse(Term *term)
         return term;
 
     int i, j, k;
-    Term *term_1, *term_2;
 
     for (i = 0;i < operator->argc;i++) {
         Operator *operator_1 = is_operator(operator->argv[i], "multiple_inverse");
         if (operator_1 == NULL)
             continue;
 
-        term_1 = operator_1->argv[0];
         j = i;
         break;
     }
@@ -876,25 +832,31 @@ simplify_combine_multiplied_multiple_inverse(Term *term)
         if (operator_1 == NULL)
             continue;
 
-        term_2 = operator_1->argv[0];
         k = i;
         break;
     }
     if (i >= operator->argc)
         return term;
 
-    Term *simple = multiple_inverse(multiply(copy_term(term_1), copy_term(term_2)));
+    TermBuilder inverse_builder, temp_builder;
+
+    // 1/a * 1/b -> 1/(a * b), a and b move out of their inverses
+    begin_operator(&inverse_builder, "*", 2);
+    push_argument(&inverse_builder, take_argument(operator->argv[j], 0));
+    push_argument(&inverse_builder, take_argument(operator->argv[k], 0));
 
+    begin_operator(&temp_builder, "*", operator->argc - 1);
+    push_argument(&temp_builder, multiple_inverse(finish_operator(&inverse_builder)));
     for (i = 0;i < operator->argc;i++) {
         if (i == j || i == k)
             continue;
 
-        simple = multiply(simple, copy_term(operator->argv[i]));
+        push_argument(&temp_builder, take_argument(term, i));
     }
 
     free_term(term);
 
-    return simplify(simple);
+    return simplify(finish_operator(&temp_builder));
 }
 
 Term *
@@ -999,26 +961,28 @@ simplify_with_distributive_law(Term *term)
     if (i >= operator_0->argc)
         return term;
 
-    Term **part = (Term **) malloc(sizeof(Term*) * temp_operator->argc);
-
-    for (int j = 0;j < temp_operator->argc;j++)
-        part[j] = copy_term(temp_operator->argv[j]);
+    TermBuilder sum_builder;
 
+    // every summand moves into its own product with copies of the other
+    // factors
+    begin_operator(&sum_builder, "+", temp_operator->argc);
     for (int j = 0;j < temp_operator->argc;j++) {
+        TermBuilder product_builder;
+
+        begin_operator(&product_builder, "*", operator_0->argc);
+        push_argument(&product_builder, take_argument(operator_0->argv[i], j));
         for (int k = 0;k < operator_0->argc;k++) {
             if (i == k)
                 continue;
 
-            part[j] = multiply(part[j], copy_term(operator_0->argv[k]));
+            push_copy(&product_builder, operator_0->argv[k]);
         }
+        push_argument(&sum_builder, finish_operator(&product_builder));
     }
 
-
-    Term *simple = operator("+", temp_operator->argc, part);
-
     free_term(term);
 
-    return simple;
+    return finish_operator(&sum_builder);
 }
 
 Term *
@@ -1054,12 +1018,13 @@ simplify_recursive_multiple_inverse(Term *term)
     if (i >= operator_1->argc)
         return term;
 
-// TODO: testing because could throw error
+    // term_inverse points into one of the arguments simplified below
+    term_inverse = copy_term(term_inverse);
     for(int i = 0;i < operator_1->argc;i++)
         operator_1->argv[i]
             = simplify(multiply(operator_1->argv[i], copy_term(term_inverse)));
 
-    return simplify(multiply(copy_term(term_inverse), term));
+    return simplify(multiply(term_inverse, term));
 }
 
 Term *
@@ -1090,3 +1055,40 @@ inside_of_multiple_inverse(Term *term)
     return term_inverse;
 }
 
+Term *
+simplify_differential(Term *term)
+{
+    Operator *operator = is_operator(term, "D");
+    if (operator == NULL)
+        return term;
+
+    if (strcmp(operator->argv[1]->meaning, "variable") != 0)
+        return term;
+
+    Term *simple = differentiate(operator->argv[0], operator->argv[1]);
+    if (simple == NULL)
+        return term;
+
+    free_term(term);
+
+    return simple;
+}
+
+Term *
+simplify_integral(Term *term)
+{
+    Operator *operator = is_operator(term, "I");
+    if (operator == NULL)
+        return term;
+
+    if (operator->argc != 2)
+        return term;
+
+    Term *simple = integrate(operator->argv[0], operator->argv[1]);
+    if (simple == NULL)
+        return term;
+
+    free_term(term);
+
+    return simple;
+}
@@ -1,6 +1,10 @@
 #ifndef SIMPLIFY_TERM_H_
 #define SIMPLIFY_TERM_H_
 
+// bumped whenever a rule changes what simplify returns, persistent caches
+// written under another value are discarded
+#define SIMPLIFY_RULES 3
+
 Term *simplify(Term *term);
 
 Term *simplify_double_imaginary(Term *term);
@@ -18,6 +22,7 @@ Term *simplify_additive_inverse_add(Term *term);
 Term *simplify_imaginary_add(Term *term);
 Term *simplify_added_zero(Term *term);
 Term *simplify_combine_added_neutral_terms(Term *term);
+Term *simplify_vanishing_sum(Term *term);
 Term *simplify_additive_assoziativity(Term *term);
 Term *simplify_order_added_terms(Term *term);
 
@@ -42,5 +47,8 @@ Term *simplify_with_distributive_law(Term *term);
 Term *simplify_recursive_multiple_inverse(Term *term);
 Term *inside_of_multiple_inverse(Term *t);
 
+Term *simplify_differential(Term *term);
+Term *simplify_integral(Term *term);
+
 
 #endif // SIMPLIFY_TERM_H_
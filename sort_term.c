@@ -88,12 +88,13 @@ merge_variable_terms(Term *array[], int left, int middle, int right)
     j = 0;
     k = left;
     while (i < n1 && j < n2) {
-        if (is_greater(
-                get_variable_term(L[i]),
-                get_variable_term(R[j])) ||
-           is_equal(
-                get_variable_term(L[i]),
-                get_variable_term(R[j]))) {
+        Term *lhs = get_variable_term(L[i]);
+        Term *rhs = get_variable_term(R[j]);
+        bool is_first = is_greater(lhs, rhs) || is_equal(lhs, rhs);
+
+        free_term(lhs);
+        free_term(rhs);
+        if (is_first) {
             array[k] = L[i];
             i++;
         } else {
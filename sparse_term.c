@@ -0,0 +1,624 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "term.h"
+#include "sparse_term.h"
+
+// rows looked at by one Markowitz pivot search
+#define SPARSE_SEARCH 4
+
+typedef struct ActiveRow ActiveRow;
+typedef struct ActiveColumn ActiveColumn;
+typedef struct Elimination Elimination;
+
+struct ActiveRow {
+    int length;
+    int capacity;
+    int *columns;
+    double *values;
+};
+
+// rows that have or had an entry in the column, eliminated rows are
+// skipped when the list is walked
+struct ActiveColumn {
+    int length;
+    int capacity;
+    int *rows;
+};
+
+// active submatrix of a factorization in progress, rows are kept in
+// buckets of equal length for the pivot search
+struct Elimination {
+    int size;
+    ActiveRow *rows;
+    ActiveColumn *columns;
+    int *column_counts;
+    bool *is_row_done;
+    int *position;
+
+    int *first;
+    int *next;
+    int *previous;
+};
+
+Sparse *
+sparse(int rowc, int columnc, int nonzeroc)
+{
+    Sparse *matrix = (Sparse *) malloc(sizeof(Sparse));
+
+    matrix->rowc = rowc;
+    matrix->columnc = columnc;
+    matrix->nonzeroc = nonzeroc;
+    matrix->rows = (int *) calloc(rowc + 1, sizeof(int));
+    matrix->columns = (int *) malloc(sizeof(int) * (nonzeroc + 1));
+    matrix->values = (double *) calloc(nonzeroc + 1, sizeof(double));
+
+    return matrix;
+}
+
+Sparse *
+copy_sparse(Sparse *matrix)
+{
+    Sparse *copy = sparse(matrix->rowc, matrix->columnc, matrix->nonzeroc);
+
+    memcpy(copy->rows, matrix->rows, sizeof(int) * (matrix->rowc + 1));
+    memcpy(copy->columns, matrix->columns, sizeof(int) * matrix->nonzeroc);
+    memcpy(copy->values, matrix->values, sizeof(double) * matrix->nonzeroc);
+
+    return copy;
+}
+
+void
+free_sparse(Sparse *matrix)
+{
+    free(matrix->rows);
+    free(matrix->columns);
+    free(matrix->values);
+    free(matrix);
+    return;
+}
+
+void
+sparse_multiply_vector(Sparse *matrix, double *vector, double *result)
+{
+    for (int i = 0;i < matrix->rowc;i++) {
+        double sum = 0.0;
+
+        for (int k = matrix->rows[i];k < matrix->rows[i + 1];k++)
+            sum += matrix->values[k] * vector[matrix->columns[k]];
+        result[i] = sum;
+    }
+    return;
+}
+
+// greedy distance-2 coloring, columns of one color never share a row, so
+// a jacobian with this pattern is recovered from one directional
+// derivative per color. Returns the number of colors.
+int
+color_columns(Sparse *pattern, int *colors)
+{
+    int *count = (int *) calloc(pattern->columnc + 1, sizeof(int));
+    int *first = (int *) malloc(sizeof(int) * (pattern->columnc + 1));
+    int *rows = (int *) malloc(sizeof(int) * (pattern->nonzeroc + 1));
+    int *forbidden = (int *) malloc(sizeof(int) * (pattern->columnc + 1));
+    int colorc = 0;
+
+    // transpose the pattern to find the rows of each column
+    for (int k = 0;k < pattern->nonzeroc;k++)
+        count[pattern->columns[k]]++;
+    first[0] = 0;
+    for (int j = 0;j < pattern->columnc;j++)
+        first[j + 1] = first[j] + count[j];
+    memset(count, 0, sizeof(int) * pattern->columnc);
+    for (int i = 0;i < pattern->rowc;i++)
+        for (int k = pattern->rows[i];k < pattern->rows[i + 1];k++) {
+            int j = pattern->columns[k];
+
+            rows[first[j] + count[j]++] = i;
+        }
+
+    for (int j = 0;j < pattern->columnc;j++) {
+        colors[j] = -1;
+        forbidden[j] = -1;
+    }
+
+    for (int j = 0;j < pattern->columnc;j++) {
+        int color = 0;
+
+        for (int r = first[j];r < first[j + 1];r++) {
+            int i = rows[r];
+
+            for (int k = pattern->rows[i];k < pattern->rows[i + 1];k++)
+                if (colors[pattern->columns[k]] >= 0)
+                    forbidden[colors[pattern->columns[k]]] = j;
+        }
+
+        while (forbidden[color] == j)
+            color++;
+        colors[j] = color;
+        if (color + 1 > colorc)
+            colorc = color + 1;
+    }
+
+    free(count);
+    free(first);
+    free(rows);
+    free(forbidden);
+
+    return colorc;
+}
+
+static void
+append_entry(ActiveRow *row, int column, double value)
+{
+    if (row->length == row->capacity) {
+        row->capacity = 2 * row->capacity + 4;
+        row->columns = (int *) realloc(row->columns, sizeof(int) * row->capacity);
+        row->values = (double *) realloc(row->values, sizeof(double) * row->capacity);
+    }
+    row->columns[row->length] = column;
+    row->values[row->length] = value;
+    row->length++;
+    return;
+}
+
+static void
+append_row(ActiveColumn *column, int row)
+{
+    if (column->length == column->capacity) {
+        column->capacity = 2 * column->capacity + 4;
+        column->rows = (int *) realloc(column->rows, sizeof(int) * column->capacity);
+    }
+    column->rows[column->length++] = row;
+    return;
+}
+
+static void
+unlink_row(Elimination *elimination, int row)
+{
+    int length = elimination->rows[row].length;
+
+    if (elimination->previous[row] >= 0)
+        elimination->next[elimination->previous[row]] = elimination->next[row];
+    else
+        elimination->first[length] = elimination->next[row];
+    if (elimination->next[row] >= 0)
+        elimination->previous[elimination->next[row]] = elimination->previous[row];
+    return;
+}
+
+static void
+link_row(Elimination *elimination, int row)
+{
+    int length = elimination->rows[row].length;
+
+    elimination->previous[row] = -1;
+    elimination->next[row] = elimination->first[length];
+    if (elimination->first[length] >= 0)
+        elimination->previous[elimination->first[length]] = row;
+    elimination->first[length] = row;
+    return;
+}
+
+static Elimination *
+begin_elimination(Sparse *matrix)
+{
+    Elimination *elimination = (Elimination *) malloc(sizeof(Elimination));
+    int size = matrix->rowc;
+
+    elimination->size = size;
+    elimination->rows = (ActiveRow *) calloc(size, sizeof(ActiveRow));
+    elimination->columns = (ActiveColumn *) calloc(size, sizeof(ActiveColumn));
+    elimination->column_counts = (int *) calloc(size, sizeof(int));
+    elimination->is_row_done = (bool *) calloc(size, sizeof(bool));
+    elimination->position = (int *) malloc(sizeof(int) * size);
+    elimination->first = (int *) malloc(sizeof(int) * (size + 1));
+    elimination->next = (int *) malloc(sizeof(int) * size);
+    elimination->previous = (int *) malloc(sizeof(int) * size);
+
+    for (int i = 0;i < size;i++)
+        elimination->position[i] = -1;
+    for (int i = 0;i <= size;i++)
+        elimination->first[i] = -1;
+
+    for (int i = 0;i < size;i++) {
+        for (int k = matrix->rows[i];k < matrix->rows[i + 1];k++) {
+            int j = matrix->columns[k];
+
+            // duplicate entries are summed
+            if (elimination->position[j] >= 0) {
+                elimination->rows[i].values[elimination->position[j]] += matrix->values[k];
+                continue;
+            }
+            elimination->position[j] = elimination->rows[i].length;
+            append_entry(&elimination->rows[i], j, matrix->values[k]);
+            append_row(&elimination->columns[j], i);
+            elimination->column_counts[j]++;
+        }
+        for (int k = 0;k < elimination->rows[i].length;k++)
+            elimination->position[elimination->rows[i].columns[k]] = -1;
+
+        link_row(elimination, i);
+    }
+
+    return elimination;
+}
+
+static void
+end_elimination(Elimination *elimination)
+{
+    for (int i = 0;i < elimination->size;i++) {
+        free(elimination->rows[i].columns);
+        free(elimination->rows[i].values);
+        free(elimination->columns[i].rows);
+    }
+    free(elimination->rows);
+    free(elimination->columns);
+    free(elimination->column_counts);
+    free(elimination->is_row_done);
+    free(elimination->position);
+    free(elimination->first);
+    free(elimination->next);
+    free(elimination->previous);
+    free(elimination);
+    return;
+}
+
+static double
+row_maximum(ActiveRow *row)
+{
+    double maximum = 0.0;
+
+    for (int k = 0;k < row->length;k++)
+        if (fabs(row->values[k]) > maximum)
+            maximum = fabs(row->values[k]);
+    return maximum;
+}
+
+// Markowitz search over the shortest rows, an entry is admissible if it
+// is at least threshold times the largest entry of its row and the one
+// with the smallest (r - 1) (c - 1) wins. Returns false if no row has an
+// admissible entry.
+static bool
+find_pivot(Elimination *elimination, double threshold, int *pivot_row, int *pivot_column)
+{
+    long best = -1;
+    double best_value = 0.0;
+    int searched = 0;
+
+    for (int length = 1;length <= elimination->size && searched < SPARSE_SEARCH;length++) {
+        for (int i = elimination->first[length];i >= 0 && searched < SPARSE_SEARCH;i = elimination->next[i]) {
+            ActiveRow *row = &elimination->rows[i];
+            double maximum = row_maximum(row);
+
+            if (maximum == 0.0)
+                continue;
+            searched++;
+
+            for (int k = 0;k < row->length;k++) {
+                double value = fabs(row->values[k]);
+                long cost = (long) (length - 1) * (elimination->column_counts[row->columns[k]] - 1);
+
+                if (value < threshold * maximum)
+                    continue;
+                if (best < 0 || cost < best || (cost == best && value > best_value)) {
+                    best = cost;
+                    best_value = value;
+                    *pivot_row = i;
+                    *pivot_column = row->columns[k];
+                }
+            }
+        }
+
+        if (best == 0)
+            break;
+    }
+
+    return best >= 0;
+}
+
+static void
+store_lower(SparseLU *lu, int *lowerc, int *capacity, int row, double value)
+{
+    if (*lowerc == *capacity) {
+        *capacity = 2 * *capacity + 16;
+        lu->lower_rows = (int *) realloc(lu->lower_rows, sizeof(int) * *capacity);
+        lu->lower_values = (double *) realloc(lu->lower_values, sizeof(double) * *capacity);
+    }
+    lu->lower_rows[*lowerc] = row;
+    lu->lower_values[*lowerc] = value;
+    (*lowerc)++;
+    return;
+}
+
+static void
+store_upper(SparseLU *lu, int *upperc, int *capacity, int column, double value)
+{
+    if (*upperc == *capacity) {
+        *capacity = 2 * *capacity + 16;
+        lu->upper_columns = (int *) realloc(lu->upper_columns, sizeof(int) * *capacity);
+        lu->upper_values = (double *) realloc(lu->upper_values, sizeof(double) * *capacity);
+    }
+    lu->upper_columns[*upperc] = column;
+    lu->upper_values[*upperc] = value;
+    (*upperc)++;
+    return;
+}
+
+// eliminates the pivot from every other active row of its column
+static void
+eliminate(Elimination *elimination, SparseLU *lu, int pivot_row, int pivot_column, double pivot,
+        int *lowerc, int *lower_capacity)
+{
+    ActiveRow *row = &elimination->rows[pivot_row];
+    ActiveColumn *column = &elimination->columns[pivot_column];
+    int *position = elimination->position;
+
+    for (int k = 0;k < row->length;k++)
+        elimination->column_counts[row->columns[k]]--;
+
+    for (int c = 0;c < column->length;c++) {
+        int i = column->rows[c];
+        ActiveRow *target = &elimination->rows[i];
+        double factor;
+        int at;
+
+        if (elimination->is_row_done[i])
+            continue;
+
+        for (int k = 0;k < target->length;k++)
+            position[target->columns[k]] = k;
+
+        unlink_row(elimination, i);
+
+        // take the pivot column out of the target row
+        at = position[pivot_column];
+        factor = target->values[at] / pivot;
+        target->length--;
+        target->columns[at] = target->columns[target->length];
+        target->values[at] = target->values[target->length];
+        position[target->columns[at]] = at;
+        position[pivot_column] = -1;
+
+        for (int k = 0;k < row->length;k++) {
+            int j = row->columns[k];
+
+            if (j == pivot_column)
+                continue;
+
+            if (position[j] >= 0) {
+                target->values[position[j]] -= factor * row->values[k];
+            } else {
+                position[j] = target->length;
+                append_entry(target, j, -factor * row->values[k]);
+                append_row(&elimination->columns[j], i);
+                elimination->column_counts[j]++;
+            }
+        }
+
+        for (int k = 0;k < target->length;k++)
+            position[target->columns[k]] = -1;
+
+        link_row(elimination, i);
+        store_lower(lu, lowerc, lower_capacity, i, factor);
+    }
+    return;
+}
+
+// a factorization with the pivot sequence of order if it is given, or
+// one chosen by the Markowitz search otherwise. Returns NULL if the matrix
+// is singular or a prescribed pivot fails the threshold test.
+static SparseLU *
+factor(Sparse *matrix, double threshold, SparseLU *order)
+{
+    Elimination *elimination;
+    SparseLU *lu;
+    int size = matrix->rowc;
+    int lowerc = 0, upperc = 0, lower_capacity = 0, upper_capacity = 0;
+
+    if (matrix->rowc != matrix->columnc)
+        return NULL;
+
+    elimination = begin_elimination(matrix);
+
+    // size counts the completed steps, a factorization that stops early
+    // is freed below
+    lu = (SparseLU *) malloc(sizeof(SparseLU));
+    lu->size = 0;
+    lu->row_order = (int *) malloc(sizeof(int) * (size + 1));
+    lu->column_order = (int *) malloc(sizeof(int) * (size + 1));
+    lu->pivots = (double *) malloc(sizeof(double) * (size + 1));
+    lu->lower_first = (int *) malloc(sizeof(int) * (size + 1));
+    lu->upper_first = (int *) malloc(sizeof(int) * (size + 1));
+    lu->lower_rows = NULL;
+    lu->lower_values = NULL;
+    lu->upper_columns = NULL;
+    lu->upper_values = NULL;
+
+    for (int step = 0;step < size;step++) {
+        int pivot_row, pivot_column, at = -1;
+        ActiveRow *row;
+        double pivot;
+
+        if (order != NULL) {
+            pivot_row = order->row_order[step];
+            pivot_column = order->column_order[step];
+        } else if (!find_pivot(elimination, threshold, &pivot_row, &pivot_column)) {
+            break;
+        }
+
+        row = &elimination->rows[pivot_row];
+        for (int k = 0;k < row->length;k++)
+            if (row->columns[k] == pivot_column)
+                at = k;
+
+        if (at < 0 || row->values[at] == 0.0 || isnan(row->values[at]) ||
+                fabs(row->values[at]) < threshold * row_maximum(row))
+            break;
+        pivot = row->values[at];
+
+        unlink_row(elimination, pivot_row);
+        elimination->is_row_done[pivot_row] = true;
+
+        lu->row_order[step] = pivot_row;
+        lu->column_order[step] = pivot_column;
+        lu->pivots[step] = pivot;
+
+        lu->upper_first[step] = upperc;
+        for (int k = 0;k < row->length;k++)
+            if (k != at)
+                store_upper(lu, &upperc, &upper_capacity, row->columns[k], row->values[k]);
+
+        lu->lower_first[step] = lowerc;
+        eliminate(elimination, lu, pivot_row, pivot_column, pivot, &lowerc, &lower_capacity);
+
+        lu->lower_first[step + 1] = lowerc;
+        lu->upper_first[step + 1] = upperc;
+        lu->size = step + 1;
+    }
+
+    end_elimination(elimination);
+
+    if (lu->size != size) {
+        free_sparse_lu(lu);
+        return NULL;
+    }
+    lu->lower_first[0] = 0;
+    lu->upper_first[0] = 0;
+
+    return lu;
+}
+
+// threshold in (0, 1] trades sparsity for stability, 0.1 is the usual
+// choice
+SparseLU *
+sparse_lu(Sparse *matrix, double threshold)
+{
+    return factor(matrix, threshold, NULL);
+}
+
+// new values with the same pattern reuse the pivot sequence and skip the
+// search, returns false and leaves lu untouched if a pivot became too small
+bool
+sparse_lu_refactor(SparseLU *lu, Sparse *matrix, double threshold)
+{
+    SparseLU *refactored = factor(matrix, threshold, lu);
+    SparseLU old;
+
+    if (refactored == NULL)
+        return false;
+
+    old = *lu;
+    *lu = *refactored;
+    *refactored = old;
+    free_sparse_lu(refactored);
+
+    return true;
+}
+
+void
+sparse_lu_solve(SparseLU *lu, double *rhs, double *solution)
+{
+    double *work = (double *) malloc(sizeof(double) * (lu->size + 1));
+
+    memcpy(work, rhs, sizeof(double) * lu->size);
+
+    // L y = P b, the multipliers of step k act on rows below the pivot
+    for (int step = 0;step < lu->size;step++) {
+        double value = work[lu->row_order[step]];
+
+        if (value == 0.0)
+            continue;
+        for (int k = lu->lower_first[step];k < lu->lower_first[step + 1];k++)
+            work[lu->lower_rows[k]] -= lu->lower_values[k] * value;
+    }
+
+    // U Q^T x = y, row k of U only refers to columns pivoted later
+    for (int step = lu->size - 1;step >= 0;step--) {
+        double value = work[lu->row_order[step]];
+
+        for (int k = lu->upper_first[step];k < lu->upper_first[step + 1];k++)
+            value -= lu->upper_values[k] * solution[lu->upper_columns[k]];
+        solution[lu->column_order[step]] = value / lu->pivots[step];
+    }
+
+    free(work);
+    return;
+}
+
+void
+free_sparse_lu(SparseLU *lu)
+{
+    free(lu->row_order);
+    free(lu->column_order);
+    free(lu->pivots);
+    free(lu->lower_first);
+    free(lu->lower_rows);
+    free(lu->lower_values);
+    free(lu->upper_first);
+    free(lu->upper_columns);
+    free(lu->upper_values);
+    free(lu);
+    return;
+}
+
+// LU with partial pivoting in place of a row major size x size matrix,
+// for the small systems that do not pay for the sparse factorization
+bool
+dense_lu(int size, double *matrix, int *pivots)
+{
+    double *a = matrix;
+
+    for (int k = 0;k < size;k++) {
+        int pivot = k;
+
+        for (int i = k + 1;i < size;i++)
+            if (fabs(a[i * size + k]) > fabs(a[pivot * size + k]))
+                pivot = i;
+
+        if (a[pivot * size + k] == 0.0 || isnan(a[pivot * size + k]))
+            return false;
+
+        pivots[k] = pivot;
+        if (pivot != k)
+            for (int j = 0;j < size;j++) {
+                double temp = a[k * size + j];
+
+                a[k * size + j] = a[pivot * size + j];
+                a[pivot * size + j] = temp;
+            }
+
+        for (int i = k + 1;i < size;i++) {
+            double factor = a[i * size + k] /= a[k * size + k];
+
+            if (factor == 0.0)
+                continue;
+            for (int j = k + 1;j < size;j++)
+                a[i * size + j] -= factor * a[k * size + j];
+        }
+    }
+    return true;
+}
+
+void
+dense_lu_solve(int size, double *matrix, int *pivots, double *rhs, double *solution)
+{
+    double *a = matrix;
+
+    memmove(solution, rhs, sizeof(double) * size);
+
+    for (int k = 0;k < size;k++) {
+        double temp = solution[pivots[k]];
+
+        solution[pivots[k]] = solution[k];
+        solution[k] = temp;
+        for (int i = k + 1;i < size;i++)
+            solution[i] -= a[i * size + k] * solution[k];
+    }
+    for (int k = size - 1;k >= 0;k--) {
+        for (int j = k + 1;j < size;j++)
+            solution[k] -= a[k * size + j] * solution[j];
+        solution[k] /= a[k * size + k];
+    }
+    return;
+}
@@ -0,0 +1,51 @@
+#ifndef SPARSE_TERM_H_
+#define SPARSE_TERM_H_
+
+typedef struct Sparse Sparse;
+typedef struct SparseLU SparseLU;
+
+// compressed sparse rows, the entries of row i are
+// columns[rows[i] .. rows[i + 1] - 1] with their values
+struct Sparse {
+    int rowc;
+    int columnc;
+    int nonzeroc;
+    int *rows;
+    int *columns;
+    double *values;
+};
+
+// P A Q = L U, step k eliminates row row_order[k] with column
+// column_order[k]. Column k of L and row k of U are stored in the same
+// compressed form as a Sparse matrix, the pivot is kept separately.
+struct SparseLU {
+    int size;
+    int *row_order;
+    int *column_order;
+    double *pivots;
+
+    int *lower_first;
+    int *lower_rows;
+    double *lower_values;
+
+    int *upper_first;
+    int *upper_columns;
+    double *upper_values;
+};
+
+Sparse *sparse(int rowc, int columnc, int nonzeroc);
+Sparse *copy_sparse(Sparse *matrix);
+void free_sparse(Sparse *matrix);
+
+void sparse_multiply_vector(Sparse *matrix, double *vector, double *result);
+int color_columns(Sparse *pattern, int *colors);
+
+SparseLU *sparse_lu(Sparse *matrix, double threshold);
+bool sparse_lu_refactor(SparseLU *lu, Sparse *matrix, double threshold);
+void sparse_lu_solve(SparseLU *lu, double *rhs, double *solution);
+void free_sparse_lu(SparseLU *lu);
+
+bool dense_lu(int size, double *matrix, int *pivots);
+void dense_lu_solve(int size, double *matrix, int *pivots, double *rhs, double *solution);
+
+#endif // SPARSE_TERM_H_
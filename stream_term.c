@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "term.h"
+#include "memory_term.h"
+#include "parse_term.h"
+#include "simplify_term.h"
+#include "cache_term.h"
+#include "format_term.h"
+#include "compile_term.h"
+#include "egraph_term.h"
+#include "stream_term.h"
+
+typedef struct Job Job;
+typedef struct Queue Queue;
+typedef struct Stream Stream;
+
+// one input line on its way through the stages
+struct Job {
+    long sequence;
+    char *line;
+    size_t length;
+    double start;
+
+    Term *result;
+    ParseError error;
+};
+
+// bounded ring of jobs, pop returns NULL once the queue is closed and empty
+struct Queue {
+    int capacity;
+    int head;
+    int count;
+    Job **jobs;
+    bool is_closed;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t is_readable;
+    pthread_cond_t is_writable;
+};
+
+// reader -> lines -> workers -> results -> writer. In ordered mode the
+// reader stays less than window lines ahead of the writer, so the
+// reordering buffer never overflows.
+struct Stream {
+    int inputc;
+    FILE **inputs;
+    StreamOptions *options;
+
+    Queue *lines;
+    Queue *results;
+    int workers;
+    long cache_hits;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t is_written;
+    long written;
+    int window;
+};
+
+static double
+seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+static Queue *
+queue(int capacity)
+{
+    Queue *temp_queue = (Queue *) malloc(sizeof(Queue));
+
+    temp_queue->capacity = capacity;
+    temp_queue->head = 0;
+    temp_queue->count = 0;
+    temp_queue->jobs = (Job **) malloc(sizeof(Job *) * capacity);
+    temp_queue->is_closed = false;
+
+    pthread_mutex_init(&temp_queue->mutex, NULL);
+    pthread_cond_init(&temp_queue->is_readable, NULL);
+    pthread_cond_init(&temp_queue->is_writable, NULL);
+
+    return temp_queue;
+}
+
+static void
+free_queue(Queue *temp_queue)
+{
+    pthread_mutex_destroy(&temp_queue->mutex);
+    pthread_cond_destroy(&temp_queue->is_readable);
+    pthread_cond_destroy(&temp_queue->is_writable);
+    free(temp_queue->jobs);
+    free(temp_queue);
+    return;
+}
+
+static void
+push_job(Queue *temp_queue, Job *job)
+{
+    pthread_mutex_lock(&temp_queue->mutex);
+    while (temp_queue->count == temp_queue->capacity)
+        pthread_cond_wait(&temp_queue->is_writable, &temp_queue->mutex);
+
+    temp_queue->jobs[(temp_queue->head + temp_queue->count) % temp_queue->capacity] = job;
+    temp_queue->count++;
+
+    pthread_cond_signal(&temp_queue->is_readable);
+    pthread_mutex_unlock(&temp_queue->mutex);
+    return;
+}
+
+static Job *
+pop_job(Queue *temp_queue)
+{
+    Job *job = NULL;
+
+    pthread_mutex_lock(&temp_queue->mutex);
+    while (temp_queue->count == 0 && !temp_queue->is_closed)
+        pthread_cond_wait(&temp_queue->is_readable, &temp_queue->mutex);
+
+    if (temp_queue->count != 0) {
+        job = temp_queue->jobs[temp_queue->head];
+        temp_queue->head = (temp_queue->head + 1) % temp_queue->capacity;
+        temp_queue->count--;
+        pthread_cond_signal(&temp_queue->is_writable);
+    }
+
+    pthread_mutex_unlock(&temp_queue->mutex);
+    return job;
+}
+
+static bool
+is_queue_empty(Queue *temp_queue)
+{
+    bool is_empty;
+
+    pthread_mutex_lock(&temp_queue->mutex);
+    is_empty = temp_queue->count == 0;
+    pthread_mutex_unlock(&temp_queue->mutex);
+    return is_empty;
+}
+
+static void
+close_queue(Queue *temp_queue)
+{
+    pthread_mutex_lock(&temp_queue->mutex);
+    temp_queue->is_closed = true;
+    pthread_cond_broadcast(&temp_queue->is_readable);
+    pthread_mutex_unlock(&temp_queue->mutex);
+    return;
+}
+
+static void *
+read_lines(void *argument)
+{
+    Stream *stream = argument;
+    long sequence = 0;
+    char *line = NULL;
+    size_t size = 0;
+
+    for (int i = 0;i < stream->inputc;i++) {
+        ssize_t length;
+
+        while ((length = getline(&line, &size, stream->inputs[i])) != -1) {
+            Job *job;
+
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+                length--;
+            if (length == 0)
+                continue;
+
+            if (stream->options->is_ordered) {
+                pthread_mutex_lock(&stream->mutex);
+                while (sequence - stream->written >= stream->window)
+                    pthread_cond_wait(&stream->is_written, &stream->mutex);
+                pthread_mutex_unlock(&stream->mutex);
+            }
+
+            job = (Job *) malloc(sizeof(Job));
+            job->sequence = sequence++;
+            job->line = line;
+            job->length = length;
+            job->start = seconds();
+            job->result = NULL;
+
+            // the job keeps the buffer, getline allocates the next one
+            line = NULL;
+            size = 0;
+
+            push_job(stream->lines, job);
+        }
+    }
+
+    free(line);
+    close_queue(stream->lines);
+    return NULL;
+}
+
+// a line is parsed and simplified in the worker's own arena and only its
+// result is copied out, so the nodes in between are never freed one by
+// one. Tracked allocations skip the arena, so that leaks still show.
+static void *
+simplify_lines(void *argument)
+{
+    Stream *stream = argument;
+    SymbolTable *table = symbol_table();
+    TermCache *cache = NULL;
+    Arena *line_arena = NULL;
+    MemoryStatistics memory;
+    Job *job;
+
+    // every worker maps the file on its own, the file lock serializes them
+    // just like separate processes
+    if (stream->options->cache_path != NULL)
+        cache = open_cache(stream->options->cache_path, stream->options->cache_limit, SIMPLIFY_RULES);
+
+    memory_statistics(&memory);
+    if (!memory.is_tracking)
+        line_arena = arena();
+    free(memory.sites);
+
+    while ((job = pop_job(stream->lines)) != NULL) {
+        Allocator *previous = NULL;
+        Term *parsed;
+
+        if (line_arena != NULL)
+            previous = set_allocator(arena_allocator(line_arena));
+
+        parsed = parse_term(job->line, job->length, table, &job->error);
+        if (parsed != NULL)
+            job->result = cached_simplify(cache, parsed);
+        if (job->result != NULL && stream->options->cost != NULL) {
+            Term *cheapest = cheapest_form(job->result, stream->options->cost);
+
+            free_term(job->result);
+            job->result = cheapest;
+        }
+
+        if (line_arena != NULL) {
+            set_allocator(previous);
+            if (job->result != NULL)
+                job->result = copy_term(job->result);
+            reset_arena(line_arena);
+        }
+
+        free(job->line);
+        job->line = NULL;
+        push_job(stream->results, job);
+    }
+
+    free_symbol_table(table);
+    if (line_arena != NULL)
+        free_arena(line_arena);
+
+    pthread_mutex_lock(&stream->mutex);
+    if (cache != NULL) {
+        stream->cache_hits += cache->hits;
+        close_cache(cache);
+    }
+    stream->workers--;
+    if (stream->workers == 0)
+        close_queue(stream->results);
+    pthread_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+static void
+write_job(Output *output, Format format, Job *job, StreamStatistics *statistics, double *latencies)
+{
+    if (job->result != NULL) {
+        write_term(output, job->result, format);
+        write_string(output, "\n", 1);
+        free_term(job->result);
+    } else {
+        char buffer[128];
+        int length = snprintf(buffer, sizeof(buffer), "error: %s at %zu\n",
+                job->error.message, job->error.position);
+
+        write_string(output, buffer, length);
+        statistics->errors++;
+    }
+
+    latencies[statistics->expressions++] = seconds() - job->start;
+    free(job);
+    return;
+}
+
+static int
+compare_latencies(const void *lhs, const void *rhs)
+{
+    double a = *(const double *) lhs, b = *(const double *) rhs;
+
+    return (a > b) - (a < b);
+}
+
+static double
+percentile(double *latencies, long count, double fraction)
+{
+    if (count == 0)
+        return 0.0;
+    return latencies[(long) (fraction * (count - 1))];
+}
+
+// reads newline separated terms from inputs in order, simplifies them on
+// options->threadc threads and prints one line per term to stdout in
+// options->format, a malformed line prints an error line instead
+bool
+process_stream(int inputc, FILE **inputs, StreamOptions *options, StreamStatistics *statistics)
+{
+    Stream stream;
+    StreamStatistics temp_statistics;
+    pthread_t reader, *workers;
+    Job **pending = NULL;
+    Output *output = output_file(stdout);
+    double *latencies;
+    long capacity = 1024;
+    double start = seconds();
+    int threadc = options->threadc, queue_capacity = options->capacity;
+    Job *job;
+
+    if (threadc <= 0)
+        threadc = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadc <= 0)
+        threadc = 1;
+    if (queue_capacity <= 0)
+        queue_capacity = STREAM_QUEUE;
+
+    if (statistics == NULL)
+        statistics = &temp_statistics;
+    memset(statistics, 0, sizeof(StreamStatistics));
+
+    stream.inputc = inputc;
+    stream.inputs = inputs;
+    stream.options = options;
+    stream.lines = queue(queue_capacity);
+    stream.results = queue(queue_capacity);
+    stream.workers = threadc;
+    stream.cache_hits = 0;
+    pthread_mutex_init(&stream.mutex, NULL);
+    pthread_cond_init(&stream.is_written, NULL);
+    stream.written = 0;
+    stream.window = 2 * queue_capacity + threadc;
+
+    if (options->is_ordered)
+        pending = (Job **) calloc(stream.window, sizeof(Job *));
+    latencies = (double *) malloc(sizeof(double) * capacity);
+
+    workers = (pthread_t *) malloc(sizeof(pthread_t) * threadc);
+    for (int i = 0;i < threadc;i++)
+        pthread_create(&workers[i], NULL, simplify_lines, &stream);
+    pthread_create(&reader, NULL, read_lines, &stream);
+
+    while ((job = pop_job(stream.results)) != NULL) {
+        if (statistics->expressions + stream.window >= capacity) {
+            capacity *= 2;
+            latencies = (double *) realloc(latencies, sizeof(double) * capacity);
+        }
+
+        if (!options->is_ordered) {
+            write_job(output, options->format, job, statistics, latencies);
+        } else {
+            pending[job->sequence % stream.window] = job;
+            while ((job = pending[stream.written % stream.window]) != NULL) {
+                pending[stream.written % stream.window] = NULL;
+                write_job(output, options->format, job, statistics, latencies);
+
+                pthread_mutex_lock(&stream.mutex);
+                stream.written++;
+                pthread_cond_signal(&stream.is_written);
+                pthread_mutex_unlock(&stream.mutex);
+            }
+        }
+
+        // nothing else is ready, so an interactive caller sees the result
+        if (is_queue_empty(stream.results)) {
+            flush_output(output);
+            fflush(stdout);
+        }
+    }
+
+    pthread_join(reader, NULL);
+    for (int i = 0;i < threadc;i++)
+        pthread_join(workers[i], NULL);
+    free_output(output);
+    fflush(stdout);
+
+    statistics->time = seconds() - start;
+    statistics->cache_hits = stream.cache_hits;
+    statistics->throughput = statistics->time > 0.0 ? statistics->expressions / statistics->time : 0.0;
+
+    qsort(latencies, statistics->expressions, sizeof(double), compare_latencies);
+    statistics->latency_median = percentile(latencies, statistics->expressions, 0.5);
+    statistics->latency_p99 = percentile(latencies, statistics->expressions, 0.99);
+    statistics->latency_p999 = percentile(latencies, statistics->expressions, 0.999);
+    statistics->latency_max = percentile(latencies, statistics->expressions, 1.0);
+
+    free(latencies);
+    free(pending);
+    free(workers);
+    free_queue(stream.lines);
+    free_queue(stream.results);
+    pthread_mutex_destroy(&stream.mutex);
+    pthread_cond_destroy(&stream.is_written);
+
+    return statistics->errors == 0;
+}
+
+void
+print_stream_statistics(FILE *file, StreamStatistics *statistics)
+{
+    fprintf(file, "expressions: %ld (%ld errors)\n", statistics->expressions, statistics->errors);
+    fprintf(file, "time: %.3f s\n", statistics->time);
+    fprintf(file, "throughput: %.0f expressions/s\n", statistics->throughput);
+    fprintf(file, "latency: median %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+            1e3 * statistics->latency_median, 1e3 * statistics->latency_p99,
+            1e3 * statistics->latency_p999, 1e3 * statistics->latency_max);
+    if (statistics->cache_hits > 0)
+        fprintf(file, "cache hits: %ld\n", statistics->cache_hits);
+    return;
+}
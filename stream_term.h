@@ -0,0 +1,45 @@
+#ifndef STREAM_TERM_H_
+#define STREAM_TERM_H_
+
+// default capacity of the queues between the stages
+#define STREAM_QUEUE 256
+
+typedef struct StreamOptions StreamOptions;
+typedef struct StreamStatistics StreamStatistics;
+
+// threadc <= 0 uses one simplifying thread per processor. Ordered output
+// keeps the input order, otherwise results are written as they finish.
+struct StreamOptions {
+    int threadc;
+    int capacity;
+    bool is_ordered;
+    Format format;
+
+    // persistent simplification cache shared with other processes, NULL
+    // disables it, cache_limit 0 lets the file grow without bound
+    char *cache_path;
+    size_t cache_limit;
+
+    // simplified terms are replaced by the cheapest form under this cost,
+    // NULL keeps them. The cache holds them before.
+    NodeCost cost;
+};
+
+// latencies are seconds from reading a line to writing its result
+struct StreamStatistics {
+    long expressions;
+    long errors;
+    double time;
+    double throughput;
+    long cache_hits;
+
+    double latency_median;
+    double latency_p99;
+    double latency_p999;
+    double latency_max;
+};
+
+bool process_stream(int inputc, FILE **inputs, StreamOptions *options, StreamStatistics *statistics);
+void print_stream_statistics(FILE *file, StreamStatistics *statistics);
+
+#endif // STREAM_TERM_H_
@@ -0,0 +1,397 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "term.h"
+#include "compile_term.h"
+#include "sparse_term.h"
+#include "tape_term.h"
+
+// the program stays owned by the caller and has to outlive the tape
+Tape *
+record_tape(Program *program)
+{
+    Tape *tape = (Tape *) malloc(sizeof(Tape));
+
+    tape->program = program;
+    tape->values = (double *) malloc(sizeof(double) * (program->length + 1));
+    tape->partials = (double *) malloc(sizeof(double) * (program->operandc + 1));
+    tape->adjoints = (double *) malloc(sizeof(double) * (program->length + 1));
+
+    return tape;
+}
+
+void
+free_tape(Tape *tape)
+{
+    free(tape->values);
+    free(tape->partials);
+    free(tape->adjoints);
+    free(tape);
+    return;
+}
+
+// partials of a product are the products of all other factors, built
+// from prefix and suffix products so that zero factors need no division
+static double
+multiply_partials(double *values, int argc, int *operands, double *partials)
+{
+    double prefix = 1.0, suffix = 1.0;
+
+    for (int j = 0;j < argc;j++) {
+        partials[j] = prefix;
+        prefix *= values[operands[j]];
+    }
+    for (int j = argc - 1;j >= 0;j--) {
+        partials[j] *= suffix;
+        suffix *= values[operands[j]];
+    }
+
+    return prefix;
+}
+
+void
+forward_tape(Tape *tape, double *values, double *results)
+{
+    Program *program = tape->program;
+    double *registers = tape->values;
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double *partials = &tape->partials[instruction->first];
+        double value, base, exponent;
+
+        switch (instruction->opcode) {
+        case OPCODE_LITERAL:
+        case OPCODE_CONSTANT:
+            value = instruction->value;
+            break;
+        case OPCODE_VARIABLE:
+            value = values[instruction->index];
+            break;
+        case OPCODE_ADD:
+            value = 0.0;
+            for (int j = 0;j < instruction->argc;j++) {
+                value += registers[operands[j]];
+                partials[j] = 1.0;
+            }
+            break;
+        case OPCODE_ADDITIVE_INVERSE:
+            value = -registers[operands[0]];
+            partials[0] = -1.0;
+            break;
+        case OPCODE_MULTIPLY:
+            value = multiply_partials(registers, instruction->argc, operands, partials);
+            break;
+        case OPCODE_MULTIPLE_INVERSE:
+            value = 1.0 / registers[operands[0]];
+            partials[0] = -value * value;
+            break;
+        case OPCODE_POWER:
+            base = registers[operands[0]];
+            exponent = registers[operands[1]];
+            value = pow(base, exponent);
+            partials[0] = exponent * pow(base, exponent - 1.0);
+            if (base > 0.0)
+                partials[1] = value * log(base);
+            else if (base == 0.0)
+                partials[1] = 0.0;
+            else
+                partials[1] = NAN;
+            break;
+        default:
+            // imaginary terms are not real valued
+            value = NAN;
+            for (int j = 0;j < instruction->argc;j++)
+                partials[j] = NAN;
+            break;
+        }
+
+        registers[i] = value;
+    }
+
+    if (results == NULL)
+        return;
+
+    for (int i = 0;i < program->resultc;i++)
+        results[i] = registers[program->results[i]];
+    return;
+}
+
+// accumulates the gradient of one result of the last forward pass into
+// gradient, which has to be cleared by the caller
+void
+reverse_tape(Tape *tape, int result, double *gradient)
+{
+    Program *program = tape->program;
+    double *adjoints = tape->adjoints;
+    int last = program->results[result];
+
+    memset(adjoints, 0, sizeof(double) * (last + 1));
+    adjoints[last] = 1.0;
+
+    for (int i = last;i >= 0;i--) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double *partials = &tape->partials[instruction->first];
+        double adjoint = adjoints[i];
+
+        if (adjoint == 0.0)
+            continue;
+
+        if (instruction->opcode == OPCODE_VARIABLE) {
+            gradient[instruction->index] += adjoint;
+            continue;
+        }
+
+        for (int j = 0;j < instruction->argc;j++)
+            adjoints[operands[j]] += adjoint * partials[j];
+    }
+    return;
+}
+
+// value and gradient of the first result
+double
+gradient_tape(Tape *tape, double *values, double *gradient)
+{
+    double result;
+
+    forward_tape(tape, values, NULL);
+    result = tape->values[tape->program->results[0]];
+
+    memset(gradient, 0, sizeof(double) * tape->program->variablec);
+    reverse_tape(tape, 0, gradient);
+
+    return result;
+}
+
+// values[v][k] is variable slot v at point k, gradient[v][k] receives the
+// derivative of the first result with respect to slot v at point k
+void
+gradient_tape_batch(Tape *tape, int count, double **values, double *results, double **gradient)
+{
+    int variablec = tape->program->variablec;
+    double *point = (double *) malloc(sizeof(double) * (variablec + 1));
+    double *point_gradient = (double *) malloc(sizeof(double) * (variablec + 1));
+
+    for (int k = 0;k < count;k++) {
+        for (int v = 0;v < variablec;v++)
+            point[v] = values[v][k];
+
+        results[k] = gradient_tape(tape, point, point_gradient);
+
+        for (int v = 0;v < variablec;v++)
+            gradient[v][k] = point_gradient[v];
+    }
+
+    free(point);
+    free(point_gradient);
+    return;
+}
+
+// one reverse sweep per result, the jacobian is stored row major
+void
+jacobian_tape(Tape *tape, double *values, double *results, double *jacobian)
+{
+    Program *program = tape->program;
+
+    forward_tape(tape, values, results);
+
+    memset(jacobian, 0, sizeof(double) * program->resultc * program->variablec);
+    for (int i = 0;i < program->resultc;i++)
+        reverse_tape(tape, i, &jacobian[i * program->variablec]);
+    return;
+}
+
+// tangents of every instruction along direction for the last forward pass.
+// Operands with a tangent of 0 are skipped like adjoints of 0 in the
+// reverse sweep, so a NaN partial of an operand that does not depend on
+// direction, like the exponent of x^2 at x < 0, is not picked up.
+static void
+propagate_tangents(Tape *tape, double *direction, double *tangents)
+{
+    Program *program = tape->program;
+
+    for (int i = 0;i < program->length;i++) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double *partials = &tape->partials[instruction->first];
+        double tangent = 0.0;
+
+        if (instruction->opcode == OPCODE_VARIABLE)
+            tangent = direction[instruction->index];
+
+        for (int j = 0;j < instruction->argc;j++)
+            if (tangents[operands[j]] != 0.0)
+                tangent += partials[j] * tangents[operands[j]];
+
+        tangents[i] = tangent;
+    }
+    return;
+}
+
+// J * direction by propagating tangents along the recorded partials
+void
+jacobian_vector_product(Tape *tape, double *values, double *direction, double *results, double *product)
+{
+    Program *program = tape->program;
+
+    forward_tape(tape, values, results);
+    propagate_tangents(tape, direction, tape->adjoints);
+
+    for (int i = 0;i < program->resultc;i++)
+        product[i] = tape->adjoints[program->results[i]];
+    return;
+}
+
+// weights^T * J in a single reverse sweep over all results
+void
+vector_jacobian_product(Tape *tape, double *values, double *weights, double *results, double *product)
+{
+    Program *program = tape->program;
+    double *adjoints = tape->adjoints;
+
+    forward_tape(tape, values, results);
+
+    memset(adjoints, 0, sizeof(double) * program->length);
+    memset(product, 0, sizeof(double) * program->variablec);
+    for (int i = 0;i < program->resultc;i++)
+        adjoints[program->results[i]] += weights[i];
+
+    for (int i = program->length - 1;i >= 0;i--) {
+        Instruction *instruction = &program->instructions[i];
+        int *operands = &program->operands[instruction->first];
+        double *partials = &tape->partials[instruction->first];
+        double adjoint = adjoints[i];
+
+        if (adjoint == 0.0)
+            continue;
+
+        if (instruction->opcode == OPCODE_VARIABLE) {
+            product[instruction->index] += adjoint;
+            continue;
+        }
+
+        for (int j = 0;j < instruction->argc;j++)
+            adjoints[operands[j]] += adjoint * partials[j];
+    }
+    return;
+}
+
+static int
+compare_slots(const void *lhs, const void *rhs)
+{
+    return *(const int *) lhs - *(const int *) rhs;
+}
+
+// structural nonzeros of the jacobian, the variable slots each result
+// depends on, with zero values
+Sparse *
+jacobian_pattern(Tape *tape)
+{
+    Program *program = tape->program;
+    int *stamp = (int *) malloc(sizeof(int) * (program->length + 1));
+    int *stack = (int *) malloc(sizeof(int) * (program->length + 1));
+    int *slots = (int *) malloc(sizeof(int) * (program->variablec + 1));
+    int *rows = (int *) calloc(program->resultc + 1, sizeof(int));
+    int *columns = NULL, nonzeroc = 0, capacity = 0;
+    Sparse *pattern;
+
+    for (int i = 0;i < program->length;i++)
+        stamp[i] = -1;
+
+    for (int r = 0;r < program->resultc;r++) {
+        int top = 0, slotc = 0;
+
+        stack[top++] = program->results[r];
+        stamp[program->results[r]] = r;
+
+        while (top > 0) {
+            Instruction *instruction = &program->instructions[stack[--top]];
+
+            if (instruction->opcode == OPCODE_VARIABLE)
+                slots[slotc++] = instruction->index;
+
+            for (int j = 0;j < instruction->argc;j++) {
+                int operand = program->operands[instruction->first + j];
+
+                if (stamp[operand] != r) {
+                    stamp[operand] = r;
+                    stack[top++] = operand;
+                }
+            }
+        }
+
+        if (nonzeroc + slotc > capacity) {
+            capacity = 2 * (nonzeroc + slotc);
+            columns = (int *) realloc(columns, sizeof(int) * capacity);
+        }
+        qsort(slots, slotc, sizeof(int), compare_slots);
+        memcpy(&columns[nonzeroc], slots, sizeof(int) * slotc);
+        nonzeroc += slotc;
+        rows[r + 1] = nonzeroc;
+    }
+
+    pattern = sparse(program->resultc, program->variablec, nonzeroc);
+    memcpy(pattern->rows, rows, sizeof(int) * (program->resultc + 1));
+    memcpy(pattern->columns, columns, sizeof(int) * nonzeroc);
+
+    free(stamp);
+    free(stack);
+    free(slots);
+    free(rows);
+    free(columns);
+
+    return pattern;
+}
+
+// values of a jacobian with a known pattern from one forward pass and one
+// tangent sweep per color of color_columns
+void
+sparse_jacobian_tape(Tape *tape, double *values, double *results, Sparse *jacobian, int colorc, int *colors)
+{
+    Program *program = tape->program;
+    double *direction = (double *) malloc(sizeof(double) * (program->variablec + 1));
+
+    forward_tape(tape, values, results);
+
+    for (int color = 0;color < colorc;color++) {
+        for (int v = 0;v < program->variablec;v++)
+            direction[v] = colors[v] == color ? 1.0 : 0.0;
+
+        propagate_tangents(tape, direction, tape->adjoints);
+
+        for (int i = 0;i < jacobian->rowc;i++)
+            for (int k = jacobian->rows[i];k < jacobian->rows[i + 1];k++)
+                if (colors[jacobian->columns[k]] == color)
+                    jacobian->values[k] = tape->adjoints[program->results[i]];
+    }
+
+    free(direction);
+    return;
+}
+
+static void
+evaluate_tape(void *context, double *values, double *results, double *jacobian)
+{
+    Tape *tape = context;
+
+    if (jacobian == NULL)
+        forward_tape(tape, values, results);
+    else
+        jacobian_tape(tape, values, results, jacobian);
+    return;
+}
+
+Derivative
+tape_derivative(Tape *tape)
+{
+    Derivative derivative;
+
+    derivative.context = tape;
+    derivative.variablec = tape->program->variablec;
+    derivative.resultc = tape->program->resultc;
+    derivative.evaluate = evaluate_tape;
+
+    return derivative;
+}
@@ -0,0 +1,42 @@
+#ifndef TAPE_TERM_H_
+#define TAPE_TERM_H_
+
+typedef struct Tape Tape;
+typedef struct Derivative Derivative;
+
+// forward values and local partial derivatives of a compiled program,
+// partials[k] belongs to program->operands[k]
+struct Tape {
+    Program *program;
+    double *values;
+    double *partials;
+    double *adjoints;
+};
+
+// residuals and their jacobian (row major, resultc x variablec) at values,
+// jacobian may be NULL when only the residuals are needed
+struct Derivative {
+    void *context;
+    int variablec;
+    int resultc;
+    void (*evaluate)(void *context, double *values, double *results, double *jacobian);
+};
+
+Tape *record_tape(Program *program);
+void free_tape(Tape *tape);
+
+void forward_tape(Tape *tape, double *values, double *results);
+void reverse_tape(Tape *tape, int result, double *gradient);
+
+double gradient_tape(Tape *tape, double *values, double *gradient);
+void gradient_tape_batch(Tape *tape, int count, double **values, double *results, double **gradient);
+void jacobian_tape(Tape *tape, double *values, double *results, double *jacobian);
+void jacobian_vector_product(Tape *tape, double *values, double *direction, double *results, double *product);
+void vector_jacobian_product(Tape *tape, double *values, double *weights, double *results, double *product);
+
+Sparse *jacobian_pattern(Tape *tape);
+void sparse_jacobian_tape(Tape *tape, double *values, double *results, Sparse *jacobian, int colorc, int *colors);
+
+Derivative tape_derivative(Tape *tape);
+
+#endif // TAPE_TERM_H_
@@ -3,25 +3,45 @@
 #include <string.h>
 
 #include "term.h"
+#include "memory_term.h"
+#include "traverse_term.h"
+#include "format_term.h"
 
 
 char*
 copy_string(char* str)
 {
-    char *value = (char*) malloc(sizeof(char) * (strlen(str) + 1));
+    char *value = (char*) allocate(sizeof(char) * (strlen(str) + 1));
 
     strcpy(value, str);
 
     return value;
 }
 
+// size bytes followed by a copy of text in one allocation, text is
+// returned in copy. The names and meanings of terms are stored this way
+// and go with the struct they belong to.
+static void *
+allocate_with_text(size_t size, char *text, char **copy)
+{
+    size_t length = strlen(text) + 1;
+    char *memory = (char *) allocate(size + length);
+
+    *copy = memory + size;
+    memcpy(*copy, text, length);
+
+    return memory;
+}
+
 Term *
 term(void *content, char* meaning)
 {
-    Term *term = (Term *) malloc(sizeof(Term));
+    Term *term;
+    char *copy;
 
+    term = (Term *) allocate_with_text(sizeof(Term), meaning, &copy);
     term->content = content;
-    term->meaning = copy_string(meaning);
+    term->meaning = copy;
 
     return term;
 }
@@ -69,7 +89,7 @@ operator(char *name, int argc, Term **argv)
 Literal *
 construct_literal(double value)
 {
-    Literal* literal = (Literal *) malloc(sizeof(Literal));
+    Literal* literal = (Literal *) allocate(sizeof(Literal));
 
     literal->value = value;
 
@@ -79,9 +99,11 @@ construct_literal(double value)
 Constant *
 construct_constant(char *name, double upper_limit, double lower_limit)
 {
-    Constant *constant = (Constant *) malloc(sizeof(Constant));
+    Constant *constant;
+    char *copy;
 
-    constant->name = copy_string(name);
+    constant = (Constant *) allocate_with_text(sizeof(Constant), name, &copy);
+    constant->name = copy;
     constant->upper_limit = upper_limit;
     constant->lower_limit = lower_limit;
 
@@ -91,9 +113,11 @@ construct_constant(char *name, double upper_limit, double lower_limit)
 Variable *
 construct_variable(char *name, int indec, Term **index)
 {
-    Variable* variable = (Variable *) malloc(sizeof(Variable));
+    Variable *variable;
+    char *copy;
 
-    variable->name = copy_string(name);
+    variable = (Variable *) allocate_with_text(sizeof(Variable), name, &copy);
+    variable->name = copy;
     variable->indec = indec;
     variable->index = index;
 
@@ -103,87 +127,209 @@ construct_variable(char *name, int indec, Term **index)
 Operator *
 construct_operator(char *name, int argc, Term **argv)
 {
-    Operator *operator = (Operator *) malloc(sizeof(Operator));
+    Operator *operator;
+    char *copy;
 
-    operator->name = copy_string(name);
+    operator = (Operator *) allocate_with_text(sizeof(Operator), name, &copy);
+    operator->name = copy;
     operator->argc = argc;
     operator->argv = argv;
 
     return operator;
 }
 
+// releases one literal, constant, variable or operator but none of the
+// terms it holds
+static void
+release_content(void *content, char *meaning)
+{
+    if (strcmp(meaning, "literal") == 0) {
+        release(content);
+    } else if (strcmp(meaning, "operator") == 0) {
+        Operator *temp_operator = content;
+
+        release(temp_operator->argv);
+        release(temp_operator);
+    } else if (strcmp(meaning, "variable") == 0) {
+        Variable *temp_variable = content;
+
+        release(temp_variable->index);
+        release(temp_variable);
+    } else if (strcmp(meaning, "constant") == 0) {
+        Constant *temp_constant = content;
+
+        release(temp_constant);
+    }
+    return;
+}
+
+// frees everything below term and its content, bottom up over an explicit
+// stack so the depth of term is not limited by the C stack. Only terms with
+// arguments or indices are pushed, arguments moved out by take_argument are
+// NULL and skipped.
+static void
+free_content(Term *term)
+{
+    Traversal temp_traversal;
+
+    begin_traversal(&temp_traversal);
+    push_visit(&temp_traversal, term, NULL);
+
+    while (temp_traversal.depth > 0) {
+        Visit *visit = top_visit(&temp_traversal);
+        Term *temp_term = visit->term, *child = NULL, **childv;
+
+        while (visit->child < visit->childc) {
+            child = visit->childv[visit->child++];
+            if (child != NULL && get_children(child, &childv) > 0)
+                break;
+            if (child != NULL) {
+                release_content(child->content, child->meaning);
+                release(child);
+            }
+            child = NULL;
+        }
+        if (child != NULL) {
+            push_visit(&temp_traversal, child, NULL);
+            continue;
+        }
+
+        pop_visit(&temp_traversal);
+        release_content(temp_term->content, temp_term->meaning);
+        if (temp_traversal.depth > 0)
+            release(temp_term);
+    }
+
+    end_traversal(&temp_traversal);
+    return;
+}
+
 void
 free_term(Term *term)
 {
-    if (strcmp(term->meaning, "literal") == 0)
-        free_literal(term->content);
-    if (strcmp(term->meaning, "constant") == 0)
-        free_constant(term->content);
-    if (strcmp(term->meaning, "variable") == 0)
-        free_variable(term->content);
-    if (strcmp(term->meaning, "operator") == 0)
-        free_operator(term->content);
-    free(term->meaning);
-    free(term);
+    Term **childv;
+
+    if (get_children(term, &childv) > 0)
+        free_content(term);
+    else
+        release_content(term->content, term->meaning);
+    release(term);
     return;
 }
 
 void
 free_literal(Literal *literal)
 {
-    free(literal);
+    release(literal);
     return;
 }
 
 void
 free_constant(Constant *constant)
 {
-    free(constant->name);
-    free(constant);
+    release(constant);
     return;
 }
 
 void
 free_variable(Variable *variable)
 {
-    for (int i = 0;i < variable->indec;i++)
-        free_term(variable->index[i]);
-    free(variable->index);
-    free(variable->name);
-    free(variable);
+    Term temp_term = {variable, "variable"};
+
+    free_content(&temp_term);
     return;
 }
 
 void
 free_operator(Operator *operator)
 {
-    for (int i = 0;i < operator->argc;i++)
-        free_term(operator->argv[i]);
-    free(operator->argv);
-    free(operator->name);
-    free(operator);
+    Term temp_term = {operator, "operator"};
+
+    free_content(&temp_term);
     return;
 }
 
-Term *
-copy_term(Term *term)
+// frees an operator term but not its arguments, for callers that moved
+// them somewhere else
+void
+free_shell(Term *term)
+{
+    Operator *operator = term->content;
+
+    release(operator->argv);
+    release(operator);
+    release(term);
+    return;
+}
+
+// copies term without the terms it holds. An operator or indexed variable
+// gets an array for the copies of those, returned in copies.
+static Term *
+copy_node(Term *term, Term ***copies)
 {
-    Term *new = (Term *) malloc(sizeof(Term));
+    Term *new;
+    char *copy;
+
+    new = (Term *) allocate_with_text(sizeof(Term), term->meaning, &copy);
+    new->meaning = copy;
+    new->content = NULL;
+    *copies = NULL;
 
-    new->meaning = copy_string(term->meaning);
+    if (strcmp(term->meaning, "operator") == 0) {
+        Operator *temp_operator = term->content;
 
-    if(strcmp(term->meaning, "literal") == 0)
+        *copies = (Term **) allocate(sizeof(Term *) * temp_operator->argc);
+        new->content = construct_operator(temp_operator->name, temp_operator->argc, *copies);
+    } else if (strcmp(term->meaning, "literal") == 0) {
         new->content = copy_literal(term->content);
-    if(strcmp(term->meaning, "constant") == 0)
+    } else if (strcmp(term->meaning, "variable") == 0) {
+        Variable *temp_variable = term->content;
+
+        *copies = (Term **) allocate(sizeof(Term *) * temp_variable->indec);
+        new->content = construct_variable(temp_variable->name, temp_variable->indec, *copies);
+    } else if (strcmp(term->meaning, "constant") == 0) {
         new->content = copy_constant(term->content);
-    if(strcmp(term->meaning, "variable") == 0)
-        new->content = copy_variable(term->content);
-    if(strcmp(term->meaning, "operator") == 0)
-        new->content = copy_operator(term->content);
+    }
 
     return new;
 }
 
+// top down over an explicit stack, every visit keeps the array the copies
+// of its children go to in other. Leaves are done when their copy is made.
+Term *
+copy_term(Term *term)
+{
+    Traversal temp_traversal;
+    Term *new, **copies;
+
+    new = copy_node(term, &copies);
+    if (copies == NULL)
+        return new;
+
+    begin_traversal(&temp_traversal);
+    push_visit(&temp_traversal, term, copies);
+
+    while (temp_traversal.depth > 0) {
+        Visit *visit = top_visit(&temp_traversal);
+        Term *child, **child_copies;
+        int i;
+
+        if (visit->child == visit->childc) {
+            pop_visit(&temp_traversal);
+            continue;
+        }
+
+        i = visit->child++;
+        child = visit->childv[i];
+        ((Term **) visit->other)[i] = copy_node(child, &child_copies);
+        if (child_copies != NULL)
+            push_visit(&temp_traversal, child, child_copies);
+    }
+
+    end_traversal(&temp_traversal);
+    return new;
+}
+
 Literal *
 copy_literal(Literal *literal)
 {
@@ -196,203 +342,139 @@ copy_constant(Constant *constant)
     return construct_constant(constant->name, constant->upper_limit, constant->lower_limit);
 }
 
-Variable *
-copy_variable(Variable *variable)
+// the copied content is moved out of a temporary term
+static void *
+copy_content(void *content, char *meaning)
 {
-    Term **index = (Term **) malloc(sizeof(Term *) * variable->indec);
+    Term temp_term = {content, meaning};
+    Term *new = copy_term(&temp_term);
+
+    content = new->content;
+    release(new);
 
-    for(int i = 0;i < variable->indec;i++)
-        index[i] = copy_term(variable->index[i]);
+    return content;
+}
 
-    return construct_variable(variable->name, variable->indec, index);
+Variable *
+copy_variable(Variable *variable)
+{
+    return copy_content(variable, "variable");
 }
 
 Operator *
 copy_operator(Operator *operator)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *) * operator->argc);
-
-    for(int i = 0;i < operator->argc;i++)
-        argv[i] = copy_term(operator->argv[i]);
-
-    return construct_operator(operator->name, operator->argc, argv);
+    return copy_content(operator, "operator");
 }
 
 void
 print_term(Term *term)
 {
-    if (strcmp(term->meaning, "literal") == 0)
-        print_literal(term->content);
-    if (strcmp(term->meaning, "constant") == 0)
-        print_constant(term->content);
-    if (strcmp(term->meaning, "variable") == 0)
-        print_variable(term->content);
-    if (strcmp(term->meaning, "operator") == 0)
-        print_operator(term->content);
+    Output *output = output_file(stdout);
+
+    write_term(output, term, FORMAT_INFIX);
+    free_output(output);
+    return;
+}
+
+// the helpers below print their argument as a term of its own
+static void
+print_content(void *content, char *meaning)
+{
+    Term temp_term = {content, meaning};
+
+    print_term(&temp_term);
     return;
 }
 
 void
 print_literal(Literal *literal)
 {
-    printf("%.6g", literal->value);
+    print_content(literal, "literal");
     return;
 }
 
 void
 print_constant(Constant *constant)
 {
-    printf("%s", constant->name);
+    print_content(constant, "constant");
     return;
 }
 
 void
 print_variable(Variable *variable)
 {
-    printf("%s", variable->name);
-
-    if (variable->indec != 0) {
-        printf("_{");
-        for (int i = 0;i < variable->indec;i++) {
-            print_term(variable->index[i]);
-            if (i != variable->indec - 1)
-                printf(", ");
-        }
-        printf("}");
-    }
+    print_content(variable, "variable");
     return;
 }
 
 void
 print_operator(Operator *operator)
 {
-    if (strcmp(operator->name, "imaginary") == 0)
-        print_imaginary(operator);
-    if (strcmp(operator->name, "+") == 0)
-        print_addition(operator);
-    if (strcmp(operator->name, "additive_inverse") == 0)
-        print_additive_inverse(operator);
-    if (strcmp(operator->name, "*") == 0)
-        print_multiply(operator);
-    if (strcmp(operator->name, "multiple_inverse") == 0)
-        print_multiple_inverse(operator);
-    if (strcmp(operator->name, "^") == 0)
-        print_differential(operator);
-    if (strcmp(operator->name, "D") == 0)
-        print_differential(operator);
-    if (strcmp(operator->name, "I") == 0)
-        print_integral(operator);
-    if (strcmp(operator->name, "=") == 0)
-        print_equals(operator);
+    print_content(operator, "operator");
     return;
 }
 
 void
 print_imaginary(Operator *operator)
 {
-    printf("i*");
-    print_term(operator->argv[0]);
+    print_operator(operator);
     return;
 }
 
 void
 print_addition(Operator *operator)
 {
-    printf("(");
-
-    print_term(operator->argv[0]);
-    printf(" + ");
-    print_term(operator->argv[1]);
-
-    for(int i = 2;i < operator->argc;i++) {
-        printf(" + ");
-        print_term(operator->argv[i]);
-    }
-    printf(")");
+    print_operator(operator);
     return;
 }
 
 void
 print_additive_inverse(Operator *operator)
 {
-    printf("(-");
-    print_term(operator->argv[0]);
-    printf(")");
+    print_operator(operator);
     return;
 }
 
 void
 print_multiply(Operator *operator)
 {
-    printf("(");
-
-    print_term(operator->argv[0]);
-    printf(" * ");
-    print_term(operator->argv[1]);
-
-    for(int i = 2;i < operator->argc;i++) {
-        printf(" * ");
-        print_term(operator->argv[i]);
-    }
-    printf(")");
+    print_operator(operator);
     return;
 }
 
 void
 print_multiple_inverse(Operator *operator)
 {
-    printf("(1.0/");
-    print_term(operator->argv[0]);
-    printf(")");
+    print_operator(operator);
     return;
 }
 
 void
 print_power(Operator *operator)
 {
-    printf("(");
-    print_term(operator->argv[0]);
-    printf(")^(");
-    print_term(operator->argv[1]);
-    printf(")");
+    print_operator(operator);
     return;
 }
 
 void
 print_differential(Operator *operator)
 {
-    printf("D[");
-    print_term(operator->argv[0]);
-    printf(", ");
-    print_term(operator->argv[1]);
-    printf("]");
+    print_operator(operator);
     return;
 }
 
 void
 print_integral(Operator *operator)
 {
-    printf("I[");
-    print_term(operator->argv[0]);
-    printf(", ");
-    print_term(operator->argv[1]);
-
-    if (operator->argc) {
-        printf(", ");
-        print_term(operator->argv[2]);
-        printf(", ");
-        print_term(operator->argv[3]);
-    }
-    printf("]");
+    print_operator(operator);
     return;
 }
 
 void
 print_equals(Operator *operator)
 {
-    print_term(operator->argv[0]);
-    printf(" = ");
-    print_term(operator->argv[1]);
+    print_operator(operator);
     return;
 }
 
@@ -414,7 +496,7 @@ Operator *is_operator(Term *term, char *name)
 Term *
 imaginary(Term *term)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *));
+    Term **argv = (Term **) allocate(sizeof(Term *));
 
     argv[0] = term;
 
@@ -442,7 +524,7 @@ add(Term *lhs, Term *rhs)
         argc += rhs_operator->argc;
 
     i = 0;
-    argv = (Term **) malloc(sizeof(Term *) * argc);
+    argv = (Term **) allocate(sizeof(Term *) * argc);
 
     if(lhs_operator == NULL) {
         argv[i] = lhs;
@@ -460,13 +542,19 @@ add(Term *lhs, Term *rhs)
             argv[i] = rhs_operator->argv[j];
     }
 
+    // the arguments moved over, only the flattened operators are left
+    if (lhs_operator != NULL)
+        free_shell(lhs);
+    if (rhs_operator != NULL)
+        free_shell(rhs);
+
     return operator("+", argc, argv);
 }
 
 Term *
 additive_inverse(Term *term)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *));
+    Term **argv = (Term **) allocate(sizeof(Term *));
 
     argv[0] = term;
 
@@ -494,7 +582,7 @@ multiply(Term *lhs, Term *rhs)
         argc += rhs_operator->argc;
 
     i = 0;
-    argv = (Term **) malloc(sizeof(Term *) * argc);
+    argv = (Term **) allocate(sizeof(Term *) * argc);
 
     if(lhs_operator == NULL) {
         argv[i] = lhs;
@@ -512,13 +600,19 @@ multiply(Term *lhs, Term *rhs)
             argv[i] = rhs_operator->argv[j];
     }
 
+    // the arguments moved over, only the flattened operators are left
+    if (lhs_operator != NULL)
+        free_shell(lhs);
+    if (rhs_operator != NULL)
+        free_shell(rhs);
+
     return operator("*", argc, argv);
 }
 
 Term *
 multiple_inverse(Term *term)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *));
+    Term **argv = (Term **) allocate(sizeof(Term *));
 
     argv[0] = term;
 
@@ -528,7 +622,7 @@ multiple_inverse(Term *term)
 Term *
 power(Term *base, Term* exponent)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *) * 2);
+    Term **argv = (Term **) allocate(sizeof(Term *) * 2);
 
     argv[0] = base;
     argv[1] = exponent;
@@ -539,7 +633,7 @@ power(Term *base, Term* exponent)
 Term *
 differential(Term *term, Term* variable)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *) * 2);
+    Term **argv = (Term **) allocate(sizeof(Term *) * 2);
 
     argv[0] = term;
     argv[1] = variable;
@@ -550,7 +644,7 @@ differential(Term *term, Term* variable)
 Term *
 integral(Term *term, Term *variable)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *) * 2);
+    Term **argv = (Term **) allocate(sizeof(Term *) * 2);
 
     argv[0] = term;
     argv[1] = variable;
@@ -561,12 +655,12 @@ integral(Term *term, Term *variable)
 Term *
 definite_integral(Term *term, Term *variable, Term *upper_limit, Term *lower_limit)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *) * 4);
+    Term **argv = (Term **) allocate(sizeof(Term *) * 4);
 
     argv[0] = term;
     argv[1] = variable;
-    argv[3] = upper_limit;
-    argv[4] = lower_limit;
+    argv[2] = upper_limit;
+    argv[3] = lower_limit;
 
     return operator("I", 4, argv);
 }
@@ -574,7 +668,7 @@ definite_integral(Term *term, Term *variable, Term *upper_limit, Term *lower_lim
 Term *
 equal(Term *lhs, Term *rhs)
 {
-    Term **argv = (Term **) malloc(sizeof(Term *) * 2);
+    Term **argv = (Term **) allocate(sizeof(Term *) * 2);
 
     argv[0] = lhs;
     argv[1] = rhs;
@@ -56,6 +56,7 @@ void free_variable(Variable *variable);
 void free_literal(Literal *literal);
 void free_constant(Constant *contant);
 void free_operator(Operator *operator);
+void free_shell(Term *term);
 
 Term *copy_term(Term *term);
 Literal *copy_literal(Literal *literal);
@@ -74,6 +75,7 @@ void print_addition(Operator *operator);
 void print_additive_inverse(Operator *operator);
 void print_multiply(Operator *operator);
 void print_multiple_inverse(Operator *operator);
+void print_power(Operator *operator);
 void print_differential(Operator *operator);
 void print_integral(Operator *operator);
 void print_equals(Operator *operator);
@@ -85,6 +87,7 @@ Term *add(Term *lhs, Term *rhs);
 Term *additive_inverse(Term *term);
 Term *multiply(Term *lhs, Term *rhs);
 Term *multiple_inverse(Term *term);
+Term *power(Term *base, Term* exponent);
 Term *differential(Term *term, Term* variable);
 Term *integral(Term *term, Term *variable);
 Term *definite_integral(Term *term, Term *variable, Term *upper_limit, Term *lower_limit);
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include "term.h"
+#include "traverse_term.h"
+
+void
+begin_traversal(Traversal *traversal)
+{
+    traversal->depth = 0;
+    traversal->capacity = TRAVERSAL_LOCAL;
+    traversal->visits = traversal->local;
+    return;
+}
+
+void
+end_traversal(Traversal *traversal)
+{
+    if (traversal->visits != traversal->local)
+        free(traversal->visits);
+    traversal->visits = traversal->local;
+    traversal->depth = 0;
+    return;
+}
+
+Visit *
+push_visit(Traversal *traversal, Term *term, void *other)
+{
+    Visit *visit;
+
+    if (traversal->depth == traversal->capacity) {
+        traversal->capacity *= 2;
+        if (traversal->visits == traversal->local) {
+            traversal->visits = (Visit *) malloc(sizeof(Visit) * traversal->capacity);
+            memcpy(traversal->visits, traversal->local, sizeof(Visit) * traversal->depth);
+        } else {
+            traversal->visits = (Visit *) realloc(traversal->visits, sizeof(Visit) * traversal->capacity);
+        }
+    }
+
+    visit = &traversal->visits[traversal->depth++];
+    visit->term = term;
+    visit->other = other;
+    visit->child = 0;
+    visit->childc = get_children(term, &visit->childv);
+
+    return visit;
+}
+
+// called for every term of a walk, the meanings of terms differ in their
+// first character
+int
+get_children(Term *term, Term ***childv)
+{
+    if (term->meaning[0] == 'o') {
+        Operator *temp_operator = term->content;
+
+        *childv = temp_operator->argv;
+        return temp_operator->argc;
+    }
+    if (term->meaning[0] == 'v') {
+        Variable *temp_variable = term->content;
+
+        *childv = temp_variable->index;
+        return temp_variable->indec;
+    }
+
+    *childv = NULL;
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef TRAVERSE_TERM_H_
+#define TRAVERSE_TERM_H_
+
+// levels a traversal holds before it moves to the heap
+#define TRAVERSAL_LOCAL 32
+
+typedef struct Visit Visit;
+typedef struct Traversal Traversal;
+
+// a term on the path from the root, with its arguments or indices and the
+// index of the next one to visit. other is up to the caller, usually the
+// matching array of a second term.
+struct Visit {
+    Term *term;
+    void *other;
+
+    int child;
+    int childc;
+    Term **childv;
+};
+
+// explicit stack for walking terms of any depth without recursion. Only the
+// path from the root to the current term is kept, so a wide term costs no
+// more than a narrow one, and the first TRAVERSAL_LOCAL levels live in the
+// structure itself, usually on the C stack.
+struct Traversal {
+    int depth;
+    int capacity;
+    Visit *visits;
+    Visit local[TRAVERSAL_LOCAL];
+};
+
+void begin_traversal(Traversal *traversal);
+void end_traversal(Traversal *traversal);
+
+// the returned visit and every other one stay valid until the next push
+Visit *push_visit(Traversal *traversal, Term *term, void *other);
+#define top_visit(traversal) (&(traversal)->visits[(traversal)->depth - 1])
+#define pop_visit(traversal) ((traversal)->depth--)
+
+// arguments of an operator or index of a variable, none for other terms
+int get_children(Term *term, Term ***childv);
+
+#endif // TRAVERSE_TERM_H_
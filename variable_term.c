@@ -1,25 +1,46 @@
+#include <stdlib.h>
 #include <string.h>
 #include "term.h"
+#include "traverse_term.h"
 #include "compare_term.h"
 
+static bool
+is_one(Term *term)
+{
+    return strcmp(term->meaning, "literal") == 0 && ((Literal *) term->content)->value == 1.0;
+}
+
+// walks an explicit stack, so the depth of term is not limited by the C
+// stack
 bool
 is_variable_term(Term* term)
 {
-    if(strcmp(term->meaning, "literal") == 0)
-        return false;
-    if(strcmp(term->meaning, "constant") == 0)
-        return false;
-    if(strcmp(term->meaning, "variable") == 0)
-        return true;
-    if(strcmp(term->meaning, "operator") == 0) {
-        Operator *operator = (Operator *) term->content;
+    Traversal temp_traversal;
+    bool is_variable = false;
 
-        for (int i = 0;i < operator->argc;i++)
-            if (is_variable_term(operator->argv[i]))
-                return true;
-        return false;
+    begin_traversal(&temp_traversal);
+    push_visit(&temp_traversal, term, NULL);
+
+    while (temp_traversal.depth > 0) {
+        Visit *visit = top_visit(&temp_traversal);
+        Term *child;
+
+        if (strcmp(visit->term->meaning, "variable") == 0) {
+            is_variable = true;
+            break;
+        }
+        if (visit->child == visit->childc) {
+            pop_visit(&temp_traversal);
+            continue;
+        }
+
+        child = visit->childv[visit->child++];
+        if (strcmp(child->meaning, "variable") == 0 || strcmp(child->meaning, "operator") == 0)
+            push_visit(&temp_traversal, child, NULL);
     }
-    return false;
+
+    end_traversal(&temp_traversal);
+    return is_variable;
 }
 
 Term *
@@ -70,16 +91,19 @@ get_variable_term(Term* term)
         if (strcmp(operator->name, "multiple_inverse") == 0) {
             Term *temp_term = get_variable_term(operator->argv[0]);
 
-            if (is_equal(temp_term, literal(1.0)))
-                return literal(1.0);
+            if (is_one(temp_term))
+                return temp_term;
             else
-                return multiple_inverse(copy_term(temp_term));
+                return multiple_inverse(temp_term);
         }
         if (strcmp(operator->name, "^") == 0) {
             Term *base = get_variable_term(operator->argv[0]);
             Term *exponent = get_variable_term(operator->argv[1]);
+            bool is_constant = is_one(base) && is_one(exponent);
 
-            if (is_equal(base, literal(1.0)) && is_equal(exponent, literal(1.0)))
+            free_term(base);
+            free_term(exponent);
+            if (is_constant)
                 return literal(1.0);
             else
                 return copy_term(term);
@@ -139,16 +163,19 @@ get_non_variable_term(Term* term)
         if (strcmp(operator->name, "multiple_inverse") == 0) {
             Term *temp_term = get_non_variable_term(operator->argv[0]);
 
-            if (is_equal(temp_term, literal(1.0)))
-                return literal(1.0);
+            if (is_one(temp_term))
+                return temp_term;
             else
-                return multiple_inverse(copy_term(temp_term));
+                return multiple_inverse(temp_term);
         }
         if (strcmp(operator->name, "^") == 0) {
             Term *base = get_non_variable_term(operator->argv[0]);
             Term *exponent = get_non_variable_term(operator->argv[1]);
+            bool is_constant = is_one(base) && is_one(exponent);
 
-            if (is_equal(base, literal(1.0)) && is_equal(exponent, literal(1.0)))
+            free_term(base);
+            free_term(exponent);
+            if (is_constant)
                 return literal(1.0);
             else
                 return copy_term(term);
@@ -158,3 +185,39 @@ get_non_variable_term(Term* term)
     return literal(1.0);
 }
 
+static void
+collect_variables(Term *term, Term ***variables, int *variablec, int *capacity)
+{
+    if (strcmp(term->meaning, "variable") == 0) {
+        for (int i = 0;i < *variablec;i++)
+            if (is_equal((*variables)[i], term))
+                return;
+
+        if (*variablec >= *capacity) {
+            *capacity *= 2;
+            *variables = (Term **) realloc(*variables, sizeof(Term *) * *capacity);
+        }
+        (*variables)[(*variablec)++] = copy_term(term);
+        return;
+    }
+    if (strcmp(term->meaning, "operator") == 0) {
+        Operator *operator = (Operator *) term->content;
+
+        for (int i = 0;i < operator->argc;i++)
+            collect_variables(operator->argv[i], variables, variablec, capacity);
+    }
+    return;
+}
+
+// copies of the distinct variables of term in order of appearance
+Term **
+get_variables(Term *term, int *variablec)
+{
+    int capacity = 4;
+    Term **variables = (Term **) malloc(sizeof(Term *) * capacity);
+
+    *variablec = 0;
+    collect_variables(term, &variables, variablec, &capacity);
+
+    return variables;
+}
@@ -4,5 +4,6 @@
 bool is_variable_term(Term* term);
 Term *get_variable_term(Term* term);
 Term *get_non_variable_term(Term* term);
+Term **get_variables(Term *term, int *variablec);
 
 #endif /* VARIABLE_TERM_H_ */